@@ -0,0 +1,359 @@
+/**
+ * @file bcp.c
+ *
+ */
+
+/*********************
+ *      INCLUDES
+ *********************/
+
+#include <string.h>
+#include "bcp.h"
+#include "crc16.h"
+
+/**********************
+ *  STATIC PROTOTYPES
+ **********************/
+
+static void bcp_rx_put(const uint8_t * data_p, uint16_t len);
+static void bcp_rx_end();
+static void bcp_rx_clear();
+static uint16_t bcp_execute(uint8_t * req_p, uint16_t len, uint8_t * rep_p);
+static mb_res_t bcp_op(uint8_t ** op_pp, const uint8_t * end_p,
+    uint8_t * rep_p, uint16_t * rep_len);
+static void bcp_put_u32(uint8_t * p, uint32_t v);
+static uint32_t bcp_get_u32(const uint8_t * p);
+
+/**********************
+ *  STATIC VARIABLES
+ **********************/
+
+/**
+ * Received packets, decoded while the bytes arrive. The interrupt
+ * fills the slot at the head, the main loop executes the one at the
+ * tail in place and frees it once the reply is built.
+ */
+static uint8_t rx_slot[BCP_SLOT_NUM][BCP_BUF_MAX] = {0};
+static uint16_t rx_slot_len[BCP_SLOT_NUM] = {0};
+static volatile uint16_t rx_head = 0;
+static volatile uint16_t rx_tail = 0;
+
+/*Packet being received*/
+static uint16_t rx_len = 0;
+static uint16_t rx_crc = CRC16_INIT; /*Accumulated while the packet arrives*/
+static uint8_t rx_code = 0;          /*COBS code of the block, 0 between packets*/
+static uint8_t rx_left = 0;          /*Bytes of the block still to come*/
+static bool rx_drop = false;         /*Too long, dropped at the delimiter*/
+static bool rx_open = false;         /*Leading delimiter seen, the closing one not yet*/
+
+/*The reply is built in rep_buf, tx_buf is owned by the transmitter*/
+static uint8_t rep_buf[BCP_BUF_MAX] = {0};
+static uint8_t tx_buf[BCP_TX_MAX] = {0};
+static volatile bool tx_busy = false;
+
+static bcp_diag_t diag = {0};
+
+/**********************
+ *   GLOBAL FUNCTIONS
+ **********************/
+
+void bcp_init()
+{
+    rx_head = 0;
+    rx_tail = 0;
+    bcp_rx_clear();
+    rx_open = false;
+    tx_busy = false;
+
+    memset(&diag, 0, sizeof(diag));
+}
+
+/**
+ * Bytes from the port, receive interrupt. They are decoded as they
+ * come, a zero ends the packet and the byte after it starts the next.
+ * @param data_p Received bytes.
+ * @param len Number of bytes.
+ * @return true while a packet is open, the bytes that follow 
+ * belong to it. false once the trailing delimiter came.
+ */
+bool bcp_recv(const uint8_t * data_p, uint16_t len)
+{
+    static const uint8_t zero = 0x00;
+    const uint8_t * end_p = data_p + len;
+    const uint8_t * zero_p = NULL;
+    uint16_t n = 0;
+
+    while (data_p < end_p) {
+        if (*data_p == 0x00) {
+            /*A zero between packets leads the next one*/
+            rx_open = (rx_code == 0);
+            bcp_rx_end();
+            data_p++;
+            continue;
+        }
+
+        /*Code byte, the block before ends in a zero unless it was full*/
+        if (rx_left == 0) {
+            if ((rx_code != 0) && (rx_code != 0xFF)) bcp_rx_put(&zero, 1);
+            rx_code = *data_p++;
+            rx_left = rx_code - 1;
+            continue;
+        }
+
+        /*The rest of the block in one go, a delimiter cuts it short*/
+        n = ((end_p - data_p) < rx_left) ? (uint16_t)(end_p - data_p) : rx_left;
+        zero_p = memchr(data_p, 0x00, n);
+        if (zero_p != NULL) n = (uint16_t)(zero_p - data_p);
+
+        bcp_rx_put(data_p, n);
+        rx_left -= n;
+        data_p += n;
+    }
+
+    return rx_open || (rx_code != 0);
+}
+
+/**
+ * Executes the oldest packet and starts its reply, main loop. The
+ * reply can only be built once the transmitter released its buffer.
+ */
+void bcp_poll()
+{
+    uint16_t tail = rx_tail;
+    uint16_t len = 0;
+    uint16_t crc = 0;
+
+    if (tx_busy || (tail == rx_head)) return;
+
+    len = bcp_execute(rx_slot[tail], rx_slot_len[tail] - BCP_CRC_SIZE, rep_buf);
+
+    /*Executed in place, the slot is free from here*/
+    __sync_synchronize();
+    rx_tail = (tail + 1) & (BCP_SLOT_NUM - 1);
+
+    crc = crc16(rep_buf, len);
+    rep_buf[len++] = (uint8_t)(crc & 0xFF);
+    rep_buf[len++] = (uint8_t)(crc >> 8);
+
+    tx_buf[0] = 0x00;
+    len = 1 + cobs_encode(rep_buf, len, &tx_buf[1]);
+    tx_buf[len++] = 0x00;
+
+    tx_busy = true;
+    if (!bcp_port_send(tx_buf, len)) {
+        tx_busy = false;
+        diag.no_resp++;
+    }
+}
+
+/**
+ * The reply is out, transmit complete interrupt.
+ */
+void bcp_send_end()
+{
+    tx_busy = false;
+}
+
+/**
+ * The port lost its host, a reply on the wire will not complete
+ * and a packet cut off will not either. Waiting packets still run.
+ */
+void bcp_reset()
+{
+    bcp_rx_clear();
+    rx_open = false;
+    tx_busy = false;
+}
+
+void bcp_diag_get(bcp_diag_t * diag_p)
+{
+    *diag_p = diag;
+}
+
+/**********************
+ *   STATIC FUNCTIONS
+ **********************/
+
+static void bcp_rx_put(const uint8_t * data_p, uint16_t len)
+{
+    if (rx_drop) return;
+
+    if ((rx_len + len) > BCP_BUF_MAX) {
+        rx_drop = true;
+        return;
+    }
+
+    memcpy(&rx_slot[rx_head][rx_len], data_p, len);
+    rx_len += len;
+    rx_crc = crc16_update(rx_crc, data_p, len);
+}
+
+/**
+ * Delimiter, a complete packet is checked and queued. The zero
+ * implied by the last block is not part of the packet. Over the
+ * packet including its CRC field the CRC is 0.
+ */
+static void bcp_rx_end()
+{
+    uint16_t next = (rx_head + 1) & (BCP_SLOT_NUM - 1);
+
+    /*Between packets*/
+    if (rx_code == 0) return;
+
+    diag.packets++;
+
+    if (rx_drop || (rx_left != 0) ||
+        (rx_len < BCP_BUF_MIN) || (rx_crc != 0x0000)) {
+        diag.bad++;
+    } else if (next == rx_tail) {
+        diag.overrun++;
+    } else {
+        rx_slot_len[rx_head] = rx_len;
+        __sync_synchronize();
+        rx_head = next;
+    }
+
+    bcp_rx_clear();
+}
+
+static void bcp_rx_clear()
+{
+    rx_len = 0;
+    rx_crc = CRC16_INIT;
+    rx_code = 0;
+    rx_left = 0;
+    rx_drop = false;
+}
+
+/**
+ * Runs the ops of a packet in order until the first one fails.
+ * @param req_p Packet without its CRC.
+ * @param len Number of bytes.
+ * @param rep_p Receives the reply.
+ * @return Length of the reply without its CRC.
+ */
+static uint16_t bcp_execute(uint8_t * req_p, uint16_t len, uint8_t * rep_p)
+{
+    const uint8_t * end_p = req_p + len;
+    uint8_t * op_p = &req_p[BCP_HEAD_SIZE];
+    uint16_t rep_len = BCP_REPLY_HEAD;
+    uint8_t done = 0;
+    mb_res_t res = MB_RES_NONE;
+
+    while (op_p < end_p) {
+        res = bcp_op(&op_p, end_p, rep_p, &rep_len);
+        if (res != MB_RES_NONE) break;
+        done++;
+    }
+
+    diag.ops += done;
+    if (res != MB_RES_NONE) diag.exception++;
+
+    rep_p[0] = req_p[0];
+    rep_p[1] = res;
+    rep_p[2] = done;
+    return rep_len;
+}
+
+/**
+ * One op, its results are appended to the reply.
+ * @param op_pp Op code, moved past the arguments on success.
+ * @param end_p End of the packet.
+ * @param rep_p Reply.
+ * @param rep_len Length of the reply so far, grows by the results.
+ * @return MB_RES_NONE, or why the op failed.
+ */
+static mb_res_t bcp_op(uint8_t ** op_pp, const uint8_t * end_p,
+    uint8_t * rep_p, uint16_t * rep_len)
+{
+    uint8_t * op_p = *op_pp;
+    uint16_t args = (uint16_t)(end_p - op_p) - 1;
+    uint16_t room = BCP_BUF_MAX - BCP_CRC_SIZE - *rep_len;
+    mb_motor_state_t state = {0};
+    mb_res_t res = MB_RES_NONE;
+    uint16_t addr = 0;
+    uint16_t num = 0;
+    uint32_t val = 0;
+    float fval = 0.0f;
+
+    switch (op_p[0]) {
+    case BCP_OP_NOP:
+        *op_pp = op_p + 1;
+        return MB_RES_NONE;
+
+    case BCP_OP_SETPOINT:
+        if (args < 5) return MB_RES_ILLEGAL_DATA_VALUE;
+
+        val = bcp_get_u32(&op_p[2]);
+        memcpy(&fval, &val, sizeof(fval));
+        if (!mb_rtu_setpoint_set(op_p[1], fval)) return MB_RES_ILLEGAL_DATA_VALUE;
+
+        *op_pp = op_p + 6;
+        return MB_RES_NONE;
+
+    case BCP_OP_STATE:
+        if (room < BCP_STATE_SIZE) return MB_RES_ILLEGAL_DATA_VALUE;
+
+        for (uint8_t axis = 0; axis < MB_AXIS_NUM; axis++) {
+            uint8_t * p = &rep_p[*rep_len];
+
+            mb_rtu_input_get(axis, &state);
+            bcp_put_u32(&p[0], (uint32_t)state.pos);
+            memcpy(&val, &state.vel, sizeof(val));
+            bcp_put_u32(&p[4], val);
+            memcpy(&val, &state.iq, sizeof(val));
+            bcp_put_u32(&p[8], val);
+            memcpy(&val, &state.vbus, sizeof(val));
+            bcp_put_u32(&p[12], val);
+            bcp_put_u32(&p[16], state.fault);
+            *rep_len += BCP_AXIS_STATE_SIZE;
+        }
+
+        *op_pp = op_p + 1;
+        return MB_RES_NONE;
+
+    case BCP_OP_REG_READ:
+        if (args < 3) return MB_RES_ILLEGAL_DATA_VALUE;
+
+        addr = op_p[1] | (op_p[2] << 8);
+        num = op_p[3];
+        if ((num == 0) || (room < num * 2)) return MB_RES_ILLEGAL_DATA_VALUE;
+
+        res = mb_rtu_read_data(rep_p, rep_len, addr, num);
+        if (res != MB_RES_NONE) return res;
+
+        *op_pp = op_p + 4;
+        return MB_RES_NONE;
+
+    case BCP_OP_REG_WRITE:
+        if (args < 3) return MB_RES_ILLEGAL_DATA_VALUE;
+
+        addr = op_p[1] | (op_p[2] << 8);
+        num = op_p[3];
+        if ((num == 0) || (args < 3 + num * 2)) return MB_RES_ILLEGAL_DATA_VALUE;
+
+        /*The data is in Modbus order already, written as it stands*/
+        res = mb_rtu_write_data(&op_p[4], addr, num);
+        if (res != MB_RES_NONE) return res;
+
+        *op_pp = op_p + 4 + num * 2;
+        return MB_RES_NONE;
+
+    default:
+        return MB_RES_ILLEGAL_FUNCTION;
+    }
+}
+
+static void bcp_put_u32(uint8_t * p, uint32_t v)
+{
+    p[0] = (uint8_t)(v >> 0);
+    p[1] = (uint8_t)(v >> 8);
+    p[2] = (uint8_t)(v >> 16);
+    p[3] = (uint8_t)(v >> 24);
+}
+
+static uint32_t bcp_get_u32(const uint8_t * p)
+{
+    return (uint32_t)p[0] | ((uint32_t)p[1] << 8) |
+        ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24);
+}
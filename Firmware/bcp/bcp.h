@@ -0,0 +1,123 @@
+/**
+ * @file bcp.h
+ *
+ * Binary command protocol for tight host loops. One packet carries a
+ * batch of commands and queries that run in order, the reply carries
+ * the results of the queries in the same order, so a host sets the
+ * setpoints and reads the state back in one round trip. Packets are
+ * COBS encoded with a zero byte before and after, the CRC is the one
+ * of Modbus RTU, low byte first. Values are little endian, register
+ * data keeps the Modbus byte order of mbmap.h.
+ *
+ *  Request, before COBS:
+ *  +-----+----------------------------------------------+-------+
+ *  | Seq | Op, Arguments, Op, Arguments ...             | CRC16 |
+ *  +-----+----------------------------------------------+-------+
+ *    u8                                                    u16
+ *
+ *  Reply:
+ *  +-----+--------+------+-------------------------------+-------+
+ *  | Seq | Status | Done | Results of the queries done   | CRC16 |
+ *  +-----+--------+------+-------------------------------+-------+
+ *    u8    u8       u8                                     u16
+ *
+ *  Op    Name       Arguments                   Result
+ *  0x00  NOP        -                           -
+ *  0x01  SETPOINT   u8 axis, f32 setpoint       -
+ *  0x10  STATE      -                           BCP_STATE_SIZE bytes
+ *  0x20  REG_READ   u16 address, u8 num         num * 2 bytes
+ *  0x21  REG_WRITE  u16 address, u8 num, data   -
+ *
+ * STATE is the motor state published through mb_rtu_input_publish(),
+ * per axis i32 pos, f32 vel, f32 iq, f32 vbus, u32 fault, axis 0
+ * first. REG_READ and REG_WRITE reach the holding registers of Modbus,
+ * at their Modbus addresses. Setpoints go to mb_rtu_setpoint_set().
+ *
+ * Status is MB_RES_NONE when the whole batch ran, else the mb_res_t of
+ * the op that failed, Done counts the ops before it and the rest is
+ * skipped. An unknown op fails with MB_RES_ILLEGAL_FUNCTION, one cut
+ * short by the end of the packet or with a result that would not fit
+ * into BCP_BUF_MAX with MB_RES_ILLEGAL_DATA_VALUE. Damaged packets get
+ * no reply.
+ *
+ * The reply echoes Seq. A host may send up to BCP_WINDOW packets ahead
+ * of their replies, they are answered in order. On a stream shared
+ * with other traffic a write of packets starts with a zero delimiter,
+ * the port routes it by that and keeps routing to bcp_recv() for as
+ * long as it reports a packet open.
+ */
+
+#ifndef __BCP_H__
+#define __BCP_H__
+
+/*********************
+ *      INCLUDES
+ *********************/
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "cobs.h"
+#include "mb.h"
+
+/*********************
+ *      DEFINES
+ *********************/
+
+#define BCP_OP_NOP       0x00U
+#define BCP_OP_SETPOINT  0x01U
+#define BCP_OP_STATE     0x10U
+#define BCP_OP_REG_READ  0x20U
+#define BCP_OP_REG_WRITE 0x21U
+
+/*Decoded packet, CRC included*/
+#define BCP_BUF_MIN 3U
+#define BCP_BUF_MAX 256U
+
+#define BCP_HEAD_SIZE  1U
+#define BCP_REPLY_HEAD 3U
+#define BCP_CRC_SIZE   2U
+
+#define BCP_AXIS_STATE_SIZE 20U
+#define BCP_STATE_SIZE (MB_AXIS_NUM * BCP_AXIS_STATE_SIZE)
+
+/*Received packets waiting, a power of two, one is being filled*/
+#define BCP_SLOT_NUM 8U
+#define BCP_WINDOW   (BCP_SLOT_NUM - 1U)
+
+/*Encoded reply with both delimiters*/
+#define BCP_TX_MAX (COBS_ENC_MAX(BCP_BUF_MAX) + 2U)
+
+/**********************
+ *      TYPEDEFS
+ **********************/
+
+/**
+ * Link counters, they wrap around.
+ */
+typedef struct {
+    uint32_t packets;   /**< Packets received*/
+    uint32_t bad;       /**< Packets failing COBS, length or CRC*/
+    uint32_t overrun;   /**< Packets lost, BCP_WINDOW exceeded*/
+    uint32_t ops;       /**< Ops executed*/
+    uint32_t exception; /**< Replies with a status other than MB_RES_NONE*/
+    uint32_t no_resp;   /**< Replies the port refused*/
+} bcp_diag_t;
+
+/**********************
+ * GLOBAL PROTOTYPES
+ **********************/
+
+void bcp_init();
+bool bcp_recv(const uint8_t * data_p, uint16_t len);
+void bcp_poll();
+void bcp_send_end();
+void bcp_reset();
+void bcp_diag_get(bcp_diag_t * diag_p);
+
+/**
+ * Port hook, starts sending a reply and returns,
+ * bcp_send_end() follows once it is out.
+ */
+bool bcp_port_send(const uint8_t * data_p, uint16_t len);
+
+#endif /*__BCP_H__*/
@@ -0,0 +1,82 @@
+/**
+ * @file cobs.c
+ *
+ */
+
+/*********************
+ *      INCLUDES
+ *********************/
+
+#include <string.h>
+#include "cobs.h"
+
+/**********************
+ *   GLOBAL FUNCTIONS
+ **********************/
+
+/**
+ * Encodes a frame, the zero delimiters are up to the caller.
+ * @param src_p Frame.
+ * @param len Number of bytes in the frame.
+ * @param dst_p Receives COBS_ENC_MAX(len) bytes at most,
+ * must not overlap the frame.
+ * @return Number of bytes written.
+ */
+uint16_t cobs_encode(const uint8_t * src_p, uint16_t len, uint8_t * dst_p)
+{
+    uint16_t code_pos = 0;
+    uint16_t pos = 1;
+    uint8_t code = 1;
+
+    for (uint16_t i = 0; i < len; i++) {
+        if (src_p[i] != 0x00) {
+            dst_p[pos++] = src_p[i];
+            code++;
+        }
+
+        /*A zero ends the block, so does a full one*/
+        if ((src_p[i] == 0x00) || (code == 0xFF)) {
+            dst_p[code_pos] = code;
+            code_pos = pos++;
+            code = 1;
+
+            /*A full block at the very end needs no empty one after it*/
+            if ((src_p[i] != 0x00) && (i + 1 == len)) return code_pos;
+        }
+    }
+
+    dst_p[code_pos] = code;
+    return pos;
+}
+
+/**
+ * Decodes a frame without its delimiters, host side, the
+ * firmware decodes on the fly as the bytes arrive.
+ * @param src_p Encoded frame.
+ * @param len Number of bytes.
+ * @param dst_p Receives len - 1 bytes at most, may be src_p.
+ * @param dst_len Receives the number of bytes decoded.
+ * @return false if the frame is not valid COBS.
+ */
+bool cobs_decode(const uint8_t * src_p, uint16_t len,
+    uint8_t * dst_p, uint16_t * dst_len)
+{
+    uint16_t pos = 0;
+    uint16_t out = 0;
+    uint8_t code = 0;
+
+    while (pos < len) {
+        code = src_p[pos++];
+        if ((code == 0x00) || (pos + code - 1 > len)) return false;
+
+        for (uint8_t i = 1; i < code; i++) {
+            if (src_p[pos] == 0x00) return false;
+            dst_p[out++] = src_p[pos++];
+        }
+
+        if ((code != 0xFF) && (pos < len)) dst_p[out++] = 0x00;
+    }
+
+    *dst_len = out;
+    return true;
+}
@@ -0,0 +1,35 @@
+/**
+ * @file cobs.h
+ *
+ * Consistent overhead byte stuffing. The encoded data holds no zero
+ * byte, so a zero marks the frame boundary on a byte stream. Every
+ * block starts with a code byte n, n - 1 data bytes follow and an
+ * implied zero unless n is 0xFF. The overhead is one byte per 254.
+ */
+
+#ifndef __COBS_H__
+#define __COBS_H__
+
+/*********************
+ *      INCLUDES
+ *********************/
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/*********************
+ *      DEFINES
+ *********************/
+
+/*Encoded size of len bytes at most, without the delimiter*/
+#define COBS_ENC_MAX(len) ((len) + (len) / 254U + 1U)
+
+/**********************
+ * GLOBAL PROTOTYPES
+ **********************/
+
+uint16_t cobs_encode(const uint8_t * src_p, uint16_t len, uint8_t * dst_p);
+bool cobs_decode(const uint8_t * src_p, uint16_t len,
+    uint8_t * dst_p, uint16_t * dst_len);
+
+#endif /*__COBS_H__*/
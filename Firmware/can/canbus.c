@@ -0,0 +1,176 @@
+/**
+ * @file canbus.c
+ *
+ */
+
+/*********************
+ *      INCLUDES
+ *********************/
+
+#include <stddef.h>
+#include <string.h>
+#include "canbus.h"
+
+/**********************
+ *  STATIC VARIABLES
+ **********************/
+
+static can_isr_hook_t isr_hook_p = NULL;
+
+/*Receive interrupt writes the head, main loop the tail*/
+static can_frame_t rx_queue[CAN_RX_QUEUE_SIZE] = {0};
+static volatile uint16_t rx_head = 0;
+static volatile uint16_t rx_tail = 0;
+
+/*Only touched with the port locked*/
+static can_frame_t tx_queue[CAN_TX_QUEUE_SIZE] = {0};
+static uint16_t tx_head = 0;
+static uint16_t tx_tail = 0;
+
+static volatile can_stats_t stats = {0};
+
+/**********************
+ *   GLOBAL FUNCTIONS
+ **********************/
+
+/**
+ * Empties both queues, before the controller is started.
+ * @param hook_p Receive interrupt hook or NULL.
+ */
+void can_init(can_isr_hook_t hook_p)
+{
+    isr_hook_p = hook_p;
+
+    rx_head = 0;
+    rx_tail = 0;
+    tx_head = 0;
+    tx_tail = 0;
+
+    memset((void *)&stats, 0, sizeof(stats));
+}
+
+/**
+ * Lets the frames with (id & mask) == (id & mask of the bank) in.
+ * @param bank Filter bank, below CAN_FILTER_NUM.
+ * @param id Identifier, CAN_FRAME_EXT for 29 bit.
+ * @param mask Identifier bits to compare, CAN_FRAME_EXT included.
+ * @return false if the bank does not exist.
+ */
+bool can_filter_set(uint8_t bank, uint32_t id, uint32_t mask)
+{
+    if (bank >= CAN_FILTER_NUM) return false;
+    return can_port_filter(bank, id, mask, true);
+}
+
+bool can_filter_off(uint8_t bank)
+{
+    if (bank >= CAN_FILTER_NUM) return false;
+    return can_port_filter(bank, 0, 0, false);
+}
+
+/**
+ * Sends a frame, any context. Frames leave in the order they were
+ * sent, a frame only takes a mailbox when none waits before it.
+ * @param frame_p Frame.
+ * @return false if the frame was dropped, transmit queue full.
+ */
+bool can_send(const can_frame_t * frame_p)
+{
+    uint16_t next = 0;
+    bool ok = true;
+
+    if (frame_p->dlc > 8) return false;
+
+    can_port_lock();
+
+    if ((tx_head == tx_tail) && can_port_send(frame_p)) {
+        stats.tx++;
+    } else {
+        next = (tx_head + 1) & (CAN_TX_QUEUE_SIZE - 1);
+
+        if (next != tx_tail) {
+            tx_queue[tx_head] = *frame_p;
+            tx_head = next;
+        } else {
+            stats.tx_overrun++;
+            ok = false;
+        }
+    }
+
+    can_port_unlock();
+    return ok;
+}
+
+/**
+ * Takes the oldest frame the hook did not consume, main loop.
+ * @param frame_p Receives the frame.
+ * @return false if there is none.
+ */
+bool can_recv(can_frame_t * frame_p)
+{
+    uint16_t tail = rx_tail;
+
+    if (tail == rx_head) return false;
+
+    *frame_p = rx_queue[tail];
+    __sync_synchronize();
+    rx_tail = (tail + 1) & (CAN_RX_QUEUE_SIZE - 1);
+    return true;
+}
+
+/**
+ * A frame has been received, from the receive interrupt.
+ */
+void can_rx_isr(const can_frame_t * frame_p)
+{
+    uint16_t head = rx_head;
+    uint16_t next = (head + 1) & (CAN_RX_QUEUE_SIZE - 1);
+
+    stats.rx++;
+
+    if ((isr_hook_p != NULL) && isr_hook_p(frame_p)) return;
+
+    if (next == rx_tail) {
+        stats.rx_overrun++;
+        return;
+    }
+
+    rx_queue[head] = *frame_p;
+    __sync_synchronize();
+    rx_head = next;
+}
+
+/**
+ * A mailbox is free again, from the transmit interrupt.
+ * Refills the mailboxes from the queue.
+ */
+void can_tx_isr()
+{
+    can_port_lock();
+
+    while (tx_tail != tx_head) {
+        if (!can_port_send(&tx_queue[tx_tail])) break;
+
+        tx_tail = (tx_tail + 1) & (CAN_TX_QUEUE_SIZE - 1);
+        stats.tx++;
+    }
+
+    can_port_unlock();
+}
+
+/**
+ * The controller reported a bus error, from its interrupt.
+ */
+void can_error_isr()
+{
+    stats.error++;
+}
+
+void can_stats_get(can_stats_t * stats_p)
+{
+    stats_p->rx = stats.rx;
+    stats_p->tx = stats.tx;
+    stats_p->rx_overrun = stats.rx_overrun;
+    stats_p->tx_overrun = stats.tx_overrun;
+    stats_p->error = stats.error;
+}
@@ -0,0 +1,99 @@
+/**
+ * @file canbus.h
+ *
+ * CAN driver, independent of the controller. The port moves frames
+ * between the mailboxes and the driver, everything above it sees only
+ * can_frame_t. Received frames that pass the hardware filters are
+ * first offered to the hook given to can_init(), still in the receive
+ * interrupt, so time critical frames like SYNC are handled at once.
+ * Frames the hook leaves go into a queue that the main loop drains
+ * with can_recv(). Frames to send go straight into a free mailbox,
+ * the rest wait in a queue that the transmit interrupt refills from,
+ * in the order they were sent.
+ *
+ * The port runs receive and transmit interrupts at one priority, so
+ * they never preempt each other.
+ */
+
+#ifndef __CANBUS_H__
+#define __CANBUS_H__
+
+/*********************
+ *      INCLUDES
+ *********************/
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/*********************
+ *      DEFINES
+ *********************/
+
+/*Set in can_frame_t.id for a 29 bit identifier*/
+#define CAN_FRAME_EXT      0x80000000U
+#define CAN_FRAME_STD_MASK 0x7FFU
+#define CAN_FRAME_EXT_MASK 0x1FFFFFFFU
+
+/*Powers of two*/
+#define CAN_RX_QUEUE_SIZE 32U
+#define CAN_TX_QUEUE_SIZE 32U
+
+/*Filter banks of CAN1, the other 14 belong to CAN2*/
+#define CAN_FILTER_NUM 14U
+
+/**********************
+ *      TYPEDEFS
+ **********************/
+
+typedef struct {
+    uint32_t id;      /**< Identifier, CAN_FRAME_EXT for a 29 bit one*/
+    uint8_t dlc;      /**< Data bytes, 0 ... 8*/
+    uint8_t data[8];
+} can_frame_t;
+
+/**
+ * Receive interrupt hook.
+ * @param frame_p Frame that passed the filters.
+ * @return true if consumed, false to queue it for can_recv().
+ */
+typedef bool (*can_isr_hook_t)(const can_frame_t * frame_p);
+
+/**
+ * Driver counters.
+ */
+typedef struct {
+    uint32_t rx;          /**< Frames received*/
+    uint32_t tx;          /**< Frames handed to the controller*/
+    uint32_t rx_overrun;  /**< Frames lost, receive queue full*/
+    uint32_t tx_overrun;  /**< Frames lost, transmit queue full*/
+    uint32_t error;       /**< Bus errors the controller reported*/
+} can_stats_t;
+
+/**********************
+ * GLOBAL PROTOTYPES
+ **********************/
+
+void can_init(can_isr_hook_t hook_p);
+bool can_filter_set(uint8_t bank, uint32_t id, uint32_t mask);
+bool can_filter_off(uint8_t bank);
+bool can_send(const can_frame_t * frame_p);
+bool can_recv(can_frame_t * frame_p);
+void can_rx_isr(const can_frame_t * frame_p);
+void can_tx_isr();
+void can_error_isr();
+void can_stats_get(can_stats_t * stats_p);
+
+/**
+ * Port hooks, provided by the controller driver.
+ * can_port_send() puts a frame into a free mailbox and returns
+ * false if there is none, a freed mailbox calls can_tx_isr().
+ * can_port_filter() sets up a bank, a frame passes when
+ * (frame id & mask) == (id & mask), on false it is turned off.
+ * can_port_lock() holds off the receive and transmit interrupts.
+ */
+bool can_port_send(const can_frame_t * frame_p);
+bool can_port_filter(uint8_t bank, uint32_t id, uint32_t mask, bool on);
+void can_port_lock();
+void can_port_unlock();
+
+#endif /*__CANBUS_H__*/
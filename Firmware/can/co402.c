@@ -0,0 +1,944 @@
+/**
+ * @file co402.c
+ *
+ */
+
+/*********************
+ *      INCLUDES
+ *********************/
+
+#include <stddef.h>
+#include <string.h>
+#include "co402.h"
+
+/*********************
+ *      DEFINES
+ *********************/
+
+/*Profile 402, servo drive*/
+#define CO402_DEVICE_TYPE 0x00020192UL
+
+/*Filter banks*/
+#define CO402_BANK_NMT  0U
+#define CO402_BANK_SYNC 1U
+#define CO402_BANK_SDO  2U
+#define CO402_BANK_RPDO 3U /*+ PDO number*/
+
+/*Standard frames only*/
+#define CO402_FILTER_MASK (CAN_FRAME_EXT | CAN_FRAME_STD_MASK)
+
+/*SDO command specifiers, bits 7 ... 5 of the first byte*/
+#define CO402_SDO_CCS_DOWNLOAD 1U
+#define CO402_SDO_CCS_UPLOAD   2U
+#define CO402_SDO_CCS_ABORT    4U
+#define CO402_SDO_SCS_DOWNLOAD 0x60U
+#define CO402_SDO_SCS_UPLOAD   0x43U /*Expedited, size indicated*/
+#define CO402_SDO_SCS_ABORT    0x80U
+#define CO402_SDO_EXPEDITED    0x02U
+#define CO402_SDO_SIZED        0x01U
+
+/*Transmission types*/
+#define CO402_TRANS_SYNC_MAX 240U
+#define CO402_TRANS_ASYNC    254U
+
+/**********************
+ *      TYPEDEFS
+ **********************/
+
+typedef struct _co402_obj_t {
+    uint16_t index;
+    uint8_t sub;
+    uint8_t size;
+    uint8_t access;
+    void * var_p;
+    uint32_t (*on_write)(const struct _co402_obj_t * obj_p, uint32_t val);
+} co402_obj_t;
+
+typedef struct {
+    uint8_t comm_num;
+    uint32_t cob_id;
+    uint8_t trans;
+    uint8_t map_num;
+    uint32_t map[CO402_MAP_MAX];
+    /*Mapping resolved when map_num was written*/
+    const co402_obj_t * obj_p[CO402_MAP_MAX];
+    uint8_t len;
+    uint8_t sync_cnt;
+    volatile bool pending;  /*RPDO data waits for the SYNC*/
+    bool sent;
+    uint8_t buf[8];         /*Received or last sent data*/
+} co402_pdo_t;
+
+typedef struct {
+    uint16_t controlword;
+    uint16_t statusword;
+    int8_t mode;
+    int8_t mode_disp;
+    int32_t pos_act;
+    int32_t vel_act;
+    int16_t torque_tgt;
+    int16_t torque_act;
+    int32_t pos_tgt;
+    int32_t vel_tgt;
+    /*Drive state machine*/
+    co402_drive_t state;
+    uint16_t cw_last;
+    bool fault;
+} co402_axis_t;
+
+typedef struct {
+    uint8_t num;
+    uint32_t vendor;
+    uint32_t product;
+    uint32_t revision;
+} co402_ident_t;
+
+/**********************
+ *  STATIC PROTOTYPES
+ **********************/
+
+static void co402_reset(bool app);
+static void co402_comm_defaults();
+static void co402_filters();
+static void co402_nmt(const can_frame_t * frame_p);
+static void co402_heartbeat(co402_nmt_t state);
+static void co402_sdo(const can_frame_t * frame_p);
+static uint32_t co402_sdo_download(uint16_t index, uint8_t sub,
+    const uint8_t * req_p, uint8_t * resp_p);
+static uint32_t co402_sdo_upload(uint16_t index, uint8_t sub, uint8_t * resp_p);
+static void co402_sync();
+static void co402_rpdo_rx(co402_pdo_t * pdo_p, const can_frame_t * frame_p);
+static void co402_tpdo_send(co402_pdo_t * pdo_p, const uint8_t * data_p);
+static void co402_pdo_pack(const co402_pdo_t * pdo_p, uint8_t * data_p);
+static void co402_pdo_unpack(const co402_pdo_t * pdo_p, const uint8_t * data_p);
+static uint32_t co402_pdo_resolve(co402_pdo_t * pdo_p, bool rx, uint8_t num);
+static co402_pdo_t * co402_pdo_of(const co402_obj_t * obj_p, bool * rx_p);
+static void co402_drive_step(volatile co402_axis_t * ax_p);
+static const co402_obj_t * co402_obj_find(uint16_t index, uint8_t sub, uint32_t * abort_p);
+static uint32_t co402_obj_get(const co402_obj_t * obj_p);
+static void co402_obj_put(const co402_obj_t * obj_p, uint32_t val);
+static uint32_t co402_sync_cob_write(const co402_obj_t * obj_p, uint32_t val);
+static uint32_t co402_pdo_cob_write(const co402_obj_t * obj_p, uint32_t val);
+static uint32_t co402_pdo_trans_write(const co402_obj_t * obj_p, uint32_t val);
+static uint32_t co402_pdo_map_num_write(const co402_obj_t * obj_p, uint32_t val);
+static uint32_t co402_pdo_map_write(const co402_obj_t * obj_p, uint32_t val);
+static uint32_t co402_mode_write(const co402_obj_t * obj_p, uint32_t val);
+static bool co402_mode_valid(int8_t mode);
+static uint32_t co402_get_u32(const uint8_t * p);
+static void co402_put_u32(uint8_t * p, uint32_t v);
+
+/**********************
+ *  STATIC VARIABLES
+ **********************/
+
+static uint8_t node_id = 1;
+static volatile co402_nmt_t nmt_state = CO402_NMT_INIT;
+
+/*Object dictionary variables*/
+static uint32_t device_type = CO402_DEVICE_TYPE;
+static uint8_t error_reg = 0;
+static uint32_t sync_cob = CO402_COB_SYNC;
+static uint16_t hb_time = 0;
+static co402_ident_t ident = {3, 0, 0x0402U, 1};
+static co402_pdo_t rpdo[CO402_PDO_NUM] = {0};
+static co402_pdo_t tpdo[CO402_PDO_NUM] = {0};
+static volatile co402_axis_t axis[CO402_AXIS_NUM] = {0};
+
+#define CO402_OBJ_DESC(index, sub, size, access, var, hook) \
+    {index, sub, size, access, (void *)(var), hook},
+
+static const co402_obj_t od[] = {
+    CO402_OD_MAP(CO402_OBJ_DESC)
+};
+
+/*Default mapping, see co402.h*/
+static const uint32_t rpdo_map_default[CO402_PDO_NUM][2] = {
+    {CO402_MAP_ENTRY(CO402_IDX_CONTROLWORD, 0, 16), CO402_MAP_ENTRY(CO402_IDX_POS_TGT, 0, 32)},
+    {CO402_MAP_ENTRY(CO402_IDX_CONTROLWORD, 0, 16), CO402_MAP_ENTRY(CO402_IDX_VEL_TGT, 0, 32)},
+    {CO402_MAP_ENTRY(CO402_IDX_CONTROLWORD + CO402_AXIS_OFFSET, 0, 16),
+        CO402_MAP_ENTRY(CO402_IDX_POS_TGT + CO402_AXIS_OFFSET, 0, 32)},
+    {CO402_MAP_ENTRY(CO402_IDX_CONTROLWORD + CO402_AXIS_OFFSET, 0, 16),
+        CO402_MAP_ENTRY(CO402_IDX_VEL_TGT + CO402_AXIS_OFFSET, 0, 32)},
+};
+
+static const uint32_t tpdo_map_default[CO402_PDO_NUM][2] = {
+    {CO402_MAP_ENTRY(CO402_IDX_STATUSWORD, 0, 16), CO402_MAP_ENTRY(CO402_IDX_POS_ACT, 0, 32)},
+    {CO402_MAP_ENTRY(CO402_IDX_STATUSWORD, 0, 16), CO402_MAP_ENTRY(CO402_IDX_VEL_ACT, 0, 32)},
+    {CO402_MAP_ENTRY(CO402_IDX_STATUSWORD + CO402_AXIS_OFFSET, 0, 16),
+        CO402_MAP_ENTRY(CO402_IDX_POS_ACT + CO402_AXIS_OFFSET, 0, 32)},
+    {CO402_MAP_ENTRY(CO402_IDX_STATUSWORD + CO402_AXIS_OFFSET, 0, 16),
+        CO402_MAP_ENTRY(CO402_IDX_VEL_ACT + CO402_AXIS_OFFSET, 0, 32)},
+};
+
+/*Statusword of every drive state*/
+static const uint16_t drive_sw[CO402_DRIVE_NUM] = {
+    [CO402_DRIVE_NOT_READY] = 0,
+    [CO402_DRIVE_SOD] = CO402_SW_SOD,
+    [CO402_DRIVE_READY] = CO402_SW_QUICK_STOP | CO402_SW_READY,
+    [CO402_DRIVE_SWITCHED_ON] = CO402_SW_QUICK_STOP | CO402_SW_VOLTAGE |
+        CO402_SW_SWITCHED_ON | CO402_SW_READY,
+    [CO402_DRIVE_OP_ENABLED] = CO402_SW_QUICK_STOP | CO402_SW_VOLTAGE |
+        CO402_SW_OP_ENABLED | CO402_SW_SWITCHED_ON | CO402_SW_READY,
+    [CO402_DRIVE_QUICK_STOP] = CO402_SW_VOLTAGE |
+        CO402_SW_OP_ENABLED | CO402_SW_SWITCHED_ON | CO402_SW_READY,
+    [CO402_DRIVE_FAULT_REACTION] = CO402_SW_FAULT |
+        CO402_SW_OP_ENABLED | CO402_SW_SWITCHED_ON | CO402_SW_READY,
+    [CO402_DRIVE_FAULT] = CO402_SW_FAULT,
+};
+
+/*SYNC, receive interrupt*/
+static volatile uint32_t sync_id = CO402_COB_SYNC;
+static uint32_t sync_count = 0;
+
+/*1 ms tick, heartbeat and asynchronous TPDOs in the main loop*/
+static volatile uint32_t ms = 0;
+static uint32_t hb_last = 0;
+static uint32_t poll_ms = 0;
+
+/**********************
+ *   GLOBAL FUNCTIONS
+ **********************/
+
+/**
+ * Starts the node with the default dictionary, sends the
+ * boot-up message and enters pre-operational. The controller
+ * must be running, the receive filters are set up here.
+ * @param id Node id, 1 ... CO402_NODE_ID_MAX.
+ * @return false if the node id is out of range.
+ */
+bool co402_init(uint8_t id)
+{
+    if ((id == 0) || (id > CO402_NODE_ID_MAX)) return false;
+
+    node_id = id;
+    can_init(co402_isr);
+
+    for (uint8_t a = 0; a < CO402_AXIS_NUM; a++) {
+        axis[a].state = CO402_DRIVE_NOT_READY;
+        axis[a].statusword = drive_sw[CO402_DRIVE_NOT_READY];
+    }
+
+    co402_reset(true);
+    return true;
+}
+
+/**
+ * Receive interrupt hook of the CAN driver, takes SYNC and the
+ * RPDOs, the rest is left for co402_poll().
+ */
+bool co402_isr(const can_frame_t * frame_p)
+{
+    uint32_t cob = 0;
+
+    if (frame_p->id == sync_id) {
+        if (nmt_state == CO402_NMT_OPERATIONAL) co402_sync();
+        return true;
+    }
+
+    if (nmt_state != CO402_NMT_OPERATIONAL) return false;
+
+    for (uint8_t n = 0; n < CO402_PDO_NUM; n++) {
+        cob = rpdo[n].cob_id;
+
+        if (cob & CO402_COB_INVALID) continue;
+        if (frame_p->id != (cob & CAN_FRAME_STD_MASK)) continue;
+
+        co402_rpdo_rx(&rpdo[n], frame_p);
+        return true;
+    }
+
+    return false;
+}
+
+/**
+ * NMT and SDO, heartbeat and asynchronous TPDOs, from the main loop.
+ */
+void co402_poll()
+{
+    can_frame_t frame = {0};
+    uint8_t data[8] = {0};
+    uint32_t now = 0;
+
+    while (can_recv(&frame)) {
+        if (frame.id == CO402_COB_NMT) co402_nmt(&frame);
+        else if (frame.id == CO402_COB_SDO_RX + node_id) co402_sdo(&frame);
+    }
+
+    now = ms;
+
+    if ((hb_time != 0) && ((uint32_t)(now - hb_last) >= hb_time)) {
+        hb_last = now;
+        co402_heartbeat(nmt_state);
+    }
+
+    /*Asynchronous TPDOs are checked once per tick, a
+    value that changes all the time does not flood the bus*/
+    if (now == poll_ms) return;
+    poll_ms = now;
+
+    if (nmt_state != CO402_NMT_OPERATIONAL) return;
+
+    for (uint8_t n = 0; n < CO402_PDO_NUM; n++) {
+        co402_pdo_t * pdo_p = &tpdo[n];
+
+        if (pdo_p->cob_id & CO402_COB_INVALID) continue;
+        if (pdo_p->trans < CO402_TRANS_ASYNC) continue;
+
+        co402_pdo_pack(pdo_p, data);
+        if (pdo_p->sent && (memcmp(data, pdo_p->buf, pdo_p->len) == 0)) continue;
+
+        co402_tpdo_send(pdo_p, data);
+    }
+}
+
+/**
+ * Drive state machines, every 1 ms.
+ */
+void co402_tick()
+{
+    bool fault = false;
+
+    ms++;
+
+    for (uint8_t a = 0; a < CO402_AXIS_NUM; a++) {
+        co402_drive_step(&axis[a]);
+        fault |= axis[a].fault;
+    }
+
+    /*Generic error*/
+    error_reg = fault ? 0x01U : 0x00U;
+}
+
+co402_nmt_t co402_nmt_state()
+{
+    return nmt_state;
+}
+
+/**
+ * What the master commands, the targets as of the last SYNC
+ * for synchronous RPDOs.
+ * @param axis_nr Axis.
+ * @param cmd_p Receives the command, all zero for a missing axis.
+ */
+void co402_cmd_get(uint8_t axis_nr, co402_cmd_t * cmd_p)
+{
+    volatile co402_axis_t * ax_p = NULL;
+
+    memset(cmd_p, 0, sizeof(co402_cmd_t));
+    if (axis_nr >= CO402_AXIS_NUM) return;
+
+    ax_p = &axis[axis_nr];
+    cmd_p->state = ax_p->state;
+    cmd_p->enabled = (ax_p->state == CO402_DRIVE_OP_ENABLED);
+    cmd_p->mode = ax_p->mode_disp;
+    cmd_p->pos = ax_p->pos_tgt;
+    cmd_p->vel = ax_p->vel_tgt;
+    cmd_p->torque = ax_p->torque_tgt;
+}
+
+/**
+ * Actual values for the TPDOs and SDO, a fault
+ * stops the axis with the next tick.
+ */
+void co402_actual_publish(uint8_t axis_nr, const co402_actual_t * act_p)
+{
+    volatile co402_axis_t * ax_p = NULL;
+
+    if (axis_nr >= CO402_AXIS_NUM) return;
+
+    ax_p = &axis[axis_nr];
+    ax_p->pos_act = act_p->pos;
+    ax_p->vel_act = act_p->vel;
+    ax_p->torque_act = act_p->torque;
+    ax_p->fault = act_p->fault;
+}
+
+/**********************
+ *   STATIC FUNCTIONS
+ **********************/
+
+/**
+ * NMT reset, the communication objects take their defaults,
+ * a node reset also clears the targets of the drive.
+ * The interrupt leaves the PDOs alone until operational.
+ */
+static void co402_reset(bool app)
+{
+    nmt_state = CO402_NMT_INIT;
+    __sync_synchronize();
+
+    co402_comm_defaults();
+
+    if (app) {
+        for (uint8_t a = 0; a < CO402_AXIS_NUM; a++) {
+            axis[a].controlword = 0;
+            axis[a].mode = CO402_MODE_NONE;
+            axis[a].pos_tgt = 0;
+            axis[a].vel_tgt = 0;
+            axis[a].torque_tgt = 0;
+        }
+    }
+
+    co402_filters();
+
+    /*Boot-up*/
+    co402_heartbeat(CO402_NMT_INIT);
+
+    hb_last = ms;
+    nmt_state = CO402_NMT_PREOP;
+}
+
+static void co402_comm_defaults()
+{
+    sync_cob = CO402_COB_SYNC;
+    sync_id = CO402_COB_SYNC;
+    hb_time = 0;
+    sync_count = 0;
+
+    for (uint8_t n = 0; n < CO402_PDO_NUM; n++) {
+        co402_pdo_t * pdo_p[2] = {&rpdo[n], &tpdo[n]};
+        const uint32_t * map_p[2] = {rpdo_map_default[n], tpdo_map_default[n]};
+
+        for (uint8_t rx = 0; rx < 2; rx++) {
+            co402_pdo_t * p = pdo_p[rx];
+
+            memset(p, 0, sizeof(co402_pdo_t));
+            p->comm_num = 2;
+            p->cob_id = (rx ? CO402_COB_TPDO : CO402_COB_RPDO) + n * 0x100U + node_id;
+            /*Axis positions only, velocities on request*/
+            if (n & 1U) p->cob_id |= CO402_COB_INVALID;
+            p->trans = 1;
+            p->map[0] = map_p[rx][0];
+            p->map[1] = map_p[rx][1];
+            co402_pdo_resolve(p, (rx == 0), 2);
+        }
+    }
+}
+
+static void co402_filters()
+{
+    can_filter_set(CO402_BANK_NMT, CO402_COB_NMT, CO402_FILTER_MASK);
+    can_filter_set(CO402_BANK_SYNC, sync_id, CO402_FILTER_MASK);
+    can_filter_set(CO402_BANK_SDO, CO402_COB_SDO_RX + node_id, CO402_FILTER_MASK);
+
+    for (uint8_t n = 0; n < CO402_PDO_NUM; n++) {
+        uint32_t cob = rpdo[n].cob_id;
+
+        if (cob & CO402_COB_INVALID) can_filter_off(CO402_BANK_RPDO + n);
+        else can_filter_set(CO402_BANK_RPDO + n, cob & CAN_FRAME_STD_MASK, CO402_FILTER_MASK);
+    }
+}
+
+static void co402_nmt(const can_frame_t * frame_p)
+{
+    if (frame_p->dlc < 2) return;
+    if ((frame_p->data[1] != 0) && (frame_p->data[1] != node_id)) return;
+
+    switch (frame_p->data[0]) {
+    case CO402_NMT_CMD_START:
+        nmt_state = CO402_NMT_OPERATIONAL;
+        break;
+
+    case CO402_NMT_CMD_STOP:
+        nmt_state = CO402_NMT_STOPPED;
+        break;
+
+    case CO402_NMT_CMD_PREOP:
+        nmt_state = CO402_NMT_PREOP;
+        break;
+
+    case CO402_NMT_CMD_RESET_NODE:
+        co402_reset(true);
+        break;
+
+    case CO402_NMT_CMD_RESET_COMM:
+        co402_reset(false);
+        break;
+
+    default:
+        break;
+    }
+}
+
+/**
+ * Heartbeat, the boot-up message is one in the init state.
+ */
+static void co402_heartbeat(co402_nmt_t state)
+{
+    can_frame_t frame = {
+        .id = CO402_COB_HEARTBEAT + node_id,
+        .dlc = 1,
+    };
+
+    frame.data[0] = state;
+    can_send(&frame);
+}
+
+static void co402_sdo(const can_frame_t * frame_p)
+{
+    const uint8_t * req_p = frame_p->data;
+    can_frame_t resp = {
+        .id = CO402_COB_SDO_TX + node_id,
+        .dlc = 8,
+    };
+    uint16_t index = (uint16_t)(req_p[1] | (req_p[2] << 8));
+    uint8_t sub = req_p[3];
+    uint32_t abort = 0;
+
+    if (frame_p->dlc != 8) return;
+    if (nmt_state == CO402_NMT_STOPPED) return;
+
+    resp.data[1] = req_p[1];
+    resp.data[2] = req_p[2];
+    resp.data[3] = req_p[3];
+
+    switch (req_p[0] >> 5) {
+    case CO402_SDO_CCS_DOWNLOAD:
+        abort = co402_sdo_download(index, sub, req_p, resp.data);
+        break;
+
+    case CO402_SDO_CCS_UPLOAD:
+        abort = co402_sdo_upload(index, sub, resp.data);
+        break;
+
+    case CO402_SDO_CCS_ABORT:
+        return;
+
+    default:
+        abort = CO402_ABORT_CS;
+        break;
+    }
+
+    if (abort != 0) {
+        resp.data[0] = CO402_SDO_SCS_ABORT;
+        co402_put_u32(&resp.data[4], abort);
+    }
+
+    can_send(&resp);
+}
+
+/**
+ * Expedited download, the value is in the request.
+ * @return Abort code, 0 when written.
+ */
+static uint32_t co402_sdo_download(uint16_t index, uint8_t sub,
+    const uint8_t * req_p, uint8_t * resp_p)
+{
+    const co402_obj_t * obj_p = NULL;
+    uint8_t cs = req_p[0];
+    uint32_t abort = 0;
+    uint32_t val = 0;
+
+    obj_p = co402_obj_find(index, sub, &abort);
+    if (obj_p == NULL) return abort;
+
+    /*No segmented transfer, every object fits 4 bytes*/
+    if (!(cs & CO402_SDO_EXPEDITED)) return CO402_ABORT_CS;
+    if (!(obj_p->access & CO402_ACC_W)) return CO402_ABORT_READ_ONLY;
+
+    if ((cs & CO402_SDO_SIZED) && (4U - ((cs >> 2) & 0x03U) != obj_p->size))
+        return CO402_ABORT_LEN;
+
+    val = co402_get_u32(&req_p[4]);
+    if (obj_p->size < 4) val &= (1UL << (obj_p->size * 8)) - 1;
+
+    if (obj_p->on_write != NULL) {
+        abort = obj_p->on_write(obj_p, val);
+        if (abort != 0) return abort;
+    } else co402_obj_put(obj_p, val);
+
+    resp_p[0] = CO402_SDO_SCS_DOWNLOAD;
+    return 0;
+}
+
+static uint32_t co402_sdo_upload(uint16_t index, uint8_t sub, uint8_t * resp_p)
+{
+    const co402_obj_t * obj_p = NULL;
+    uint32_t abort = 0;
+
+    obj_p = co402_obj_find(index, sub, &abort);
+    if (obj_p == NULL) return abort;
+
+    if (!(obj_p->access & CO402_ACC_R)) return CO402_ABORT_WRITE_ONLY;
+
+    resp_p[0] = CO402_SDO_SCS_UPLOAD | ((4U - obj_p->size) << 2);
+    co402_put_u32(&resp_p[4], co402_obj_get(obj_p));
+    return 0;
+}
+
+/**
+ * SYNC, receive interrupt. The RPDOs of the last cycle take
+ * effect together, then the TPDOs sample the actual values.
+ */
+static void co402_sync()
+{
+    uint8_t data[8] = {0};
+
+    sync_count++;
+
+    for (uint8_t n = 0; n < CO402_PDO_NUM; n++) {
+        if (!rpdo[n].pending) continue;
+
+        co402_pdo_unpack(&rpdo[n], rpdo[n].buf);
+        rpdo[n].pending = false;
+    }
+
+    co402_port_sync(sync_count);
+
+    for (uint8_t n = 0; n < CO402_PDO_NUM; n++) {
+        co402_pdo_t * pdo_p = &tpdo[n];
+
+        if (pdo_p->cob_id & CO402_COB_INVALID) continue;
+        if (pdo_p->trans > CO402_TRANS_SYNC_MAX) continue;
+
+        if (pdo_p->trans == 0) {
+            /*Acyclic, only when the data changed*/
+            co402_pdo_pack(pdo_p, data);
+            if (pdo_p->sent && (memcmp(data, pdo_p->buf, pdo_p->len) == 0)) continue;
+        } else {
+            if (++pdo_p->sync_cnt < pdo_p->trans) continue;
+            pdo_p->sync_cnt = 0;
+            co402_pdo_pack(pdo_p, data);
+        }
+
+        co402_tpdo_send(pdo_p, data);
+    }
+}
+
+static void co402_rpdo_rx(co402_pdo_t * pdo_p, const can_frame_t * frame_p)
+{
+    /*Too short for the mapping, CiA 301 drops it*/
+    if (frame_p->dlc < pdo_p->len) return;
+
+    if (pdo_p->trans <= CO402_TRANS_SYNC_MAX) {
+        memcpy(pdo_p->buf, frame_p->data, pdo_p->len);
+        pdo_p->pending = true;
+    } else co402_pdo_unpack(pdo_p, frame_p->data);
+}
+
+static void co402_tpdo_send(co402_pdo_t * pdo_p, const uint8_t * data_p)
+{
+    can_frame_t frame = {
+        .id = pdo_p->cob_id & CAN_FRAME_STD_MASK,
+        .dlc = pdo_p->len,
+    };
+
+    memcpy(frame.data, data_p, pdo_p->len);
+    memcpy(pdo_p->buf, data_p, pdo_p->len);
+    pdo_p->sent = true;
+
+    can_send(&frame);
+}
+
+static void co402_pdo_pack(const co402_pdo_t * pdo_p, uint8_t * data_p)
+{
+    uint8_t pos = 0;
+
+    for (uint8_t i = 0; i < pdo_p->map_num; i++) {
+        const co402_obj_t * obj_p = pdo_p->obj_p[i];
+        uint32_t val = co402_obj_get(obj_p);
+
+        for (uint8_t b = 0; b < obj_p->size; b++)
+            data_p[pos++] = (uint8_t)(val >> (b * 8));
+    }
+}
+
+static void co402_pdo_unpack(const co402_pdo_t * pdo_p, const uint8_t * data_p)
+{
+    uint8_t pos = 0;
+
+    for (uint8_t i = 0; i < pdo_p->map_num; i++) {
+        const co402_obj_t * obj_p = pdo_p->obj_p[i];
+        uint32_t val = 0;
+
+        for (uint8_t b = 0; b < obj_p->size; b++)
+            val |= (uint32_t)data_p[pos++] << (b * 8);
+
+        co402_obj_put(obj_p, val);
+    }
+}
+
+/**
+ * Looks up the first num mapping entries, so the PDO path
+ * copies without searching the dictionary.
+ * @return Abort code, 0 when the mapping is taken over.
+ */
+static uint32_t co402_pdo_resolve(co402_pdo_t * pdo_p, bool rx, uint8_t num)
+{
+    const co402_obj_t * obj_p[CO402_MAP_MAX] = {NULL};
+    uint32_t abort = 0;
+    uint8_t len = 0;
+
+    if (num > CO402_MAP_MAX) return CO402_ABORT_RANGE;
+
+    for (uint8_t i = 0; i < num; i++) {
+        uint32_t entry = pdo_p->map[i];
+        uint8_t bits = entry & 0xFFU;
+
+        obj_p[i] = co402_obj_find(entry >> 16, (entry >> 8) & 0xFFU, &abort);
+        if (obj_p[i] == NULL) return CO402_ABORT_NO_MAP;
+
+        if (!(obj_p[i]->access & (rx ? CO402_ACC_RPDO : CO402_ACC_TPDO)))
+            return CO402_ABORT_NO_MAP;
+
+        if (bits != obj_p[i]->size * 8) return CO402_ABORT_PARAM;
+
+        len += obj_p[i]->size;
+        if (len > 8) return CO402_ABORT_MAP_LEN;
+    }
+
+    memcpy(pdo_p->obj_p, obj_p, sizeof(obj_p));
+    pdo_p->len = len;
+    pdo_p->map_num = num;
+    return 0;
+}
+
+static co402_pdo_t * co402_pdo_of(const co402_obj_t * obj_p, bool * rx_p)
+{
+    uint16_t base = obj_p->index & 0xFF00U;
+    uint8_t n = obj_p->index & 0x00FFU;
+
+    *rx_p = (base == CO402_IDX_RPDO_COMM) || (base == CO402_IDX_RPDO_MAP);
+    return *rx_p ? &rpdo[n] : &tpdo[n];
+}
+
+/**
+ * CiA 402 state machine of one axis, the controlword is
+ * evaluated in the tick only so a state never changes twice
+ * in between.
+ */
+static void co402_drive_step(volatile co402_axis_t * ax_p)
+{
+    uint16_t cw = ax_p->controlword;
+    co402_drive_t st = ax_p->state;
+    bool reset = (cw & CO402_CW_FAULT_RESET) && !(ax_p->cw_last & CO402_CW_FAULT_RESET);
+    bool dis_volt = !(cw & CO402_CW_ENABLE_VOLT);
+    bool quick_stop = (cw & 0x0006U) == CO402_CW_ENABLE_VOLT;
+    bool shutdown = (cw & 0x0087U) == 0x0006U;
+    bool switch_on = (cw & 0x008FU) == 0x0007U;
+    bool enable_op = (cw & 0x008FU) == 0x000FU;
+    uint16_t sw = 0;
+
+    ax_p->cw_last = cw;
+
+    if (ax_p->fault && (st != CO402_DRIVE_FAULT) && (st != CO402_DRIVE_FAULT_REACTION)) {
+        st = CO402_DRIVE_FAULT_REACTION;
+    } else switch (st) {
+    case CO402_DRIVE_NOT_READY:
+        st = CO402_DRIVE_SOD;
+        break;
+
+    case CO402_DRIVE_SOD:
+        if (shutdown) st = CO402_DRIVE_READY;
+        break;
+
+    case CO402_DRIVE_READY:
+        if (dis_volt || quick_stop) st = CO402_DRIVE_SOD;
+        else if (switch_on) st = CO402_DRIVE_SWITCHED_ON;
+        else if (enable_op) st = CO402_DRIVE_OP_ENABLED;
+        break;
+
+    case CO402_DRIVE_SWITCHED_ON:
+        if (dis_volt || quick_stop) st = CO402_DRIVE_SOD;
+        else if (shutdown) st = CO402_DRIVE_READY;
+        else if (enable_op) st = CO402_DRIVE_OP_ENABLED;
+        break;
+
+    case CO402_DRIVE_OP_ENABLED:
+        if (dis_volt) st = CO402_DRIVE_SOD;
+        else if (quick_stop) st = CO402_DRIVE_QUICK_STOP;
+        else if (shutdown) st = CO402_DRIVE_READY;
+        else if (switch_on) st = CO402_DRIVE_SWITCHED_ON;
+        break;
+
+    case CO402_DRIVE_QUICK_STOP:
+        /*The application brakes, done once the axis stands*/
+        if (dis_volt || (ax_p->vel_act == 0)) st = CO402_DRIVE_SOD;
+        break;
+
+    case CO402_DRIVE_FAULT_REACTION:
+        st = CO402_DRIVE_FAULT;
+        break;
+
+    case CO402_DRIVE_FAULT:
+        if (reset && !ax_p->fault) st = CO402_DRIVE_SOD;
+        break;
+
+    default:
+        st = CO402_DRIVE_NOT_READY;
+        break;
+    }
+
+    /*A mode only takes effect when supported, a PDO may write anything*/
+    if (co402_mode_valid(ax_p->mode)) ax_p->mode_disp = ax_p->mode;
+
+    sw = drive_sw[st] | CO402_SW_REMOTE;
+    if ((st == CO402_DRIVE_OP_ENABLED) && (ax_p->mode_disp != CO402_MODE_NONE))
+        sw |= CO402_SW_FOLLOWING;
+
+    ax_p->state = st;
+    ax_p->statusword = sw;
+}
+
+/**
+ * Linear search, only SDO and mapping changes come here.
+ */
+static const co402_obj_t * co402_obj_find(uint16_t index, uint8_t sub, uint32_t * abort_p)
+{
+    bool index_found = false;
+
+    for (uint16_t i = 0; i < sizeof(od) / sizeof(od[0]); i++) {
+        if (od[i].index != index) continue;
+        if (od[i].sub == sub) return &od[i];
+        index_found = true;
+    }
+
+    *abort_p = index_found ? CO402_ABORT_NO_SUB : CO402_ABORT_NO_OBJECT;
+    return NULL;
+}
+
+static uint32_t co402_obj_get(const co402_obj_t * obj_p)
+{
+    switch (obj_p->size) {
+    case 1:  return *(volatile uint8_t *)obj_p->var_p;
+    case 2:  return *(volatile uint16_t *)obj_p->var_p;
+    default: return *(volatile uint32_t *)obj_p->var_p;
+    }
+}
+
+static void co402_obj_put(const co402_obj_t * obj_p, uint32_t val)
+{
+    switch (obj_p->size) {
+    case 1:  *(volatile uint8_t *)obj_p->var_p = (uint8_t)val; break;
+    case 2:  *(volatile uint16_t *)obj_p->var_p = (uint16_t)val; break;
+    default: *(volatile uint32_t *)obj_p->var_p = val; break;
+    }
+}
+
+/**
+ * 0x1005, consumer only, no 29 bit identifier.
+ */
+static uint32_t co402_sync_cob_write(const co402_obj_t * obj_p, uint32_t val)
+{
+    uint32_t id = val & CAN_FRAME_STD_MASK;
+
+    (void)obj_p;
+
+    if ((val & ~CO402_COB_INVALID) != id) return CO402_ABORT_RANGE;
+    if (id == CO402_COB_NMT) return CO402_ABORT_RANGE;
+
+    sync_cob = val;
+    sync_id = id;
+    can_filter_set(CO402_BANK_SYNC, id, CO402_FILTER_MASK);
+    return 0;
+}
+
+/**
+ * PDO COB-ID, bit 31 turns the PDO off. The identifier only
+ * changes while the PDO is off, so the interrupt never sees
+ * a half changed PDO.
+ */
+static uint32_t co402_pdo_cob_write(const co402_obj_t * obj_p, uint32_t val)
+{
+    bool rx = false;
+    co402_pdo_t * pdo_p = co402_pdo_of(obj_p, &rx);
+    uint8_t n = obj_p->index & 0x00FFU;
+    uint32_t id = val & CAN_FRAME_STD_MASK;
+    bool valid = !(val & CO402_COB_INVALID);
+
+    /*Bit 30 is no RTR, which is always the case*/
+    if ((val & ~(CO402_COB_INVALID | 0x40000000UL)) != id) return CO402_ABORT_RANGE;
+    if (id == CO402_COB_NMT) return CO402_ABORT_RANGE;
+
+    if (valid && !(pdo_p->cob_id & CO402_COB_INVALID) &&
+        (id != (pdo_p->cob_id & CAN_FRAME_STD_MASK)))
+        return CO402_ABORT_RANGE;
+
+    if (valid) {
+        pdo_p->pending = false;
+        pdo_p->sent = false;
+        pdo_p->sync_cnt = 0;
+        __sync_synchronize();
+        pdo_p->cob_id = val;
+    } else {
+        pdo_p->cob_id = val;
+        __sync_synchronize();
+        pdo_p->pending = false;
+    }
+
+    if (rx) {
+        if (valid) can_filter_set(CO402_BANK_RPDO + n, id, CO402_FILTER_MASK);
+        else can_filter_off(CO402_BANK_RPDO + n);
+    }
+
+    return 0;
+}
+
+/**
+ * Transmission type, 0 ... 240, 254 or 255, not while the PDO
+ * is valid, a TPDO moves between the interrupt and the main loop.
+ */
+static uint32_t co402_pdo_trans_write(const co402_obj_t * obj_p, uint32_t val)
+{
+    bool rx = false;
+    co402_pdo_t * pdo_p = co402_pdo_of(obj_p, &rx);
+
+    if (!(pdo_p->cob_id & CO402_COB_INVALID)) return CO402_ABORT_STATE;
+    if ((val > CO402_TRANS_SYNC_MAX) && (val < CO402_TRANS_ASYNC)) return CO402_ABORT_RANGE;
+
+    pdo_p->trans = (uint8_t)val;
+    return 0;
+}
+
+/**
+ * Number of mapped objects, checks and resolves the entries.
+ */
+static uint32_t co402_pdo_map_num_write(const co402_obj_t * obj_p, uint32_t val)
+{
+    bool rx = false;
+    co402_pdo_t * pdo_p = co402_pdo_of(obj_p, &rx);
+
+    if (!(pdo_p->cob_id & CO402_COB_INVALID)) return CO402_ABORT_STATE;
+    return co402_pdo_resolve(pdo_p, rx, (uint8_t)val);
+}
+
+/**
+ * Mapping entry, only while the number of entries is 0.
+ */
+static uint32_t co402_pdo_map_write(const co402_obj_t * obj_p, uint32_t val)
+{
+    bool rx = false;
+    co402_pdo_t * pdo_p = co402_pdo_of(obj_p, &rx);
+
+    if (pdo_p->map_num != 0) return CO402_ABORT_STATE;
+
+    pdo_p->map[obj_p->sub - 1] = val;
+    return 0;
+}
+
+static uint32_t co402_mode_write(const co402_obj_t * obj_p, uint32_t val)
+{
+    if (!co402_mode_valid((int8_t)val)) return CO402_ABORT_RANGE;
+
+    co402_obj_put(obj_p, val);
+    return 0;
+}
+
+static bool co402_mode_valid(int8_t mode)
+{
+    return (mode == CO402_MODE_NONE) || (mode == CO402_MODE_CSP) ||
+        (mode == CO402_MODE_CSV) || (mode == CO402_MODE_CST);
+}
+
+static uint32_t co402_get_u32(const uint8_t * p)
+{
+    return p[0] | (p[1] << 8) | ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+static void co402_put_u32(uint8_t * p, uint32_t v)
+{
+    p[0] = (uint8_t)v;
+    p[1] = (uint8_t)(v >> 8);
+    p[2] = (uint8_t)(v >> 16);
+    p[3] = (uint8_t)(v >> 24);
+}
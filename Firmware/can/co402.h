@@ -0,0 +1,188 @@
+/**
+ * @file co402.h
+ *
+ * CANopen slave with a subset of the CiA 402 drive profile, both axes
+ * of the board in one node, axis n at object + n * CO402_AXIS_OFFSET.
+ *
+ *  NMT  ... Boot-up message, start, stop, pre-operational, resets.
+ *           Heartbeat producer, 0x1017 in ms, 0 is off.
+ *  SDO  ... Expedited upload and download, no segmented transfer.
+ *  PDO  ... 4 RPDOs and 4 TPDOs, up to 4 mapped objects each.
+ *           Transmission types 0 ... 240 are synchronous, 254/255
+ *           asynchronous: an RPDO takes effect on reception, a TPDO
+ *           is sent when its data changes. Mappings and transmission
+ *           types only change while the PDO is not valid.
+ *  SYNC ... Consumer. Synchronous RPDOs received since the last SYNC
+ *           are applied together at the next one, so every axis on
+ *           the bus switches to its new setpoint at the same instant.
+ *           The synchronous TPDOs go out right after.
+ *  402  ... Controlword / statusword state machine, cyclic synchronous
+ *           position, velocity and torque modes.
+ *
+ * Default mapping, sent every SYNC, PDOs 2 and 4 not valid:
+ *  RPDO1 0x200 + id ... Controlword, target position of axis 0
+ *  RPDO2 0x300 + id ... Controlword, target velocity of axis 0
+ *  RPDO3 0x400 + id ... Controlword, target position of axis 1
+ *  RPDO4 0x500 + id ... Controlword, target velocity of axis 1
+ *  TPDO1 0x180 + id ... Statusword, actual position of axis 0
+ *  TPDO2 0x280 + id ... Statusword, actual velocity of axis 0
+ *  TPDO3 0x380 + id ... Statusword, actual position of axis 1
+ *  TPDO4 0x480 + id ... Statusword, actual velocity of axis 1
+ *
+ * SYNC and PDOs are handled in the CAN receive interrupt, NMT and SDO
+ * in the main loop, the drive state machine in the 1 ms tick.
+ */
+
+#ifndef __CO402_H__
+#define __CO402_H__
+
+/*********************
+ *      INCLUDES
+ *********************/
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "canbus.h"
+#include "co402od.h"
+
+/*********************
+ *      DEFINES
+ *********************/
+
+#define CO402_AXIS_NUM 2U
+#define CO402_PDO_NUM  4U
+#define CO402_MAP_MAX  4U
+
+#define CO402_NODE_ID_MAX 127U
+
+/*Function codes, the COB-ID is the code + node id*/
+#define CO402_COB_NMT       0x000U
+#define CO402_COB_SYNC      0x080U
+#define CO402_COB_TPDO      0x180U /*+ 0x100 per PDO*/
+#define CO402_COB_RPDO      0x200U
+#define CO402_COB_SDO_TX    0x580U
+#define CO402_COB_SDO_RX    0x600U
+#define CO402_COB_HEARTBEAT 0x700U
+
+/*NMT commands*/
+#define CO402_NMT_CMD_START      0x01U
+#define CO402_NMT_CMD_STOP       0x02U
+#define CO402_NMT_CMD_PREOP      0x80U
+#define CO402_NMT_CMD_RESET_NODE 0x81U
+#define CO402_NMT_CMD_RESET_COMM 0x82U
+
+/*Bit 31 of a PDO or SYNC COB-ID, the PDO is not valid*/
+#define CO402_COB_INVALID 0x80000000U
+
+/*Controlword bits*/
+#define CO402_CW_SWITCH_ON   0x0001U
+#define CO402_CW_ENABLE_VOLT 0x0002U
+#define CO402_CW_QUICK_STOP  0x0004U /*Active low*/
+#define CO402_CW_ENABLE_OP   0x0008U
+#define CO402_CW_FAULT_RESET 0x0080U
+
+/*Statusword bits*/
+#define CO402_SW_READY       0x0001U
+#define CO402_SW_SWITCHED_ON 0x0002U
+#define CO402_SW_OP_ENABLED  0x0004U
+#define CO402_SW_FAULT       0x0008U
+#define CO402_SW_VOLTAGE     0x0010U
+#define CO402_SW_QUICK_STOP  0x0020U /*Active low*/
+#define CO402_SW_SOD         0x0040U
+#define CO402_SW_REMOTE      0x0200U
+#define CO402_SW_FOLLOWING   0x1000U /*Cyclic modes, follows the target*/
+
+/*SDO abort codes*/
+#define CO402_ABORT_CS          0x05040001UL
+#define CO402_ABORT_WRITE_ONLY  0x06010001UL
+#define CO402_ABORT_READ_ONLY   0x06010002UL
+#define CO402_ABORT_NO_OBJECT   0x06020000UL
+#define CO402_ABORT_NO_MAP      0x06040041UL
+#define CO402_ABORT_MAP_LEN     0x06040042UL
+#define CO402_ABORT_PARAM       0x06040043UL
+#define CO402_ABORT_LEN         0x06070010UL
+#define CO402_ABORT_NO_SUB      0x06090011UL
+#define CO402_ABORT_RANGE       0x06090030UL
+#define CO402_ABORT_STATE       0x08000022UL
+
+/**********************
+ *      TYPEDEFS
+ **********************/
+
+/*NMT states, as the heartbeat reports them*/
+enum {
+    CO402_NMT_INIT = 0x00,
+    CO402_NMT_STOPPED = 0x04,
+    CO402_NMT_OPERATIONAL = 0x05,
+    CO402_NMT_PREOP = 0x7F
+};
+
+typedef uint8_t co402_nmt_t;
+
+/*CiA 402 drive states*/
+enum {
+    CO402_DRIVE_NOT_READY = 0,
+    CO402_DRIVE_SOD,          /**< Switch on disabled*/
+    CO402_DRIVE_READY,        /**< Ready to switch on*/
+    CO402_DRIVE_SWITCHED_ON,
+    CO402_DRIVE_OP_ENABLED,   /**< Power on, follows the target*/
+    CO402_DRIVE_QUICK_STOP,   /**< Braking until the velocity is 0*/
+    CO402_DRIVE_FAULT_REACTION,
+    CO402_DRIVE_FAULT,
+    CO402_DRIVE_NUM
+};
+
+typedef uint8_t co402_drive_t;
+
+/*Modes of operation, 0x6060*/
+enum {
+    CO402_MODE_NONE = 0,
+    CO402_MODE_CSP = 8,       /**< Cyclic synchronous position*/
+    CO402_MODE_CSV = 9,       /**< Cyclic synchronous velocity*/
+    CO402_MODE_CST = 10       /**< Cyclic synchronous torque*/
+};
+
+typedef int8_t co402_mode_t;
+
+/**
+ * What the master commands an axis, as of the last SYNC.
+ */
+typedef struct {
+    co402_drive_t state;
+    bool enabled;         /**< Operation enabled, the axis may drive*/
+    co402_mode_t mode;
+    int32_t pos;          /**< Target position, [counts]*/
+    int32_t vel;          /**< Target velocity, [counts/s]*/
+    int16_t torque;       /**< Target torque, per mille of rated*/
+} co402_cmd_t;
+
+/**
+ * Actual values of an axis, published by the application.
+ */
+typedef struct {
+    int32_t pos;          /**< [counts]*/
+    int32_t vel;          /**< [counts/s]*/
+    int16_t torque;       /**< Per mille of rated*/
+    bool fault;
+} co402_actual_t;
+
+/**********************
+ * GLOBAL PROTOTYPES
+ **********************/
+
+bool co402_init(uint8_t node_id);
+bool co402_isr(const can_frame_t * frame_p);
+void co402_poll();
+void co402_tick();
+co402_nmt_t co402_nmt_state();
+void co402_cmd_get(uint8_t axis, co402_cmd_t * cmd_p);
+void co402_actual_publish(uint8_t axis, const co402_actual_t * act_p);
+
+/**
+ * Port hook, from the receive interrupt at every SYNC after the
+ * setpoints were latched and before the TPDOs are sampled.
+ * @param count SYNC messages since start.
+ */
+void co402_port_sync(uint32_t count);
+
+#endif /*__CO402_H__*/
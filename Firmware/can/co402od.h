@@ -0,0 +1,138 @@
+/**
+ * @file co402od.h
+ *
+ */
+
+#ifndef __CO402OD_H__
+#define __CO402OD_H__
+
+/*********************
+ *      INCLUDES
+ *********************/
+
+#include <stdint.h>
+
+/*********************
+ *      DEFINES
+ *********************/
+
+/*Communication objects*/
+#define CO402_IDX_DEVICE_TYPE  0x1000U
+#define CO402_IDX_ERROR_REG    0x1001U
+#define CO402_IDX_SYNC_COB     0x1005U
+#define CO402_IDX_HEARTBEAT    0x1017U
+#define CO402_IDX_IDENTITY     0x1018U
+#define CO402_IDX_RPDO_COMM    0x1400U /*+ PDO number*/
+#define CO402_IDX_RPDO_MAP     0x1600U
+#define CO402_IDX_TPDO_COMM    0x1800U
+#define CO402_IDX_TPDO_MAP     0x1A00U
+
+/*Drive objects of axis 0, axis n is at + n * CO402_AXIS_OFFSET*/
+#define CO402_IDX_CONTROLWORD  0x6040U
+#define CO402_IDX_STATUSWORD   0x6041U
+#define CO402_IDX_MODE         0x6060U
+#define CO402_IDX_MODE_DISP    0x6061U
+#define CO402_IDX_POS_ACT      0x6064U
+#define CO402_IDX_VEL_ACT      0x606CU
+#define CO402_IDX_TORQUE_TGT   0x6071U
+#define CO402_IDX_TORQUE_ACT   0x6077U
+#define CO402_IDX_POS_TGT      0x607AU
+#define CO402_IDX_VEL_TGT      0x60FFU
+
+#define CO402_AXIS_OFFSET 0x800U
+
+/*Object access, mappable objects also carry the PDO direction*/
+#define CO402_ACC_R    0x01U
+#define CO402_ACC_W    0x02U
+#define CO402_ACC_RW   (CO402_ACC_R | CO402_ACC_W)
+#define CO402_ACC_RPDO 0x04U
+#define CO402_ACC_TPDO 0x08U
+
+/**
+ * Mapping entry of a PDO, the object and its length in bits.
+ */
+#define CO402_MAP_ENTRY(index, sub, bits) \
+    (((uint32_t)(index) << 16) | ((uint32_t)(sub) << 8) | (bits))
+
+/**
+ * Communication and mapping parameters of one PDO.
+ */
+#define CO402_PDO_COMM(X, index, pdo) \
+    X(index, 0, 1, CO402_ACC_R,  &pdo.comm_num, NULL) \
+    X(index, 1, 4, CO402_ACC_RW, &pdo.cob_id,   co402_pdo_cob_write) \
+    X(index, 2, 1, CO402_ACC_RW, &pdo.trans,    co402_pdo_trans_write)
+
+#define CO402_PDO_MAP(X, index, pdo) \
+    X(index, 0, 1, CO402_ACC_RW, &pdo.map_num,  co402_pdo_map_num_write) \
+    X(index, 1, 4, CO402_ACC_RW, &pdo.map[0],   co402_pdo_map_write) \
+    X(index, 2, 4, CO402_ACC_RW, &pdo.map[1],   co402_pdo_map_write) \
+    X(index, 3, 4, CO402_ACC_RW, &pdo.map[2],   co402_pdo_map_write) \
+    X(index, 4, 4, CO402_ACC_RW, &pdo.map[3],   co402_pdo_map_write)
+
+/**
+ * Drive objects of one axis.
+ */
+#define CO402_AXIS(X, n) \
+    X(CO402_IDX_CONTROLWORD + (n) * CO402_AXIS_OFFSET, 0, 2, \
+        CO402_ACC_RW | CO402_ACC_RPDO, &axis[n].controlword, NULL) \
+    X(CO402_IDX_STATUSWORD + (n) * CO402_AXIS_OFFSET, 0, 2, \
+        CO402_ACC_R | CO402_ACC_TPDO, &axis[n].statusword, NULL) \
+    X(CO402_IDX_MODE + (n) * CO402_AXIS_OFFSET, 0, 1, \
+        CO402_ACC_RW | CO402_ACC_RPDO, &axis[n].mode, co402_mode_write) \
+    X(CO402_IDX_MODE_DISP + (n) * CO402_AXIS_OFFSET, 0, 1, \
+        CO402_ACC_R | CO402_ACC_TPDO, &axis[n].mode_disp, NULL) \
+    X(CO402_IDX_POS_ACT + (n) * CO402_AXIS_OFFSET, 0, 4, \
+        CO402_ACC_R | CO402_ACC_TPDO, &axis[n].pos_act, NULL) \
+    X(CO402_IDX_VEL_ACT + (n) * CO402_AXIS_OFFSET, 0, 4, \
+        CO402_ACC_R | CO402_ACC_TPDO, &axis[n].vel_act, NULL) \
+    X(CO402_IDX_TORQUE_TGT + (n) * CO402_AXIS_OFFSET, 0, 2, \
+        CO402_ACC_RW | CO402_ACC_RPDO, &axis[n].torque_tgt, NULL) \
+    X(CO402_IDX_TORQUE_ACT + (n) * CO402_AXIS_OFFSET, 0, 2, \
+        CO402_ACC_R | CO402_ACC_TPDO, &axis[n].torque_act, NULL) \
+    X(CO402_IDX_POS_TGT + (n) * CO402_AXIS_OFFSET, 0, 4, \
+        CO402_ACC_RW | CO402_ACC_RPDO, &axis[n].pos_tgt, NULL) \
+    X(CO402_IDX_VEL_TGT + (n) * CO402_AXIS_OFFSET, 0, 4, \
+        CO402_ACC_RW | CO402_ACC_RPDO, &axis[n].vel_tgt, NULL)
+
+/**
+ * The object dictionary, one row per sub-index.
+ *
+ *  index  ... Object index.
+ *  sub    ... Sub-index.
+ *  size   ... Value size in bytes, 1, 2 or 4, little endian on the bus.
+ *  access ... CO402_ACC_*, mappable objects with their PDO direction.
+ *  var    ... Address of the variable backing the object.
+ *  hook   ... Checks and stores an SDO write, returns the abort code
+ *             or 0, NULL stores the value unchecked. PDOs bypass it.
+ *
+ * One CO402_AXIS() per axis, CO402_AXIS_NUM of them.
+ */
+#define CO402_OD_MAP(X) \
+    X(CO402_IDX_DEVICE_TYPE, 0, 4, CO402_ACC_R,  &device_type,  NULL) \
+    X(CO402_IDX_ERROR_REG,   0, 1, CO402_ACC_R | CO402_ACC_TPDO, &error_reg, NULL) \
+    X(CO402_IDX_SYNC_COB,    0, 4, CO402_ACC_RW, &sync_cob,     co402_sync_cob_write) \
+    X(CO402_IDX_HEARTBEAT,   0, 2, CO402_ACC_RW, &hb_time,      NULL) \
+    X(CO402_IDX_IDENTITY,    0, 1, CO402_ACC_R,  &ident.num,    NULL) \
+    X(CO402_IDX_IDENTITY,    1, 4, CO402_ACC_R,  &ident.vendor,   NULL) \
+    X(CO402_IDX_IDENTITY,    2, 4, CO402_ACC_R,  &ident.product,  NULL) \
+    X(CO402_IDX_IDENTITY,    3, 4, CO402_ACC_R,  &ident.revision, NULL) \
+    CO402_PDO_COMM(X, CO402_IDX_RPDO_COMM + 0, rpdo[0]) \
+    CO402_PDO_COMM(X, CO402_IDX_RPDO_COMM + 1, rpdo[1]) \
+    CO402_PDO_COMM(X, CO402_IDX_RPDO_COMM + 2, rpdo[2]) \
+    CO402_PDO_COMM(X, CO402_IDX_RPDO_COMM + 3, rpdo[3]) \
+    CO402_PDO_MAP(X,  CO402_IDX_RPDO_MAP + 0,  rpdo[0]) \
+    CO402_PDO_MAP(X,  CO402_IDX_RPDO_MAP + 1,  rpdo[1]) \
+    CO402_PDO_MAP(X,  CO402_IDX_RPDO_MAP + 2,  rpdo[2]) \
+    CO402_PDO_MAP(X,  CO402_IDX_RPDO_MAP + 3,  rpdo[3]) \
+    CO402_PDO_COMM(X, CO402_IDX_TPDO_COMM + 0, tpdo[0]) \
+    CO402_PDO_COMM(X, CO402_IDX_TPDO_COMM + 1, tpdo[1]) \
+    CO402_PDO_COMM(X, CO402_IDX_TPDO_COMM + 2, tpdo[2]) \
+    CO402_PDO_COMM(X, CO402_IDX_TPDO_COMM + 3, tpdo[3]) \
+    CO402_PDO_MAP(X,  CO402_IDX_TPDO_MAP + 0,  tpdo[0]) \
+    CO402_PDO_MAP(X,  CO402_IDX_TPDO_MAP + 1,  tpdo[1]) \
+    CO402_PDO_MAP(X,  CO402_IDX_TPDO_MAP + 2,  tpdo[2]) \
+    CO402_PDO_MAP(X,  CO402_IDX_TPDO_MAP + 3,  tpdo[3]) \
+    CO402_AXIS(X, 0) \
+    CO402_AXIS(X, 1)
+
+#endif /*__CO402OD_H__*/
@@ -0,0 +1,324 @@
+/**
+  ******************************************************************************
+  * File Name          : CAN.c
+  * Description        : This file provides code for the configuration
+  *                      of the CAN instances.
+  ******************************************************************************
+  * This notice applies to any and all portions of this file
+  * that are not between comment pairs USER CODE BEGIN and
+  * USER CODE END. Other portions of this file, whether 
+  * inserted by the user or by software development tools
+  * are owned by their respective copyright owners.
+  *
+  * Copyright (c) 2018 STMicroelectronics International N.V. 
+  * All rights reserved.
+  *
+  * Redistribution and use in source and binary forms, with or without 
+  * modification, are permitted, provided that the following conditions are met:
+  *
+  * 1. Redistribution of source code must retain the above copyright notice, 
+  *    this list of conditions and the following disclaimer.
+  * 2. Redistributions in binary form must reproduce the above copyright notice,
+  *    this list of conditions and the following disclaimer in the documentation
+  *    and/or other materials provided with the distribution.
+  * 3. Neither the name of STMicroelectronics nor the names of other 
+  *    contributors to this software may be used to endorse or promote products 
+  *    derived from this software without specific written permission.
+  * 4. This software, including modifications and/or derivative works of this 
+  *    software, must execute solely and exclusively on microcontroller or
+  *    microprocessor devices manufactured by or for STMicroelectronics.
+  * 5. Redistribution and use of this software other than as permitted under 
+  *    this license is void and will automatically terminate your rights under 
+  *    this license. 
+  *
+  * THIS SOFTWARE IS PROVIDED BY STMICROELECTRONICS AND CONTRIBUTORS "AS IS" 
+  * AND ANY EXPRESS, IMPLIED OR STATUTORY WARRANTIES, INCLUDING, BUT NOT 
+  * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY, FITNESS FOR A 
+  * PARTICULAR PURPOSE AND NON-INFRINGEMENT OF THIRD PARTY INTELLECTUAL PROPERTY
+  * RIGHTS ARE DISCLAIMED TO THE FULLEST EXTENT PERMITTED BY LAW. IN NO EVENT 
+  * SHALL STMICROELECTRONICS OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+  * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+  * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, 
+  * OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF 
+  * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING 
+  * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+  * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+  *
+  ******************************************************************************
+  */
+
+/* Includes ------------------------------------------------------------------*/
+#include "can.h"
+
+/* USER CODE BEGIN 0 */
+#include "canbus.h"
+
+/* USER CODE END 0 */
+
+CAN_HandleTypeDef hcan1;
+
+/* CAN1 init function */
+void MX_CAN1_Init(uint32_t bit_rate)
+{
+
+  hcan1.Instance = CAN1;
+  hcan1.Init.Prescaler = 3;
+  hcan1.Init.Mode = CAN_MODE_NORMAL;
+  hcan1.Init.SyncJumpWidth = CAN_SJW_1TQ;
+  hcan1.Init.TimeSeg1 = CAN_BS1_11TQ;
+  hcan1.Init.TimeSeg2 = CAN_BS2_2TQ;
+  hcan1.Init.TimeTriggeredMode = DISABLE;
+  hcan1.Init.AutoBusOff = ENABLE;
+  hcan1.Init.AutoWakeUp = DISABLE;
+  hcan1.Init.AutoRetransmission = ENABLE;
+  hcan1.Init.ReceiveFifoLocked = DISABLE;
+  hcan1.Init.TransmitFifoPriority = ENABLE;
+  /* USER CODE BEGIN CAN1_Init 1 */
+  /* 14 time quanta per bit, sample point at 86%, 
+     42 MHz / 14 / 3 = 1 Mbit/s, 500, 250 and 125 kbit/s alike */
+  hcan1.Init.Prescaler = HAL_RCC_GetPCLK1Freq() / (14U * bit_rate);
+  /* USER CODE END CAN1_Init 1 */
+  if (HAL_CAN_Init(&hcan1) != HAL_OK)
+  {
+    Error_Handler();
+  }
+
+  /* USER CODE BEGIN CAN1_Init 2 */
+  /* Nothing passes until the stack sets up its filters */
+  if (HAL_CAN_ActivateNotification(&hcan1, CAN_IT_RX_FIFO0_MSG_PENDING | 
+      CAN_IT_TX_MAILBOX_EMPTY | CAN_IT_ERROR | CAN_IT_BUSOFF | 
+      CAN_IT_LAST_ERROR_CODE) != HAL_OK)
+  {
+    Error_Handler();
+  }
+
+  if (HAL_CAN_Start(&hcan1) != HAL_OK)
+  {
+    Error_Handler();
+  }
+  /* USER CODE END CAN1_Init 2 */
+
+}
+
+void HAL_CAN_MspInit(CAN_HandleTypeDef* canHandle)
+{
+
+  GPIO_InitTypeDef GPIO_InitStruct;
+  if(canHandle->Instance==CAN1)
+  {
+  /* USER CODE BEGIN CAN1_MspInit 0 */
+
+  /* USER CODE END CAN1_MspInit 0 */
+    /* CAN1 clock enable */
+    __HAL_RCC_CAN1_CLK_ENABLE();
+  
+    /**CAN1 GPIO Configuration    
+    PB8     ------> CAN1_RX
+    PB9     ------> CAN1_TX 
+    */
+    GPIO_InitStruct.Pin = GPIO_PIN_8|GPIO_PIN_9;
+    GPIO_InitStruct.Mode = GPIO_MODE_AF_PP;
+    GPIO_InitStruct.Pull = GPIO_NOPULL;
+    GPIO_InitStruct.Speed = GPIO_SPEED_FREQ_VERY_HIGH;
+    GPIO_InitStruct.Alternate = GPIO_AF9_CAN1;
+    HAL_GPIO_Init(GPIOB, &GPIO_InitStruct);
+
+    /* CAN1 interrupt Init */
+    /* One priority for all three, the driver queues rely on it. 
+       Above the Modbus port, SYNC latches the setpoints */
+    HAL_NVIC_SetPriority(CAN1_TX_IRQn, 5, 0);
+    HAL_NVIC_EnableIRQ(CAN1_TX_IRQn);
+    HAL_NVIC_SetPriority(CAN1_RX0_IRQn, 5, 0);
+    HAL_NVIC_EnableIRQ(CAN1_RX0_IRQn);
+    HAL_NVIC_SetPriority(CAN1_SCE_IRQn, 5, 0);
+    HAL_NVIC_EnableIRQ(CAN1_SCE_IRQn);
+  /* USER CODE BEGIN CAN1_MspInit 1 */
+
+  /* USER CODE END CAN1_MspInit 1 */
+  }
+}
+
+void HAL_CAN_MspDeInit(CAN_HandleTypeDef* canHandle)
+{
+
+  if(canHandle->Instance==CAN1)
+  {
+  /* USER CODE BEGIN CAN1_MspDeInit 0 */
+
+  /* USER CODE END CAN1_MspDeInit 0 */
+    /* Peripheral clock disable */
+    __HAL_RCC_CAN1_CLK_DISABLE();
+  
+    /**CAN1 GPIO Configuration    
+    PB8     ------> CAN1_RX
+    PB9     ------> CAN1_TX 
+    */
+    HAL_GPIO_DeInit(GPIOB, GPIO_PIN_8|GPIO_PIN_9);
+
+    /* CAN1 interrupt Deinit */
+    HAL_NVIC_DisableIRQ(CAN1_TX_IRQn);
+    HAL_NVIC_DisableIRQ(CAN1_RX0_IRQn);
+    HAL_NVIC_DisableIRQ(CAN1_SCE_IRQn);
+  /* USER CODE BEGIN CAN1_MspDeInit 1 */
+
+  /* USER CODE END CAN1_MspDeInit 1 */
+  }
+} 
+
+/* USER CODE BEGIN 1 */
+
+/**
+  * CAN driver hook, puts the frame into a free mailbox. 
+  * The mailboxes send in the order they were filled.
+  */
+bool can_port_send(const can_frame_t * frame_p)
+{
+  CAN_TxHeaderTypeDef header = {0};
+  uint32_t mailbox = 0;
+
+  if (HAL_CAN_GetTxMailboxesFreeLevel(&hcan1) == 0)
+  {
+    return false;
+  }
+
+  if (frame_p->id & CAN_FRAME_EXT)
+  {
+    header.ExtId = frame_p->id & CAN_FRAME_EXT_MASK;
+    header.IDE = CAN_ID_EXT;
+  }
+  else
+  {
+    header.StdId = frame_p->id & CAN_FRAME_STD_MASK;
+    header.IDE = CAN_ID_STD;
+  }
+  header.RTR = CAN_RTR_DATA;
+  header.DLC = frame_p->dlc;
+  header.TransmitGlobalTime = DISABLE;
+
+  return HAL_CAN_AddTxMessage(&hcan1, &header, 
+    (uint8_t *)frame_p->data, &mailbox) == HAL_OK;
+}
+
+/**
+  * CAN driver hook, one 32 bit mask filter per bank, into FIFO 0.
+  */
+bool can_port_filter(uint8_t bank, uint32_t id, uint32_t mask, bool on)
+{
+  CAN_FilterTypeDef filter = {0};
+  uint32_t fr_id = 0;
+  uint32_t fr_mask = 0;
+
+  /* STID in bits 31:21, EXID in bits 31:3, IDE in bit 2 */
+  if (id & CAN_FRAME_EXT)
+  {
+    fr_id = ((id & CAN_FRAME_EXT_MASK) << 3) | CAN_ID_EXT;
+    fr_mask = (mask & CAN_FRAME_EXT_MASK) << 3;
+  }
+  else
+  {
+    fr_id = (id & CAN_FRAME_STD_MASK) << 21;
+    fr_mask = (mask & CAN_FRAME_STD_MASK) << 21;
+  }
+  if (mask & CAN_FRAME_EXT)
+  {
+    fr_mask |= CAN_ID_EXT;
+  }
+
+  filter.FilterBank = bank;
+  filter.FilterMode = CAN_FILTERMODE_IDMASK;
+  filter.FilterScale = CAN_FILTERSCALE_32BIT;
+  filter.FilterIdHigh = fr_id >> 16;
+  filter.FilterIdLow = fr_id & 0xFFFFU;
+  filter.FilterMaskIdHigh = fr_mask >> 16;
+  filter.FilterMaskIdLow = fr_mask & 0xFFFFU;
+  filter.FilterFIFOAssignment = CAN_FILTER_FIFO0;
+  filter.FilterActivation = on ? CAN_FILTER_ENABLE : CAN_FILTER_DISABLE;
+  filter.SlaveStartFilterBank = CAN_FILTER_NUM;
+
+  return HAL_CAN_ConfigFilter(&hcan1, &filter) == HAL_OK;
+}
+
+void can_port_lock(void)
+{
+  HAL_NVIC_DisableIRQ(CAN1_RX0_IRQn);
+  HAL_NVIC_DisableIRQ(CAN1_TX_IRQn);
+  __DSB();
+  __ISB();
+}
+
+void can_port_unlock(void)
+{
+  HAL_NVIC_EnableIRQ(CAN1_TX_IRQn);
+  HAL_NVIC_EnableIRQ(CAN1_RX0_IRQn);
+}
+
+void HAL_CAN_RxFifo0MsgPendingCallback(CAN_HandleTypeDef *hcan)
+{
+  CAN_RxHeaderTypeDef header;
+  can_frame_t frame;
+
+  while (HAL_CAN_GetRxFifoFillLevel(hcan, CAN_RX_FIFO0) != 0)
+  {
+    if (HAL_CAN_GetRxMessage(hcan, CAN_RX_FIFO0, &header, frame.data) != HAL_OK)
+    {
+      break;
+    }
+    /* No remote frames in the stack */
+    if (header.RTR != CAN_RTR_DATA)
+    {
+      continue;
+    }
+
+    frame.id = (header.IDE == CAN_ID_EXT) ? (header.ExtId | CAN_FRAME_EXT) : header.StdId;
+    frame.dlc = (header.DLC > 8) ? 8 : header.DLC;
+    can_rx_isr(&frame);
+  }
+}
+
+void HAL_CAN_TxMailbox0CompleteCallback(CAN_HandleTypeDef *hcan)
+{
+  can_tx_isr();
+}
+
+void HAL_CAN_TxMailbox1CompleteCallback(CAN_HandleTypeDef *hcan)
+{
+  can_tx_isr();
+}
+
+void HAL_CAN_TxMailbox2CompleteCallback(CAN_HandleTypeDef *hcan)
+{
+  can_tx_isr();
+}
+
+/* Aborted after an error, the mailbox is free all the same */
+void HAL_CAN_TxMailbox0AbortCallback(CAN_HandleTypeDef *hcan)
+{
+  can_tx_isr();
+}
+
+void HAL_CAN_TxMailbox1AbortCallback(CAN_HandleTypeDef *hcan)
+{
+  can_tx_isr();
+}
+
+void HAL_CAN_TxMailbox2AbortCallback(CAN_HandleTypeDef *hcan)
+{
+  can_tx_isr();
+}
+
+void HAL_CAN_ErrorCallback(CAN_HandleTypeDef *hcan)
+{
+  can_error_isr();
+}
+
+/* USER CODE END 1 */
+
+/**
+  * @}
+  */
+
+/**
+  * @}
+  */
+
+/************************ (C) COPYRIGHT STMicroelectronics *****END OF FILE****/
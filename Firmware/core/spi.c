@@ -54,6 +54,7 @@
 #include "dma.h"
 
 /* USER CODE BEGIN 0 */
+#include "drv8301.h"
 
 /* USER CODE END 0 */
 
@@ -203,6 +204,15 @@ void HAL_SPI_MspDeInit(SPI_HandleTypeDef* spiHandle)
 
 /* USER CODE BEGIN 1 */
 
+void HAL_SPI_TxRxCpltCallback(SPI_HandleTypeDef* spiHandle)
+{
+  /* Every DRV8301 frame is a TransmitReceive, chain the next queued one */
+  if(spiHandle->Instance==SPI3)
+  {
+    md_drv8301_spi_transfer_end();
+  }
+}
+
 /* USER CODE END 1 */
 
 /**
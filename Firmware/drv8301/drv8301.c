@@ -11,13 +11,72 @@
 #include "time.h"
 #include "spi.h"
 
+/*********************
+ *      DEFINES
+ *********************/
+
+/*Queued SPI frames shared by all DRV8301 on the bus*/
+#define XFER_QUEUE_MAX 32U
+
+/*Frames of the pipelined status read done by the init*/
+#define INIT_READBACK_LEN 3U
+
+/*Gate driver reset bit of control register 1, reverts to 0 by itself*/
+#define CTL1_GATE_RESET (1 << 2)
+
+/*Control register contents after EN_GATE was low, all fields 0*/
+#define CTL1_DEFAULT 0x0000U
+#define CTL2_DEFAULT 0x0000U
+
+/*Faults that the gate reset clears without touching the registers*/
+#define FAULT_OC_MASK (FAULT_FETLC_OC | FAULT_FETHC_OC | FAULT_FETLB_OC | \
+    FAULT_FETHB_OC | FAULT_FETLA_OC | FAULT_FETHA_OC)
+
+/*Faults after which the register contents can not be trusted*/
+#define FAULT_FATAL_MASK (FAULT_OTSD | FAULT_PVDD_UV | \
+    FAULT_GVDD_UV | FAULT_GVDD_OV)
+
+/**********************
+ *      TYPEDEFS
+ **********************/
+
+/**
+ * Actions taken when a queued frame completes.
+ */
+enum {
+    XFER_FLAG_NONE   = 0,
+    XFER_FLAG_BLOCK   = (1 << 0), /**< Last frame of a blocking transfer*/
+    XFER_FLAG_COMMIT  = (1 << 1), /**< Last frame of a status poll*/
+    XFER_FLAG_RECOVER = (1 << 2), /**< Last frame of the fault classification*/
+    XFER_FLAG_VERIFY  = (1 << 3), /**< Last frame of the fault reset check*/
+    XFER_FLAG_SYNC    = (1 << 4)  /**< Last frame of a register sync*/
+};
+
+/**
+ * A single 16-bit frame waiting for the SPI bus, 
+ * the chip select is cycled around every frame.
+ */
+typedef struct {
+    md_drv8301_t * drv8301_p;
+    uint16_t tx_data;
+    volatile uint16_t * rx_p;
+    uint8_t flags;
+} md_xfer_t;
+
 /**********************
  *  STATIC VARIABLES
  **********************/
 
-volatile uint16_t tx_buf = 0xFFFF, rx_buf = 0xFFFF;
-volatile static uint8_t spi_tran_ret = 0xFF;
-static md_drv8301_t * act_drv_p = NULL;
+static md_xfer_t xfer_queue[XFER_QUEUE_MAX];
+static volatile uint8_t xfer_head = 0;
+static volatile uint8_t xfer_tail = 0;
+static volatile bool xfer_busy = false;
+
+/*Selectable shunt amplifier gains, indexed by the CTL2 GAIN field*/
+static const float kgain_all[4] = {10.0f, 20.0f, 40.0f, 80.0f};
+
+/*DMA works on these, never on the caller buffers*/
+static uint16_t dma_tx = 0xFFFF, dma_rx = 0xFFFF;
 
 /**********************
  *  STATIC PROTOTYPES
@@ -26,6 +85,23 @@ static md_drv8301_t * act_drv_p = NULL;
 static bool md_drv8301_spi_start(md_drv8301_t * drv8301_p, 
     const uint8_t * tx_buf, uint8_t * rx_buf, 
     size_t length);
+static bool md_drv8301_xfer_push(const md_xfer_t * xfers, 
+    uint8_t cnt);
+static bool md_drv8301_xfer_idle();
+static void md_drv8301_xfer_kick();
+static void md_drv8301_xfer_done(const md_xfer_t * xfer_p, 
+    bool res);
+static void md_drv8301_status_commit(md_drv8301_t * drv8301_p);
+static bool md_drv8301_burst_wait(md_drv8301_t * const * drv8301_pp, 
+    uint8_t cnt, uint32_t timeout_ms);
+static bool md_drv8301_recover_start(md_drv8301_t * drv8301_p);
+static void md_drv8301_recover_classify(md_drv8301_t * drv8301_p);
+static void md_drv8301_recover_verify(md_drv8301_t * drv8301_p);
+static bool md_drv8301_sync_idle_wait(md_drv8301_t * const * drv8301_pp, 
+    uint8_t cnt, uint32_t timeout_ms);
+static bool md_drv8301_sync_queue(md_drv8301_t * drv8301_p);
+static void md_drv8301_sync_check(md_drv8301_t * drv8301_p);
+static void md_drv8301_sync_finish(md_drv8301_t * drv8301_p, bool res);
 
 /**********************
  *   GLOBAL FUNCTIONS
@@ -74,27 +150,170 @@ static bool md_drv8301_spi_start(md_drv8301_t * drv8301_p,
 }
 
 /**
- * Transmit and Receive an amount of data in non-blocking mode with DMA.
+ * Appends frames to the bus queue in one go, so a 
+ * multi-frame sequence is never interleaved with another one.
+ * @param xfers pointer to the frames to be queued.
+ * @param cnt number of frames.
+ * @return false if the queue has no room for all frames.
+ */
+static bool md_drv8301_xfer_push(const md_xfer_t * xfers, 
+    uint8_t cnt)
+{
+    uint32_t primask = __get_PRIMASK();
+    __disable_irq();
+
+    uint8_t used = (uint8_t)(xfer_head - xfer_tail);
+
+    if (used + cnt > XFER_QUEUE_MAX) {
+        __set_PRIMASK(primask);
+        return false;
+    }
+
+    for (uint8_t i = 0; i < cnt; i++) {
+        xfer_queue[xfer_head % XFER_QUEUE_MAX] = xfers[i];
+        xfer_head++;
+    }
+
+    __set_PRIMASK(primask);
+    return true;
+}
+
+/**
+ * Tells whether the bus has nothing queued or running.
+ * @return true if a new frame would go out right away.
+ */
+static bool md_drv8301_xfer_idle()
+{
+    return !xfer_busy && (xfer_head == xfer_tail);
+}
+
+/**
+ * Starts the frame at the head of the queue if the bus is idle. 
+ * Runs from thread context after queueing and from the 
+ * SPI completion interrupt to chain the next frame.
+ */
+static void md_drv8301_xfer_kick()
+{
+    for (;;) {
+        uint32_t primask = __get_PRIMASK();
+        __disable_irq();
+
+        if (xfer_busy || (xfer_head == xfer_tail)) {
+            __set_PRIMASK(primask);
+            return;
+        }
+
+        xfer_busy = true;
+        __set_PRIMASK(primask);
+
+        md_xfer_t * xfer_p = &xfer_queue[
+            xfer_tail % XFER_QUEUE_MAX];
+
+        dma_tx = xfer_p->tx_data;
+        dma_rx = 0xFFFF;
+
+        bool res = md_drv8301_spi_start(
+            xfer_p->drv8301_p, 
+            (uint8_t *)(&dma_tx), 
+            (uint8_t *)(&dma_rx), 1);
+
+        if (res) return;
+
+        /*The frame could not be started, drop it 
+        and report the failure to its owner*/
+        md_xfer_t xfer = *xfer_p;
+        xfer_tail++;
+        xfer_busy = false;
+        md_drv8301_xfer_done(&xfer, false);
+    }
+}
+
+/**
+ * Applies the completion actions of a frame.
+ * @param xfer_p pointer to the finished frame.
+ * @param res whether the frame went out on the bus.
+ */
+static void md_drv8301_xfer_done(const md_xfer_t * xfer_p, 
+    bool res)
+{
+    if (res && xfer_p->rx_p != NULL)
+        *xfer_p->rx_p = dma_rx;
+
+    if (xfer_p->flags & XFER_FLAG_BLOCK)
+        xfer_p->drv8301_p->xfer.tran_ret = res;
+
+    if (xfer_p->flags & XFER_FLAG_COMMIT) {
+        if (res) md_drv8301_status_commit(
+            xfer_p->drv8301_p);
+        xfer_p->drv8301_p->poll_pending = false;
+    }
+
+    if (xfer_p->flags & XFER_FLAG_RECOVER) {
+        if (res) md_drv8301_recover_classify(
+            xfer_p->drv8301_p);
+        else xfer_p->drv8301_p->init_state = STATE_UNINITED;
+    }
+
+    if (xfer_p->flags & XFER_FLAG_VERIFY) {
+        if (res) md_drv8301_recover_verify(
+            xfer_p->drv8301_p);
+        else xfer_p->drv8301_p->init_state = STATE_UNINITED;
+    }
+
+    if (xfer_p->flags & XFER_FLAG_SYNC) {
+        if (res) md_drv8301_sync_check(
+            xfer_p->drv8301_p);
+        else md_drv8301_sync_finish(
+            xfer_p->drv8301_p, false);
+    }
+}
+
+/**
+ * Queue an amount of 16-bit frames in non-blocking mode with DMA, 
+ * every frame gets its own chip select cycle. Completion is 
+ * reported through drv8301_p->xfer.tran_ret.
  * @param  tx_buf pointer to transmission data buffer
- * @param  rx_buf pointer to reception data buffer
+ * @param  rx_buf pointer to reception data buffer, may be NULL
  * @param  Size amount of data to be sent
- * @return HAL status.
  */
 void md_drv8301_spi_transfer_async(md_drv8301_t * drv8301_p, 
     const uint8_t * tx_buf, uint8_t * rx_buf, 
     size_t length)
 {
-    bool res = md_drv8301_spi_start(drv8301_p, 
-        tx_buf, rx_buf, length);
+    md_xfer_t xfers[XFER_QUEUE_MAX];
+    const uint16_t * tx_p = (const uint16_t *)tx_buf;
+    uint16_t * rx_p = (uint16_t *)rx_buf;
+
+    drv8301_p->xfer.tran_ret = 0xFF;
+
+    if (!length || length > XFER_QUEUE_MAX) {
+        drv8301_p->xfer.tran_ret = false;
+        return;
+    }
+
+    for (size_t i = 0; i < length; i++) {
+        xfers[i].drv8301_p = drv8301_p;
+        xfers[i].tx_data = tx_p[i];
+        xfers[i].rx_p = rx_p ? &rx_p[i] : NULL;
+        xfers[i].flags = XFER_FLAG_NONE;
+    }
+
+    /*Only the last frame reports back*/
+    xfers[length - 1].flags = XFER_FLAG_BLOCK;
+
+    if (!md_drv8301_xfer_push(xfers, length)) {
+        drv8301_p->xfer.tran_ret = false;
+        return;
+    }
 
-    if (!res) spi_tran_ret = false;
     /*Note that the complete interrupt must be 
     sent by the SPI to set the state to true*/
-    /*else spi_tran_ret = true;*/
+    md_drv8301_xfer_kick();
 }
 
 /**
- * Transmit and Receive an amount of data in non-blocking mode with DMA.
+ * Transmit and Receive an amount of data in blocking mode, 
+ * the frames queue behind any pending background poll.
  * @param  tx_buf pointer to transmission data buffer
  * @param  rx_buf pointer to reception data buffer
  * @param  Size amount of data to be sent
@@ -104,37 +323,43 @@ bool md_drv8301_spi_transfer(md_drv8301_t * drv8301_p,
     const uint8_t* tx_buf, uint8_t* rx_buf, 
     size_t length, uint32_t timeout_ms)
 {
-    spi_tran_ret = 0xFF;
-    act_drv_p = drv8301_p;
-
     md_drv8301_spi_transfer_async(drv8301_p, 
         tx_buf, rx_buf, length);
 
-    /*Wait for the conversion to complete*/
-    while (spi_tran_ret == 0xFF) {sleep_us(1);}
-
-    return spi_tran_ret;
+    return md_drv8301_burst_wait(&drv8301_p, 
+        1, timeout_ms);
 }
 
 /**
- * SPI Transmit and Receive completed callback.
- * act_drv_p pointer to a The currently active drive object.
+ * SPI Transmit and Receive completed callback, releases the 
+ * chip select of the finished frame and starts the next queued one.
  */
 void md_drv8301_spi_transfer_end()
 {
+    if (!xfer_busy) return;
+
+    md_xfer_t xfer = xfer_queue[
+        xfer_tail % XFER_QUEUE_MAX];
+
     /*The data is sent, cancel the DRV8301 chip selection*/
-    act_drv_p->pin_cs.setval(true);
+    xfer.drv8301_p->pin_cs.setval(true);
+
+    xfer_tail++;
+    xfer_busy = false;
+
     /*The data is sent and the state is set to true*/
-    spi_tran_ret = true;
+    md_drv8301_xfer_done(&xfer, true);
+    md_drv8301_xfer_kick();
 }
 
 /**
  * Based on the actual combination of configuration parameters, 
  * a frame of configuration data is constructed and stored, 
  * where the data is not immediately updated to the device. 
- * If the gate driver was in ready state and the new 
- * configuration is different from the old one then 
- * the gate driver will exit ready state.
+ * If the gate driver was in ready state and control register 1 
+ * changed then the gate driver will exit ready state. A change 
+ * of the amplifier gain only marks control register 2 dirty, 
+ * md_drv8301_register_sync() applies it while the gate keeps running.
  * @param drv8301_p pointer to DRV8301 that are currently 
  * in the configuration phase.
  * @param requested_gain The value of the gain requested.
@@ -148,7 +373,6 @@ bool md_drv8301_register_config(md_drv8301_t * drv8301_p,
       larger range as requested or largest possible 
       range otherwise*/
 
-    const float kgain_all[4] = {10.0f, 20.0f, 40.0f, 80.0f};
     uint16_t kgain_idx = 3;
 
     /**
@@ -202,9 +426,20 @@ bool md_drv8301_register_config(md_drv8301_t * drv8301_p,
     the configuration value to be updated*/
     if (!regs_equal) {
         drv8301_p->regctl = _regctl;
-        drv8301_p->init_state = \
-            STATE_UNINITED;
-        drv8301_p->pin_en.setval(false);
+
+        md_dirty_t dirty = 0;
+        md_regctl_t shadow = drv8301_p->shadow;
+
+        /*Only what differs from the chip is written*/
+        if (shadow.reg1data != _regctl.reg1data) dirty |= MD_DIRTY_CTL1;
+        if (shadow.reg2data != _regctl.reg2data) dirty |= MD_DIRTY_CTL2;
+        drv8301_p->dirty = dirty;
+
+        if (regctl.reg1data != _regctl.reg1data) {
+            drv8301_p->init_state = \
+                STATE_UNINITED;
+            drv8301_p->pin_en.setval(false);
+        }
     }
 
     return true;
@@ -218,69 +453,141 @@ bool md_drv8301_register_config(md_drv8301_t * drv8301_p,
  */
 bool md_drv8301_register_init(md_drv8301_t * drv8301_p)
 {
-    uint16_t val = 0;
+    return md_drv8301_register_init_all(&drv8301_p, 1);
+}
+
+/**
+ * Apply the configuration of several DRV8301 sharing the SPI bus 
+ * in one batch. The chips are reset together and their register 
+ * writes and read-backs are queued as a single burst, so a 
+ * dual-axis board comes up in about the time of one chip.
+ * @param drv8301_pp array of DRV8301 to be configured.
+ * @param cnt number of entries in the array.
+ * @return true if every chip ended up ready.
+ */
+bool md_drv8301_register_init_all(md_drv8301_t * const * drv8301_pp, 
+    uint8_t cnt)
+{
+    bool all_ready = true;
+
+    for (uint8_t i = 0; i < cnt; i++)
+        all_ready &= (drv8301_pp[i]->init_state == STATE_READY);
 
-    if (drv8301_p->init_state == STATE_READY) return true;
+    if (all_ready) return true;
+
+    /*make is_ready() ignore transient errors 
+    before registers are set up, no new gain change starts*/
+    for (uint8_t i = 0; i < cnt; i++) {
+        drv8301_pp[i]->init_state = STATE_UNINITED;
+        drv8301_pp[i]->recover_cnt = 0;
+    }
+
+    /*A gain change still on the bus would land in the reset*/
+    if (!md_drv8301_sync_idle_wait(drv8301_pp, cnt, 10)) return false;
 
     /*Reset DRV chip. The enable pin also controls the SPI interface, not only the driver stages.*/
-    drv8301_p->pin_en.setval(false);
+    /*Chips sharing an enable pin are always reset together, so all of them are set up again.*/
+    for (uint8_t i = 0; i < cnt; i++)
+        drv8301_pp[i]->pin_en.setval(false);
     sleep_us(40); /*mimumum pull-down time for full reset: 20us*/
 
-    /*make is_ready() ignore transient errors 
-    before registers are set up*/
-    drv8301_p->init_state = STATE_UNINITED;
+    /*The reset restored the defaults, the shadow follows the chip*/
+    for (uint8_t i = 0; i < cnt; i++) {
+        drv8301_pp[i]->shadow.reg1data = CTL1_DEFAULT;
+        drv8301_pp[i]->shadow.reg2data = CTL2_DEFAULT;
+        drv8301_pp[i]->gain_idx = (CTL2_DEFAULT >> 2) & 0x03;
+    }
 
-    drv8301_p->pin_en.setval(true);
-    sleep_us(20); /*t_spi_ready, max = 10ms*/
-
-    /*the write operation tends to be ignored if only done once (not sure why)*/
-    bool wrote_regs = \
-           md_drv8301_write_reg(drv8301_p, ADDR_REG_CTL1, 
-            drv8301_p->regctl.reg1data) 
-        && md_drv8301_write_reg(drv8301_p, ADDR_REG_CTL1, 
-            drv8301_p->regctl.reg1data) 
-        && md_drv8301_write_reg(drv8301_p, ADDR_REG_CTL1, 
-            drv8301_p->regctl.reg1data) 
-        && md_drv8301_write_reg(drv8301_p, ADDR_REG_CTL1, 
-            drv8301_p->regctl.reg1data) 
-        && md_drv8301_write_reg(drv8301_p, ADDR_REG_CTL1, 
-            drv8301_p->regctl.reg1data) 
-        && md_drv8301_write_reg(drv8301_p, ADDR_REG_CTL2, 
-            drv8301_p->regctl.reg2data);
+    for (uint8_t i = 0; i < cnt; i++)
+        drv8301_pp[i]->pin_en.setval(true);
+    sleep_ms(10); /*t_spi_ready, max = 10ms*/
 
     /**
-     * Of particular note is that kRegNameControl1 and regs_.control_register_1 
-     * are repeated five times.This may mean that the code has repeatedly 
-     * performed the write operation to ensure that the write operation 
-     * succeeds. The note mentions: "If you only perform a write 
-     * operation once, then the operation tends to be ignored (not sure why)".
-     * This may be a specific behavior of the hardware or device and requires 
-     * multiple writes to ensure that the configuration is valid.
+     * The write operation tends to be ignored if only done once (not sure why), 
+     * ODrive wrote control register 1 five times in a row. Each write is 
+     * read back instead and only repeated on a mismatch.
+     * The reset lost the configuration, so every register is dirty.
      */
+    for (uint8_t i = 0; i < cnt; i++) {
+        drv8301_pp[i]->dirty = MD_DIRTY_CTL1 | MD_DIRTY_CTL2;
+        md_drv8301_register_sync_async(drv8301_pp[i]);
+    }
 
-    if (!wrote_regs) return false;
+    if (!md_drv8301_burst_wait(drv8301_pp, cnt, 1000)) return false;
     sleep_us(100); /*Wait for configuration to be applied*/
-    drv8301_p->init_state = STATE_CHECKS;
 
-    bool is_read_regs = \
-        md_drv8301_read_reg(drv8301_p, ADDR_REG_CTL1, &val) && 
-        (val == drv8301_p->regctl.reg1data) && 
-        md_drv8301_read_reg(drv8301_p, ADDR_REG_CTL2, &val) && 
-        (val == drv8301_p->regctl.reg2data);
+    for (uint8_t i = 0; i < cnt; i++)
+        drv8301_pp[i]->init_state = STATE_CHECKS;
+
+    /**
+     * A read command is answered in the following frame, so the 
+     * status registers are read back in one pipeline:
+     * tx: R STA1 | R STA2 | R STA2
+     * rx:   xx   |  STA1  |  STA2
+     */
+    for (uint8_t i = 0; i < cnt; i++) {
+        md_drv8301_t * drv8301_p = drv8301_pp[i];
+        uint16_t * tx_p = drv8301_p->xfer.tx_buf;
+
+        tx_p[0] = build_spi_data(READ, ADDR_REG_STA1, 0);
+        tx_p[1] = build_spi_data(READ, ADDR_REG_STA2, 0);
+        tx_p[2] = build_spi_data(READ, ADDR_REG_STA2, 0);
 
-    if (!is_read_regs) return false;
+        md_drv8301_spi_transfer_async(drv8301_p, 
+            (uint8_t *)tx_p, (uint8_t *)drv8301_p->xfer.rx_buf, 
+            INIT_READBACK_LEN);
+    }
 
-    md_fault_t fault = \
-        md_drv8301_get_error(drv8301_p);
+    if (!md_drv8301_burst_wait(drv8301_pp, cnt, 1000)) return false;
 
-    if (fault != FAULT_NOFAULT) return false;
+    all_ready = true;
 
-    /*There could have been an nFAULT edge meanwhile. 
-    In this case we shouldn't consider the driver ready.*/
-    if (drv8301_p->init_state == STATE_CHECKS)
-        drv8301_p->init_state = STATE_READY;
+    for (uint8_t i = 0; i < cnt; i++) {
+        md_drv8301_t * drv8301_p = drv8301_pp[i];
+        volatile uint16_t * rx_p = drv8301_p->xfer.rx_buf;
+
+        md_fault_t fault = \
+            md_drv8301_decode_fault(rx_p[1], rx_p[2]);
 
-    return drv8301_p->init_state == STATE_READY;
+        /*There could have been an nFAULT edge meanwhile. 
+        In this case we shouldn't consider the driver ready.*/
+        if (!drv8301_p->dirty && (fault == FAULT_NOFAULT) && 
+            (drv8301_p->init_state == STATE_CHECKS))
+            drv8301_p->init_state = STATE_READY;
+
+        all_ready &= (drv8301_p->init_state == STATE_READY);
+    }
+
+    return all_ready;
+}
+
+/**
+ * Waits until the queued bursts of all given devices completed.
+ * @param drv8301_pp array of DRV8301 with a burst in flight.
+ * @param cnt number of entries in the array.
+ * @param timeout_ms Give up after this long.
+ * @return false on timeout or if any burst failed.
+ */
+static bool md_drv8301_burst_wait(md_drv8301_t * const * drv8301_pp, 
+    uint8_t cnt, uint32_t timeout_ms)
+{
+    uint32_t tick = HAL_GetTick();
+    bool res = true;
+
+    for (uint8_t i = 0; i < cnt; i++) {
+        volatile uint8_t * ret_p = &drv8301_pp[i]->xfer.tran_ret;
+
+        /*Wait for the conversion to complete*/
+        while (*ret_p == 0xFF) {
+            if (HAL_GetTick() - tick > timeout_ms)
+                return false;
+            sleep_us(1);
+        }
+
+        res &= (*ret_p == true);
+    }
+
+    return res;
 }
 
 /**
@@ -294,12 +601,14 @@ bool md_drv8301_write_reg(md_drv8301_t * drv8301_p,
 {
     bool tran_res = 0;
 
+    md_xfer_ctx_t * xfer_p = &drv8301_p->xfer;
+
     /*Do blocking write*/
-    tx_buf = build_spi_data(WRITE, 
+    xfer_p->tx_buf[0] = build_spi_data(WRITE, 
         reg_addr, data);
 
     tran_res = md_drv8301_spi_transfer(
-        drv8301_p, (uint8_t *)(&tx_buf), 
+        drv8301_p, (uint8_t *)xfer_p->tx_buf, 
         NULL, 1, 1000);
 
     if (!tran_res) return false;
@@ -319,29 +628,31 @@ bool md_drv8301_read_reg(md_drv8301_t * drv8301_p,
 {
     bool tran_res = 0;
 
-    tx_buf = build_spi_data(READ, reg_addr, 0);
+    md_xfer_ctx_t * xfer_p = &drv8301_p->xfer;
 
-    tran_res = md_drv8301_spi_transfer(drv8301_p, 
-        (uint8_t *)(&tx_buf), NULL, 1, 1000);
-
-    if (!tran_res) return false;
-
-    sleep_us(1);
-
-    tx_buf = build_spi_data(READ, reg_addr, 0);
-    rx_buf = 0xFFFF;
+    /**
+     * A read command is answered in the following frame, both frames 
+     * go into the queue in one burst so no poll can get in between:
+     * tx: R reg | R reg
+     * rx:   xx  |  reg
+     */
+    xfer_p->tx_buf[0] = build_spi_data(READ, reg_addr, 0);
+    xfer_p->tx_buf[1] = build_spi_data(READ, reg_addr, 0);
+    xfer_p->rx_buf[1] = 0xFFFF;
 
     tran_res = md_drv8301_spi_transfer(drv8301_p, 
-        (uint8_t *)(&tx_buf), (uint8_t *)(&rx_buf), 
-        1, 1000);
+        (uint8_t *)xfer_p->tx_buf, (uint8_t *)xfer_p->rx_buf, 
+        2, 1000);
 
     if (!tran_res) return false;
 
     sleep_us(1);
 
-    if (rx_buf == 0xBEEF) return false;
+    uint16_t rx_data = xfer_p->rx_buf[1];
 
-    if (data_p != NULL) *data_p = rx_buf & 0x07FF;
+    if (rx_data == 0xBEEF) return false;
+
+    if (data_p != NULL) *data_p = rx_data & 0x07FF;
 
     return true;
 }
@@ -359,29 +670,28 @@ uint16_t build_spi_data(uint16_t _mode, uint16_t reg_addr,
 }
 
 /**
- * Transmit and Receive an amount of data in non-blocking mode with DMA.
+ * Reads both status registers with blocking transfers.
  * @param drv8301_p pointer to DRV8301 that are currently 
  * in the configuration phase.
  * @return Failure field.
  */
 md_fault_t md_drv8301_get_error(md_drv8301_t * drv8301_p)
 {
-    uint16_t _flt = 0, flt = 0;
+    uint16_t sta1 = 0, sta2 = 0;
 
     bool res = md_drv8301_read_reg(
         drv8301_p, ADDR_REG_STA1, 
-        &_flt);
+        &sta1);
 
     if (!res) return (md_fault_t)0xFFFFFFFF;
 
     res = md_drv8301_read_reg(
-        drv8301_p, ADDR_REG_STA1, 
-        &flt);
+        drv8301_p, ADDR_REG_STA2, 
+        &sta2);
 
     if (!res) return (md_fault_t)0xFFFFFFFF;
 
-    return (md_fault_t)((uint32_t)_flt | 
-        ((uint32_t)(flt & 0x0080) << 16));
+    return md_drv8301_decode_fault(sta1, sta2);
 }
 
 /**
@@ -397,9 +707,140 @@ void md_drv8301_checks(md_drv8301_t * drv8301_p)
     uint8_t init_state = drv8301_p->init_state;
     bool pin = drv8301_p->pin_nfalt.readval();
 
-    if (init_state != STATE_UNINITED && !pin)
-        init_state = STATE_UNINITED;
-    drv8301_p->init_state = init_state;
+    if (pin) {
+        if (init_state == STATE_READY)
+            drv8301_p->recover_cnt = 0;
+        return;
+    }
+
+    /*Capture the status registers while 
+    the fault is still latched*/
+    md_drv8301_status_poll(drv8301_p);
+
+    /*The re-arm sequence is already running 
+    and decides about the state itself*/
+    if (init_state == STATE_RECOVER) return;
+
+    if (init_state == STATE_READY && 
+        drv8301_p->recover_cnt < MD_RECOVER_MAX && 
+        md_drv8301_recover_start(drv8301_p))
+        return;
+
+    drv8301_p->init_state = STATE_UNINITED;
+}
+
+/**
+ * Queues the reads that classify a fault signalled on nFAULT, 
+ * the gate stays off until the classification is done.
+ * @param drv8301_p pointer to DRV8301 that saw nFAULT low.
+ * @return false if the frames could not be queued.
+ */
+static bool md_drv8301_recover_start(md_drv8301_t * drv8301_p)
+{
+    volatile uint16_t * rx_p = drv8301_p->xfer.rx_buf;
+
+    /**
+     * tx: R STA1 | R STA2 | R CTL1 | R CTL2 | R CTL2
+     * rx:   xx   |  STA1  |  STA2  |  CTL1  |  CTL2
+     */
+    md_xfer_t xfers[5] = {
+        {drv8301_p, build_spi_data(READ, ADDR_REG_STA1, 0), 
+            NULL, XFER_FLAG_NONE},
+        {drv8301_p, build_spi_data(READ, ADDR_REG_STA2, 0), 
+            &rx_p[0], XFER_FLAG_NONE},
+        {drv8301_p, build_spi_data(READ, ADDR_REG_CTL1, 0), 
+            &rx_p[1], XFER_FLAG_NONE},
+        {drv8301_p, build_spi_data(READ, ADDR_REG_CTL2, 0), 
+            &rx_p[2], XFER_FLAG_NONE},
+        {drv8301_p, build_spi_data(READ, ADDR_REG_CTL2, 0), 
+            &rx_p[3], XFER_FLAG_RECOVER},
+    };
+
+    drv8301_p->init_state = STATE_RECOVER;
+
+    if (!md_drv8301_xfer_push(xfers, 5))
+        return false;
+
+    md_drv8301_xfer_kick();
+    return true;
+}
+
+/**
+ * Decides how to recover from the fault, runs in the SPI 
+ * completion interrupt once the status and control registers are in.
+ * @param drv8301_p pointer to DRV8301 in STATE_RECOVER.
+ */
+static void md_drv8301_recover_classify(md_drv8301_t * drv8301_p)
+{
+    volatile uint16_t * rx_p = drv8301_p->xfer.rx_buf;
+
+    md_fault_t fault = md_drv8301_decode_fault(
+        rx_p[0], rx_p[1]);
+
+    /*A gain change may have landed before its read-back, 
+    control register 2 can also hold the requested value*/
+    bool regs_equal = (
+        (rx_p[2] & 0x07FF) == drv8301_p->shadow.reg1data
+    ) && (
+        ((rx_p[3] & 0x07FF) == drv8301_p->shadow.reg2data) || 
+        ((rx_p[3] & 0x07FF) == drv8301_p->regctl.reg2data)
+    );
+
+    /*A power loss or over temperature shut down, 
+    only a full init brings the chip back*/
+    if (!regs_equal || (fault & FAULT_FATAL_MASK)) {
+        drv8301_p->init_state = STATE_UNINITED;
+        return;
+    }
+
+    /*Each pass counts, the other chip may hold 
+    the shared nFAULT low for good*/
+    drv8301_p->recover_cnt++;
+
+    /*Nothing latched here, nFAULT is shared 
+    and was pulled by the other chip*/
+    if (!(fault & FAULT_OC_MASK)) {
+        drv8301_p->init_state = STATE_READY;
+        return;
+    }
+
+    /**
+     * Clear the latched over current and check the result:
+     * tx: W CTL1|RST | R STA1 | R CTL1 | R CTL1
+     * rx:     xx     |   xx   |  STA1  |  CTL1
+     */
+    md_xfer_t xfers[4] = {
+        {drv8301_p, build_spi_data(WRITE, ADDR_REG_CTL1, 
+            drv8301_p->shadow.reg1data | CTL1_GATE_RESET), 
+            NULL, XFER_FLAG_NONE},
+        {drv8301_p, build_spi_data(READ, ADDR_REG_STA1, 0), 
+            NULL, XFER_FLAG_NONE},
+        {drv8301_p, build_spi_data(READ, ADDR_REG_CTL1, 0), 
+            &rx_p[0], XFER_FLAG_NONE},
+        {drv8301_p, build_spi_data(READ, ADDR_REG_CTL1, 0), 
+            &rx_p[1], XFER_FLAG_VERIFY},
+    };
+
+    if (!md_drv8301_xfer_push(xfers, 4))
+        drv8301_p->init_state = STATE_UNINITED;
+}
+
+/**
+ * Re-arms the chip if the reset cleared the latched fault and 
+ * control register 1 still holds the configuration.
+ * @param drv8301_p pointer to DRV8301 in STATE_RECOVER.
+ */
+static void md_drv8301_recover_verify(md_drv8301_t * drv8301_p)
+{
+    volatile uint16_t * rx_p = drv8301_p->xfer.rx_buf;
+
+    md_fault_t fault = md_drv8301_decode_fault(rx_p[0], 0);
+
+    bool is_cleared = !(fault & (FAULT_OC_MASK | FAULT_FATAL_MASK)) && 
+        ((rx_p[1] & 0x07FF) == drv8301_p->shadow.reg1data);
+
+    drv8301_p->init_state = is_cleared ? 
+        STATE_READY : STATE_UNINITED;
 }
 
 /**
@@ -414,3 +855,418 @@ bool md_drv8301_ready(md_drv8301_t * drv8301_p)
     uint8_t init_state = drv8301_p->init_state;
     return init_state == STATE_READY;
 }
+
+/**
+ * Queue a background read of both status registers. The frames 
+ * run from the SPI DMA interrupt, the result is published 
+ * to the double buffer once the last frame completes.
+ * Call this every few milliseconds from a periodic context.
+ * @param drv8301_p pointer to DRV8301 to be polled.
+ * @return false if a poll is still pending or the queue is full.
+ */
+bool md_drv8301_status_poll(md_drv8301_t * drv8301_p)
+{
+    if (drv8301_p->poll_pending) return false;
+
+    /*The buffer that is not published right now*/
+    md_status_t * next_p = &drv8301_p->status[
+        (drv8301_p->status_seq + 1) & 0x01];
+
+    /**
+     * A read command is answered in the following frame, 
+     * so three frames return both registers:
+     * tx: R STA1 | R STA2 | R STA2
+     * rx:   xx   |  STA1  |  STA2
+     */
+    md_xfer_t xfers[3] = {
+        {drv8301_p, build_spi_data(READ, ADDR_REG_STA1, 0), 
+            NULL, XFER_FLAG_NONE},
+        {drv8301_p, build_spi_data(READ, ADDR_REG_STA2, 0), 
+            &next_p->sta1, XFER_FLAG_NONE},
+        {drv8301_p, build_spi_data(READ, ADDR_REG_STA2, 0), 
+            &next_p->sta2, XFER_FLAG_COMMIT},
+    };
+
+    drv8301_p->poll_pending = true;
+
+    if (!md_drv8301_xfer_push(xfers, 3)) {
+        drv8301_p->poll_pending = false;
+        return false;
+    }
+
+    md_drv8301_xfer_kick();
+    return true;
+}
+
+/**
+ * Publishes the freshly polled buffer and logs fault transitions, 
+ * runs in the SPI completion interrupt.
+ * @param drv8301_p pointer to the polled DRV8301.
+ */
+static void md_drv8301_status_commit(md_drv8301_t * drv8301_p)
+{
+    uint32_t seq = drv8301_p->status_seq + 1;
+    md_status_t * next_p = &drv8301_p->status[seq & 0x01];
+
+    next_p->sta1 &= 0x07FF;
+    next_p->sta2 &= 0x07FF;
+    next_p->tick = HAL_GetTick();
+
+    /*Flip the buffers, readers follow the sequence*/
+    drv8301_p->status_seq = seq;
+
+    md_fault_t fault = md_drv8301_decode_fault(
+        next_p->sta1, next_p->sta2);
+    md_fault_t changed = fault ^ drv8301_p->fault;
+
+    drv8301_p->fault = fault;
+
+    if (changed == FAULT_NOFAULT) return;
+
+    uint8_t head = drv8301_p->log_head;
+
+    /*Drop the newest event when the reader falls behind, 
+    the first transition is the one worth keeping*/
+    if ((uint8_t)(head - drv8301_p->log_tail) >= MD_FAULT_LOG_MAX)
+        return;
+
+    md_fault_evt_t * evt_p = &drv8301_p->fault_log[
+        head % MD_FAULT_LOG_MAX];
+
+    evt_p->changed = changed;
+    evt_p->fault = fault;
+    evt_p->tick = next_p->tick;
+
+    drv8301_p->log_head = head + 1;
+}
+
+/**
+ * Copies the latest published status snapshot without locking.
+ * @param drv8301_p pointer to DRV8301 to be read.
+ * @param status_p pointer to the copy destination.
+ * @return false if no snapshot has been published yet.
+ */
+bool md_drv8301_read_status(md_drv8301_t * drv8301_p, 
+    md_status_t * status_p)
+{
+    uint32_t seq = 0;
+
+    do {
+        seq = drv8301_p->status_seq;
+        if (seq == 0) return false;
+        *status_p = drv8301_p->status[seq & 0x01];
+    /*The writer published twice meanwhile, 
+    the copied buffer may have been reused*/
+    } while (seq != drv8301_p->status_seq);
+
+    return true;
+}
+
+/**
+ * Pops the oldest fault transition from the log.
+ * @param drv8301_p pointer to DRV8301 to be read.
+ * @param evt_p pointer to the event destination.
+ * @return false if the log is empty.
+ */
+bool md_drv8301_fault_event(md_drv8301_t * drv8301_p, 
+    md_fault_evt_t * evt_p)
+{
+    uint8_t tail = drv8301_p->log_tail;
+
+    if (tail == drv8301_p->log_head) return false;
+
+    *evt_p = drv8301_p->fault_log[tail % MD_FAULT_LOG_MAX];
+    drv8301_p->log_tail = tail + 1;
+
+    return true;
+}
+
+/**
+ * Writes the dirty control registers in non-blocking mode. Every write 
+ * is verified by reading the register back and only the mismatching 
+ * registers are written again. A single register costs three frames. 
+ * Completion is reported through drv8301_p->xfer.tran_ret.
+ * @param drv8301_p pointer to DRV8301 to be synchronised.
+ * @return false if the frames could not be queued or 
+ * a gain change is still in flight.
+ */
+bool md_drv8301_register_sync_async(md_drv8301_t * drv8301_p)
+{
+    /*A gain change owns the sync frames until it is through*/
+    if (drv8301_p->xfer.sync_mask) {
+        drv8301_p->xfer.tran_ret = false;
+        return false;
+    }
+
+    drv8301_p->xfer.tran_ret = 0xFF;
+    drv8301_p->xfer.sync_retry = 0;
+    drv8301_p->xfer.sync_bg = false;
+
+    if (!drv8301_p->dirty) {
+        drv8301_p->xfer.tran_ret = true;
+        return true;
+    }
+
+    if (!md_drv8301_sync_queue(drv8301_p)) {
+        drv8301_p->xfer.tran_ret = false;
+        return false;
+    }
+
+    md_drv8301_xfer_kick();
+    return true;
+}
+
+/**
+ * Writes the dirty control registers and waits for the verification.
+ * @param drv8301_p pointer to DRV8301 to be synchronised.
+ * @param timeout_ms Give up after this long.
+ * @return true if the chip holds the requested configuration.
+ */
+bool md_drv8301_register_sync(md_drv8301_t * drv8301_p, 
+    uint32_t timeout_ms)
+{
+    if (!md_drv8301_sync_idle_wait(&drv8301_p, 1, timeout_ms)) return false;
+    md_drv8301_register_sync_async(drv8301_p);
+
+    return md_drv8301_burst_wait(&drv8301_p, 
+        1, timeout_ms);
+}
+
+/**
+ * Waits until no register sync of the given devices is in flight.
+ * @param drv8301_pp array of DRV8301.
+ * @param cnt number of entries in the array.
+ * @param timeout_ms Give up after this long.
+ * @return false on timeout.
+ */
+static bool md_drv8301_sync_idle_wait(md_drv8301_t * const * drv8301_pp, 
+    uint8_t cnt, uint32_t timeout_ms)
+{
+    uint32_t tick = HAL_GetTick();
+
+    for (uint8_t i = 0; i < cnt; i++) {
+        while (drv8301_pp[i]->xfer.sync_mask) {
+            if (HAL_GetTick() - tick > timeout_ms)
+                return false;
+            sleep_us(1);
+        }
+    }
+
+    return true;
+}
+
+/**
+ * Queues one write per dirty register, then one read per dirty 
+ * register and a trailing read. A write is answered with status 
+ * register 1 and a read in the following frame, so the writes are 
+ * checked through the answers to the reads:
+ * tx: W CTL1 | W CTL2 | R CTL1 | R CTL2 | R STA1
+ * rx:   xx   |  STA1  |  STA1  |  CTL1  |  CTL2
+ * @param drv8301_p pointer to DRV8301 to be synchronised.
+ * @return false if the queue has no room.
+ */
+static bool md_drv8301_sync_queue(md_drv8301_t * drv8301_p)
+{
+    md_xfer_ctx_t * ctx_p = &drv8301_p->xfer;
+    md_regctl_t regctl = drv8301_p->regctl;
+    md_dirty_t mask = drv8301_p->dirty;
+    md_xfer_t xfers[MD_SYNC_FRAME_MAX];
+    uint8_t cnt = 0;
+
+    if (mask & MD_DIRTY_CTL1)
+        ctx_p->sync_tx[cnt++] = build_spi_data(WRITE, 
+            ADDR_REG_CTL1, regctl.reg1data);
+
+    if (mask & MD_DIRTY_CTL2)
+        ctx_p->sync_tx[cnt++] = build_spi_data(WRITE, 
+            ADDR_REG_CTL2, regctl.reg2data);
+
+    if (mask & MD_DIRTY_CTL1)
+        ctx_p->sync_tx[cnt++] = build_spi_data(READ, 
+            ADDR_REG_CTL1, 0);
+
+    if (mask & MD_DIRTY_CTL2)
+        ctx_p->sync_tx[cnt++] = build_spi_data(READ, 
+            ADDR_REG_CTL2, 0);
+
+    ctx_p->sync_tx[cnt++] = build_spi_data(READ, 
+        ADDR_REG_STA1, 0);
+
+    for (uint8_t i = 0; i < cnt; i++) {
+        xfers[i].drv8301_p = drv8301_p;
+        xfers[i].tx_data = ctx_p->sync_tx[i];
+        xfers[i].rx_p = &ctx_p->sync_rx[i];
+        xfers[i].flags = XFER_FLAG_NONE;
+    }
+
+    xfers[cnt - 1].flags = XFER_FLAG_SYNC;
+    ctx_p->sync_mask = mask;
+    ctx_p->sync_retry++;
+
+    if (md_drv8301_xfer_push(xfers, cnt)) return true;
+
+    ctx_p->sync_mask = 0;
+    return false;
+}
+
+/**
+ * Compares the read-backs with what was written, updates the 
+ * shadow and retries the mismatching registers. Runs in the 
+ * SPI completion interrupt.
+ * @param drv8301_p pointer to DRV8301 being synchronised.
+ */
+static void md_drv8301_sync_check(md_drv8301_t * drv8301_p)
+{
+    md_xfer_ctx_t * ctx_p = &drv8301_p->xfer;
+    md_dirty_t mask = ctx_p->sync_mask;
+    uint8_t num = ((mask & MD_DIRTY_CTL1) ? 1 : 0) + 
+        ((mask & MD_DIRTY_CTL2) ? 1 : 0);
+    uint8_t idx = 0;
+
+    /*The read of register n is answered in frame num + n + 1*/
+    if (mask & MD_DIRTY_CTL1) {
+        uint16_t data = ctx_p->sync_tx[idx] & 0x07FF;
+        if ((ctx_p->sync_rx[num + idx + 1] & 0x07FF) == data)
+            drv8301_p->shadow.reg1data = data;
+        idx++;
+    }
+
+    if (mask & MD_DIRTY_CTL2) {
+        uint16_t data = ctx_p->sync_tx[idx] & 0x07FF;
+        if ((ctx_p->sync_rx[num + idx + 1] & 0x07FF) == data)
+            drv8301_p->shadow.reg2data = data;
+        idx++;
+    }
+
+    /*The request may have changed meanwhile, 
+    compare against the latest one*/
+    md_dirty_t dirty = 0;
+    if (drv8301_p->shadow.reg1data != drv8301_p->regctl.reg1data) 
+        dirty |= MD_DIRTY_CTL1;
+    if (drv8301_p->shadow.reg2data != drv8301_p->regctl.reg2data) 
+        dirty |= MD_DIRTY_CTL2;
+    drv8301_p->dirty = dirty;
+
+    if (!dirty) {
+        md_drv8301_sync_finish(drv8301_p, true);
+        return;
+    }
+
+    if (ctx_p->sync_retry >= MD_SYNC_RETRY_MAX || 
+        !md_drv8301_sync_queue(drv8301_p))
+        md_drv8301_sync_finish(drv8301_p, false);
+}
+
+/**
+ * Ends a register sync and reports the result to a blocking caller.
+ * @param drv8301_p pointer to DRV8301 being synchronised.
+ * @param res whether the chip holds the requested configuration.
+ */
+static void md_drv8301_sync_finish(md_drv8301_t * drv8301_p, bool res)
+{
+    md_xfer_ctx_t * ctx_p = &drv8301_p->xfer;
+
+    ctx_p->sync_mask = 0;
+    if (ctx_p->sync_bg) return;
+
+    /*The gate is off during a foreground sync, 
+    the scaling follows the chip right away*/
+    drv8301_p->gain_idx = (drv8301_p->shadow.reg2data >> 2) & 0x03;
+    ctx_p->tran_ret = res;
+}
+
+/**
+ * Amplifier gain the current loop scales its ADC readings with. 
+ * A gain change shows up here at the PWM update event following 
+ * the read-back of the CTL2 write, see md_drv8301_gain_apply().
+ * @param drv8301_p pointer to DRV8301.
+ * @return Shunt amplifier gain, [V/V].
+ */
+float md_drv8301_gain(const md_drv8301_t * drv8301_p)
+{
+    return kgain_all[drv8301_p->gain_idx & 0x03];
+}
+
+/**
+ * Evaluates the gain schedule against the measured current and 
+ * marks control register 2 dirty when another gain fits better. 
+ * The gain is only raised once the current fits well inside the 
+ * narrower range and only lowered near the end of the active range, 
+ * the gap in between keeps it from toggling on a steady current.
+ * @param drv8301_p pointer to DRV8301.
+ * @param current Largest phase current magnitude of the last cycle, [A].
+ * @return true if a gain change is waiting for md_drv8301_gain_apply().
+ */
+bool md_drv8301_gain_schedule(md_drv8301_t * drv8301_p, float current)
+{
+    md_gain_sched_t * sched_p = &drv8301_p->gain_sched;
+
+    if (sched_p->range <= 0.0f) return false;
+    if (current < 0.0f) current = -current;
+
+    uint16_t reg2data = drv8301_p->regctl.reg2data;
+    uint16_t kgain_idx = (reg2data >> 2) & 0x03;
+
+    /*Range shrinks as the gain grows*/
+    float range = sched_p->range * kgain_all[0] / kgain_all[kgain_idx];
+
+    if (kgain_idx && (current > range * sched_p->lower))
+        kgain_idx--;
+    else if ((kgain_idx < 3) && (current < range * 0.5f * sched_p->raise))
+        kgain_idx++;
+    else return (drv8301_p->dirty & MD_DIRTY_CTL2) != 0;
+
+    drv8301_p->regctl.reg2data = (reg2data & ~(0x03 << 2)) | (kgain_idx << 2);
+
+    if (drv8301_p->shadow.reg2data != drv8301_p->regctl.reg2data) 
+        drv8301_p->dirty |= MD_DIRTY_CTL2;
+    else drv8301_p->dirty &= ~MD_DIRTY_CTL2;
+
+    return (drv8301_p->dirty & MD_DIRTY_CTL2) != 0;
+}
+
+/**
+ * Gain switch at the PWM update event, call it from the update 
+ * interrupt before the next ADC sample is taken. A CTL2 write that 
+ * was read back during the last period switches the scaling now, 
+ * so chip and current loop change over at the same boundary. 
+ * A pending change is only written with the SPI bus idle, the 
+ * three frames then land well inside the period and the scaling 
+ * follows at the next update event. Anything touching control 
+ * register 1 goes through the full init instead.
+ * @param drv8301_p pointer to DRV8301.
+ * @return true if the CTL2 write was queued.
+ */
+bool md_drv8301_gain_apply(md_drv8301_t * drv8301_p)
+{
+    md_xfer_ctx_t * ctx_p = &drv8301_p->xfer;
+
+    if (ctx_p->sync_mask) return false; /*Previous sync still in flight*/
+
+    /*The chip took the new gain during the last period*/
+    drv8301_p->gain_idx = (drv8301_p->shadow.reg2data >> 2) & 0x03;
+
+    if (drv8301_p->dirty != MD_DIRTY_CTL2) return false;
+    if (drv8301_p->init_state != STATE_READY) return false;
+    if (!md_drv8301_xfer_idle()) return false; /*Retried at the next update*/
+
+    ctx_p->sync_retry = 0;
+    ctx_p->sync_bg = true;
+
+    if (!md_drv8301_sync_queue(drv8301_p)) return false;
+
+    md_drv8301_xfer_kick();
+    return true;
+}
+
+/**
+ * Combines the status register contents into fault bits.
+ * @param sta1 Status register 1.
+ * @param sta2 Status register 2.
+ * @return Failure field.
+ */
+md_fault_t md_drv8301_decode_fault(uint16_t sta1, uint16_t sta2)
+{
+    return (md_fault_t)((uint32_t)(sta1 & 0x07FF) | 
+        ((uint32_t)(sta2 & 0x0080) << 16));
+}
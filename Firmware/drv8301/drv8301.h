@@ -18,6 +18,22 @@
  *      DEFINES
  *********************/
 
+/*Depth of the per-device fault transition log*/
+#define MD_FAULT_LOG_MAX 16U
+
+/*Frames a single device can have in flight at once*/
+#define MD_XFER_BURST_MAX 6U
+
+/*Recovery passes per nFAULT low phase before falling back to a full init*/
+#define MD_RECOVER_MAX 3U
+
+/*Write attempts per register before a sync gives up*/
+#define MD_SYNC_RETRY_MAX 5U
+
+/*Frames of a register sync, two writes, two reads and 
+the frame that clocks out the answer to the last read*/
+#define MD_SYNC_FRAME_MAX 5U
+
 /**********************
  *      TYPEDEFS
  **********************/
@@ -42,8 +58,9 @@ enum {
     FAULT_GVDD_OV  = (1 << 23)  /**< DRV8301 Vdd over voltage fault*/
 };
 
-/*The fault type of the MOS driver IC*/
-typedef uint16_t md_fault_t;
+/*The fault type of the MOS driver IC, 
+FAULT_GVDD_OV lives above bit 16*/
+typedef uint32_t md_fault_t;
 
 /**
  * DRV8301 register address, DRV8301 There are 
@@ -67,6 +84,7 @@ enum {
     STATE_UNINITED = 0,
     STATE_CHECKS,
     STATE_READY,
+    STATE_RECOVER, /**< nFAULT seen, fast re-arm in progress*/
 };
 
 typedef uint8_t md_state_t;
@@ -81,6 +99,16 @@ enum {
 
 typedef uint16_t md_RW_t;
 
+/**
+ * Control registers that differ from the register shadow.
+ */
+enum {
+    MD_DIRTY_CTL1 = (1 << 0),
+    MD_DIRTY_CTL2 = (1 << 1)
+};
+
+typedef uint8_t md_dirty_t;
+
 /*Dev Select the I/O operation portal*/
 typedef void (*_setval_t)(bool val);
 /*Dev Select the I/O operation portal*/
@@ -104,13 +132,72 @@ typedef struct {
     uint16_t reg2data;
 } md_regctl_t;
 
+/**
+ * Snapshot of both status registers, captured 
+ * by the background poll.
+ */
+typedef struct {
+    uint16_t sta1; /**< Status register 1, data bits only*/
+    uint16_t sta2; /**< Status register 2, data bits only*/
+    uint32_t tick; /**< HAL tick (ms) when the snapshot completed*/
+} md_status_t;
+
+/**
+ * A fault transition observed between two consecutive 
+ * status snapshots.
+ */
+typedef struct {
+    md_fault_t changed; /**< Fault bits that toggled*/
+    md_fault_t fault;   /**< Fault bits after the transition*/
+    uint32_t tick;      /**< HAL tick (ms) of the snapshot*/
+} md_fault_evt_t;
+
+/**
+ * Per-device transfer context, the DMA completion writes 
+ * the received frames here so several DRV8301 can have 
+ * transfers queued on the shared bus at the same time.
+ */
+typedef struct {
+    uint16_t tx_buf[MD_XFER_BURST_MAX];
+    volatile uint16_t rx_buf[MD_XFER_BURST_MAX];
+    volatile uint8_t tran_ret; /**< 0xFF while the burst is in flight*/
+    uint16_t sync_tx[MD_SYNC_FRAME_MAX]; /**< Register sync frames, kept apart from tx_buf*/
+    volatile uint16_t sync_rx[MD_SYNC_FRAME_MAX];
+    volatile md_dirty_t sync_mask; /**< Registers written by the sync in flight*/
+    uint8_t sync_retry;        /**< Sync bursts issued for the current change*/
+    bool sync_bg;              /**< Background sync, leaves tran_ret alone*/
+} md_xfer_ctx_t;
+
+/**
+ * Shunt amplifier gain scheduling, picks the highest gain whose 
+ * range still covers the measured current. A zero range disables it.
+ */
+typedef struct {
+    float range; /**< Current measurable at 10V/V, [A]*/
+    float raise; /**< Raise the gain below this share of the next range*/
+    float lower; /**< Lower the gain above this share of the active range*/
+} md_gain_sched_t;
+
 /**
  * Object-oriented design, construct a MOSFET-Driven 
  * device descriptor to store device parameters
  */
 typedef struct {
     uint8_t init_state;
-    md_regctl_t regctl;
+    md_regctl_t regctl;           /**< Requested configuration*/
+    md_regctl_t shadow;           /**< Configuration verified on the chip*/
+    volatile md_dirty_t dirty;    /**< Registers where regctl and shadow differ*/
+    md_xfer_ctx_t xfer;           /**< Transfer buffers of this device*/
+    md_gain_sched_t gain_sched;   /**< Shunt amplifier gain scheduling*/
+    uint8_t recover_cnt;          /**< Recovery passes since nFAULT was last high*/
+    volatile uint8_t gain_idx;    /**< Gain the current loop scales with, switched at the PWM update*/
+    md_status_t status[2];        /**< Double buffered status, written by the SPI ISR*/
+    volatile uint32_t status_seq; /**< Published snapshot count, selects the stable buffer*/
+    volatile bool poll_pending;   /**< A status poll is queued on the SPI bus*/
+    md_fault_t fault;             /**< Fault bits of the last published snapshot*/
+    md_fault_evt_t fault_log[MD_FAULT_LOG_MAX];
+    volatile uint8_t log_head;    /**< Written by the SPI ISR*/
+    volatile uint8_t log_tail;    /**< Written by the reader*/
     md_pin_t pin_nfalt; /**< Multiple DRV8301common pin*/
     md_pin_t pin_cs;    /**< Multiple DRV8301 common pin*/
     md_pin_t pin_en;    /**< Multiple DRV8301 common pin*/
@@ -121,18 +208,20 @@ typedef struct {
  **********************/
 
 /**
- * Transmit and Receive an amount of data in non-blocking mode with DMA.
+ * Queue an amount of 16-bit frames in non-blocking mode with DMA, 
+ * every frame gets its own chip select cycle. Completion is 
+ * reported through drv8301_p->xfer.tran_ret.
  * @param  tx_buf pointer to transmission data buffer
- * @param  rx_buf pointer to reception data buffer
+ * @param  rx_buf pointer to reception data buffer, may be NULL
  * @param  Size amount of data to be sent
- * @return HAL status.
  */
 void md_drv8301_spi_transfer_async(md_drv8301_t * drv8301_p, 
     const uint8_t * tx_buf, uint8_t * rx_buf, 
     size_t length);
 
 /**
- * Transmit and Receive an amount of data in non-blocking mode with DMA.
+ * Transmit and Receive an amount of data in blocking mode, 
+ * the frames queue behind any pending background poll.
  * @param  tx_buf pointer to transmission data buffer
  * @param  rx_buf pointer to reception data buffer
  * @param  Size amount of data to be sent
@@ -143,14 +232,71 @@ bool md_drv8301_spi_transfer(md_drv8301_t * drv8301_p,
     size_t length, uint32_t timeout_ms);
 
 /**
- * SPI Transmit and Receive completed callback.
- * act_drv_p pointer to a The currently active drive object.
+ * SPI Transmit and Receive completed callback, releases the 
+ * chip select of the finished frame and starts the next queued one.
  */
 void md_drv8301_spi_transfer_end();
 
+/**
+ * Builds the register configuration for the requested gain. Changes 
+ * to control register 1 drop the chip out of ready state, a gain-only 
+ * change just marks control register 2 dirty for md_drv8301_register_sync().
+ * @param drv8301_p pointer to DRV8301 to be configured.
+ * @param requested_gain The value of the gain requested.
+ * @param actual_gain Match to a close gain value.
+ * @return Configuration result.
+ */
 bool md_drv8301_register_config(md_drv8301_t * drv8301_p, 
     float requested_gain, float * actual_gain);
 
+/**
+ * Writes the dirty control registers in non-blocking mode. Every write 
+ * is verified by reading the register back and only the mismatching 
+ * registers are written again. A single register costs three frames. 
+ * Completion is reported through drv8301_p->xfer.tran_ret.
+ * @param drv8301_p pointer to DRV8301 to be synchronised.
+ * @return false if the frames could not be queued or 
+ * a gain change is still in flight.
+ */
+bool md_drv8301_register_sync_async(md_drv8301_t * drv8301_p);
+
+/**
+ * Writes the dirty control registers and waits for the verification.
+ * @param drv8301_p pointer to DRV8301 to be synchronised.
+ * @param timeout_ms Give up after this long.
+ * @return true if the chip holds the requested configuration.
+ */
+bool md_drv8301_register_sync(md_drv8301_t * drv8301_p, 
+    uint32_t timeout_ms);
+
+/**
+ * Amplifier gain the current loop scales its ADC readings with. 
+ * A gain change shows up here at the PWM update event following 
+ * the read-back of the CTL2 write, see md_drv8301_gain_apply().
+ * @param drv8301_p pointer to DRV8301.
+ * @return Shunt amplifier gain, [V/V].
+ */
+float md_drv8301_gain(const md_drv8301_t * drv8301_p);
+
+/**
+ * Evaluates the gain schedule against the measured current and 
+ * marks control register 2 dirty when another gain fits better.
+ * @param drv8301_p pointer to DRV8301.
+ * @param current Largest phase current magnitude of the last cycle, [A].
+ * @return true if a gain change is waiting for md_drv8301_gain_apply().
+ */
+bool md_drv8301_gain_schedule(md_drv8301_t * drv8301_p, float current);
+
+/**
+ * Gain switch at the PWM update event, call it from the update 
+ * interrupt before the next ADC sample is taken. A CTL2 write read 
+ * back during the last period switches the scaling now, a pending 
+ * change is written while the SPI bus is idle.
+ * @param drv8301_p pointer to DRV8301.
+ * @return true if the CTL2 write was queued.
+ */
+bool md_drv8301_gain_apply(md_drv8301_t * drv8301_p);
+
 /**
  * Apply the changed configuration parameters to the actual DRV8301 device.
  * @param drv8301_p pointer to DRV8301 that are currently 
@@ -159,6 +305,20 @@ bool md_drv8301_register_config(md_drv8301_t * drv8301_p,
  */
 bool md_drv8301_register_init(md_drv8301_t * drv8301_p);
 
+/**
+ * Apply the configuration of several DRV8301 sharing the SPI bus 
+ * in one batch. The chips are reset together and their register 
+ * writes and read-backs are queued as a single burst, so a 
+ * dual-axis board comes up in about the time of one chip. 
+ * Call it again once a chip fell back to STATE_UNINITED, 
+ * it returns right away while every chip is ready.
+ * @param drv8301_pp array of DRV8301 to be configured.
+ * @param cnt number of entries in the array.
+ * @return true if every chip ended up ready.
+ */
+bool md_drv8301_register_init_all(md_drv8301_t * const * drv8301_pp, 
+    uint8_t cnt);
+
 /**
  * Writes data to a DRV8301 register. There is no check if the write succeeded.
  * @param drv8301_p pointer to DRV8301 that are currently 
@@ -187,7 +347,7 @@ uint16_t build_spi_data(uint16_t _mode, uint16_t reg_addr,
     uint16_t data);
 
 /**
- * Transmit and Receive an amount of data in non-blocking mode with DMA.
+ * Reads both status registers with blocking transfers.
  * @param drv8301_p pointer to DRV8301 that are currently 
  * in the configuration phase.
  * @return Failure field.
@@ -199,6 +359,12 @@ md_fault_t md_drv8301_get_error(md_drv8301_t * drv8301_p);
  * functions starts to run, otherwise it's possible that a temporary power
  * loss is missed, leading to unwanted register values.
  * In case of power loss the nFAULT pin can be low for as little as 8ms.
+ * A ready chip is not dropped right away, the status registers are read 
+ * first: latched over current faults with intact registers are cleared 
+ * in place, anything else falls back to STATE_UNINITED for a full init. 
+ * A fault of the other chip on the shared nFAULT costs a pass as well, 
+ * so a line held low ends up in STATE_UNINITED too. The full init is 
+ * up to the caller, see md_drv8301_register_init_all().
  * @param drv8301_p pointer to DRV8301 that are currently 
  * in the configuration phase.
  */
@@ -213,4 +379,40 @@ void md_drv8301_checks(md_drv8301_t * drv8301_p);
  */
 bool md_drv8301_ready(md_drv8301_t * drv8301_p);
 
+/**
+ * Queue a background read of both status registers. The frames 
+ * run from the SPI DMA interrupt, the result is published 
+ * to the double buffer once the last frame completes.
+ * Call this every few milliseconds from a periodic context.
+ * @param drv8301_p pointer to DRV8301 to be polled.
+ * @return false if a poll is still pending or the queue is full.
+ */
+bool md_drv8301_status_poll(md_drv8301_t * drv8301_p);
+
+/**
+ * Copies the latest published status snapshot without locking.
+ * @param drv8301_p pointer to DRV8301 to be read.
+ * @param status_p pointer to the copy destination.
+ * @return false if no snapshot has been published yet.
+ */
+bool md_drv8301_read_status(md_drv8301_t * drv8301_p, 
+    md_status_t * status_p);
+
+/**
+ * Pops the oldest fault transition from the log.
+ * @param drv8301_p pointer to DRV8301 to be read.
+ * @param evt_p pointer to the event destination.
+ * @return false if the log is empty.
+ */
+bool md_drv8301_fault_event(md_drv8301_t * drv8301_p, 
+    md_fault_evt_t * evt_p);
+
+/**
+ * Combines the status register contents into fault bits.
+ * @param sta1 Status register 1.
+ * @param sta2 Status register 2.
+ * @return Failure field.
+ */
+md_fault_t md_drv8301_decode_fault(uint16_t sta1, uint16_t sta2);
+
 #endif /*__DRV8301_H__*/
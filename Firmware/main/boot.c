@@ -0,0 +1,145 @@
+/**
+ * @file boot.c
+ *
+ */
+
+/*********************
+ *      INCLUDES
+ *********************/
+
+#include <math.h>
+#include "stm32f4xx_hal.h"
+#include "boot.h"
+#include "nvm.h"
+
+/**********************
+ *  STATIC PROTOTYPES
+ **********************/
+
+static boot_calib_res_t boot_calib_axis(uint8_t axis);
+static bool boot_calib_check(uint8_t axis, boot_calib_t * calib_p);
+
+/**********************
+ *  STATIC VARIABLES
+ **********************/
+
+static uint32_t boot_us = 0; /*Time spent before the last clock change*/
+
+static boot_calib_t calib[BOOT_AXIS_NUM] = {0};
+static boot_calib_res_t calib_res[BOOT_AXIS_NUM] = {0};
+
+static const nvm_key_t calib_key[BOOT_AXIS_NUM] = {
+    NVM_KEY_M0_CALIB, NVM_KEY_M1_CALIB
+};
+
+/**********************
+ *   GLOBAL FUNCTIONS
+ **********************/
+
+/**
+ * Starts the boot clock, first thing in main(). The time
+ * the startup code spent before is not counted.
+ */
+void boot_time_start()
+{
+    CoreDebug->DEMCR |= CoreDebug_DEMCR_TRCENA_Msk;
+    DWT->CYCCNT = 0;
+    DWT->CTRL |= DWT_CTRL_CYCCNTENA_Msk;
+    boot_us = 0;
+}
+
+/**
+ * The core clock is about to change or just did, the cycles
+ * counted so far are converted at the clock they ran at.
+ * @param hz Core clock up to now, HSI_VALUE after reset.
+ */
+void boot_time_clock(uint32_t hz)
+{
+    uint32_t cycles = DWT->CYCCNT;
+
+    DWT->CYCCNT = 0;
+    boot_us += cycles / (hz / 1000000U);
+}
+
+/**
+ * Time since boot_time_start(), valid for 25 s at 168 MHz.
+ * @return [us].
+ */
+uint32_t boot_time_us()
+{
+    return boot_us + DWT->CYCCNT / (SystemCoreClock / 1000000U);
+}
+
+/**
+ * Brings up the calibration of every axis, needs the parameter
+ * store and the gate drivers. Blocks for as long as a full
+ * calibration takes where one is needed.
+ */
+void boot_calib_run()
+{
+    for (uint8_t axis = 0; axis < BOOT_AXIS_NUM; axis++)
+        calib_res[axis] = boot_calib_axis(axis);
+}
+
+boot_calib_res_t boot_calib_result(uint8_t axis)
+{
+    if (axis >= BOOT_AXIS_NUM) return BOOT_CALIB_NONE;
+    return calib_res[axis];
+}
+
+/**
+ * Calibration the control loop runs with.
+ * @param axis Motor axis.
+ * @return NULL if the axis is not calibrated.
+ */
+const boot_calib_t * boot_calib_get(uint8_t axis)
+{
+    if (boot_calib_result(axis) == BOOT_CALIB_NONE) return NULL;
+    return &calib[axis];
+}
+
+/**********************
+ *   STATIC FUNCTIONS
+ **********************/
+
+static boot_calib_res_t boot_calib_axis(uint8_t axis)
+{
+    boot_calib_t * calib_p = &calib[axis];
+    uint32_t sig = boot_port_signature(axis);
+
+    /*Stored for this setup and still in line with the hardware*/
+    if (nvm_read(calib_key[axis], calib_p, sizeof(boot_calib_t)) &&
+        (calib_p->sig == sig) && boot_calib_check(axis, calib_p)
+    ) return BOOT_CALIB_STORED;
+
+    if (!boot_port_calibrate(axis, calib_p)) return BOOT_CALIB_NONE;
+
+    /*A failed store only costs the next boot its shortcut*/
+    calib_p->sig = sig;
+    nvm_write(calib_key[axis], calib_p, sizeof(boot_calib_t));
+    return BOOT_CALIB_FULL;
+}
+
+/**
+ * Quick checks of a stored calibration, the fresh
+ * ADC offsets replace the stored ones.
+ */
+static bool boot_calib_check(uint8_t axis, boot_calib_t * calib_p)
+{
+    float zero[2] = {0};
+    float err = 0.0f;
+
+    if (!boot_port_adc_zero(axis, zero)) return false;
+
+    for (uint8_t i = 0; i < 2; i++) {
+        if (fabsf(zero[i] - calib_p->adc_zero[i]) > BOOT_ADC_ZERO_TOL)
+            return false;
+    }
+
+    /*The pulse is read with the fresh offsets*/
+    calib_p->adc_zero[0] = zero[0];
+    calib_p->adc_zero[1] = zero[1];
+
+    if (!boot_port_align(axis, calib_p, &err)) return false;
+    return fabsf(err) <= BOOT_ALIGN_TOL;
+}
@@ -0,0 +1,97 @@
+/**
+ * @file boot.h
+ *
+ * Boot sequence of the drive. A stored calibration is only checked,
+ * an ADC zero reading with the bridge off and one short alignment
+ * pulse, the full calibration runs when it is missing or fails the
+ * checks. The time from reset to torque ready is measured with the
+ * cycle counter.
+ */
+
+#ifndef __BOOT_H__
+#define __BOOT_H__
+
+/*********************
+ *      INCLUDES
+ *********************/
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/*********************
+ *      DEFINES
+ *********************/
+
+#define BOOT_AXIS_NUM 2U
+
+/*Largest drift of a shunt amplifier offset from the stored one, [counts]*/
+#define BOOT_ADC_ZERO_TOL 20.0f
+
+/*Largest electrical angle error of the alignment pulse, [rad], 20 deg*/
+#define BOOT_ALIGN_TOL 0.35f
+
+/**********************
+ *      TYPEDEFS
+ **********************/
+
+/**How the calibration of an axis was obtained*/
+enum {
+    BOOT_CALIB_NONE = 0, /**< Not calibrated, no torque*/
+    BOOT_CALIB_STORED,   /**< The stored calibration passed the checks*/
+    BOOT_CALIB_FULL      /**< Calibrated again and stored*/
+};
+
+typedef uint8_t boot_calib_res_t;
+
+/**
+ * Calibration of one axis, stored under NVM_KEY_Mx_CALIB.
+ */
+typedef struct {
+    uint32_t sig;        /**< Setup it was taken with, see boot_port_signature()*/
+    int32_t enc_offset;  /**< Encoder count at electrical angle 0*/
+    float adc_zero[2];   /**< Shunt amplifier offsets, phases B and C, [counts]*/
+    float phase_r;       /**< [Ohm]*/
+    float phase_l;       /**< [H]*/
+} boot_calib_t;
+
+/**********************
+ * GLOBAL PROTOTYPES
+ **********************/
+
+void boot_time_start();
+void boot_time_clock(uint32_t hz);
+uint32_t boot_time_us();
+void boot_calib_run();
+boot_calib_res_t boot_calib_result(uint8_t axis);
+const boot_calib_t * boot_calib_get(uint8_t axis);
+
+/**
+ * Port hooks, provided by the motor control. All of them
+ * run with the power stage of the other axis off.
+ */
+
+/**
+ * Identity of the setup a calibration belongs to, motor, encoder
+ * and amplifier gain. A stored calibration of another setup is redone.
+ */
+uint32_t boot_port_signature(uint8_t axis);
+
+/**
+ * Averages the shunt amplifier outputs with the bridge off.
+ * @param zero_p Receives the offsets of phases B and C, [counts].
+ */
+bool boot_port_adc_zero(uint8_t axis, float * zero_p);
+
+/**
+ * Drives a short current pulse along electrical angle 0 and
+ * compares the encoder with the stored offset.
+ * @param err_p Receives the electrical angle error, [rad].
+ */
+bool boot_port_align(uint8_t axis, const boot_calib_t * calib_p, float * err_p);
+
+/**
+ * Full calibration, offset search and phase resistance and inductance.
+ */
+bool boot_port_calibrate(uint8_t axis, boot_calib_t * calib_p);
+
+#endif /*__BOOT_H__*/
@@ -11,6 +11,11 @@
 #include <stdio.h>
 #include "main.h"
 #include "stm32.h"
+#include "mbrtu.h"
+#include "boot.h"
+#include "telem.h"
+#include "co402.h"
+#include "bcp.h"
 
 /**********************
  *  STATIC PROTOTYPES
@@ -28,17 +33,26 @@ static void SystemClock_Config(void);
  */
 int32_t main()
 {
+  /*Reset to torque ready is reported, the clock runs from here*/
+  boot_time_start();
+
   /*Reset of all peripherals, Initializes the Flash interface and the Systick.*/
   HAL_Init();
 
-  /*Configure the system clock*/
+  /*Configure the system clock, the cycles so far ran on the HSI*/
   SystemClock_Config();
+  boot_time_clock(HSI_VALUE);
 
   /*Initialize all configured peripherals*/
   stm32_init();
 
   for (;;) {
-
+    mb_rtu_pdu_field_deal();
+    stm32_drv8301_poll();
+    bcp_poll();
+    telem_poll();
+    stm32_scope_poll();
+    co402_poll();
   }
 
 	return 0;
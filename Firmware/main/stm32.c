@@ -1,5 +1,5 @@
 /**
- * @file stm32.h
+ * @file stm32.c
  *
  */
 
@@ -7,17 +7,87 @@
  *      INCLUDES
  *********************/
 
+#include <string.h>
 #include "stm32.h"
 
 #include "gpio.h"
 #include "spi.h"
 #include "dma.h"
+#include "usart.h"
+#include "tim.h"
+#include "can.h"
+#include "usb_device.h"
 #include "time.h"
+#include "mbrtu.h"
+#include "nvm.h"
+#include "boot.h"
+#include "telem.h"
+#include "scope.h"
+#include "co402.h"
+#include "bcp.h"
+
+/*********************
+ *      DEFINES
+ *********************/
+
+#define MODBUS_SLAVE_ADDR 0x01U
+#define MODBUS_BAUD_RATE  115200U
+
+#define CAN_NODE_ID  0x01U
+#define CAN_BIT_RATE 1000000U
+
+/*Gate driver re-init after a fault, spacing and attempts in a row*/
+#define DRV8301_REINIT_MS  1000U
+#define DRV8301_REINIT_MAX 5U
 
 /**********************
  *  STATIC PROTOTYPES
  **********************/
 
+static void m0_cs_setval(bool val);
+static void m1_cs_setval(bool val);
+static void en_gate_setval(bool val);
+static bool nfault_readval();
+static bool stm32_file_read(uint16_t file, 
+    uint16_t record, uint16_t num, uint8_t * buf_p);
+
+/**********************
+ *  GLOBAL VARIABLES
+ **********************/
+
+/*Both gate drivers share EN_GATE and nFAULT, 
+only the chip selects are separate*/
+md_drv8301_t drv8301_m0 = {
+    .pin_nfalt = {NULL, nfault_readval},
+    .pin_cs = {m0_cs_setval, NULL},
+    .pin_en = {en_gate_setval, NULL},
+    /*500uOhm shunt, +/- 300A at 10V/V*/
+    .gain_sched = {300.0f, 0.4f, 0.8f},
+};
+
+md_drv8301_t drv8301_m1 = {
+    .pin_nfalt = {NULL, nfault_readval},
+    .pin_cs = {m1_cs_setval, NULL},
+    .pin_en = {en_gate_setval, NULL},
+    /*500uOhm shunt, +/- 300A at 10V/V*/
+    .gain_sched = {300.0f, 0.4f, 0.8f},
+};
+
+static md_drv8301_t * const drv8301_all[] = {
+    &drv8301_m0, &drv8301_m1
+};
+
+/*Fault bits of the last tick, a new trip triggers the scope*/
+static md_fault_t fault_last[MB_AXIS_NUM] = {0};
+
+/*SysTick runs from HAL_Init on, the tick waits for the peripherals*/
+static volatile bool init_done = false;
+
+/*The main loop resets the gate drivers, the tick keeps off the bus*/
+static volatile bool drv8301_reinit = false;
+static uint32_t reinit_tick = 0;
+static uint8_t reinit_cnt = 0;
+
 /**********************
  *   GLOBAL FUNCTIONS
  **********************/
@@ -28,18 +98,305 @@
  */
 void stm32_init()
 {
+    uint8_t slave_addr = MODBUS_SLAVE_ADDR;
+    uint8_t node_id = CAN_NODE_ID;
+    mb_boot_state_t boot = {0};
+
     /*Initialize all configured peripherals*/
     MX_GPIO_Init();
     MX_DMA_Init();
     MX_SPI3_Init();
+    MX_USART2_UART_Init(MODBUS_BAUD_RATE);
+    MX_TIM7_Init();
+
+    /*Configure both gate drivers in one SPI burst, the batch 
+    resets both chips on the shared enable pin itself*/
+    md_drv8301_register_config(&drv8301_m0, 40.0f, NULL);
+    md_drv8301_register_config(&drv8301_m1, 40.0f, NULL);
+    md_drv8301_register_init_all(drv8301_all, 2);
+
+    /*Parameters stored by an earlier run, defaults where none are*/
+    nvm_init();
+    nvm_read(NVM_KEY_SLAVE_ID, &slave_addr, sizeof(slave_addr));
+    nvm_read(NVM_KEY_CAN_NODE_ID, &node_id, sizeof(node_id));
+
+    /*A damaged or foreign value would leave the slave off the bus*/
+    if ((slave_addr < ADDRESS_MIN) || (slave_addr > ADDRESS_MAX))
+        slave_addr = MODBUS_SLAVE_ADDR;
+
+    /*Modbus RTU on USART2, the idle line and TIM7 close the frames*/
+    mb_rtu_mode_init(slave_addr, MODBUS_BAUD_RATE);
+    mb_rtu_set_tick_rate(SystemCoreClock / 1000000U);
+    usart2_receive_start();
+    mb_rtu_file_register(stm32_file_read);
+
+    /*CANopen on CAN1, the boot-up message goes out with the filters set*/
+    MX_CAN1_Init(CAN_BIT_RATE);
+    if (!co402_init(node_id)) co402_init(CAN_NODE_ID);
+
+    /*Telemetry and the command protocol on the USB CDC port, 
+    enumerates while the boot goes on*/
+    telem_init();
+    bcp_init();
+    MX_USB_DEVICE_Init();
+
+    /*Stored calibration where it still fits, torque ready from here*/
+    boot_calib_run();
+
+    /*Without the measurement hooks no axis is calibrated, 
+    the master reads BOOT_CALIB_NONE for both*/
+    boot.time_us = boot_time_us();
+    for (uint8_t i = 0; i < MB_AXIS_NUM; i++)
+        boot.calib[i] = boot_calib_result(i);
+    mb_rtu_boot_publish(&boot);
+
+    init_done = true;
+}
+
+/**
+ * Gate driver housekeeping, must run at an interval of <8ms. 
+ * Watches nFAULT and keeps the background status poll going.
+ */
+void stm32_drv8301_tick()
+{
+    /*GPIO, SPI and DMA are not set up before stm32_init() is through*/
+    if (!init_done || drv8301_reinit) return;
+
+    for (uint8_t i = 0; i < 2; i++) {
+        md_drv8301_checks(drv8301_all[i]);
+        if (md_drv8301_ready(drv8301_all[i]))
+            md_drv8301_status_poll(drv8301_all[i]);
+    }
+
+    /*No control loop publishes the motor state yet, 
+    keep at least the gate driver faults visible to the master*/
+    for (uint8_t i = 0; i < MB_AXIS_NUM; i++) {
+        mb_motor_state_t state = {0};
+        co402_actual_t actual = {0};
+
+        state.fault = drv8301_all[i]->fault;
+        mb_rtu_input_publish(i, &state);
+
+        actual.fault = (state.fault != 0);
+        co402_actual_publish(i, &actual);
+
+        /*A trip stops an armed scope, the capture shows the run up*/
+        if (state.fault && !fault_last[i]) scope_trigger();
+        fault_last[i] = state.fault;
+    }
+}
+
+/**
+ * Current loop hook at the PWM update event of an axis. Picks the 
+ * amplifier gain for the current of the last cycle and switches 
+ * chip and ADC scaling at the PWM boundary. The last axis of a 
+ * cycle also records the scope sample, the signals of the cycle 
+ * that just ended are all in by then.
+ * @param axis Axis whose timer raised the update.
+ * @param current Largest phase current magnitude of the last cycle, [A].
+ * @return Amplifier gain for the samples of this cycle, [V/V].
+ */
+float stm32_pwm_update(uint8_t axis, float current)
+{
+    md_drv8301_t * drv8301_p = drv8301_all[axis];
+
+    if (init_done && !drv8301_reinit) {
+        md_drv8301_gain_schedule(drv8301_p, current);
+        md_drv8301_gain_apply(drv8301_p);
+    }
+
+    if (axis == MB_AXIS_NUM - 1) scope_cycle();
+
+    return md_drv8301_gain(drv8301_p);
+}
+
+/**
+ * Gate driver recovery from the main loop. A chip the tick dropped 
+ * to a full init is reset and configured again, both chips share 
+ * EN_GATE and go through the reset together. A chip that does not 
+ * come back is retried a few times, then left off.
+ */
+void stm32_drv8301_poll()
+{
+    bool all_ready = true;
+
+    for (uint8_t i = 0; i < 2; i++)
+        all_ready &= md_drv8301_ready(drv8301_all[i]);
+
+    if (all_ready) {
+        reinit_cnt = 0;
+        return;
+    }
+
+    if (reinit_cnt >= DRV8301_REINIT_MAX) return;
+    if (HAL_GetTick() - reinit_tick < DRV8301_REINIT_MS) return;
+
+    drv8301_reinit = true;
+    md_drv8301_register_init_all(drv8301_all, 2);
+    drv8301_reinit = false;
+
+    reinit_tick = HAL_GetTick();
+    reinit_cnt++;
+}
+
+/**
+ * Scope housekeeping from the main loop, takes over the 
+ * commands of the master and publishes the capture state.
+ */
+void stm32_scope_poll()
+{
+    mb_scope_cfg_t mb_cfg = {0};
+    mb_scope_state_t mb_state = {0};
+    scope_status_t status = {0};
+
+    if (mb_rtu_scope_cmd(&mb_cfg)) {
+        scope_cfg_t cfg = {
+            .mask = mb_cfg.mask,
+            .decim = mb_cfg.decim,
+            .pre = mb_cfg.pre,
+            .trig_ch = (mb_cfg.trig_ch < TELEM_CH_NUM) ? mb_cfg.trig_ch : TELEM_CH_NUM,
+            .trig = (mb_cfg.trig < SCOPE_TRIG_NUM) ? mb_cfg.trig : SCOPE_TRIG_NUM,
+            .level = (int16_t)mb_cfg.level,
+        };
+
+        switch (mb_cfg.cmd) {
+        case MB_SCOPE_CMD_ARM:
+            if (scope_config(&cfg)) scope_arm();
+            break;
+
+        case MB_SCOPE_CMD_FORCE:
+            scope_trigger();
+            break;
+
+        default:
+            scope_stop();
+            break;
+        }
+    }
+
+    scope_status_get(&status);
+    mb_state.state = status.state;
+    mb_state.chans = status.chans;
+    mb_state.depth = status.depth;
+    mb_state.pre = status.pre;
+    mb_state.count = status.count;
+    mb_rtu_scope_publish(&mb_state);
+}
+
+/**
+ * Boot hook, the setup a stored calibration belongs to. 
+ * Only the amplifier gain is known to the board so far.
+ */
+uint32_t boot_port_signature(uint8_t axis)
+{
+    float gain = md_drv8301_gain(drv8301_all[axis]);
+    uint32_t sig = 0;
+
+    memcpy(&sig, &gain, sizeof(sig));
+    return sig;
+}
+
+/**
+ * CANopen hook, the setpoints of this SYNC are latched. An enabled 
+ * axis takes the target of its mode as setpoint, the same one a 
+ * Modbus master writes, so the control loop has a single source.
+ */
+void co402_port_sync(uint32_t count)
+{
+    (void)count;
+
+    for (uint8_t i = 0; i < MB_AXIS_NUM; i++) {
+        co402_cmd_t cmd = {0};
+
+        co402_cmd_get(i, &cmd);
+        if (!cmd.enabled) continue;
+
+        switch (cmd.mode) {
+        case CO402_MODE_CSP:
+            mb_rtu_setpoint_set(i, (float)cmd.pos);
+            break;
+
+        case CO402_MODE_CSV:
+            mb_rtu_setpoint_set(i, (float)cmd.vel);
+            break;
+
+        case CO402_MODE_CST:
+            mb_rtu_setpoint_set(i, (float)cmd.torque);
+            break;
+
+        default:
+            break;
+        }
+    }
+}
+
+/*No current sense or encoder driver yet, the boot hooks report 
+every measurement as unavailable and every axis ends up 
+BOOT_CALIB_NONE, no torque until a control loop provides them*/
+bool boot_port_adc_zero(uint8_t axis, float * zero_p)
+{
+    (void)axis;
+    zero_p[0] = 0.0f;
+    zero_p[1] = 0.0f;
+    return false;
+}
+
+bool boot_port_align(uint8_t axis, const boot_calib_t * calib_p, float * err_p)
+{
+    (void)axis;
+    (void)calib_p;
+    *err_p = 0.0f;
+    return false;
+}
+
+bool boot_port_calibrate(uint8_t axis, boot_calib_t * calib_p)
+{
+    (void)axis;
+    (void)calib_p;
+    return false;
+}
+
+static void m0_cs_setval(bool val)
+{
+    HAL_GPIO_WritePin(GPIOC, GPIO_PIN_13, 
+        val ? GPIO_PIN_SET : GPIO_PIN_RESET);
+}
+
+static void m1_cs_setval(bool val)
+{
+    HAL_GPIO_WritePin(GPIOC, GPIO_PIN_14, 
+        val ? GPIO_PIN_SET : GPIO_PIN_RESET);
+}
+
+static void en_gate_setval(bool val)
+{
+    HAL_GPIO_WritePin(GPIOB, GPIO_PIN_12, 
+        val ? GPIO_PIN_SET : GPIO_PIN_RESET);
+}
+
+static bool nfault_readval()
+{
+    return HAL_GPIO_ReadPin(GPIOD, GPIO_PIN_2) == GPIO_PIN_SET;
+}
+
+/**
+ * Modbus file records, the files from MB_FILE_SCOPE 
+ * on hold the scope capture.
+ */
+static bool stm32_file_read(uint16_t file, 
+    uint16_t record, uint16_t num, uint8_t * buf_p)
+{
+    uint32_t offset = 0;
+    int16_t val = 0;
+
+    if (file < MB_FILE_SCOPE) return false;
+    offset = (uint32_t)(file - MB_FILE_SCOPE) * MB_FILE_RECORDS + record;
 
-    /*Reset both DRV chips. The enable pin also controls the SPI interface, not*/
-    /*only the driver stages.*/
-    /*drv_enable_gpio.write(false);*/
-    HAL_GPIO_WritePin(GPIOB, GPIO_PIN_12, GPIO_PIN_RESET);
-    sleep_ms(1); /*Mimumum pull-down time for full reset: 20us*/
+    for (uint16_t i = 0; i < num; i++) {
+        if (scope_read(offset + i, 1, &val) != 1) return false;
+        buf_p[i * 2 + 0] = (uint16_t)val >> 8;
+        buf_p[i * 2 + 1] = (uint16_t)val & 0xFF;
+    }
 
-    /*drv_enable_gpio.write(true);*/
-    HAL_GPIO_WritePin(GPIOB, GPIO_PIN_12, GPIO_PIN_SET);
-    sleep_ms(20); /*Mimumum pull-down time for full reset: 20us*/
+    return true;
 }
@@ -11,11 +11,15 @@
  *********************/
 
 #include "stm32f4xx_hal.h"
+#include "drv8301.h"
 
 /**********************
- *  STATIC PROTOTYPES
+ *  GLOBAL VARIABLES
  **********************/
 
+extern md_drv8301_t drv8301_m0;
+extern md_drv8301_t drv8301_m1;
+
 /**********************
  *   GLOBAL FUNCTIONS
  **********************/
@@ -26,4 +30,34 @@
  */
 void stm32_init();
 
+/**
+ * Gate driver housekeeping, must run at an interval of <8ms. 
+ * Watches nFAULT and keeps the background status poll going.
+ */
+void stm32_drv8301_tick();
+
+/**
+ * Current loop hook at the PWM update event of an axis. Picks the 
+ * amplifier gain for the current of the last cycle and switches 
+ * chip and ADC scaling at the PWM boundary. The last axis of a 
+ * cycle also records the scope sample, the signals of the cycle 
+ * that just ended are all in by then.
+ * @param axis Axis whose timer raised the update.
+ * @param current Largest phase current magnitude of the last cycle, [A].
+ * @return Amplifier gain for the samples of this cycle, [V/V].
+ */
+float stm32_pwm_update(uint8_t axis, float current);
+
+/**
+ * Gate driver recovery from the main loop. A chip the tick 
+ * dropped to a full init is reset and configured again.
+ */
+void stm32_drv8301_poll();
+
+/**
+ * Scope housekeeping from the main loop, takes over the 
+ * commands of the master and publishes the capture state.
+ */
+void stm32_scope_poll();
+
 #endif /*__STM32_H__*/
@@ -12,11 +12,20 @@
 
 #include <stdint.h>
 
+/*********************
+ *      DEFINES
+ *********************/
+
+/*Start value of the Modbus CRC16*/
+#define CRC16_INIT 0xFFFFU
+
 /**********************
  * GLOBAL PROTOTYPES
  **********************/
 
-uint16_t crc16(uint8_t *buffer, 
+uint16_t crc16(const uint8_t *buffer, 
 	uint16_t buffer_length);
+uint16_t crc16_update(uint16_t crc, 
+	const uint8_t *buffer, uint16_t buffer_length);
 
 #endif /*__CRC16_H__*/
@@ -8,7 +8,7 @@
  *********************/
 
 #include "devdesc.h"
-#include "xt_flash.h"
+#include "nvm.h"
 #include "log.h"
 
 /**********************
@@ -42,48 +42,34 @@ void _devdesc()
 }
 
 /**
- * Initializes the device's core clock in preparation for startup.
- * The initialization frequency is 168 MHZ.
+ * Stores the descriptor as a record of the parameter journal, 
+ * an unchanged descriptor is not written again and a changed 
+ * one is appended, no sector is erased for it.
+ * @return Whether the descriptor is stored.
  */
-void xt_devdesc_write_data()
+bool xt_devdesc_write_data()
 {
-	uint32_t ofs = sizeof(xt_devdesc_t);
-	uint32_t * desc_p = (uint32_t *)(&devdesc);
-
-    /*Operational memory erases sectors of 
-    data to be written.*/
-    xt_flash_erase_pages(FLASH_START_ADDR, 
-    	FLASH_END_ADDR);
-
-    /*Operational memory erases sectors of 
-    data to be written.*/
-    xt_flash_write(FLASH_START_ADDR, 
-    	FLASH_START_ADDR + ofs, 
-    	desc_p);
+    bool res = nvm_write(NVM_KEY_DEVDESC, 
+        &devdesc, sizeof(xt_devdesc_t));
 
     _devdesc();
+    return res;
 }
 
 /**
- * Initializes the device's core clock in preparation for startup.
- * The initialization frequency is 168 MHZ.
+ * Loads the descriptor from the parameter journal.
+ * @return Whether a stored descriptor was found, 
+ * the descriptor is left empty if not.
  */
-void xt_devdesc_read_data()
+bool xt_devdesc_read_data()
 {
-	uint32_t ofs = sizeof(xt_devdesc_t);
-	uint32_t * desc_p = (uint32_t *)(&devdesc);
-
-    /*Operational memory erases sectors of 
-    data to be written.*/
     memset(&devdesc, '\0', sizeof(devdesc));
 
-    /*Operational memory erases sectors of 
-    data to be written.*/
-    xt_flash_read(FLASH_START_ADDR, 
-    	FLASH_START_ADDR + ofs, 
-    	desc_p);
+    if (!nvm_read(NVM_KEY_DEVDESC, 
+        &devdesc, sizeof(xt_devdesc_t))) return false;
 
     _devdesc();
+    return true;
 }
 
 /**
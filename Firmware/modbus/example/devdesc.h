@@ -39,10 +39,8 @@
  **********************/
 
 /**
- * Construct a device descriptor that contains all the information
- * Flash Is written by 4 bytes at a time, 
- * and if it is a structure, make sure each member 
- * is 4-byte aligned
+ * Construct a device descriptor that contains all the information, 
+ * stored as one record of the parameter journal under NVM_KEY_DEVDESC
  */
 typedef struct {
 	uint16_t sn[8];     /**< SN:RC2020010101*/
@@ -59,16 +57,16 @@ extern xt_devdesc_t devdesc;
  **********************/
 
 /**
- * Initializes the device's core clock in preparation for startup.
- * The initialization frequency is 168 MHZ.
+ * Stores the descriptor in the parameter journal.
+ * @return Whether the descriptor is stored.
  */
-void xt_devdesc_write_data();
+bool xt_devdesc_write_data();
 
 /**
- * Initializes the device's core clock in preparation for startup.
- * The initialization frequency is 168 MHZ.
+ * Loads the descriptor from the parameter journal.
+ * @return Whether a stored descriptor was found.
  */
-void xt_devdesc_read_data();
+bool xt_devdesc_read_data();
 
 /**
  * Initializes the device's core clock in preparation for startup.
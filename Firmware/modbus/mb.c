@@ -7,14 +7,52 @@
  *      INCLUDES
  *********************/
 
+#include <string.h>
 #include "mb.h"
+#include "mbrtu.h"
 
 /*********************
  *      DEFINES
  *********************/
 
-#define REG_ADDR_START 40001U
-#define REG_COUNT      40U
+/*Protocol limits of 0x03/0x04, 0x10 and 0x17*/
+#define READ_NUM_MAX     125U
+#define WRITE_NUM_MAX    123U
+#define RW_WRITE_NUM_MAX 121U
+
+/*Protocol limits of 0x14, 7 bytes per sub-request*/
+#define FILE_REQ_SIZE    7U
+#define FILE_DATA_MAX    0xF5U
+
+/**********************
+ *      TYPEDEFS
+ **********************/
+
+/**
+ * One register space, the descriptors sorted by address.
+ */
+typedef struct {
+    const mb_reg_t * regs;
+    uint16_t num;   /**< Number of descriptors*/
+    uint16_t start; /**< Wire address of offset 0*/
+    uint16_t count; /**< Size of the address window*/
+} mb_reg_tab_t;
+
+/**********************
+ *  STATIC PROTOTYPES
+ **********************/
+
+static void mb_input_snapshot();
+static mb_res_t mb_reg_block(const mb_reg_tab_t * tab_p, 
+    uint16_t address, uint16_t num, mb_acc_t access, 
+    const mb_reg_t ** reg_pp);
+static uint16_t mb_reg_block_read(const mb_reg_t * reg_p, 
+    uint16_t num, uint8_t * buf_p);
+static void mb_reg_block_write(const mb_reg_t * reg_p, 
+    uint16_t num, const uint8_t * buf_p);
+static uint8_t mb_reg_pack(const mb_reg_t * reg_p, uint8_t * buf_p);
+static uint8_t mb_reg_unpack(const mb_reg_t * reg_p, const uint8_t * buf_p);
+static void mb_scope_cmd_write(const mb_reg_t * reg_p);
 
 /**********************
  *  STATIC VARIABLES
@@ -23,6 +61,32 @@
 static uint16_t hello_1 = 1900;
 static uint16_t hello_2 = 1902;
 
+static float setpoint[MB_AXIS_NUM] = {0};
+
+/**
+ * The control loop publishes into state_buf, one buffer is 
+ * stable while the other one is written. Reads copy the stable 
+ * one into input_state first and the registers are served from 
+ * there, a 32-bit value can never mix two cycles.
+ */
+static mb_motor_state_t state_buf[MB_AXIS_NUM][2] = {0};
+static volatile uint32_t state_seq[MB_AXIS_NUM] = {0};
+static mb_motor_state_t input_state[MB_AXIS_NUM] = {0};
+
+/*Bus statistics of the link layer, copied with the motor state*/
+static mb_rtu_diag_t diag_state = {0};
+static mb_rtu_turnaround_t ta_state = {0};
+
+/*Written once at the end of the boot*/
+static mb_boot_state_t boot_state = {0};
+
+/*Scope setup of the master and the state of the application*/
+static mb_scope_cfg_t scope_cfg = {0, 1, 0, 0, 0, 0, 0};
+static bool scope_cmd_pending = false;
+static mb_scope_state_t scope_state = {0};
+
+static mb_file_read_t file_read_p = NULL;
+
 /**
  * Note that the Modbus RTU protocol uses 16-bit data transmission 
  * (whether it is a read-write coil, read discrete input, 
@@ -32,15 +96,28 @@ static uint16_t hello_2 = 1902;
  * while paying attention to the combined byte order (size-side mode) .
  */
 
-static uint16_t * const data_p[REG_COUNT] = {
-    &hello_1, &hello_2, NULL, NULL, NULL, 
-    NULL, NULL, NULL, NULL, NULL, 
-    NULL, NULL, NULL, NULL, NULL, 
-    NULL, NULL, NULL, NULL, NULL,
-    NULL, NULL, NULL, NULL, NULL, 
-    NULL, NULL, NULL, NULL, NULL, 
-    NULL, NULL, NULL, NULL, NULL, 
-    NULL, NULL, NULL, NULL, NULL,
+#define MB_REG_DESC(name, addr, type, scale, mask, access, var, hook) \
+    {(addr), (type), (access), (mask), (scale), (void *)(var), (hook)},
+
+/*Sorted by address, expanded from MB_HOLDING_MAP*/
+static const mb_reg_t holding_regs[] = {
+    MB_HOLDING_MAP(MB_REG_DESC)
+};
+
+static const mb_reg_t input_regs[] = {
+    MB_INPUT_MAP(MB_REG_DESC)
+};
+
+static const mb_reg_tab_t holding_tab = {
+    holding_regs, 
+    sizeof(holding_regs) / sizeof(holding_regs[0]), 
+    REG_ADDR_START, REG_COUNT
+};
+
+static const mb_reg_tab_t input_tab = {
+    input_regs, 
+    sizeof(input_regs) / sizeof(input_regs[0]), 
+    INPUT_ADDR_START, INPUT_COUNT
 };
 
 static uint16_t register_start_nr = 0xFFFF;
@@ -118,6 +195,10 @@ mb_res_t mb_rtu_read_reg_data(
     read_num =  (pdu_data_frame_p[2] << 8);
     read_num |= (pdu_data_frame_p[3] << 0);
 
+    if ((*pdu_data_len < 4) || (read_num == 0) || 
+        (read_num > READ_NUM_MAX))
+        return MB_RES_ILLEGAL_DATA_VALUE;
+
     (*pdu_data_len) = 0;
 
     /*1data = 2bytes*/
@@ -152,32 +233,422 @@ mb_res_t mb_rtu_read_data(uint8_t * pdu_data_frame_p,
     uint16_t * pdu_data_len, uint16_t address, 
     uint16_t num)
 {
-    uint32_t start = REG_ADDR_START;
-    uint32_t end = REG_ADDR_START + REG_COUNT;
+    const mb_reg_t * reg_p = NULL;
 
-    /*Read the number of data, not the number of bytes*/
+    /*Read the number of data, not the number of bytes. 
+    The whole block is checked before the first byte is written, 
+    the reply overwrites the request in the same buffer*/
+    mb_res_t res = mb_reg_block(&holding_tab, 
+        address, num, MB_ACC_R, &reg_p);
+    if (res != MB_RES_NONE) return res;
 
-    if ((address < start) || ((address + num) > end))
-        return MB_RES_ILLEGAL_DATA_ADDRESS;
+    (*pdu_data_len) += mb_reg_block_read(reg_p, 
+        num, &pdu_data_frame_p[*pdu_data_len]);
+
+    return MB_RES_NONE;
+}
+
+/**
+ * Reads the motor state from the input registers (0x04).
+ * @param pdu_data_frame_p Points to an area of the cached data frame 
+ * that belongs to the receiving and sending shared space.
+ * @param pdu_data_len This parameter describes the number of 
+ * bytes in the frame of data received or to be sent.
+ * @return Get the results from the data.
+ */
+mb_res_t mb_rtu_read_input_data(uint8_t * pdu_data_frame_p, 
+    uint16_t * pdu_data_len)
+{
+    uint16_t read_addr = 0;
+    uint16_t read_num = 0;
+    const mb_reg_t * reg_p = NULL;
+
+    read_addr =  (pdu_data_frame_p[0] << 8);
+    read_addr |= (pdu_data_frame_p[1] << 0);
+
+    read_num =  (pdu_data_frame_p[2] << 8);
+    read_num |= (pdu_data_frame_p[3] << 0);
+
+    if ((*pdu_data_len < 4) || (read_num == 0) || 
+        (read_num > READ_NUM_MAX))
+        return MB_RES_ILLEGAL_DATA_VALUE;
+
+    mb_res_t res = mb_reg_block(&input_tab, 
+        read_addr, read_num, MB_ACC_R, &reg_p);
+    if (res != MB_RES_NONE) return res;
+
+    pdu_data_frame_p[0] = read_num * 2;
+    *pdu_data_len = 1 + mb_reg_block_read(reg_p, 
+        read_num, &pdu_data_frame_p[1]);
+
+    return MB_RES_NONE;
+}
+
+/**
+ * Writes a block of holding registers and reads another one back 
+ * in the same transaction (0x17). The write is applied first, so 
+ * a master can set the new setpoints and fetch the state in one frame.
+ * @param pdu_data_frame_p Points to an area of the cached data frame 
+ * that belongs to the receiving and sending shared space.
+ * @param pdu_data_len This parameter describes the number of 
+ * bytes in the frame of data received or to be sent.
+ * @return Get the results from the data.
+ */
+mb_res_t mb_rtu_rw_reg_data(uint8_t * pdu_data_frame_p, 
+    uint16_t * pdu_data_len)
+{
+    const mb_reg_t * read_p = NULL;
+    const mb_reg_t * write_p = NULL;
+
+    if (*pdu_data_len < 9) return MB_RES_ILLEGAL_DATA_VALUE;
+
+    uint16_t read_addr = (pdu_data_frame_p[0] << 8) | pdu_data_frame_p[1];
+    uint16_t read_num = (pdu_data_frame_p[2] << 8) | pdu_data_frame_p[3];
+    uint16_t write_addr = (pdu_data_frame_p[4] << 8) | pdu_data_frame_p[5];
+    uint16_t write_num = (pdu_data_frame_p[6] << 8) | pdu_data_frame_p[7];
+    uint8_t byte_cnt = pdu_data_frame_p[8];
 
-    uint16_t index = (uint16_t)(
-        address - REG_ADDR_START);
+    if ((read_num == 0) || (read_num > READ_NUM_MAX) || 
+        (write_num == 0) || (write_num > RW_WRITE_NUM_MAX) || 
+        (byte_cnt != write_num * 2) || (*pdu_data_len < 9 + byte_cnt))
+        return MB_RES_ILLEGAL_DATA_VALUE;
 
-    for (uint16_t i = 0; i < num; i++) {
-        pdu_data_frame_p[*pdu_data_len] = \
-            (*data_p[index + i] >> 8) & 0xFF;
+    /*Both blocks are checked before anything is touched*/
+    mb_res_t res = mb_reg_block(&holding_tab, 
+        write_addr, write_num, MB_ACC_W, &write_p);
+    if (res != MB_RES_NONE) return res;
 
-        (*pdu_data_len) += 1;
+    res = mb_reg_block(&holding_tab, 
+        read_addr, read_num, MB_ACC_R, &read_p);
+    if (res != MB_RES_NONE) return res;
 
-        pdu_data_frame_p[*pdu_data_len] = \
-            (*data_p[index + i] >> 0) & 0xFF;
+    mb_reg_block_write(write_p, write_num, 
+        &pdu_data_frame_p[9]);
 
-        (*pdu_data_len) += 1;
+    register_start_nr = write_addr - REG_ADDR_START;
+    register_end_nr = register_start_nr + write_num;
+
+    /*The write data is consumed, the reply may overwrite it*/
+    pdu_data_frame_p[0] = read_num * 2;
+    *pdu_data_len = 1 + mb_reg_block_read(read_p, 
+        read_num, &pdu_data_frame_p[1]);
+
+    return MB_RES_NONE;
+}
+
+/**
+ * Writes a single holding register (0x06), 
+ * the reply echoes the request.
+ * @param pdu_data_frame_p Points to an area of the cached data frame 
+ * that belongs to the receiving and sending shared space.
+ * @param pdu_data_len This parameter describes the number of 
+ * bytes in the frame of data received or to be sent.
+ * @return Get the results from the data.
+ */
+mb_res_t mb_rtu_write_single_reg_data(uint8_t * pdu_data_frame_p, 
+    uint16_t * pdu_data_len)
+{
+    if (*pdu_data_len < 4) return MB_RES_ILLEGAL_DATA_VALUE;
+
+    uint16_t write_addr = (pdu_data_frame_p[0] << 8) | pdu_data_frame_p[1];
+
+    /*Half of a 32-bit value is refused by the block check*/
+    mb_res_t res = mb_rtu_write_data(&pdu_data_frame_p[2], 
+        write_addr, 1);
+    if (res != MB_RES_NONE) return res;
+
+    *pdu_data_len = 4;
+    return MB_RES_NONE;
+}
+
+/**
+ * Changes bits of a holding register (0x16): 
+ * result = (current AND and_mask) OR (or_mask AND NOT and_mask), 
+ * the reply echoes the request.
+ * @param pdu_data_frame_p Points to an area of the cached data frame 
+ * that belongs to the receiving and sending shared space.
+ * @param pdu_data_len This parameter describes the number of 
+ * bytes in the frame of data received or to be sent.
+ * @return Get the results from the data.
+ */
+mb_res_t mb_rtu_mask_write_reg_data(uint8_t * pdu_data_frame_p, 
+    uint16_t * pdu_data_len)
+{
+    const mb_reg_t * reg_p = NULL;
+    uint8_t buf[4];
+
+    if (*pdu_data_len < 6) return MB_RES_ILLEGAL_DATA_VALUE;
+
+    uint16_t write_addr = (pdu_data_frame_p[0] << 8) | pdu_data_frame_p[1];
+    uint16_t and_mask = (pdu_data_frame_p[2] << 8) | pdu_data_frame_p[3];
+    uint16_t or_mask = (pdu_data_frame_p[4] << 8) | pdu_data_frame_p[5];
+
+    /*The register is read and written, it needs both rights*/
+    mb_res_t res = mb_reg_block(&holding_tab, 
+        write_addr, 1, MB_ACC_R, &reg_p);
+    if (res != MB_RES_NONE) return res;
+
+    res = mb_reg_block(&holding_tab, 
+        write_addr, 1, MB_ACC_W, &reg_p);
+    if (res != MB_RES_NONE) return res;
+
+    mb_reg_pack(reg_p, buf);
+
+    uint16_t val = (buf[0] << 8) | buf[1];
+    val = (val & and_mask) | (or_mask & ~and_mask);
+
+    buf[0] = (val >> 8) & 0xFF;
+    buf[1] = (val >> 0) & 0xFF;
+    mb_reg_block_write(reg_p, 1, buf);
+
+    register_start_nr = write_addr - REG_ADDR_START;
+    register_end_nr = register_start_nr + 1;
+
+    *pdu_data_len = 6;
+    return MB_RES_NONE;
+}
+
+/**
+ * Reads file records (0x14), reference type 6. Every sub-request 
+ * is checked before the first byte of the reply is written, the 
+ * records come from the reader set by mb_rtu_file_register().
+ * @param pdu_data_frame_p Points to an area of the cached data frame 
+ * that belongs to the receiving and sending shared space.
+ * @param pdu_data_len This parameter describes the number of 
+ * bytes in the frame of data received or to be sent.
+ * @return Get the results from the data.
+ */
+mb_res_t mb_rtu_read_file_data(uint8_t * pdu_data_frame_p, 
+    uint16_t * pdu_data_len)
+{
+    uint8_t req[FILE_DATA_MAX];
+    uint8_t byte_cnt = 0;
+    uint32_t resp_len = 0;
+    uint16_t pos = 1;
+
+    if (*pdu_data_len < 1) return MB_RES_ILLEGAL_DATA_VALUE;
+
+    byte_cnt = pdu_data_frame_p[0];
+
+    if ((byte_cnt < FILE_REQ_SIZE) || (byte_cnt > FILE_DATA_MAX) || 
+        (byte_cnt % FILE_REQ_SIZE) || (*pdu_data_len < 1 + byte_cnt))
+        return MB_RES_ILLEGAL_DATA_VALUE;
+
+    for (uint8_t i = 0; i < byte_cnt; i += FILE_REQ_SIZE) {
+        const uint8_t * sub_p = &pdu_data_frame_p[1 + i];
+        uint16_t record = (sub_p[3] << 8) | sub_p[4];
+        uint16_t num = (sub_p[5] << 8) | sub_p[6];
+
+        if ((sub_p[0] != MB_FILE_REF_TYPE) || (num == 0)) 
+            return MB_RES_ILLEGAL_DATA_VALUE;
+        if ((record >= MB_FILE_RECORDS) || 
+            (record + num > MB_FILE_RECORDS))
+            return MB_RES_ILLEGAL_DATA_ADDRESS;
+
+        /*Length and reference type of every sub-response, checked 
+        before any record is read so the reply never outgrows the frame*/
+        resp_len += 2U + num * 2U;
+        if (resp_len > FILE_DATA_MAX) return MB_RES_ILLEGAL_DATA_VALUE;
+    }
+    if (file_read_p == NULL) return MB_RES_ILLEGAL_DATA_ADDRESS;
+
+    /*The reply overwrites the sub-requests*/
+    memcpy(req, &pdu_data_frame_p[1], byte_cnt);
+
+    for (uint8_t i = 0; i < byte_cnt; i += FILE_REQ_SIZE) {
+        const uint8_t * sub_p = &req[i];
+        uint16_t file = (sub_p[1] << 8) | sub_p[2];
+        uint16_t record = (sub_p[3] << 8) | sub_p[4];
+        uint16_t num = (sub_p[5] << 8) | sub_p[6];
+
+        pdu_data_frame_p[pos + 0] = 1 + num * 2;
+        pdu_data_frame_p[pos + 1] = MB_FILE_REF_TYPE;
+
+        if (!file_read_p(file, record, num, &pdu_data_frame_p[pos + 2]))
+            return MB_RES_ILLEGAL_DATA_ADDRESS;
+
+        pos += 2 + num * 2;
     }
 
+    pdu_data_frame_p[0] = (uint8_t)resp_len;
+    *pdu_data_len = (uint16_t)(1 + resp_len);
+
     return MB_RES_NONE;
 }
 
+/**
+ * Sets the reader of the file records (0x14), 
+ * without one every file is an illegal address.
+ * @param read_p Reader, NULL removes it.
+ */
+void mb_rtu_file_register(mb_file_read_t read_p)
+{
+    file_read_p = read_p;
+}
+
+/**
+ * Publishes the motor state of an axis, called by the control loop 
+ * once per cycle, also from interrupt context. Never blocks.
+ * @param axis Motor axis, 0 to MB_AXIS_NUM - 1.
+ * @param state_p Points to the state of this cycle.
+ */
+void mb_rtu_input_publish(uint8_t axis, const mb_motor_state_t * state_p)
+{
+    if (axis >= MB_AXIS_NUM) return;
+
+    uint32_t seq = state_seq[axis] + 1;
+    state_buf[axis][seq & 0x01] = *state_p;
+
+    /*The copy must be complete before the flip is visible*/
+    __sync_synchronize();
+
+    /*Flip the buffers, readers follow the sequence*/
+    state_seq[axis] = seq;
+}
+
+/**
+ * Coherent copy of the motor state last published for an axis, 
+ * the copy is retried if the publisher reused its buffer meanwhile.
+ * @param axis Motor axis, 0 to MB_AXIS_NUM - 1.
+ * @param state_p Receives the state, left alone for an unknown axis.
+ */
+void mb_rtu_input_get(uint8_t axis, mb_motor_state_t * state_p)
+{
+    uint32_t seq = 0;
+
+    if (axis >= MB_AXIS_NUM) return;
+
+    do {
+        seq = state_seq[axis];
+        __sync_synchronize();
+        *state_p = state_buf[axis][seq & 0x01];
+        __sync_synchronize();
+    } while (seq != state_seq[axis]);
+}
+
+/**
+ * Publishes the outcome of the boot sequence, 
+ * call from the main loop context.
+ * @param state_p Boot time and calibration of every axis.
+ */
+void mb_rtu_boot_publish(const mb_boot_state_t * state_p)
+{
+    boot_state = *state_p;
+}
+
+/**
+ * Takes over the scope setup once the master wrote SCOPE_CMD, 
+ * call from the main loop context.
+ * @param cfg_p Receives the setup and the command.
+ * @return true once per write of SCOPE_CMD.
+ */
+bool mb_rtu_scope_cmd(mb_scope_cfg_t * cfg_p)
+{
+    if (!scope_cmd_pending) return false;
+
+    scope_cmd_pending = false;
+    *cfg_p = scope_cfg;
+    return true;
+}
+
+/**
+ * Publishes the state of the scope, 
+ * call from the main loop context.
+ * @param state_p State and progress of the capture.
+ */
+void mb_rtu_scope_publish(const mb_scope_state_t * state_p)
+{
+    scope_state = *state_p;
+}
+
+/**
+ * Checks that both register maps are in ascending address order 
+ * without overlap, the register lookup is a binary search over them.
+ * @return false if an entry of mbmap.h is out of place.
+ */
+bool mb_rtu_map_check()
+{
+    const mb_reg_tab_t * tabs[] = {&holding_tab, &input_tab};
+
+    for (uint8_t t = 0; t < 2; t++) {
+        const mb_reg_t * regs = tabs[t]->regs;
+
+        for (uint16_t i = 1; i < tabs[t]->num; i++) {
+            if (regs[i].addr < regs[i - 1].addr + 
+                MB_TYPE_WORDS(regs[i - 1].type))
+                return false;
+        }
+    }
+
+    return true;
+}
+
+/**
+ * Setpoint the master last wrote for an axis.
+ * @param axis Motor axis, 0 to MB_AXIS_NUM - 1.
+ * @return Setpoint, 0 for an unknown axis.
+ */
+float mb_rtu_setpoint(uint8_t axis)
+{
+    if (axis >= MB_AXIS_NUM) return 0.0f;
+    return setpoint[axis];
+}
+
+/**
+ * Sets the setpoint of an axis as the master would write it, 
+ * for the links besides Modbus.
+ * @param axis Motor axis, 0 to MB_AXIS_NUM - 1.
+ * @param val Setpoint.
+ * @return false for an unknown axis.
+ */
+bool mb_rtu_setpoint_set(uint8_t axis, float val)
+{
+    if (axis >= MB_AXIS_NUM) return false;
+
+    setpoint[axis] = val;
+    return true;
+}
+
+/**
+ * Latches the setpoints of this slave from a group setpoint write, 
+ * see MB_GROUP_WRITE_CODE. Called at the frame end from interrupt 
+ * context, the frame is already known to be intact and broadcast. 
+ * Frames without an entry for this slave are ignored.
+ * @param slave_addr Address of this slave.
+ * @param pdu_data_frame_p Points to the data field of the frame.
+ * @param pdu_data_len Number of bytes in the data field.
+ */
+void mb_rtu_group_latch(uint8_t slave_addr, 
+    const uint8_t * pdu_data_frame_p, uint16_t pdu_data_len)
+{
+    const uint8_t * entry_p = NULL;
+    uint8_t first = 0;
+    uint8_t count = 0;
+    uint32_t val = 0;
+
+    if (pdu_data_len < MB_GROUP_HEAD_SIZE) return;
+
+    first = pdu_data_frame_p[0];
+    count = pdu_data_frame_p[1];
+
+    if (pdu_data_len != MB_GROUP_HEAD_SIZE + 
+        count * MB_GROUP_ENTRY_SIZE) return;
+    if ((slave_addr < first) || 
+        ((slave_addr - first) >= count)) return;
+
+    entry_p = &pdu_data_frame_p[MB_GROUP_HEAD_SIZE + 
+        (slave_addr - first) * MB_GROUP_ENTRY_SIZE];
+
+    for (uint8_t axis = 0; axis < MB_AXIS_NUM; axis++) {
+        val  = (uint32_t)entry_p[0] << 24;
+        val |= (uint32_t)entry_p[1] << 16;
+        val |= (uint32_t)entry_p[2] << 8;
+        val |= (uint32_t)entry_p[3] << 0;
+        memcpy(&setpoint[axis], &val, sizeof(val));
+        entry_p += 4;
+    }
+}
+
 /**
  * Writes data to the specified slave device register.
  * @param pdu_data_frame_p Points to an area of the cached data frame 
@@ -201,9 +672,12 @@ mb_res_t mb_rtu_write_reg_data(uint8_t * pdu_data_frame_p,
 
     byte_cnt = (uint8_t)(pdu_data_frame_p[4]); /*write_num * 2*/
 
+    if ((write_num == 0) || (write_num > WRITE_NUM_MAX) || 
+        (byte_cnt != write_num * 2) || (*pdu_data_len < 5 + byte_cnt))
+        return MB_RES_ILLEGAL_DATA_VALUE;
+
     mb_res_t res = mb_rtu_write_data(&pdu_data_frame_p[5], 
-        pdu_data_len, write_addr, 
-        write_num);
+        write_addr, write_num);
 
     if (res == MB_RES_NONE)
         *pdu_data_len = 4; /*Address + write num*/
@@ -213,42 +687,251 @@ mb_res_t mb_rtu_write_reg_data(uint8_t * pdu_data_frame_p,
 
 /**
  * Writes data to the specified slave device register.
- * @param pdu_data_frame_p Points to an area of the cached data frame 
- * that belongs to the receiving and sending shared space.
- * @param pdu_data_len This parameter describes the number of 
- * bytes in the frame of data received or to be sent.
+ * @param pdu_data_frame_p Points to the register data, 
+ * num * 2 bytes in Modbus byte order.
  * @param address The starting address of the register in which the data resides.
  * @param num Read the number of data, not the number of bytes.
  * @return Get the results from the data.
  */
 mb_res_t mb_rtu_write_data(uint8_t * pdu_data_frame_p, 
-    uint16_t * pdu_data_len, uint16_t address, 
-    uint16_t num)
+    uint16_t address, uint16_t num)
+{
+    const mb_reg_t * reg_p = NULL;
+
+    /*Nothing is written unless the whole block is writable*/
+    mb_res_t res = mb_reg_block(&holding_tab, 
+        address, num, MB_ACC_W, &reg_p);
+    if (res != MB_RES_NONE) return res;
+
+    mb_reg_block_write(reg_p, num, pdu_data_frame_p);
+
+    register_start_nr = address - REG_ADDR_START;
+    register_end_nr = register_start_nr + num;
+
+    return MB_RES_NONE;
+}
+
+/**
+ * Copies the published motor state into the buffer the registers 
+ * are served from. The publisher never waits, the copy is retried 
+ * if it published twice meanwhile and reused the buffer being read. 
+ * The bus statistics are copied along.
+ */
+static void mb_input_snapshot()
+{
+    for (uint8_t axis = 0; axis < MB_AXIS_NUM; axis++)
+        mb_rtu_input_get(axis, &input_state[axis]);
+
+    mb_rtu_diag_get(&diag_state);
+    mb_rtu_turnaround_get(&ta_state);
+}
+
+/**
+ * Checks that a block of registers lies in the address window, 
+ * is mapped without gaps, does not split a 32-bit value and 
+ * grants the access. The descriptors are found by binary search.
+ * @param tab_p Register space.
+ * @param address Wire address of the first register.
+ * @param num Number of registers in the block.
+ * @param access Access the master requests.
+ * @param reg_pp Receives the descriptor of the first register.
+ * @return MB_RES_NONE if the whole block can be served.
+ */
+static mb_res_t mb_reg_block(const mb_reg_tab_t * tab_p, 
+    uint16_t address, uint16_t num, mb_acc_t access, 
+    const mb_reg_t ** reg_pp)
 {
-    uint32_t start = REG_ADDR_START;
-    uint32_t end = REG_ADDR_START + REG_COUNT;
+    uint32_t start = tab_p->start;
+    uint32_t end = tab_p->start + tab_p->count;
 
     if ((address < start) || ((address + num) > end))
         return MB_RES_ILLEGAL_DATA_ADDRESS;
 
-    uint16_t index = (uint16_t)(
-        address - REG_ADDR_START);
+    uint16_t index = (uint16_t)(address - start);
+    uint16_t lo = 0;
+    uint16_t hi = tab_p->num;
 
-    for (uint16_t i = 0; i < num; i++) {
-        *data_p[index + i]  = \
-            pdu_data_frame_p[i * 2 + 0] << 8;
-        *data_p[index + i] |= \
-            pdu_data_frame_p[i * 2 + 1] << 0;
+    while (lo < hi) {
+        uint16_t mid = (lo + hi) / 2;
+        if (tab_p->regs[mid].addr < index) lo = mid + 1;
+        else hi = mid;
     }
 
-#if 0 /*Apply to motor drive*/
-    MotorDrive.mod = ModeDigitalSpeed;
-    MotorDriveWriteSpeed(
-    51200 * data_p[index]); /*60rpm*/
-#endif
+    const mb_reg_t * reg_p = &tab_p->regs[lo];
+    const mb_reg_t * end_p = &tab_p->regs[tab_p->num];
+    uint16_t pos = index;
+
+    *reg_pp = reg_p;
+
+    while (pos < index + num) {
+        if ((reg_p >= end_p) || (reg_p->addr != pos)) 
+            return MB_RES_ILLEGAL_DATA_ADDRESS;
 
-    register_start_nr = index;
-    register_end_nr = index + num;
+        if (!(reg_p->access & access)) 
+            return MB_RES_ILLEGAL_DATA_ADDRESS;
+
+        pos += MB_TYPE_WORDS(reg_p->type);
+        reg_p++;
+    }
+
+    /*The last value reaches beyond the block*/
+    if (pos != index + num) return MB_RES_ILLEGAL_DATA_ADDRESS;
 
     return MB_RES_NONE;
 }
+
+/**
+ * Serialises a checked block, the descriptors of a block 
+ * are contiguous and walked in order.
+ * @param reg_p Descriptor of the first register.
+ * @param num Number of registers in the block.
+ * @param buf_p Destination in the reply.
+ * @return Number of bytes written.
+ */
+static uint16_t mb_reg_block_read(const mb_reg_t * reg_p, 
+    uint16_t num, uint8_t * buf_p)
+{
+    uint16_t offs = 0;
+
+    /*One coherent copy per request*/
+    mb_input_snapshot();
+
+    for (uint16_t n = 0; n < num; reg_p++) {
+        offs += mb_reg_pack(reg_p, &buf_p[offs]);
+        n += MB_TYPE_WORDS(reg_p->type);
+    }
+
+    return offs;
+}
+
+/**
+ * Stores a checked block and runs the on-write hooks 
+ * once the complete block is in place.
+ * @param reg_p Descriptor of the first register.
+ * @param num Number of registers in the block.
+ * @param buf_p Source in the request.
+ */
+static void mb_reg_block_write(const mb_reg_t * reg_p, 
+    uint16_t num, const uint8_t * buf_p)
+{
+    const mb_reg_t * _reg_p = reg_p;
+    uint16_t offs = 0;
+
+    for (uint16_t n = 0; n < num; _reg_p++) {
+        offs += mb_reg_unpack(_reg_p, &buf_p[offs]);
+        n += MB_TYPE_WORDS(_reg_p->type);
+    }
+
+    for (; reg_p < _reg_p; reg_p++) {
+        if (reg_p->on_write != NULL) 
+            reg_p->on_write(reg_p);
+    }
+}
+
+/**
+ * Serialises a register value in Modbus byte order.
+ * @param reg_p Register descriptor.
+ * @param buf_p Destination in the reply.
+ * @return Number of bytes written.
+ */
+static uint8_t mb_reg_pack(const mb_reg_t * reg_p, uint8_t * buf_p)
+{
+    uint32_t val = 0;
+    float fval = 0.0f;
+
+    switch (reg_p->type) {
+    case MB_TYPE_U16:
+    case MB_TYPE_BITS:
+        val = *(const uint16_t *)reg_p->var_p;
+        buf_p[0] = (val >> 8) & 0xFF;
+        buf_p[1] = (val >> 0) & 0xFF;
+        return 2;
+
+    case MB_TYPE_I32:
+        val = (uint32_t)(*(const int32_t *)reg_p->var_p);
+        break;
+
+    case MB_TYPE_U32:
+        val = *(const uint32_t *)reg_p->var_p;
+        break;
+
+    case MB_TYPE_F32:
+        memcpy(&val, reg_p->var_p, sizeof(val));
+        break;
+
+    case MB_TYPE_FIX32:
+        fval = *(const float *)reg_p->var_p * reg_p->scale;
+        val = (uint32_t)(int32_t)(fval + ((fval < 0.0f) ? -0.5f : 0.5f));
+        break;
+    }
+
+    buf_p[0] = (val >> 24) & 0xFF;
+    buf_p[1] = (val >> 16) & 0xFF;
+    buf_p[2] = (val >> 8) & 0xFF;
+    buf_p[3] = (val >> 0) & 0xFF;
+
+    return 4;
+}
+
+/**
+ * Stores a register value received in Modbus byte order.
+ * @param reg_p Register descriptor.
+ * @param buf_p Source in the request.
+ * @return Number of bytes consumed.
+ */
+static uint8_t mb_reg_unpack(const mb_reg_t * reg_p, const uint8_t * buf_p)
+{
+    uint16_t * u16_p = (uint16_t *)reg_p->var_p;
+    uint32_t val = 0;
+    float fval = 0.0f;
+
+    switch (reg_p->type) {
+    case MB_TYPE_U16:
+        *u16_p = (uint16_t)((buf_p[0] << 8) | buf_p[1]);
+        return 2;
+
+    case MB_TYPE_BITS:
+        val = (uint16_t)((buf_p[0] << 8) | buf_p[1]);
+        *u16_p = (*u16_p & ~reg_p->mask) | (val & reg_p->mask);
+        return 2;
+
+    default:
+        break;
+    }
+
+    val  = (uint32_t)buf_p[0] << 24;
+    val |= (uint32_t)buf_p[1] << 16;
+    val |= (uint32_t)buf_p[2] << 8;
+    val |= (uint32_t)buf_p[3] << 0;
+
+    switch (reg_p->type) {
+    case MB_TYPE_I32:
+        *(int32_t *)reg_p->var_p = (int32_t)val;
+        break;
+
+    case MB_TYPE_U32:
+        *(uint32_t *)reg_p->var_p = val;
+        break;
+
+    case MB_TYPE_F32:
+        memcpy(reg_p->var_p, &val, sizeof(val));
+        break;
+
+    case MB_TYPE_FIX32:
+        fval = (float)(int32_t)val;
+        *(float *)reg_p->var_p = fval / reg_p->scale;
+        break;
+    }
+
+    return 4;
+}
+
+/**
+ * SCOPE_CMD written, the setup registers of the 
+ * same request are already in place.
+ */
+static void mb_scope_cmd_write(const mb_reg_t * reg_p)
+{
+    (void)reg_p;
+    scope_cmd_pending = true;
+}
@@ -13,6 +13,7 @@
 #include <stdint.h>
 #include <stdio.h>
 #include <stdbool.h>
+#include "mbmap.h"
 
 /**********************
  *      TYPEDEFS
@@ -37,6 +38,75 @@ enum {
 
 typedef uint8_t mb_res_t;
 
+/**
+ * Motor state of one axis, published once per control cycle 
+ * and served through the input registers.
+ */
+typedef struct {
+    int32_t pos;    /**< Encoder position, [counts]*/
+    float vel;      /**< Velocity, [counts/s]*/
+    float iq;       /**< Torque producing current, [A]*/
+    float vbus;     /**< DC bus voltage, [V]*/
+    uint32_t fault; /**< Gate driver fault bits*/
+} mb_motor_state_t;
+
+/**
+ * Outcome of the boot sequence, published once.
+ */
+typedef struct {
+    uint32_t time_us;              /**< Reset to torque ready*/
+    uint16_t calib[MB_AXIS_NUM];   /**< How the calibration was obtained, boot_calib_res_t*/
+} mb_boot_state_t;
+
+/**
+ * Setup of the on-drive scope as the master writes it, 
+ * taken over by the application when SCOPE_CMD is written.
+ */
+typedef struct {
+    uint32_t mask;    /**< Telemetry channels, bit n is channel n*/
+    uint16_t decim;   /**< Record every decim-th control cycle*/
+    uint16_t pre;     /**< Samples before the trigger*/
+    uint16_t trig_ch; /**< Channel the trigger watches*/
+    uint16_t trig;    /**< Trigger condition, scope_trig_t*/
+    uint16_t level;   /**< Trigger level, int16 in channel counts*/
+    uint16_t cmd;     /**< MB_SCOPE_CMD_*/
+} mb_scope_cfg_t;
+
+/**
+ * State of the on-drive scope, published by the application.
+ */
+typedef struct {
+    uint16_t state;   /**< scope_state_t*/
+    uint16_t chans;   /**< Channels per sample*/
+    uint16_t depth;   /**< Samples of a capture*/
+    uint16_t pre;     /**< Samples before the trigger*/
+    uint16_t count;   /**< Samples recorded*/
+} mb_scope_state_t;
+
+/**
+ * Serves file records (0x14).
+ * @param file File number.
+ * @param record First record, below MB_FILE_RECORDS.
+ * @param num Number of registers, the records stay in the file.
+ * @param buf_p Receives the registers in Modbus byte order.
+ * @return false if the records do not exist.
+ */
+typedef bool (*mb_file_read_t)(uint16_t file, 
+    uint16_t record, uint16_t num, uint8_t * buf_p);
+
+/**
+ * Register descriptor expanded from the schema in mbmap.h.
+ */
+typedef struct _mb_reg_t {
+    uint16_t addr;    /**< Offset from REG_ADDR_START*/
+    mb_type_t type;
+    mb_acc_t access;
+    uint16_t mask;    /**< Writable bits of MB_TYPE_BITS*/
+    float scale;      /**< Wire scaling of MB_TYPE_FIX32*/
+    void * var_p;     /**< Backing variable*/
+    void (*on_write)(const struct _mb_reg_t * reg_p);
+} mb_reg_t;
+
 /**********************
  * GLOBAL PROTOTYPES
  **********************/
@@ -49,8 +119,28 @@ mb_res_t mb_rtu_read_data(uint8_t * pdu_data_frame_p,
 mb_res_t mb_rtu_write_reg_data(uint8_t * pdu_data_frame_p, 
     uint16_t * pdu_data_len);
 mb_res_t mb_rtu_write_data(uint8_t * pdu_data_frame_p, 
-    uint16_t * pdu_data_len, uint16_t address, 
-    uint16_t num);
+    uint16_t address, uint16_t num);
+mb_res_t mb_rtu_read_input_data(uint8_t * pdu_data_frame_p, 
+    uint16_t * pdu_data_len);
+mb_res_t mb_rtu_write_single_reg_data(uint8_t * pdu_data_frame_p, 
+    uint16_t * pdu_data_len);
+mb_res_t mb_rtu_mask_write_reg_data(uint8_t * pdu_data_frame_p, 
+    uint16_t * pdu_data_len);
+mb_res_t mb_rtu_rw_reg_data(uint8_t * pdu_data_frame_p, 
+    uint16_t * pdu_data_len);
+mb_res_t mb_rtu_read_file_data(uint8_t * pdu_data_frame_p, 
+    uint16_t * pdu_data_len);
+void mb_rtu_file_register(mb_file_read_t read_p);
+void mb_rtu_input_publish(uint8_t axis, const mb_motor_state_t * state_p);
+void mb_rtu_input_get(uint8_t axis, mb_motor_state_t * state_p);
+void mb_rtu_boot_publish(const mb_boot_state_t * state_p);
+bool mb_rtu_scope_cmd(mb_scope_cfg_t * cfg_p);
+void mb_rtu_scope_publish(const mb_scope_state_t * state_p);
+bool mb_rtu_map_check();
+float mb_rtu_setpoint(uint8_t axis);
+bool mb_rtu_setpoint_set(uint8_t axis, float val);
+void mb_rtu_group_latch(uint8_t slave_addr, 
+    const uint8_t * pdu_data_frame_p, uint16_t pdu_data_len);
 void mb_rtu_reg_get_range(uint16_t * start, uint16_t * end);
 void mb_rtu_reg_clear_range();
 bool mb_rtu_reg_range_valid();
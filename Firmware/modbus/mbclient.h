@@ -0,0 +1,186 @@
+/**
+ * @file mbclient.h
+ *
+ * Host side view of the register map, expanded from the schema in
+ * mbmap.h by the preprocessor so master and slave can not drift apart.
+ * Include it from the master application, the firmware does not use it.
+ * A flat copy for other languages can be dumped with
+ * `cc -E -P -I Firmware/modbus Firmware/modbus/mbclient.h`.
+ */
+
+#ifndef __MBCLIENT_H__
+#define __MBCLIENT_H__
+
+/*********************
+ *      INCLUDES
+ *********************/
+
+#include <stdint.h>
+#include <string.h>
+#include "mbmap.h"
+
+/*********************
+ *      DEFINES
+ *********************/
+
+#define MB_CLIENT_ADDR(name, addr, type, scale, mask, access, var, hook) \
+    MB_REG_##name = REG_ADDR_START + (addr),
+
+#define MB_CLIENT_DESC(name, addr, type, scale, mask, access, var, hook) \
+    {#name, REG_ADDR_START + (addr), (type), (access), (mask), (scale)},
+
+#define MB_CLIENT_IN_ADDR(name, addr, type, scale, mask, access, var, hook) \
+    MB_IN_##name = INPUT_ADDR_START + (addr),
+
+#define MB_CLIENT_IN_DESC(name, addr, type, scale, mask, access, var, hook) \
+    {#name, INPUT_ADDR_START + (addr), (type), (access), (mask), (scale)},
+
+/**********************
+ *      TYPEDEFS
+ **********************/
+
+/**Holding register addresses as sent on the wire*/
+enum {
+    MB_HOLDING_MAP(MB_CLIENT_ADDR)
+};
+
+/**Input register addresses as sent on the wire*/
+enum {
+    MB_INPUT_MAP(MB_CLIENT_IN_ADDR)
+};
+
+/**
+ * Wire description of a register, the host has no variable to bind.
+ */
+typedef struct {
+    const char * name;
+    uint16_t addr;
+    mb_type_t type;
+    mb_acc_t access;
+    uint16_t mask;
+    float scale;
+} mb_client_reg_t;
+
+/**********************
+ *  STATIC VARIABLES
+ **********************/
+
+static const mb_client_reg_t mb_client_holding[] = {
+    MB_HOLDING_MAP(MB_CLIENT_DESC)
+};
+
+#define MB_CLIENT_HOLDING_NUM \
+    (sizeof(mb_client_holding) / sizeof(mb_client_holding[0]))
+
+static const mb_client_reg_t mb_client_input[] = {
+    MB_INPUT_MAP(MB_CLIENT_IN_DESC)
+};
+
+#define MB_CLIENT_INPUT_NUM \
+    (sizeof(mb_client_input) / sizeof(mb_client_input[0]))
+
+/**********************
+ *   GLOBAL FUNCTIONS
+ **********************/
+
+/**
+ * Decodes a register value from the registers of a read reply.
+ * @param reg_p Register description.
+ * @param regs_p Registers, already converted to host byte order.
+ * @return Value in the units of the firmware variable.
+ */
+static inline double mb_client_decode(const mb_client_reg_t * reg_p,
+    const uint16_t * regs_p)
+{
+    uint32_t val = regs_p[0];
+    float fval = 0.0f;
+
+    if (MB_TYPE_WORDS(reg_p->type) == 1) return (double)val;
+
+    val = (val << 16) | regs_p[1];
+
+    switch (reg_p->type) {
+    case MB_TYPE_I32:
+        return (double)(int32_t)val;
+    case MB_TYPE_U32:
+        return (double)val;
+    case MB_TYPE_F32:
+        memcpy(&fval, &val, sizeof(fval));
+        return (double)fval;
+    case MB_TYPE_FIX32:
+        return (double)(int32_t)val / reg_p->scale;
+    }
+
+    return 0.0;
+}
+
+/**
+ * Encodes a value into the registers of a write request.
+ * @param reg_p Register description.
+ * @param value Value in the units of the firmware variable.
+ * @param regs_p Registers in host byte order, MB_TYPE_WORDS() of them.
+ */
+static inline void mb_client_encode(const mb_client_reg_t * reg_p,
+    double value, uint16_t * regs_p)
+{
+    uint32_t val = 0;
+    float fval = (float)value;
+
+    switch (reg_p->type) {
+    case MB_TYPE_U16:
+    case MB_TYPE_BITS:
+        regs_p[0] = (uint16_t)value;
+        return;
+    case MB_TYPE_I32:
+        val = (uint32_t)(int32_t)value;
+        break;
+    case MB_TYPE_U32:
+        val = (uint32_t)value;
+        break;
+    case MB_TYPE_F32:
+        memcpy(&val, &fval, sizeof(val));
+        break;
+    case MB_TYPE_FIX32:
+        fval *= reg_p->scale;
+        val = (uint32_t)(int32_t)(fval + ((fval < 0.0f) ? -0.5f : 0.5f));
+        break;
+    }
+
+    regs_p[0] = (uint16_t)(val >> 16);
+    regs_p[1] = (uint16_t)(val >> 0);
+}
+
+/**
+ * Builds the data field of a group setpoint write, send it to the 
+ * broadcast address with function code MB_GROUP_WRITE_CODE.
+ * @param first Address of the slave the first entry belongs to.
+ * @param count Number of consecutive slaves, MB_GROUP_SLAVE_MAX at most.
+ * @param setpoint_p Setpoints, MB_AXIS_NUM per slave.
+ * @param data_p Data field of the request.
+ * @return Length of the data field, 0 if count is out of range.
+ */
+static inline uint16_t mb_client_group_encode(uint8_t first, uint8_t count,
+    const float (*setpoint_p)[MB_AXIS_NUM], uint8_t * data_p)
+{
+    uint16_t len = MB_GROUP_HEAD_SIZE;
+    uint32_t val = 0;
+
+    if ((count == 0) || (count > MB_GROUP_SLAVE_MAX)) return 0;
+
+    data_p[0] = first;
+    data_p[1] = count;
+
+    for (uint8_t i = 0; i < count; i++) {
+        for (uint8_t axis = 0; axis < MB_AXIS_NUM; axis++) {
+            memcpy(&val, &setpoint_p[i][axis], sizeof(val));
+            data_p[len++] = (uint8_t)(val >> 24);
+            data_p[len++] = (uint8_t)(val >> 16);
+            data_p[len++] = (uint8_t)(val >> 8);
+            data_p[len++] = (uint8_t)(val >> 0);
+        }
+    }
+
+    return len;
+}
+
+#endif /*__MBCLIENT_H__*/
@@ -0,0 +1,201 @@
+/**
+ * @file mbmap.h
+ *
+ */
+
+#ifndef __MBMAP_H__
+#define __MBMAP_H__
+
+/*********************
+ *      INCLUDES
+ *********************/
+
+#include <stdint.h>
+
+/*********************
+ *      DEFINES
+ *********************/
+
+/**
+ * The address windows end behind the highest entry of their map, 
+ * the size of a union of one array per entry reaching that far.
+ */
+#define MB_MAP_SPAN(name, addr, type, scale, mask, access, var, hook) \
+    uint8_t span_##name[(addr) + MB_TYPE_WORDS(type)];
+
+#define REG_ADDR_START 40001U
+#define REG_COUNT      ((uint16_t)sizeof(union {MB_HOLDING_MAP(MB_MAP_SPAN)}))
+
+#define INPUT_ADDR_START 30001U
+#define INPUT_COUNT      ((uint16_t)sizeof(union {MB_INPUT_MAP(MB_MAP_SPAN)}))
+
+/**
+ * Turnaround histogram, bin i counts replies started less than 
+ * MB_DIAG_HIST_BASE << i after the request, the last bin the rest.
+ */
+#define MB_DIAG_HIST_NUM  8U
+#define MB_DIAG_HIST_BASE 16U /*[us]*/
+
+/*Motor axes served by this slave*/
+#define MB_AXIS_NUM 2U
+
+/**
+ * Group setpoint write, a user defined function code sent to the 
+ * broadcast address. One frame carries the setpoints of consecutive 
+ * slaves, every slave picks its own entry by its address and latches 
+ * it at the end of the frame, so all drives on the bus switch at the 
+ * same instant.
+ *
+ *  +------------+-------+------------------------------------------+
+ *  | First Addr | Count | Count * MB_AXIS_NUM * f32 setpoint       |
+ *  +------------+-------+------------------------------------------+
+ *
+ * The entry of a slave is at (slave address - first address), 
+ * axis 0 first, every setpoint IEEE 754 high word first.
+ */
+#define MB_GROUP_WRITE_CODE  0x41U
+#define MB_GROUP_HEAD_SIZE   2U
+#define MB_GROUP_ENTRY_SIZE  (MB_AXIS_NUM * 4U)
+/*Slaves one frame can carry, 252 bytes of PDU data at most*/
+#define MB_GROUP_SLAVE_MAX   ((252U - MB_GROUP_HEAD_SIZE) / MB_GROUP_ENTRY_SIZE)
+
+/**
+ * File records, read with 0x14 and reference type 6. A file holds 
+ * MB_FILE_RECORDS registers. The scope capture spans the files from 
+ * MB_FILE_SCOPE on, register n of the capture is record 
+ * n % MB_FILE_RECORDS of file MB_FILE_SCOPE + n / MB_FILE_RECORDS, 
+ * the int16 values in the layout of scope.h.
+ */
+#define MB_FILE_REF_TYPE 0x06U
+#define MB_FILE_RECORDS  10000U
+#define MB_FILE_SCOPE    1U
+
+/*Values of SCOPE_CMD, the setup registers are taken over with it*/
+#define MB_SCOPE_CMD_STOP  0U
+#define MB_SCOPE_CMD_ARM   1U
+#define MB_SCOPE_CMD_FORCE 2U
+
+/**
+ * Number of 16-bit registers a value of the type occupies.
+ */
+#define MB_TYPE_WORDS(type) (((type) >= MB_TYPE_I32) ? 2U : 1U)
+
+/**
+ * The holding register schema. Firmware and host client are both
+ * expanded from this one list, the firmware binds the variable and
+ * the on-write hook, the host side only sees the wire description.
+ *
+ *  name   ... Register name, MB_REG_<name> on the host side.
+ *  addr   ... Offset from REG_ADDR_START, ascending order, no overlap.
+ *  type   ... Storage and wire format, see mb_type_t.
+ *  scale  ... Wire value = variable * scale, MB_TYPE_FIX32 only.
+ *  mask   ... Bits a write may change, MB_TYPE_BITS only.
+ *  access ... MB_ACC_R, MB_ACC_W or MB_ACC_RW.
+ *  var    ... Address of the variable backing the register.
+ *  hook   ... Called after the master wrote the register, or NULL.
+ */
+#define MB_HOLDING_MAP(X) \
+    /*name         addr type         scale mask     access     var                    hook*/ \
+    X(HELLO_1,     0,   MB_TYPE_U16, 1.0f, 0xFFFFU, MB_ACC_RW, &hello_1,              NULL) \
+    X(HELLO_2,     1,   MB_TYPE_U16, 1.0f, 0xFFFFU, MB_ACC_RW, &hello_2,              NULL) \
+    X(M0_SETPOINT, 2,   MB_TYPE_F32, 1.0f, 0xFFFFU, MB_ACC_RW, &setpoint[0],          NULL) \
+    X(M1_SETPOINT, 4,   MB_TYPE_F32, 1.0f, 0xFFFFU, MB_ACC_RW, &setpoint[1],          NULL) \
+    /*Motor state mirrored behind the setpoints, one 0x17 transaction per cycle*/ \
+    X(M0_POS,      16,  MB_TYPE_I32, 1.0f, 0xFFFFU, MB_ACC_R,  &input_state[0].pos,   NULL) \
+    X(M0_VEL,      18,  MB_TYPE_F32, 1.0f, 0xFFFFU, MB_ACC_R,  &input_state[0].vel,   NULL) \
+    X(M0_IQ,       20,  MB_TYPE_F32, 1.0f, 0xFFFFU, MB_ACC_R,  &input_state[0].iq,    NULL) \
+    X(M0_VBUS,     22,  MB_TYPE_F32, 1.0f, 0xFFFFU, MB_ACC_R,  &input_state[0].vbus,  NULL) \
+    X(M0_FAULT,    24,  MB_TYPE_U32, 1.0f, 0xFFFFU, MB_ACC_R,  &input_state[0].fault, NULL) \
+    X(M1_POS,      26,  MB_TYPE_I32, 1.0f, 0xFFFFU, MB_ACC_R,  &input_state[1].pos,   NULL) \
+    X(M1_VEL,      28,  MB_TYPE_F32, 1.0f, 0xFFFFU, MB_ACC_R,  &input_state[1].vel,   NULL) \
+    X(M1_IQ,       30,  MB_TYPE_F32, 1.0f, 0xFFFFU, MB_ACC_R,  &input_state[1].iq,    NULL) \
+    X(M1_VBUS,     32,  MB_TYPE_F32, 1.0f, 0xFFFFU, MB_ACC_R,  &input_state[1].vbus,  NULL) \
+    X(M1_FAULT,    34,  MB_TYPE_U32, 1.0f, 0xFFFFU, MB_ACC_R,  &input_state[1].fault, NULL) \
+    /*On-drive scope, see mb_scope_cfg_t, the capture is read with 0x14*/ \
+    X(SCOPE_MASK,  36,  MB_TYPE_U32, 1.0f, 0xFFFFU, MB_ACC_RW, &scope_cfg.mask,       NULL) \
+    X(SCOPE_DECIM, 38,  MB_TYPE_U16, 1.0f, 0xFFFFU, MB_ACC_RW, &scope_cfg.decim,      NULL) \
+    X(SCOPE_PRE,   39,  MB_TYPE_U16, 1.0f, 0xFFFFU, MB_ACC_RW, &scope_cfg.pre,        NULL) \
+    X(SCOPE_TRIG_CH, 40, MB_TYPE_U16, 1.0f, 0xFFFFU, MB_ACC_RW, &scope_cfg.trig_ch,   NULL) \
+    X(SCOPE_TRIG,  41,  MB_TYPE_U16, 1.0f, 0xFFFFU, MB_ACC_RW, &scope_cfg.trig,       NULL) \
+    X(SCOPE_LEVEL, 42,  MB_TYPE_U16, 1.0f, 0xFFFFU, MB_ACC_RW, &scope_cfg.level,      NULL) \
+    X(SCOPE_CMD,   43,  MB_TYPE_U16, 1.0f, 0xFFFFU, MB_ACC_RW, &scope_cfg.cmd,        mb_scope_cmd_write)
+
+/**
+ * The input register schema, same columns as the holding map. 
+ * Input registers are read only, they expose the motor state 
+ * published by the control loop.
+ */
+#define MB_INPUT_MAP(X) \
+    /*name         addr type         scale mask     access     var                    hook*/ \
+    X(M0_POS,      0,   MB_TYPE_I32, 1.0f, 0xFFFFU, MB_ACC_R,  &input_state[0].pos,   NULL) \
+    X(M0_VEL,      2,   MB_TYPE_F32, 1.0f, 0xFFFFU, MB_ACC_R,  &input_state[0].vel,   NULL) \
+    X(M0_IQ,       4,   MB_TYPE_F32, 1.0f, 0xFFFFU, MB_ACC_R,  &input_state[0].iq,    NULL) \
+    X(M0_VBUS,     6,   MB_TYPE_F32, 1.0f, 0xFFFFU, MB_ACC_R,  &input_state[0].vbus,  NULL) \
+    X(M0_FAULT,    8,   MB_TYPE_U32, 1.0f, 0xFFFFU, MB_ACC_R,  &input_state[0].fault, NULL) \
+    X(M1_POS,      10,  MB_TYPE_I32, 1.0f, 0xFFFFU, MB_ACC_R,  &input_state[1].pos,   NULL) \
+    X(M1_VEL,      12,  MB_TYPE_F32, 1.0f, 0xFFFFU, MB_ACC_R,  &input_state[1].vel,   NULL) \
+    X(M1_IQ,       14,  MB_TYPE_F32, 1.0f, 0xFFFFU, MB_ACC_R,  &input_state[1].iq,    NULL) \
+    X(M1_VBUS,     16,  MB_TYPE_F32, 1.0f, 0xFFFFU, MB_ACC_R,  &input_state[1].vbus,  NULL) \
+    X(M1_FAULT,    18,  MB_TYPE_U32, 1.0f, 0xFFFFU, MB_ACC_R,  &input_state[1].fault, NULL) \
+    /*Bus quality, the 0x08 counters in full width, see mb_rtu_diag_t*/ \
+    X(DIAG_BUS_MSG,    20, MB_TYPE_U32, 1.0f, 0xFFFFU, MB_ACC_R, &diag_state.bus_msg,     NULL) \
+    X(DIAG_CRC_ERR,    22, MB_TYPE_U32, 1.0f, 0xFFFFU, MB_ACC_R, &diag_state.bus_crc_err, NULL) \
+    X(DIAG_EXCEPTION,  24, MB_TYPE_U32, 1.0f, 0xFFFFU, MB_ACC_R, &diag_state.exception,   NULL) \
+    X(DIAG_SLAVE_MSG,  26, MB_TYPE_U32, 1.0f, 0xFFFFU, MB_ACC_R, &diag_state.slave_msg,   NULL) \
+    X(DIAG_NO_RESP,    28, MB_TYPE_U32, 1.0f, 0xFFFFU, MB_ACC_R, &diag_state.no_resp,     NULL) \
+    X(DIAG_OVERRUN,    30, MB_TYPE_U32, 1.0f, 0xFFFFU, MB_ACC_R, &diag_state.overrun,     NULL) \
+    X(DIAG_WRONG_ADDR, 32, MB_TYPE_U32, 1.0f, 0xFFFFU, MB_ACC_R, &diag_state.wrong_addr,  NULL) \
+    /*Turnaround in [us], see mb_rtu_turnaround_t*/ \
+    X(TA_LAST,         34, MB_TYPE_U32, 1.0f, 0xFFFFU, MB_ACC_R, &ta_state.last,          NULL) \
+    X(TA_MIN,          36, MB_TYPE_U32, 1.0f, 0xFFFFU, MB_ACC_R, &ta_state.min,           NULL) \
+    X(TA_MAX,          38, MB_TYPE_U32, 1.0f, 0xFFFFU, MB_ACC_R, &ta_state.max,           NULL) \
+    X(TA_COUNT,        40, MB_TYPE_U32, 1.0f, 0xFFFFU, MB_ACC_R, &ta_state.count,         NULL) \
+    X(TA_HIST0,        42, MB_TYPE_U32, 1.0f, 0xFFFFU, MB_ACC_R, &ta_state.hist[0],       NULL) \
+    X(TA_HIST1,        44, MB_TYPE_U32, 1.0f, 0xFFFFU, MB_ACC_R, &ta_state.hist[1],       NULL) \
+    X(TA_HIST2,        46, MB_TYPE_U32, 1.0f, 0xFFFFU, MB_ACC_R, &ta_state.hist[2],       NULL) \
+    X(TA_HIST3,        48, MB_TYPE_U32, 1.0f, 0xFFFFU, MB_ACC_R, &ta_state.hist[3],       NULL) \
+    X(TA_HIST4,        50, MB_TYPE_U32, 1.0f, 0xFFFFU, MB_ACC_R, &ta_state.hist[4],       NULL) \
+    X(TA_HIST5,        52, MB_TYPE_U32, 1.0f, 0xFFFFU, MB_ACC_R, &ta_state.hist[5],       NULL) \
+    X(TA_HIST6,        54, MB_TYPE_U32, 1.0f, 0xFFFFU, MB_ACC_R, &ta_state.hist[6],       NULL) \
+    X(TA_HIST7,        56, MB_TYPE_U32, 1.0f, 0xFFFFU, MB_ACC_R, &ta_state.hist[7],       NULL) \
+    X(DIAG_CHAR_GAP,   58, MB_TYPE_U32, 1.0f, 0xFFFFU, MB_ACC_R, &diag_state.char_gap,    NULL) \
+    /*Boot, see mb_boot_state_t*/ \
+    X(BOOT_TIME,       60, MB_TYPE_U32, 1.0f, 0xFFFFU, MB_ACC_R, &boot_state.time_us,     NULL) \
+    X(M0_BOOT_CALIB,   62, MB_TYPE_U16, 1.0f, 0xFFFFU, MB_ACC_R, &boot_state.calib[0],    NULL) \
+    X(M1_BOOT_CALIB,   63, MB_TYPE_U16, 1.0f, 0xFFFFU, MB_ACC_R, &boot_state.calib[1],    NULL) \
+    /*On-drive scope, see mb_scope_state_t*/ \
+    X(SCOPE_STATE,     64, MB_TYPE_U16, 1.0f, 0xFFFFU, MB_ACC_R, &scope_state.state,      NULL) \
+    X(SCOPE_CHANS,     65, MB_TYPE_U16, 1.0f, 0xFFFFU, MB_ACC_R, &scope_state.chans,      NULL) \
+    X(SCOPE_DEPTH,     66, MB_TYPE_U16, 1.0f, 0xFFFFU, MB_ACC_R, &scope_state.depth,      NULL) \
+    X(SCOPE_PRE,       67, MB_TYPE_U16, 1.0f, 0xFFFFU, MB_ACC_R, &scope_state.pre,        NULL) \
+    X(SCOPE_COUNT,     68, MB_TYPE_U16, 1.0f, 0xFFFFU, MB_ACC_R, &scope_state.count,      NULL)
+
+/**********************
+ *      TYPEDEFS
+ **********************/
+
+/**
+ * Storage and wire format of a register,
+ * 32-bit values are sent high word first.
+ */
+enum {
+    MB_TYPE_U16 = 0, /**< uint16_t*/
+    MB_TYPE_BITS,    /**< uint16_t, a write only changes the mask bits*/
+    MB_TYPE_I32,     /**< int32_t*/
+    MB_TYPE_U32,     /**< uint32_t*/
+    MB_TYPE_F32,     /**< float, IEEE 754 on the wire*/
+    MB_TYPE_FIX32    /**< float, int32 of value * scale on the wire*/
+};
+
+typedef uint8_t mb_type_t;
+
+/**Register access rights of the master*/
+enum {
+    MB_ACC_R  = (1 << 0),
+    MB_ACC_W  = (1 << 1),
+    MB_ACC_RW = MB_ACC_R | MB_ACC_W
+};
+
+typedef uint8_t mb_acc_t;
+
+#endif /*__MBMAP_H__*/
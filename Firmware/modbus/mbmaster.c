@@ -0,0 +1,463 @@
+/**
+ * @file mbmaster.c
+ *
+ */
+
+/*********************
+ *      INCLUDES
+ *********************/
+
+#include <string.h>
+#include "mbmaster.h"
+
+/*********************
+ *      DEFINES
+ *********************/
+
+#define QUEUE_MASK (MB_MASTER_QUEUE_LEN - 1U)
+
+#define EXCEPTION_FLAG 0x80U
+
+/**********************
+ *  STATIC PROTOTYPES
+ **********************/
+
+static mb_master_slave_t * mb_master_slave(mb_master_t * master_p,
+    uint8_t slave_addr);
+static void mb_master_transmit(mb_master_t * master_p);
+static void mb_master_retry(mb_master_t * master_p);
+static void mb_master_finish(mb_master_t * master_p, mb_master_res_t res,
+    const uint8_t * data_p, uint16_t len);
+static void mb_master_reply(mb_master_t * master_p);
+
+/**********************
+ *   GLOBAL FUNCTIONS
+ **********************/
+
+/**
+ * Initializes a master, every slave starts with the default
+ * timeout and retry policy.
+ * @param master_p Master to initialize.
+ * @param port_p Port the master sends through, must stay valid.
+ */
+void mb_master_init(mb_master_t * master_p, const mb_master_port_t * port_p)
+{
+    memset(master_p, 0, sizeof(mb_master_t));
+
+    master_p->port_p = port_p;
+    master_p->turnaround = MB_MASTER_TURNAROUND_DEFAULT;
+
+    master_p->others.timeout = MB_MASTER_TIMEOUT_DEFAULT;
+    master_p->others.retry = MB_MASTER_RETRY_DEFAULT;
+    master_p->others.lat_min = UINT32_MAX;
+
+    master_p->state = MB_MASTER_IDLE;
+}
+
+/**
+ * Gives a slave its own reply timeout and retry policy,
+ * its statistics are kept apart from then on.
+ * @param master_p Master the slave is on.
+ * @param slave_addr Slave address, ADDRESS_MIN to ADDRESS_MAX.
+ * @param timeout Reply timeout after the request is out, [us].
+ * @param retry Repeats after a timeout or a damaged reply.
+ * @return False if the address is invalid or the table is full.
+ */
+bool mb_master_slave_config(mb_master_t * master_p, uint8_t slave_addr,
+    uint32_t timeout, uint8_t retry)
+{
+    mb_master_slave_t * slave_p = NULL;
+
+    if ((slave_addr < ADDRESS_MIN) ||
+        (slave_addr > ADDRESS_MAX))
+        return false;
+
+    for (uint8_t i = 0; i < MB_MASTER_SLAVE_MAX; i++) {
+        if (master_p->slaves[i].addr == slave_addr) {
+            slave_p = &master_p->slaves[i];
+            break;
+        }
+        if ((slave_p == NULL) &&
+            (master_p->slaves[i].addr == 0))
+            slave_p = &master_p->slaves[i];
+    }
+
+    if (slave_p == NULL) return false;
+
+    if (slave_p->addr != slave_addr) {
+        memset(slave_p, 0, sizeof(mb_master_slave_t));
+        slave_p->addr = slave_addr;
+        slave_p->lat_min = UINT32_MAX;
+    }
+
+    slave_p->timeout = timeout;
+    slave_p->retry = retry;
+
+    return true;
+}
+
+/**
+ * Statistics of a slave. Slaves without an entry of
+ * their own share one set.
+ * @param master_p Master the slave is on.
+ * @param slave_addr Slave address.
+ * @return Statistics, lat_min is UINT32_MAX before the first reply.
+ */
+const mb_master_slave_t * mb_master_slave_stats(mb_master_t * master_p,
+    uint8_t slave_addr)
+{
+    return mb_master_slave(master_p, slave_addr);
+}
+
+/**
+ * Queues a request, it is sent as soon as the requests before
+ * it are finished. Not to be called from interrupt context.
+ * @param master_p Master to send through.
+ * @param req_p Request, copied into the queue.
+ * @return False if the queue is full or the request is invalid.
+ */
+bool mb_master_submit(mb_master_t * master_p, const mb_master_req_t * req_p)
+{
+    if ((uint16_t)(master_p->tail - master_p->head) >= MB_MASTER_QUEUE_LEN)
+        return false;
+
+    if ((req_p->slave_addr > ADDRESS_MAX) ||
+        (req_p->fun_code == 0) ||
+        (req_p->fun_code >= FUN_CODE_MAX) ||
+        (req_p->len > MB_MASTER_PDU_MAX))
+        return false;
+
+    mb_master_req_t * slot_p = &master_p->queue[master_p->tail & QUEUE_MASK];
+
+    slot_p->slave_addr = req_p->slave_addr;
+    slot_p->fun_code = req_p->fun_code;
+    slot_p->len = req_p->len;
+    memcpy(slot_p->data, req_p->data, req_p->len);
+    slot_p->cb = req_p->cb;
+    slot_p->user_p = req_p->user_p;
+
+    master_p->tail++;
+
+    return true;
+}
+
+/**
+ * Queues a read of holding (0x03) or input (0x04) registers.
+ * The reply data field is the byte count followed by the registers.
+ * @param master_p Master to send through.
+ * @param slave_addr Slave address.
+ * @param fun_code 0x03 or 0x04.
+ * @param address Register address as sent on the wire.
+ * @param num Number of registers.
+ * @param cb Result callback, or NULL.
+ * @param user_p Passed through to the callback.
+ * @return Whether the request was queued.
+ */
+bool mb_master_read_regs(mb_master_t * master_p, uint8_t slave_addr,
+    uint8_t fun_code, uint16_t address, uint16_t num,
+    mb_master_cb_t cb, void * user_p)
+{
+    mb_master_req_t req;
+
+    if ((fun_code != 0x03) && (fun_code != 0x04)) return false;
+
+    req.slave_addr = slave_addr;
+    req.fun_code = fun_code;
+    req.data[0] = (uint8_t)(address >> 8);
+    req.data[1] = (uint8_t)(address >> 0);
+    req.data[2] = (uint8_t)(num >> 8);
+    req.data[3] = (uint8_t)(num >> 0);
+    req.len = 4;
+    req.cb = cb;
+    req.user_p = user_p;
+
+    return mb_master_submit(master_p, &req);
+}
+
+/**
+ * Queues a write of multiple holding registers (0x10).
+ * @param master_p Master to send through.
+ * @param slave_addr Slave address, or BROADCAST_ADDRESS.
+ * @param address Register address as sent on the wire.
+ * @param num Number of registers.
+ * @param regs_p Register values in host byte order.
+ * @param cb Result callback, or NULL.
+ * @param user_p Passed through to the callback.
+ * @return Whether the request was queued.
+ */
+bool mb_master_write_regs(mb_master_t * master_p, uint8_t slave_addr,
+    uint16_t address, uint16_t num, const uint16_t * regs_p,
+    mb_master_cb_t cb, void * user_p)
+{
+    mb_master_req_t req;
+
+    if ((num == 0) ||
+        ((5U + num * 2U) > MB_MASTER_PDU_MAX))
+        return false;
+
+    req.slave_addr = slave_addr;
+    req.fun_code = 0x10;
+    req.data[0] = (uint8_t)(address >> 8);
+    req.data[1] = (uint8_t)(address >> 0);
+    req.data[2] = (uint8_t)(num >> 8);
+    req.data[3] = (uint8_t)(num >> 0);
+    req.data[4] = (uint8_t)(num * 2);
+    req.len = 5;
+
+    for (uint16_t i = 0; i < num; i++) {
+        req.data[req.len++] = (uint8_t)(regs_p[i] >> 8);
+        req.data[req.len++] = (uint8_t)(regs_p[i] >> 0);
+    }
+
+    req.cb = cb;
+    req.user_p = user_p;
+
+    return mb_master_submit(master_p, &req);
+}
+
+/**
+ * Number of requests queued or in flight.
+ * @param master_p Master to look at.
+ * @return Requests not yet finished.
+ */
+uint16_t mb_master_pending(mb_master_t * master_p)
+{
+    return (uint16_t)(master_p->tail - master_p->head);
+}
+
+/**
+ * Runs the master, starts the next request, checks replies and
+ * timeouts and calls the result callbacks. Call it from the main
+ * loop as often as possible, it never blocks.
+ * @param master_p Master to run.
+ */
+void mb_master_poll(mb_master_t * master_p)
+{
+    mb_master_req_t * req_p = &master_p->queue[master_p->head & QUEUE_MASK];
+    uint32_t now = 0;
+
+    switch (master_p->state) {
+    case MB_MASTER_IDLE:
+        if (master_p->head == master_p->tail) break;
+
+        master_p->slave_p = mb_master_slave(master_p, req_p->slave_addr);
+        master_p->tries = 0;
+        master_p->t_start = master_p->port_p->now_us();
+        mb_master_transmit(master_p);
+        break;
+
+    /*Waiting for mb_master_send_end()*/
+    case MB_MASTER_XMIT:
+        break;
+
+    case MB_MASTER_WAIT:
+        now = master_p->port_p->now_us();
+
+        /*A broadcast is never answered, give the
+        slaves time to process it before the next frame*/
+        if (req_p->slave_addr == BROADCAST_ADDRESS) {
+            if ((uint32_t)(now - master_p->t_sent) >= master_p->turnaround)
+                mb_master_finish(master_p, MB_MASTER_OK, NULL, 0);
+            break;
+        }
+
+        if ((uint32_t)(now - master_p->t_sent) >= master_p->slave_p->timeout)
+            mb_master_retry(master_p);
+        break;
+
+    case MB_MASTER_DONE:
+        mb_master_reply(master_p);
+        break;
+    }
+}
+
+/**
+ * Transmission complete, used in the transmit complete
+ * interrupt of the port. The reply timeout starts here.
+ * @param master_p Master of the port.
+ */
+void mb_master_send_end(mb_master_t * master_p)
+{
+    if (master_p->state != MB_MASTER_XMIT) return;
+
+    master_p->t_sent = master_p->port_p->now_us();
+    master_p->state = MB_MASTER_WAIT;
+}
+
+/**
+ * Hands received bytes to the master, used in the receive interrupt
+ * of the port. Bytes outside of a transaction are dropped.
+ * @param master_p Master of the port.
+ * @param data_p Points to the received bytes.
+ * @param len Number of bytes received.
+ */
+void mb_master_recv_block(mb_master_t * master_p,
+    const uint8_t * data_p, uint16_t len)
+{
+    if (master_p->state != MB_MASTER_WAIT) return;
+
+    if ((master_p->rx_len + len) > RTU_BUF_MAX) {
+        master_p->rx_overrun = true;
+        return;
+    }
+
+    memcpy(&master_p->rx_buf[master_p->rx_len], data_p, len);
+    master_p->rx_len += len;
+    master_p->rx_crc = crc16_update(master_p->rx_crc, data_p, len);
+}
+
+/**
+ * Reply frame end, used in the idle line interrupt of the
+ * port or when t3.5 expired. The reply is checked in
+ * mb_master_poll().
+ * @param master_p Master of the port.
+ */
+void mb_master_recv_end(mb_master_t * master_p)
+{
+    if ((master_p->state != MB_MASTER_WAIT) ||
+        (master_p->rx_len == 0))
+        return;
+
+    master_p->t_recv = master_p->port_p->now_us();
+    master_p->state = MB_MASTER_DONE;
+}
+
+/**********************
+ *   STATIC FUNCTIONS
+ **********************/
+
+/**
+ * Looks up the link settings and statistics of a slave.
+ * @param master_p Master the slave is on.
+ * @param slave_addr Slave address.
+ * @return Entry of the slave, the shared one if it has none.
+ */
+static mb_master_slave_t * mb_master_slave(mb_master_t * master_p,
+    uint8_t slave_addr)
+{
+    for (uint8_t i = 0; i < MB_MASTER_SLAVE_MAX; i++) {
+        if ((slave_addr != 0) &&
+            (master_p->slaves[i].addr == slave_addr))
+            return &master_p->slaves[i];
+    }
+    return &master_p->others;
+}
+
+/**
+ * Sends the request at the head of the queue,
+ * the first time or as a retry.
+ * @param master_p Master to send through.
+ */
+static void mb_master_transmit(mb_master_t * master_p)
+{
+    mb_master_req_t * req_p = &master_p->queue[master_p->head & QUEUE_MASK];
+    uint16_t crc = 0;
+    uint16_t len = 0;
+
+    master_p->tx_buf[SLAVE_ADDR_INDEX] = req_p->slave_addr;
+    master_p->tx_buf[FUN_CODE_INDEX] = req_p->fun_code;
+    memcpy(&master_p->tx_buf[PDU_DATA_INDEX], req_p->data, req_p->len);
+
+    len = PDU_DATA_INDEX + req_p->len;
+    crc = crc16(master_p->tx_buf, len);
+    master_p->tx_buf[len++] = (uint8_t)(crc >> 0);
+    master_p->tx_buf[len++] = (uint8_t)(crc >> 8);
+    master_p->tx_len = len;
+
+    master_p->rx_len = 0;
+    master_p->rx_crc = CRC16_INIT;
+    master_p->rx_overrun = false;
+    master_p->tries++;
+
+    /*The port may report the end before it returns*/
+    master_p->state = MB_MASTER_XMIT;
+
+    if (!master_p->port_p->send(master_p->tx_buf, master_p->tx_len))
+        mb_master_finish(master_p, MB_MASTER_PORT_ERR, NULL, 0);
+}
+
+/**
+ * Repeats the current request after a timeout or a
+ * damaged reply, or gives it up once the retries are used.
+ * @param master_p Master of the request.
+ */
+static void mb_master_retry(mb_master_t * master_p)
+{
+    mb_master_slave_t * slave_p = master_p->slave_p;
+
+    if (master_p->tries <= slave_p->retry) {
+        slave_p->retries++;
+        mb_master_transmit(master_p);
+        return;
+    }
+
+    slave_p->timeouts++;
+    mb_master_finish(master_p, MB_MASTER_TIMEOUT, NULL, 0);
+}
+
+/**
+ * Ends the request at the head of the queue and reports it.
+ * The callback may submit new requests.
+ * @param master_p Master of the request.
+ * @param res Outcome of the request.
+ * @param data_p Data field of the reply, or NULL.
+ * @param len Number of bytes in the data field.
+ */
+static void mb_master_finish(mb_master_t * master_p, mb_master_res_t res,
+    const uint8_t * data_p, uint16_t len)
+{
+    mb_master_req_t * req_p = &master_p->queue[master_p->head & QUEUE_MASK];
+
+    master_p->slave_p->requests++;
+    master_p->state = MB_MASTER_IDLE;
+
+    /*The entry is released after the callback,
+    a new request can not overwrite it*/
+    if (req_p->cb != NULL)
+        req_p->cb(req_p, res, data_p, len);
+
+    master_p->head++;
+}
+
+/**
+ * Checks a complete reply frame against the current request.
+ * @param master_p Master of the request.
+ */
+static void mb_master_reply(mb_master_t * master_p)
+{
+    mb_master_req_t * req_p = &master_p->queue[master_p->head & QUEUE_MASK];
+    mb_master_slave_t * slave_p = master_p->slave_p;
+    uint8_t * rx_p = master_p->rx_buf;
+    uint16_t len = master_p->rx_len;
+    uint32_t lat = 0;
+
+    /*Damaged, cut short, or not the answer to this request*/
+    if (master_p->rx_overrun ||
+        (len < RTU_BUF_MIN) ||
+        (master_p->rx_crc != 0x0000) ||
+        (rx_p[SLAVE_ADDR_INDEX] != req_p->slave_addr) ||
+        ((rx_p[FUN_CODE_INDEX] & ~EXCEPTION_FLAG) != req_p->fun_code)) {
+        slave_p->crc_errors++;
+        mb_master_retry(master_p);
+        return;
+    }
+
+    len -= SLAVE_ADDR_BYTE_SIZE + FUNCODE_BYTE_SIZE + CRC_BYTE_SIZE;
+
+    if (rx_p[FUN_CODE_INDEX] & EXCEPTION_FLAG) {
+        slave_p->exceptions++;
+        mb_master_finish(master_p, MB_MASTER_EXCEPTION,
+            &rx_p[PDU_DATA_INDEX], len);
+        return;
+    }
+
+    lat = master_p->t_recv - master_p->t_start;
+    slave_p->replies++;
+    slave_p->lat_last = lat;
+    slave_p->lat_sum += lat;
+    if (lat < slave_p->lat_min) slave_p->lat_min = lat;
+    if (lat > slave_p->lat_max) slave_p->lat_max = lat;
+
+    mb_master_finish(master_p, MB_MASTER_OK,
+        &rx_p[PDU_DATA_INDEX], len);
+}
@@ -0,0 +1,176 @@
+/**
+ * @file mbmaster.h
+ *
+ * Non-blocking Modbus RTU master. Requests are queued and go out one
+ * after the other as soon as the bus is free, the caller never waits,
+ * the result is reported through the callback of the request from
+ * mb_master_poll(). The frame check reuses crc16 and the frame layout
+ * of mbrtu.h.
+ *
+ * The master only knows the port through mb_master_port_t, so the
+ * same code runs on a USART and on the host. For a simulated line
+ * the send hook hands the frame to mb_rtu_recv_block() and
+ * mb_rtu_recv_end() of the slave, and the slave's mb_rtu_port_send()
+ * hands the reply to mb_master_recv_block() and mb_master_recv_end().
+ */
+
+#ifndef __MBMASTER_H__
+#define __MBMASTER_H__
+
+/*********************
+ *      INCLUDES
+ *********************/
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "mbrtu.h"
+
+/*********************
+ *      DEFINES
+ *********************/
+
+/*Requests waiting for the bus, a power of two*/
+#define MB_MASTER_QUEUE_LEN 8U
+
+/*Slaves with their own timeout, retry policy and statistics*/
+#define MB_MASTER_SLAVE_MAX 8U
+
+/*Request PDU data field, function code excluded*/
+#define MB_MASTER_PDU_MAX (RTU_BUF_MAX - SLAVE_ADDR_BYTE_SIZE - \
+    FUNCODE_BYTE_SIZE - CRC_BYTE_SIZE)
+
+#define MB_MASTER_TIMEOUT_DEFAULT    50000U /*[us]*/
+#define MB_MASTER_RETRY_DEFAULT      2U
+#define MB_MASTER_TURNAROUND_DEFAULT 5000U  /*[us], after a broadcast*/
+
+/**********************
+ *      TYPEDEFS
+ **********************/
+
+/**Outcome of a request*/
+enum {
+    MB_MASTER_OK = 0,    /**< Normal reply received*/
+    MB_MASTER_EXCEPTION, /**< The slave answered with an exception*/
+    MB_MASTER_TIMEOUT,   /**< No valid reply, retries used up*/
+    MB_MASTER_PORT_ERR   /**< The port refused the frame*/
+};
+
+typedef uint8_t mb_master_res_t;
+
+struct _mb_master_req_t;
+
+/**
+ * Reports the end of a request, called from mb_master_poll().
+ * @param req_p The request as it was submitted.
+ * @param res Outcome of the request.
+ * @param data_p Data field of the reply, the exception code
+ * for MB_MASTER_EXCEPTION, NULL otherwise.
+ * @param len Number of bytes in the data field.
+ */
+typedef void (*mb_master_cb_t)(const struct _mb_master_req_t * req_p,
+    mb_master_res_t res, const uint8_t * data_p, uint16_t len);
+
+/**
+ * One queued request.
+ */
+typedef struct _mb_master_req_t {
+    uint8_t slave_addr;  /**< Slave address, BROADCAST_ADDRESS is not answered*/
+    uint8_t fun_code;
+    uint16_t len;        /**< Bytes in data*/
+    uint8_t data[MB_MASTER_PDU_MAX];
+    mb_master_cb_t cb;   /**< Or NULL*/
+    void * user_p;       /**< Passed through to the callback*/
+} mb_master_req_t;
+
+/**
+ * Link timing and statistics of one slave.
+ */
+typedef struct {
+    uint8_t addr;          /**< 0 if the entry is unused*/
+    uint8_t retry;         /**< Repeats after a timeout or a damaged reply*/
+    uint32_t timeout;      /**< Reply timeout after the request is out, [us]*/
+    uint32_t requests;     /**< Requests finished*/
+    uint32_t replies;      /**< Normal replies, lat_sum / replies is the mean*/
+    uint32_t timeouts;     /**< Requests given up*/
+    uint32_t retries;      /**< Frames repeated*/
+    uint32_t crc_errors;   /**< Damaged or foreign replies*/
+    uint32_t exceptions;   /**< Exception replies*/
+    uint32_t lat_last;     /**< Request start to reply end, [us]*/
+    uint32_t lat_min;
+    uint32_t lat_max;
+    uint64_t lat_sum;      /**< Of all successful transactions*/
+} mb_master_slave_t;
+
+/**
+ * Port of the master, all hooks are mandatory.
+ */
+typedef struct {
+    /**
+     * Starts sending a frame and returns, mb_master_send_end()
+     * follows once the last byte is out.
+     */
+    bool (*send)(const uint8_t * data_p, uint16_t len);
+    /*Free running microsecond clock, wraps around*/
+    uint32_t (*now_us)();
+} mb_master_port_t;
+
+/**Master transaction state*/
+enum {
+    MB_MASTER_IDLE = 0, /**< Bus free*/
+    MB_MASTER_XMIT,     /**< Request is being sent*/
+    MB_MASTER_WAIT,     /**< Waiting for the reply or the turnaround*/
+    MB_MASTER_DONE      /**< Reply frame complete, not yet checked*/
+};
+
+typedef uint8_t mb_master_state_t;
+
+typedef struct {
+    const mb_master_port_t * port_p;
+    uint32_t turnaround;                /**< Delay after a broadcast, [us]*/
+
+    mb_master_req_t queue[MB_MASTER_QUEUE_LEN];
+    volatile uint16_t head;             /**< Next request to send*/
+    volatile uint16_t tail;             /**< Next free entry*/
+
+    volatile mb_master_state_t state;
+    uint8_t tries;                      /**< Frames sent for the current request*/
+    mb_master_slave_t * slave_p;        /**< Slave of the current request*/
+    uint32_t t_start;                   /**< First frame of the request started*/
+    volatile uint32_t t_sent;           /**< Last frame left the wire*/
+    volatile uint32_t t_recv;           /**< Reply frame ended*/
+
+    uint8_t tx_buf[RTU_BUF_MAX];
+    uint16_t tx_len;
+    uint8_t rx_buf[RTU_BUF_MAX];
+    volatile uint16_t rx_len;
+    uint16_t rx_crc;                    /**< Accumulated while the reply arrives*/
+    volatile bool rx_overrun;
+
+    mb_master_slave_t slaves[MB_MASTER_SLAVE_MAX];
+    mb_master_slave_t others;           /**< Slaves without an entry*/
+} mb_master_t;
+
+/**********************
+ * GLOBAL PROTOTYPES
+ **********************/
+
+void mb_master_init(mb_master_t * master_p, const mb_master_port_t * port_p);
+bool mb_master_slave_config(mb_master_t * master_p, uint8_t slave_addr,
+    uint32_t timeout, uint8_t retry);
+const mb_master_slave_t * mb_master_slave_stats(mb_master_t * master_p,
+    uint8_t slave_addr);
+bool mb_master_submit(mb_master_t * master_p, const mb_master_req_t * req_p);
+bool mb_master_read_regs(mb_master_t * master_p, uint8_t slave_addr,
+    uint8_t fun_code, uint16_t address, uint16_t num,
+    mb_master_cb_t cb, void * user_p);
+bool mb_master_write_regs(mb_master_t * master_p, uint8_t slave_addr,
+    uint16_t address, uint16_t num, const uint16_t * regs_p,
+    mb_master_cb_t cb, void * user_p);
+uint16_t mb_master_pending(mb_master_t * master_p);
+void mb_master_poll(mb_master_t * master_p);
+void mb_master_send_end(mb_master_t * master_p);
+void mb_master_recv_block(mb_master_t * master_p,
+    const uint8_t * data_p, uint16_t len);
+void mb_master_recv_end(mb_master_t * master_p);
+
+#endif /*__MBMASTER_H__*/
@@ -14,49 +14,76 @@
  *      DEFINES
  *********************/
 
-#define MB_SEND_BYTE(buf, len)
-
 /**
- * rs485_receive_disable(); \
- * while (HAL_UART_Transmit( \
- *         &Uart1Handle, \
- *         buf, len, \
- *         0XFFFF \
- *     ) != HAL_OK \
- * ); \
- * rs485_receive_enable();
+ * The port starts the transmission and calls mb_rtu_send_end() 
+ * once the last byte left the wire. The frame buffer must stay 
+ * untouched until then, a DMA transmitter reads it in place.
  */
+#define MB_SEND_BYTE(buf, len) mb_rtu_port_send(buf, len)
+
+/*Diagnostics (0x08) sub-functions of a serial line slave*/
+#define DIAG_RETURN_QUERY   0x0000U
+#define DIAG_RESTART        0x0001U
+#define DIAG_RETURN_REG     0x0002U
+#define DIAG_LISTEN_ONLY    0x0004U
+#define DIAG_CLEAR          0x000AU
+#define DIAG_BUS_MSG        0x000BU
+#define DIAG_BUS_CRC_ERR    0x000CU
+#define DIAG_BUS_EXCEPTION  0x000DU
+#define DIAG_SLAVE_MSG      0x000EU
+#define DIAG_SLAVE_NO_RESP  0x000FU
+#define DIAG_SLAVE_NAK      0x0010U
+#define DIAG_SLAVE_BUSY     0x0011U
+#define DIAG_BUS_OVERRUN    0x0012U
+#define DIAG_CLEAR_OVERRUN  0x0014U
+
+#define DIAG_RESTART_CLEAR_LOG 0xFF00U
 
 /**********************
  *  STATIC VARIABLES
  **********************/
 
-static uint8_t  rtu_buf[RTU_BUF_MAX] = {0};
+/**
+ * Two frame buffers swap roles when a reply goes out, the DMA 
+ * transmitter reads one while the next request arrives in the other.
+ */
+static uint8_t  rtu_frame[2][RTU_BUF_MAX] = {0};
+static uint8_t * rtu_buf = rtu_frame[0]; /*Receives and executes*/
+static uint8_t * tx_buf = rtu_frame[1];  /*Owned by the transmitter*/
 static uint16_t rtu_len = 0;
+static uint16_t tx_len = 0;
+static uint16_t rtu_crc = CRC16_INIT; /*Accumulated while the frame arrives*/
+static volatile bool rx_gap = false;  /*t1.5 passed since the last character*/
 
 static uint8_t  init_slave_addr = 0x01;
 static uint8_t  recv_slave_addr = 0x00;
 static uint16_t recv_fun_code   = 0x00;
 
-static uint8_t  pdu_data[RTU_BUF_MAX - 4];
+/*Length of the PDU data field, the field itself stays in rtu_buf*/
 static uint16_t data_len = 0;
 
 static mb_rx_state_t mb_rx_state = MB_RX_INIT;
 static mb_tx_state_t mb_tx_state = MB_TX_IDLE;
 static mb_task_t mb_task = MB_READY;
 
+/*Port ticks of the frame end and per microsecond*/
+static uint32_t rx_end_ticks = 0;
+static uint32_t ticks_per_us = 1;
+static mb_rtu_turnaround_t turnaround = {0, UINT32_MAX, 0, 0, {0}};
+
+static mb_rtu_diag_t diag = {0};
+/*Set by 0x08/0x04, requests are only counted until a restart*/
+static bool listen_only = false;
+
 /**********************
- *      TYPEDEFS
+ *  STATIC PROTOTYPES
  **********************/
 
-/**
- * The construct protocol request actually handles the interface object.
- * Function code and operational interface.
- */
-typedef struct {
-    uint8_t fun_code;
-    req_opi_t req_opi;
-} mb_req_ll_t;
+static bool mb_rtu_group_frame();
+static void mb_rtu_turnaround_update();
+static void mb_rtu_diag_clear();
+static mb_res_t mb_rtu_diag_data(uint8_t * pdu_data_frame_p, 
+    uint16_t * pdu_data_len);
 
 /**********************
  *   GLOBAL FUNCTIONS
@@ -75,6 +102,9 @@ void mb_rtu_mode_init(uint8_t slave_addr,
         (slave_addr > ADDRESS_MAX))
         return;
 
+    /*An entry of mbmap.h out of order breaks the register lookup*/
+    assert(mb_rtu_map_check());
+
     init_slave_addr = slave_addr;
     mb_timer_init(baud_rate);
 
@@ -132,10 +162,20 @@ bool mb_rtu_set_slave_addr(uint8_t slave_addr)
  * The realization of Modbus protocol data transmission.
  * @param data_p Points to an area of the cached data.
  * @param len Number of bytes in the frame of data.
+ * @return Whether the port accepted the frame.
  */
-void mb_rtu_send_bytes(uint8_t * data_p, uint16_t len)
+bool mb_rtu_send_bytes(uint8_t * data_p, uint16_t len)
 {
-    MB_SEND_BYTE(data_p, len);
+    return MB_SEND_BYTE(data_p, len);
+}
+
+/**
+ * Transmission complete, used in the transmit complete interrupt 
+ * of the port. Releases the frame buffer for the next request.
+ */
+void mb_rtu_send_end()
+{
+    mb_tx_state = MB_TX_IDLE;
 }
 
 /**
@@ -146,8 +186,13 @@ void mb_rtu_send_bytes(uint8_t * data_p, uint16_t len)
  */
 void mb_rtu_recv_bytes(uint8_t byte)
 {
-    /*A new frame of data is received when the controller is idle*/
-    assert(mb_tx_state == MB_TX_IDLE);
+    /*The request is processed in place, the buffer belongs 
+    to it until the reply moved over to the transmitter*/
+    if ((mb_task == MB_FRAME_RECEIVED) || 
+        (mb_task == MB_EXECUTE)) {
+        mb_rx_state = MB_RX_ERR;
+        return;
+    }
     
     switch (mb_rx_state) {
     /**
@@ -173,11 +218,14 @@ void mb_rtu_recv_bytes(uint8_t byte)
      */
     case MB_RX_IDLE:
         rtu_len = 0; /*Empty the byte count in preparation for the next frame of data*/
+        rtu_crc = CRC16_INIT;
+        rx_gap = false;
         mb_rx_state = MB_RX_RCV;
         /*Padding data byte by byte into a data frame buffer*/
         if (rtu_len < RTU_BUF_MAX) {
             rtu_buf[rtu_len] = byte;
             rtu_len++;
+            rtu_crc = crc16_update(rtu_crc, &byte, 1);
             mb_timer_reload();
         }
         break;
@@ -189,10 +237,18 @@ void mb_rtu_recv_bytes(uint8_t byte)
      * ignored.
      */
     case MB_RX_RCV:
+        /*More than t1.5 since the last character, the frame is broken*/
+        if (rx_gap) {
+            diag.char_gap++;
+            mb_rx_state = MB_RX_ERR;
+            mb_timer_reload();
+            break;
+        }
         /*Padding data byte by byte into a data frame buffer*/
         if (rtu_len < RTU_BUF_MAX) {
             rtu_buf[rtu_len] = byte;
             rtu_len++;
+            rtu_crc = crc16_update(rtu_crc, &byte, 1);
             mb_timer_reload();
         } else {
             mb_rx_state = MB_RX_ERR;
@@ -202,6 +258,66 @@ void mb_rtu_recv_bytes(uint8_t byte)
     }
 }
 
+/**
+ * Block receive interface for ports that collect the bytes 
+ * with DMA, hands over everything received since the last call. 
+ * The frame end is signalled separately by mb_rtu_recv_end().
+ * @param data_p Points to the received bytes.
+ * @param len Number of bytes received.
+ */
+void mb_rtu_recv_block(const uint8_t * data_p, uint16_t len)
+{
+    /*The previous request is still being processed, 
+    the buffer belongs to it. Drop the new frame.*/
+    if ((mb_task == MB_FRAME_RECEIVED) || 
+        (mb_task == MB_EXECUTE)) {
+        mb_rx_state = MB_RX_ERR;
+        return;
+    }
+
+    switch (mb_rx_state) {
+    /*Wait until the line goes idle*/
+    case MB_RX_INIT:
+    case MB_RX_ERR:
+        break;
+
+    case MB_RX_IDLE:
+        rtu_len = 0; /*Empty the byte count in preparation for the next frame of data*/
+        rtu_crc = CRC16_INIT;
+        rx_gap = false;
+        mb_rx_state = MB_RX_RCV;
+        /* fall through */
+
+    case MB_RX_RCV:
+        /*The idle line fired in the middle of the frame 
+        and t1.5 passed before this block was handed over*/
+        if (rx_gap) {
+            diag.char_gap++;
+            mb_rx_state = MB_RX_ERR;
+            break;
+        }
+        if ((rtu_len + len) <= RTU_BUF_MAX) {
+            memcpy(&rtu_buf[rtu_len], data_p, len);
+            rtu_len += len;
+            rtu_crc = crc16_update(rtu_crc, data_p, len);
+        } else {
+            mb_rx_state = MB_RX_ERR;
+        }
+        break;
+    }
+}
+
+/**
+ * Frame end for ports with a receiver timeout of their own, 
+ * takes the place of the t3.5 timer expiring. Ports with an 
+ * idle line interrupt use mb_timer_line_idle() instead.
+ */
+void mb_rtu_recv_end()
+{
+    mb_timer_disable();
+    mb_rtu_T35_expired();
+}
+
 /**
  * Get the redundancy verify value in the data, 
  * judge whether the received data frame is incorrect (valid).
@@ -209,13 +325,12 @@ void mb_rtu_recv_bytes(uint8_t byte)
  */
 uint8_t mb_rtu_frame_valid()
 {
-    uint16_t _crc16 = 0xFFFF;
-
-    assert(rtu_len < RTU_BUF_MAX);
+    assert(rtu_len <= RTU_BUF_MAX);
 
+    /*The CRC was accumulated while the bytes arrived, 
+    over the whole frame including its CRC field it is 0*/
     if (rtu_len >= RTU_BUF_MIN) {
-        _crc16 = crc16(rtu_buf, rtu_len);
-        if (_crc16 == 0x0000)
+        if (rtu_crc == 0x0000)
             return true;
     }
     return false;
@@ -254,7 +369,8 @@ uint8_t mb_rtu_read_slave_addr()
 
 /**
  * Extract the PDU message and function code to be executed 
- * from the complete data frame sent by the main device.
+ * from the complete data frame sent by the main device. 
+ * The data field is not copied, handlers work on it in rtu_buf.
  */
 void mb_rtu_read_pdu_data_frame()
 {
@@ -269,10 +385,6 @@ void mb_rtu_read_pdu_data_frame()
 
     recv_fun_code = \
         rtu_buf[FUN_CODE_INDEX];
-
-    memcpy(pdu_data, 
-        &rtu_buf[PDU_DATA_INDEX], 
-        data_len);
 }
 
 /**
@@ -286,102 +398,152 @@ uint8_t mb_rtu_read_pdu_fun_code()
 /**
  * The complete parsing of the data frame sent by the main device, 
  * and processing of the request of the main device, 
- * the function placed in a main loop repeated execution.
+ * the function placed in a main loop repeated execution. 
+ * A received frame is checked, executed and the reply started 
+ * in one pass, the reply then goes out from its own buffer.
  */
 void mb_rtu_pdu_field_deal()
 {
-    /*Check if the protocol stack is ready.*/
-    if (mb_task == MB_END) return;
-
-    uint8_t valid = 0;
-    uint8_t _valid = 0;
     uint8_t code = 0;
+    uint8_t * buf_p = NULL;
+    bool silent = false;
 
-    switch (mb_task) {
-    case MB_READY:
-        break;
-
-    case MB_FRAME_RECEIVED:
+    if (mb_task != MB_FRAME_RECEIVED) return;
 
-        /*Length and CRC check*/
-        valid = mb_rtu_frame_valid();
-
-        /*Check if the frame is for us. If not ignore the frame.*/
-        _valid = mb_rtu_slave_addr_valid();
-
-        if ((valid) && (_valid)) {
-            mb_rtu_read_pdu_data_frame();
-            mb_task = MB_EXECUTE;
-        } else {
-            rtu_len = 0;
-            mb_task = MB_END;
-            mb_rx_state = MB_RX_IDLE;
-        }
-        break;
+    /*The reply can only move over once the 
+    transmitter released the other buffer*/
+    if (mb_tx_state != MB_TX_IDLE) return;
 
-    case MB_EXECUTE:
-        code = mb_rtu_read_pdu_fun_code();
-
-        mb_rtu_fun_handlers(
-            code, pdu_data, 
-            &data_len);
-
-        mb_rtu_build_send_frames(
-            pdu_data, data_len);
-
-        mb_task = MB_FRAME_SENT;
-        break;
+    /*Length and CRC check, and check if the frame 
+    is for us. If not ignore the frame.*/
+    if (!mb_rtu_frame_valid()) {
+        diag.bus_crc_err++;
+        rtu_len = 0;
+        mb_task = MB_END;
+        return;
+    }
+    if (!mb_rtu_slave_addr_valid()) {
+        diag.wrong_addr++;
+        rtu_len = 0;
+        mb_task = MB_END;
+        return;
+    }
 
-    case MB_FRAME_SENT:
-        mb_rtu_send_bytes(
-            rtu_buf, rtu_len);
+    diag.slave_msg++;
+    mb_rtu_read_pdu_data_frame();
+    mb_task = MB_EXECUTE;
 
-        mb_tx_state = MB_TX_IDLE;
+    code = mb_rtu_read_pdu_fun_code();
 
+    /*Listen only mode waits for the restart, 
+    that is not answered either*/
+    silent = listen_only;
+    if (silent && ((code != 0x08) || 
+        (rtu_buf[PDU_DATA_INDEX + 0] != (DIAG_RESTART >> 8)) || 
+        (rtu_buf[PDU_DATA_INDEX + 1] != (DIAG_RESTART & 0xFF)))) {
+        diag.no_resp++;
         rtu_len = 0;
-        mb_rx_state = MB_RX_IDLE;
-
         mb_task = MB_END;
-        break;
+        return;
+    }
 
-    case MB_END:
-        break;
+    /*Handlers read the request and write the 
+    reply at the same PDU offset of rtu_buf*/
+    mb_rtu_fun_handlers(
+        code, &rtu_buf[PDU_DATA_INDEX], 
+        &data_len);
+
+    silent |= listen_only;
+    silent |= (recv_slave_addr == BROADCAST_ADDRESS);
+
+    /*Broadcasts and listen only mode are never answered*/
+    if (silent || !mb_rtu_build_send_frames(data_len)) {
+        diag.no_resp++;
+    } else {
+        /*Hand the reply to the transmitter, 
+        receive into the buffer it released*/
+        buf_p = tx_buf;
+        tx_buf = rtu_buf;
+        tx_len = rtu_len;
+        rtu_buf = buf_p;
+
+        mb_rtu_turnaround_update();
+
+        if (!mb_rtu_send_bytes(tx_buf, tx_len))
+            mb_tx_state = MB_TX_IDLE;
     }
+
+    rtu_len = 0;
+    mb_task = MB_END;
 }
 
-/*Defines the number of operational interfaces*/
-#define FUN_HANDLER_MAX 5U
+/**
+ * Set the rate of the port timestamps, the turnaround 
+ * time is reported in microseconds.
+ * @param rate Port ticks per microsecond, see mb_rtu_port_ticks().
+ */
+void mb_rtu_set_tick_rate(uint32_t rate)
+{
+    if (rate > 0) ticks_per_us = rate;
+}
+
+/**
+ * Turnaround time from the end of a request frame to 
+ * the start of its reply, over all replies sent.
+ * @param stat_p Receives a copy of the statistics.
+ */
+void mb_rtu_turnaround_get(mb_rtu_turnaround_t * stat_p)
+{
+    *stat_p = turnaround;
+}
+
+/**
+ * Bus quality counters, also served by function 0x08 and 
+ * in full width through the input registers.
+ * @param diag_p Receives a copy of the counters.
+ */
+void mb_rtu_diag_get(mb_rtu_diag_t * diag_p)
+{
+    *diag_p = diag;
+}
 
 /**
  * The actual function processing/operation interface is added here, 
  * pay attention to the proper use of Modbus standard function code, 
- * comply with the industry-wide function code allocation standards.
+ * comply with the industry-wide function code allocation standards. 
+ * Indexed by the function code, codes without a handler are NULL. 
+ * The map has no coils or discrete inputs, 0x01, 0x02, 0x05 
+ * and 0x0F answer with an illegal function.
  */
-static mb_req_ll_t req_lls[FUN_HANDLER_MAX] = {0};
-static uint8_t req_cnt = 0;
+static req_opi_t req_tab[FUN_CODE_MAX] = {
+    [0x03] = mb_rtu_read_reg_data,
+    [0x04] = mb_rtu_read_input_data,
+    [0x06] = mb_rtu_write_single_reg_data,
+    [0x08] = mb_rtu_diag_data,
+    [0x10] = mb_rtu_write_reg_data,
+    [0x14] = mb_rtu_read_file_data,
+    [0x16] = mb_rtu_mask_write_reg_data,
+    [0x17] = mb_rtu_rw_reg_data,
+};
 
 /**
- * Add a actual operation callback function to the callback list.
- * @param _code The interval between callback functions being executed.
- * @param req_p pointer to a task callback function.
+ * Add or replace the operation callback function of a function code. 
+ * This is the extension point for codes the table above leaves 
+ * out or an application wants to handle itself, a port registers 
+ * them once before mb_rtu_mode_init().
+ * @param _code Function code handled by the callback, 1 to 127.
+ * @param req_p pointer to a task callback function, NULL removes the handler.
  * @return The result of a match.
  */
 bool _mb_rtu_xcall_register(const uint8_t _code, req_opi_t req_p)
 {
-    while ((req_lls[req_cnt].req_opi != NULL) && 
-        (req_cnt < FUN_HANDLER_MAX)) req_cnt++;
-
-    if (req_cnt > FUN_HANDLER_MAX) return false;
+    if ((_code == 0) || (_code >= FUN_CODE_MAX)) return false;
 
-    req_lls[req_cnt].req_opi = req_p;
-    req_lls[req_cnt].fun_code = _code;
+    req_tab[_code] = req_p;
 
     return true;
 }
 
-/*_mb_rtu_xcall_register(0x03, mb_rtu_read_reg_data);*/
-/*_mb_rtu_xcall_register(0x10, mb_rtu_write_reg_data);*/
-
 /**
  * The slave device performs the corresponding request according 
  * to the function code specified by the master device.
@@ -395,24 +557,14 @@ void mb_rtu_fun_handlers(uint8_t fun_code,
     uint8_t * pdu_data_frame_p, 
     uint16_t * pdu_data_len)
 {
-    mb_res_t mb_res = MB_RES_NONE;
-
-    for (uint8_t i = 0; i < FUN_HANDLER_MAX; i++) {
+    mb_res_t mb_res = MB_RES_ILLEGAL_FUNCTION;
 
-        uint8_t _fun_code = \
-            req_lls[i].fun_code;
+    /*Bit 7 is reserved for exception replies*/
+    if (fun_code < FUN_CODE_MAX) {
+        req_opi_t req_opi = req_tab[fun_code];
 
-        if (_fun_code == fun_code) {
-            mb_res = req_lls[i]\
-                .req_opi(pdu_data_frame_p, 
-                    pdu_data_len);
-            break;
-        } 
-        else 
-        /*No more function handlers registered. Abort.*/
-        if (!_fun_code) {
-            break;
-        }
+        if (req_opi != NULL) mb_res = req_opi(
+            pdu_data_frame_p, pdu_data_len);
     }
 
     /* If the request was not sent to the broadcast address we
@@ -421,6 +573,7 @@ void mb_rtu_fun_handlers(uint8_t fun_code,
     {
         /*An exception occured. Build an error frame.*/
         if (mb_res != MB_RES_NONE) {
+            diag.exception++;
             recv_fun_code = \
                 recv_fun_code | (0x01 << 7);
             (*pdu_data_len) = 0;
@@ -434,14 +587,14 @@ void mb_rtu_fun_handlers(uint8_t fun_code,
 /**
  * After the request is processed from the equipment, 
  * a standard message is constructed according to the corresponding data 
- * required by the main equipment to reply to the request of the main equipment.
- * @param pdu_data_frame_p Points to an area of the cached data frame 
- * that belongs to the receiving and sending shared space.
+ * required by the main equipment to reply to the request of the main equipment. 
+ * The handler already left the reply data at the PDU offset of rtu_buf, 
+ * only the header and the CRC are filled in around it.
  * @param pdu_data_len This parameter describes the number of 
- * bytes in the frame of data received or to be sent.
+ * bytes in the frame of data to be sent.
+ * @return Whether a reply frame was built.
  */
-void mb_rtu_build_send_frames(uint8_t * pdu_data_frame_p, 
-    uint16_t pdu_data_len)
+bool mb_rtu_build_send_frames(uint16_t pdu_data_len)
 {
     uint16_t _crc16 = 0x0000;
 
@@ -450,25 +603,17 @@ void mb_rtu_build_send_frames(uint8_t * pdu_data_frame_p,
      * slow with processing the received frame and the master sent another
      * frame on the network. We have to abort sending the frame.
      */
-    if (mb_rx_state != MB_RX_IDLE) return;
-
-    rtu_len = 0;
+    if (mb_rx_state != MB_RX_IDLE) return false;
+    if ((pdu_data_len + 4U) > RTU_BUF_MAX) return false;
 
     /*First byte before the Modbus-PDU is the slave address.*/
-    rtu_buf[rtu_len] = \
+    rtu_buf[SLAVE_ADDR_INDEX] = \
         mb_rtu_read_slave_addr();
-    rtu_len += 1;
 
-    rtu_buf[rtu_len] = \
+    rtu_buf[FUN_CODE_INDEX] = \
         mb_rtu_read_pdu_fun_code();
-    rtu_len += 1;
 
-    if ((pdu_data_len + 4) < RTU_BUF_MAX) {
-        memcpy(&rtu_buf[rtu_len], 
-            pdu_data_frame_p, 
-            pdu_data_len);
-        rtu_len += pdu_data_len;
-    }
+    rtu_len = PDU_DATA_INDEX + pdu_data_len;
 
     /*Calculate CRC16 checksum for Modbus-Serial-Line-PDU.*/
     _crc16 = crc16(rtu_buf, rtu_len);
@@ -483,6 +628,17 @@ void mb_rtu_build_send_frames(uint8_t * pdu_data_frame_p,
 
     /*Activate the transmitter.*/
     mb_tx_state = MB_TX_XMIT;
+
+    return true;
+}
+
+/**
+ * Modbus protocol 1.5 character interval, a character after it 
+ * breaks the frame being received. Called from the timer interrupt.
+ */
+void mb_rtu_T15_expired()
+{
+    if (mb_rx_state == MB_RX_RCV) rx_gap = true;
 }
 
 /**
@@ -505,10 +661,17 @@ void mb_rtu_T35_expired()
      * a new frame was received.*/
     case MB_RX_RCV:
         mb_rx_state = MB_RX_END;
+        rx_end_ticks = mb_rtu_port_ticks();
+        diag.bus_msg++;
+        /*Group setpoints take effect on this edge, not when the 
+        main loop gets around to it, and are never answered*/
+        if (mb_rtu_group_frame()) break;
         mb_task = MB_FRAME_RECEIVED;
         break;
     /* An error occured while receiving the frame. */
     case MB_RX_ERR:
+        diag.bus_msg++;
+        if (!rx_gap) diag.overrun++;
         break;
     }
 
@@ -516,3 +679,139 @@ void mb_rtu_T35_expired()
     indicating the end of one frame of data*/
     mb_rx_state = MB_RX_IDLE;
 }
+
+/**********************
+ *   STATIC FUNCTIONS
+ **********************/
+
+/**
+ * Latches a group setpoint write at the frame end. Every slave on 
+ * the bus sees the line go idle within a character time, so the 
+ * setpoints of all drives change at one common instant.
+ * @return Whether the frame was a group write and is consumed.
+ */
+static bool mb_rtu_group_frame()
+{
+    if (!mb_rtu_frame_valid()) return false;
+
+    if ((rtu_buf[SLAVE_ADDR_INDEX] != BROADCAST_ADDRESS) || 
+        (rtu_buf[FUN_CODE_INDEX] != MB_GROUP_WRITE_CODE))
+        return false;
+
+    diag.slave_msg++;
+    diag.no_resp++;
+    if (listen_only) return true;
+
+    mb_rtu_group_latch(init_slave_addr, &rtu_buf[PDU_DATA_INDEX], 
+        rtu_len - SLAVE_ADDR_BYTE_SIZE - FUNCODE_BYTE_SIZE - CRC_BYTE_SIZE);
+
+    return true;
+}
+
+/**
+ * Accounts the turnaround of the reply about to start.
+ */
+static void mb_rtu_turnaround_update()
+{
+    uint32_t us = (mb_rtu_port_ticks() - rx_end_ticks) / ticks_per_us;
+
+    uint8_t bin = 0;
+
+    turnaround.last = us;
+    if (us < turnaround.min) turnaround.min = us;
+    if (us > turnaround.max) turnaround.max = us;
+    turnaround.count++;
+
+    while ((bin < (MB_DIAG_HIST_NUM - 1)) && 
+        (us >= (MB_DIAG_HIST_BASE << bin)))
+        bin++;
+    turnaround.hist[bin]++;
+}
+
+/**
+ * Clears the bus quality counters and the turnaround statistics.
+ */
+static void mb_rtu_diag_clear()
+{
+    memset(&diag, 0, sizeof(diag));
+    memset(&turnaround, 0, sizeof(turnaround));
+    turnaround.min = UINT32_MAX;
+}
+
+/**
+ * Diagnostics (0x08), the serial line sub-functions. The reply 
+ * echoes the sub-function, counters come back in the data word.
+ * @param pdu_data_frame_p Points to an area of the cached data frame 
+ * that belongs to the receiving and sending shared space.
+ * @param pdu_data_len This parameter describes the number of 
+ * bytes in the frame of data received or to be sent.
+ * @return Get the results from the data.
+ */
+static mb_res_t mb_rtu_diag_data(uint8_t * pdu_data_frame_p, 
+    uint16_t * pdu_data_len)
+{
+    uint16_t sub = 0;
+    uint16_t data = 0;
+    uint32_t val = 0;
+
+    if (*pdu_data_len < 4) return MB_RES_ILLEGAL_DATA_VALUE;
+
+    sub  = pdu_data_frame_p[0] << 8;
+    sub |= pdu_data_frame_p[1];
+    data  = pdu_data_frame_p[2] << 8;
+    data |= pdu_data_frame_p[3];
+
+    /*The query data is echoed whatever its length*/
+    if (sub == DIAG_RETURN_QUERY) return MB_RES_NONE;
+
+    if (*pdu_data_len != 4) return MB_RES_ILLEGAL_DATA_VALUE;
+
+    switch (sub) {
+    case DIAG_RESTART:
+        if ((data != 0x0000) && 
+            (data != DIAG_RESTART_CLEAR_LOG))
+            return MB_RES_ILLEGAL_DATA_VALUE;
+        listen_only = false;
+        mb_rtu_diag_clear();
+        return MB_RES_NONE;
+
+    case DIAG_LISTEN_ONLY:
+        if (data != 0x0000) return MB_RES_ILLEGAL_DATA_VALUE;
+        listen_only = true;
+        return MB_RES_NONE;
+
+    case DIAG_CLEAR:
+        if (data != 0x0000) return MB_RES_ILLEGAL_DATA_VALUE;
+        mb_rtu_diag_clear();
+        return MB_RES_NONE;
+
+    case DIAG_CLEAR_OVERRUN:
+        if (data != 0x0000) return MB_RES_ILLEGAL_DATA_VALUE;
+        diag.overrun = 0;
+        return MB_RES_NONE;
+
+    /*No diagnostic register bits, no NAK or busy replies*/
+    case DIAG_RETURN_REG:
+    case DIAG_SLAVE_NAK:
+    case DIAG_SLAVE_BUSY:
+        val = 0;
+        break;
+
+    case DIAG_BUS_MSG:       val = diag.bus_msg;     break;
+    case DIAG_BUS_CRC_ERR:   val = diag.bus_crc_err; break;
+    case DIAG_BUS_EXCEPTION: val = diag.exception;   break;
+    case DIAG_SLAVE_MSG:     val = diag.slave_msg;   break;
+    case DIAG_SLAVE_NO_RESP: val = diag.no_resp;     break;
+    case DIAG_BUS_OVERRUN:   val = diag.overrun;     break;
+
+    default:
+        return MB_RES_ILLEGAL_FUNCTION;
+    }
+
+    if (data != 0x0000) return MB_RES_ILLEGAL_DATA_VALUE;
+
+    pdu_data_frame_p[2] = (uint8_t)(val >> 8);
+    pdu_data_frame_p[3] = (uint8_t)(val >> 0);
+
+    return MB_RES_NONE;
+}
@@ -53,6 +53,9 @@
 #define FUNCODE_BYTE_SIZE 1U
 #define CRC_BYTE_SIZE 2U
 
+/*Function codes 128 and up are exception replies*/
+#define FUN_CODE_MAX 128U
+
 #define SLAVE_ADDR_INDEX 0U
 #define FUN_CODE_INDEX 1U
 #define PDU_DATA_INDEX 2U
@@ -94,6 +97,34 @@ enum {
 
 typedef uint8_t mb_task_t;
 
+/**
+ * Time from the end of a request frame, as the port detected it, 
+ * to the start of the reply transmission.
+ */
+typedef struct {
+    uint32_t last;  /**< [us]*/
+    uint32_t min;   /**< UINT32_MAX before the first reply*/
+    uint32_t max;
+    uint32_t count; /**< Replies measured*/
+    uint32_t hist[MB_DIAG_HIST_NUM]; /**< See MB_DIAG_HIST_BASE*/
+} mb_rtu_turnaround_t;
+
+/**
+ * Bus quality counters, the serial line counters of function 0x08. 
+ * They run from power up or the last clear and wrap around, 0x08 
+ * returns the low 16 bits.
+ */
+typedef struct {
+    uint32_t bus_msg;     /**< Frames seen on the bus*/
+    uint32_t bus_crc_err; /**< Frames failing the length or CRC check*/
+    uint32_t exception;   /**< Exception replies sent*/
+    uint32_t slave_msg;   /**< Requests for this slave, broadcasts included*/
+    uint32_t no_resp;     /**< Requests for this slave left unanswered*/
+    uint32_t overrun;     /**< Frames lost to an overrun or a busy slave*/
+    uint32_t wrong_addr;  /**< Intact frames for other slaves*/
+    uint32_t char_gap;    /**< Frames broken by a gap over t1.5*/
+} mb_rtu_diag_t;
+
 /**********************
  * GLOBAL PROTOTYPES
  **********************/
@@ -102,8 +133,11 @@ void mb_rtu_mode_init(uint8_t slave_addr, uint32_t baud_rate);
 void mb_rtu_start();
 void mb_rtu_stop();
 bool mb_rtu_set_slave_addr(uint8_t slave_addr);
-void mb_rtu_send_bytes(uint8_t * data_p, uint16_t len);
+bool mb_rtu_send_bytes(uint8_t * data_p, uint16_t len);
+void mb_rtu_send_end();
 void mb_rtu_recv_bytes(uint8_t byte);
+void mb_rtu_recv_block(const uint8_t * data_p, uint16_t len);
+void mb_rtu_recv_end();
 uint8_t mb_rtu_frame_valid();
 uint8_t mb_rtu_slave_addr_valid();
 uint8_t mb_rtu_read_slave_addr();
@@ -112,7 +146,28 @@ uint8_t mb_rtu_read_pdu_fun_code();
 void mb_rtu_pdu_field_deal();
 bool _mb_rtu_xcall_register(const uint8_t _code, req_opi_t req_p);
 void mb_rtu_fun_handlers(uint8_t fun_code, uint8_t * pdu_data_frame_p, uint16_t * pdu_data_len);
-void mb_rtu_build_send_frames(uint8_t * pdu_data_frame, uint16_t pdu_data_len);
+bool mb_rtu_build_send_frames(uint16_t pdu_data_len);
+void mb_rtu_set_tick_rate(uint32_t rate);
+void mb_rtu_turnaround_get(mb_rtu_turnaround_t * stat_p);
+void mb_rtu_diag_get(mb_rtu_diag_t * diag_p);
+void mb_rtu_T15_expired();
 void mb_rtu_T35_expired();
 
+/**
+ * Transmit hook implemented by the serial port, starts sending 
+ * the frame and returns. The port calls mb_rtu_send_end() once 
+ * the last byte is out.
+ * @param data_p Points to the frame, stays valid until mb_rtu_send_end().
+ * @param len Number of bytes in the frame.
+ * @return Whether the transmission was started.
+ */
+bool mb_rtu_port_send(const uint8_t * data_p, uint16_t len);
+
+/**
+ * Timestamp hook implemented by the port, a free running 
+ * counter wrapping at 2^32, see mb_rtu_set_tick_rate().
+ * @return Counter value.
+ */
+uint32_t mb_rtu_port_ticks();
+
 #endif /*__MBRTU_H__*/
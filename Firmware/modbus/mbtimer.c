@@ -13,14 +13,41 @@
  *      DEFINES
  *********************/
 
-#define MB_TIMEOUT_INVALID (65535U)
+/*Start, 8 data, parity or second stop, stop*/
+#define MB_CHAR_BITS 11U
+
+#define NS_PER_S 1000000000ULL
+
+/**********************
+ *      TYPEDEFS
+ **********************/
+
+/**Which interval the one-shot timer is running*/
+enum {
+    MB_TIMER_OFF = 0,
+    MB_TIMER_T15,  /**< Up to t1.5 after the last character*/
+    MB_TIMER_T35   /**< From t1.5 up to t3.5*/
+};
+
+typedef uint8_t mb_timer_phase_t;
+
+/**********************
+ *  STATIC PROTOTYPES
+ **********************/
+
+static uint32_t mb_timer_ticks(uint64_t ns);
+static void mb_timer_start(uint32_t elapsed);
 
 /**********************
  *  STATIC VARIABLES
  **********************/
 
-static __IO uint32_t tick50us_inited = 0;
-static __IO uint32_t tick50us_val = 0;
+/*Intervals in ticks of the port timer*/
+static uint32_t char_ticks = 0;
+static uint32_t t15_ticks = 0;
+static uint32_t t35_ticks = 0;
+
+static __IO mb_timer_phase_t timer_phase = MB_TIMER_OFF;
 
 /**********************
  *   GLOBAL FUNCTIONS
@@ -33,66 +60,49 @@ static __IO uint32_t tick50us_val = 0;
  */
 void mb_timer_init(uint32_t baud_rate)
 {
-    /* The timer reload value for a character is given by:
-     *
-     * ChTimeValue = Ticks_per_1s / ( Baudrate / 11 )
-     *             = 11 * Ticks_per_1s / Baudrate
-     *             = 220000 / Baudrate
-     * The reload for t3.5 is 1.5 times this value 
-     * and similary for t3.5.
-     */
-    uint32_t val = (
-        7UL * 220000UL
-    ) / (2UL * baud_rate);
-
     /**
-     * If baudrate > 19200 then we should use the fixed 
-     * timer values t35 = 1750us. Otherwise t35 must be 
-     * 3.5 times the character time.
+     * The character time is kept in ns, at 3 Mbaud 11 bits take 
+     * 3667ns and a coarse tick would round t1.5 and t3.5 into one. 
+     * Both follow from the character time at every baud rate, the 
+     * fixed 750us/1750us recommended above 19200 baud cap a fast 
+     * bus at a few hundred frames per second. Use mb_timer_set() 
+     * where a slow master needs them.
      */
-    uint32_t _val = (
-        baud_rate > 19200
-    ) ? 35 : val;
+    uint64_t char_ns = (
+        MB_CHAR_BITS * NS_PER_S + baud_rate / 2
+    ) / baud_rate;
 
-    tick50us_inited = _val;
+    char_ticks = mb_timer_ticks(char_ns);
+    t15_ticks = mb_timer_ticks(char_ns * 3 / 2);
+    t35_ticks = mb_timer_ticks(char_ns * 7 / 2);
 }
 
 /**
- * The frame interval timer updates the function, placing
- * the function intoa timed interrupt function to execute.
+ * Overrides the intervals derived from the baud rate.
+ * @param t15_ns Longest gap between characters of a frame, 
+ * 0 turns the check off.
+ * @param t35_ns Silence that ends a frame.
+ * @return Whether the intervals were taken.
  */
-void mb_timer_tick_callback()
+bool mb_timer_set(uint32_t t15_ns, uint32_t t35_ns)
 {
-    if (tick50us_val == 
-        MB_TIMEOUT_INVALID)
-        return;
+    uint32_t t15 = mb_timer_ticks(t15_ns);
+    uint32_t t35 = mb_timer_ticks(t35_ns);
 
-    /*A frame of data received, off the timer, 
-    ready to process the data*/
-    if (tick50us_val > 0)
-        tick50us_val--;
-    /*If the counter is an unsigned number, 
-    you need to use judgement, otherwise it is 
-    easy to have an abnormal negative value*/
-    
-    if (tick50us_val > 0) return;
-
-    /*tick50us_val = MB_TIMEOUT_INVALID;*/
-    mb_timer_disable();
-
-    /*The packet frame interval is up 
-    and the bus status update begins*/
-    mb_rtu_T35_expired();
+    if ((t35 == 0) || (t15 >= t35)) return false;
+
+    t15_ticks = t15;
+    t35_ticks = t35;
+    return true;
 }
 
 /**
- * Enable a 3.5 character frame interval timer, ready 
- * to receive data frame.
+ * Enable a 3.5 character frame interval timer.
+ * Ready to receive data frame.
  */
 void mb_timer_enable()
 {
-    uint32_t val = tick50us_inited;
-    tick50us_val = val;
+    mb_timer_start(0);
 }
 
 /**
@@ -101,8 +111,7 @@ void mb_timer_enable()
  */
 void mb_timer_reload()
 {
-    uint32_t val = tick50us_inited;
-    tick50us_val = val;
+    mb_timer_start(0);
 }
 
 /**
@@ -112,6 +121,81 @@ void mb_timer_reload()
  */
 void mb_timer_disable()
 {
-    tick50us_val = \
-        MB_TIMEOUT_INVALID;
+    timer_phase = MB_TIMER_OFF;
+    mb_timer_port_stop();
+}
+
+/**
+ * The port saw the line idle for one character after the last 
+ * one, a USART idle line interrupt. Times the rest of t1.5 and 
+ * t3.5, or ends the frame at once if t3.5 is that short.
+ */
+void mb_timer_line_idle()
+{
+    if (t35_ticks <= char_ticks) {
+        mb_rtu_recv_end();
+        return;
+    }
+
+    mb_timer_start(char_ticks);
+}
+
+/**
+ * The one-shot timer of the port expired, 
+ * used in the timer interrupt.
+ */
+void mb_timer_expired()
+{
+    switch (timer_phase) {
+    case MB_TIMER_T15:
+        /*Characters from now on break the frame*/
+        timer_phase = MB_TIMER_T35;
+        mb_timer_port_start(t35_ticks - t15_ticks);
+        mb_rtu_T15_expired();
+        break;
+
+    case MB_TIMER_T35:
+        /*The packet frame interval is up 
+        and the bus status update begins*/
+        timer_phase = MB_TIMER_OFF;
+        mb_rtu_T35_expired();
+        break;
+
+    default:
+        break;
+    }
+}
+
+/**********************
+ *   STATIC FUNCTIONS
+ **********************/
+
+/**
+ * Converts a time to port timer ticks, rounded up 
+ * so an interval is never shorter than asked for.
+ * @param ns Time in ns.
+ * @return Ticks of MB_TIMER_TICK_HZ.
+ */
+static uint32_t mb_timer_ticks(uint64_t ns)
+{
+    return (uint32_t)((ns * MB_TIMER_TICK_HZ + NS_PER_S - 1) / NS_PER_S);
+}
+
+/**
+ * Starts timing the silence after a character.
+ * @param elapsed Ticks of silence that already passed.
+ */
+static void mb_timer_start(uint32_t elapsed)
+{
+    if ((t15_ticks > elapsed) && (t15_ticks > 0)) {
+        timer_phase = MB_TIMER_T15;
+        mb_timer_port_start(t15_ticks - elapsed);
+        return;
+    }
+
+    /*The character gap check is off, or 
+    the port already waited past t1.5*/
+    if ((t15_ticks > 0) && (elapsed >= t15_ticks)) mb_rtu_T15_expired();
+    timer_phase = MB_TIMER_T35;
+    mb_timer_port_start(t35_ticks - elapsed);
 }
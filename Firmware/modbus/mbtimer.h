@@ -10,6 +10,7 @@
  *      INCLUDES
  *********************/
 
+#include <stdbool.h>
 #include <stdint.h>
 #include "mbrtu.h"
 
@@ -21,6 +22,12 @@
 #define __IO volatile
 #endif
 
+/**
+ * Clock of the one-shot timer the port provides, 0.5us. 
+ * t1.5 at 3 Mbaud is 11 ticks of it.
+ */
+#define MB_TIMER_TICK_HZ 2000000U
+
 /**********************
  *      TYPEDEFS
  **********************/
@@ -30,13 +37,22 @@
  **********************/
 
 /**
- * Initialize timer to set 3.5 character time 
+ * Initialize timer to set 1.5 and 3.5 character time 
  * according to the communication baud rate 
  * and slave device baud rate.
  * @param baud_rate slave device baud rate.
  */
 void mb_timer_init(uint32_t baud_rate);
 
+/**
+ * Overrides the intervals derived from the baud rate.
+ * @param t15_ns Longest gap between characters of a frame, 
+ * 0 turns the check off.
+ * @param t35_ns Silence that ends a frame.
+ * @return Whether the intervals were taken.
+ */
+bool mb_timer_set(uint32_t t15_ns, uint32_t t35_ns);
+
 /**
  * Overloading the 3.5 character time to restart 
  * the timer, For next frame interval control.
@@ -57,10 +73,29 @@ void mb_timer_enable();
 void mb_timer_disable();
 
 /**
- * The frame interval timer updates the function, 
- * placing the function into a timed interrupt 
- * function to execute.
+ * The port saw the line idle for one character after 
+ * the last one, times the rest of t1.5 and t3.5.
+ */
+void mb_timer_line_idle();
+
+/**
+ * The one-shot timer of the port expired, 
+ * placing the function into the timer interrupt.
+ */
+void mb_timer_expired();
+
+/**
+ * One-shot timer hook implemented by the port, restarts the 
+ * timer to call mb_timer_expired() once after the given time. 
+ * Its interrupt must not preempt the receive interrupt or 
+ * the other way round.
+ * @param ticks Time in ticks of MB_TIMER_TICK_HZ, at least 1.
+ */
+void mb_timer_port_start(uint32_t ticks);
+
+/**
+ * Stops the one-shot timer of the port without expiring.
  */
-void mb_timer_tick_callback();
+void mb_timer_port_stop();
 
 #endif /*__MBTIMER_H__*/
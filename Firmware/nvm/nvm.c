@@ -0,0 +1,384 @@
+/**
+ * @file nvm.c
+ *
+ */
+
+/*********************
+ *      INCLUDES
+ *********************/
+
+#include <string.h>
+#include "nvm.h"
+#include "crc16.h"
+
+/*********************
+ *      DEFINES
+ *********************/
+
+#define NVM_MAGIC 0x314D564EU /*"NVM1"*/
+
+#define NVM_ERASED 0xFFFFFFFFU
+
+/*Record length in flash, header and padded data*/
+#define NVM_REC_SIZE(len) (sizeof(nvm_rec_t) + (((len) + 3U) & ~3U))
+
+/*Words programmed per step when a value is appended*/
+#define NVM_CHUNK_WORDS 16U
+
+/**********************
+ *      TYPEDEFS
+ **********************/
+
+/**
+ * Start of a sector, valid once compaction into it is complete.
+ */
+typedef struct {
+    uint32_t magic;
+    uint32_t seq;     /**< Higher is newer, counts the compactions*/
+    uint32_t seq_inv; /**< ~seq*/
+} nvm_head_t;
+
+/**
+ * Start of a record, the data follows.
+ */
+typedef struct {
+    uint16_t key;
+    uint16_t len;  /**< Data bytes, 0 deletes the key*/
+    uint16_t crc;  /**< Over key, len and data*/
+    uint16_t rsvd; /**< Left erased*/
+} nvm_rec_t;
+
+/**********************
+ *  STATIC PROTOTYPES
+ **********************/
+
+static bool nvm_head_valid(const nvm_head_t * head_p);
+static bool nvm_rec_sane(const nvm_rec_t * rec_p, uint32_t ofs);
+static uint16_t nvm_rec_crc(const nvm_rec_t * rec_p, const uint8_t * data_p);
+static void nvm_scan();
+static bool nvm_format(uint8_t sector, uint32_t seq);
+static bool nvm_compact();
+static bool nvm_store(nvm_key_t key, const void * data_p, uint16_t len);
+static bool nvm_append(nvm_key_t key, const uint8_t * data_p, uint16_t len);
+
+/**********************
+ *  STATIC VARIABLES
+ **********************/
+
+static bool nvm_ready = false;
+static uint8_t active = 0;       /*Sector records are appended to*/
+static uint32_t active_seq = 0;
+static uint32_t append_ofs = 0;  /*First free byte of the active sector*/
+
+/*Offset of the newest record of every key, 0 if there is none*/
+static uint32_t index_ofs[NVM_KEY_NUM] = {0};
+
+/**********************
+ *   GLOBAL FUNCTIONS
+ **********************/
+
+/**
+ * Picks the newest sector and builds the index,
+ * formats the store if no sector is valid.
+ * @return Whether stored parameters were found, false
+ * on a blank or damaged store.
+ */
+bool nvm_init()
+{
+    const nvm_head_t * head_p = NULL;
+    bool found = false;
+
+    nvm_ready = false;
+
+    for (uint8_t sector = 0; sector < NVM_SECTOR_NUM; sector++) {
+        head_p = (const nvm_head_t *)nvm_port_sector(sector);
+        if (!nvm_head_valid(head_p)) continue;
+
+        /*Wrapping compare, the sequence outlives the flash anyway*/
+        if (!found || ((int32_t)(head_p->seq - active_seq) > 0)) {
+            active = sector;
+            active_seq = head_p->seq;
+            found = true;
+        }
+    }
+
+    if (!found) {
+        memset(index_ofs, 0, sizeof(index_ofs));
+        nvm_ready = nvm_format(0, 0);
+        return false;
+    }
+
+    nvm_scan();
+    nvm_ready = true;
+    return true;
+}
+
+/**
+ * Zero-copy access to a stored value, it stays valid
+ * until the next write or delete.
+ * @param key Parameter key.
+ * @param len_p Receives the length of the value.
+ * @return The value in flash, NULL if the key is not stored.
+ */
+const void * nvm_get(nvm_key_t key, uint16_t * len_p)
+{
+    const nvm_rec_t * rec_p = NULL;
+
+    if (!nvm_ready || (key == NVM_KEY_NONE) ||
+        (key >= NVM_KEY_NUM) || (index_ofs[key] == 0)
+    ) return NULL;
+
+    rec_p = (const nvm_rec_t *)(nvm_port_sector(active) + index_ofs[key]);
+    *len_p = rec_p->len;
+    return rec_p + 1;
+}
+
+/**
+ * Copies a stored value.
+ * @param key Parameter key.
+ * @param data_p Destination.
+ * @param len Expected length, a value of another length
+ * was written by a different layout and is not copied.
+ * @return Whether the value was copied.
+ */
+bool nvm_read(nvm_key_t key, void * data_p, uint16_t len)
+{
+    uint16_t stored = 0;
+    const void * value_p = nvm_get(key, &stored);
+
+    if ((value_p == NULL) || (stored != len)) return false;
+
+    memcpy(data_p, value_p, len);
+    return true;
+}
+
+/**
+ * Stores a value. An unchanged value is not written again.
+ * A full sector is compacted first, which erases the other
+ * sector and stalls code running from flash for 1-2 s,
+ * write only with the power stages off.
+ * @param key Parameter key.
+ * @param data_p Value.
+ * @param len Length of the value, 1 ... NVM_VALUE_MAX.
+ * @return Whether the value is stored, on false the
+ * previous value is kept.
+ */
+bool nvm_write(nvm_key_t key, const void * data_p, uint16_t len)
+{
+    uint16_t stored = 0;
+    const void * value_p = nvm_get(key, &stored);
+
+    if ((len == 0) || (data_p == NULL)) return false;
+
+    if ((value_p != NULL) && (stored == len) &&
+        (memcmp(value_p, data_p, len) == 0)
+    ) return true;
+
+    return nvm_store(key, data_p, len);
+}
+
+/**
+ * Removes a key, compaction drops its records.
+ * @param key Parameter key.
+ * @return Whether the key is gone.
+ */
+bool nvm_delete(nvm_key_t key)
+{
+    uint16_t stored = 0;
+
+    if (nvm_get(key, &stored) == NULL)
+        return nvm_ready && (key != NVM_KEY_NONE) && (key < NVM_KEY_NUM);
+
+    return nvm_store(key, NULL, 0);
+}
+
+/**
+ * Space left for records before the next compaction.
+ * @return Bytes, a record takes 8 more than its value.
+ */
+uint32_t nvm_free()
+{
+    if (!nvm_ready) return 0;
+    return NVM_SECTOR_SIZE - append_ofs;
+}
+
+/**********************
+ *   STATIC FUNCTIONS
+ **********************/
+
+static bool nvm_head_valid(const nvm_head_t * head_p)
+{
+    return (head_p->magic == NVM_MAGIC) &&
+        (head_p->seq == ~head_p->seq_inv);
+}
+
+/**
+ * Whether the header can be followed to the next
+ * record, the CRC is not checked.
+ */
+static bool nvm_rec_sane(const nvm_rec_t * rec_p, uint32_t ofs)
+{
+    return (rec_p->key != NVM_KEY_NONE) &&
+        (rec_p->key < NVM_KEY_NUM) &&
+        (rec_p->len <= NVM_VALUE_MAX) &&
+        (ofs + NVM_REC_SIZE(rec_p->len) <= NVM_SECTOR_SIZE);
+}
+
+static uint16_t nvm_rec_crc(const nvm_rec_t * rec_p, const uint8_t * data_p)
+{
+    uint16_t crc = crc16_update(CRC16_INIT, (const uint8_t *)rec_p, 4);
+    return crc16_update(crc, data_p, rec_p->len);
+}
+
+/**
+ * Reads every record of the active sector once,
+ * the last intact record of a key wins.
+ */
+static void nvm_scan()
+{
+    const uint8_t * base_p = nvm_port_sector(active);
+    const nvm_rec_t * rec_p = NULL;
+    uint32_t ofs = sizeof(nvm_head_t);
+
+    memset(index_ofs, 0, sizeof(index_ofs));
+
+    while (ofs + sizeof(nvm_rec_t) <= NVM_SECTOR_SIZE) {
+        rec_p = (const nvm_rec_t *)(base_p + ofs);
+
+        /*Erased, the end of the journal*/
+        if (*(const uint32_t *)rec_p == NVM_ERASED) break;
+
+        /*Nothing behind a damaged length can be trusted,
+        leave no room so the next write compacts*/
+        if (!nvm_rec_sane(rec_p, ofs)) {
+            ofs = NVM_SECTOR_SIZE;
+            break;
+        }
+
+        /*A record torn by a reset is skipped*/
+        if (nvm_rec_crc(rec_p, (const uint8_t *)(rec_p + 1)) == rec_p->crc)
+            index_ofs[rec_p->key] = (rec_p->len > 0) ? ofs : 0;
+
+        ofs += NVM_REC_SIZE(rec_p->len);
+    }
+
+    append_ofs = ofs;
+}
+
+/**
+ * Erases a sector and makes it the active one, empty.
+ */
+static bool nvm_format(uint8_t sector, uint32_t seq)
+{
+    nvm_head_t head = {NVM_MAGIC, seq, ~seq};
+
+    if (!nvm_port_erase(sector)) return false;
+    if (!nvm_port_program(nvm_port_sector(sector),
+        (const uint32_t *)&head, sizeof(head) / 4)) return false;
+    if (!nvm_head_valid((const nvm_head_t *)nvm_port_sector(sector)))
+        return false;
+
+    active = sector;
+    active_seq = seq;
+    append_ofs = sizeof(nvm_head_t);
+    return true;
+}
+
+/**
+ * Copies the newest record of every key into the other sector.
+ * Its header goes in last, until then the old sector is in charge.
+ */
+static bool nvm_compact()
+{
+    uint8_t next = active ^ 1U;
+    const uint8_t * old_p = nvm_port_sector(active);
+    const uint8_t * new_p = nvm_port_sector(next);
+    const nvm_rec_t * rec_p = NULL;
+    uint32_t moved_ofs[NVM_KEY_NUM] = {0};
+    uint32_t ofs = sizeof(nvm_head_t);
+    uint32_t size = 0;
+    nvm_head_t head = {NVM_MAGIC, active_seq + 1, ~(active_seq + 1)};
+
+    if (!nvm_port_erase(next)) return false;
+
+    for (nvm_key_t key = 1; key < NVM_KEY_NUM; key++) {
+        if (index_ofs[key] == 0) continue;
+
+        /*Records are word aligned, copied as they are, CRC included*/
+        rec_p = (const nvm_rec_t *)(old_p + index_ofs[key]);
+        size = NVM_REC_SIZE(rec_p->len);
+        if (!nvm_port_program(new_p + ofs,
+            (const uint32_t *)rec_p, size / 4)) return false;
+
+        moved_ofs[key] = ofs;
+        ofs += size;
+    }
+
+    if (!nvm_port_program(new_p,
+        (const uint32_t *)&head, sizeof(head) / 4)) return false;
+    if (!nvm_head_valid((const nvm_head_t *)new_p)) return false;
+
+    active = next;
+    active_seq = head.seq;
+    append_ofs = ofs;
+    memcpy(index_ofs, moved_ofs, sizeof(index_ofs));
+    return true;
+}
+
+static bool nvm_store(nvm_key_t key, const void * data_p, uint16_t len)
+{
+    uint32_t size = NVM_REC_SIZE(len);
+
+    if (!nvm_ready || (key == NVM_KEY_NONE) ||
+        (key >= NVM_KEY_NUM) || (len > NVM_VALUE_MAX)
+    ) return false;
+
+    if ((append_ofs + size > NVM_SECTOR_SIZE) && !nvm_compact())
+        return false;
+
+    /*Live values alone fill the sector*/
+    if (append_ofs + size > NVM_SECTOR_SIZE) return false;
+
+    return nvm_append(key, (const uint8_t *)data_p, len);
+}
+
+/**
+ * Programs a record behind the last one, header first so
+ * a torn write is found by its CRC on the next scan.
+ */
+static bool nvm_append(nvm_key_t key, const uint8_t * data_p, uint16_t len)
+{
+    const uint8_t * dst_p = nvm_port_sector(active) + append_ofs;
+    const nvm_rec_t * rec_p = (const nvm_rec_t *)dst_p;
+    uint32_t ofs = append_ofs;
+    uint32_t chunk[NVM_CHUNK_WORDS];
+    uint16_t num = 0;
+    nvm_rec_t rec = {key, len, 0, 0xFFFFU};
+
+    rec.crc = nvm_rec_crc(&rec, data_p);
+
+    /*Taken even if programming fails, some bits may be cleared*/
+    append_ofs += NVM_REC_SIZE(len);
+
+    if (!nvm_port_program(dst_p,
+        (const uint32_t *)&rec, sizeof(rec) / 4)) return false;
+    dst_p += sizeof(rec);
+
+    /*The value may be unaligned, it goes through a padded chunk*/
+    for (uint16_t i = 0; i < len; i += num) {
+        num = ((len - i) < (uint16_t)sizeof(chunk)) ? (len - i) : sizeof(chunk);
+        memset(chunk, 0xFF, sizeof(chunk));
+        memcpy(chunk, data_p + i, num);
+
+        if (!nvm_port_program(dst_p, chunk, (num + 3U) / 4)) return false;
+        dst_p += sizeof(chunk);
+    }
+
+    /*Read back, the index only points at intact records*/
+    if ((rec_p->key != key) || (rec_p->len != len) ||
+        (nvm_rec_crc(rec_p, (const uint8_t *)(rec_p + 1)) != rec_p->crc)
+    ) return false;
+
+    index_ofs[key] = (len > 0) ? ofs : 0;
+    return true;
+}
@@ -0,0 +1,99 @@
+/**
+ * @file nvm.h
+ *
+ * Parameter store, a key/value journal on two flash sectors.
+ * A write appends a record behind the last one, the newest record
+ * of a key wins. Only when the sector is full the live records
+ * are copied into the other sector and the full one is given up,
+ * so small updates never erase and both sectors wear evenly.
+ *
+ *  Sector:
+ *  +-------+-----+------+----------+----------+-----+----------+
+ *  | Magic | Seq | ~Seq | Record 0 | Record 1 | ... | 0xFF ... |
+ *  +-------+-----+------+----------+----------+-----+----------+
+ *
+ *  Record, word aligned:
+ *  +-----+-----+-------+------------+---------------------------+
+ *  | Key | Len | CRC16 | 0xFFFF     | Data, 0xFF padded to 4    |
+ *  +-----+-----+-------+------------+---------------------------+
+ *
+ * The CRC16 of the Modbus stack covers key, len and data, a record
+ * torn by a reset fails it and is skipped. The sector header is
+ * written last during compaction, an interrupted compaction leaves
+ * the old sector in charge. A RAM index keeps the newest record of
+ * every key, so loading reads every record once and a read is a
+ * table lookup.
+ */
+
+#ifndef __NVM_H__
+#define __NVM_H__
+
+/*********************
+ *      INCLUDES
+ *********************/
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/*********************
+ *      DEFINES
+ *********************/
+
+#define NVM_SECTOR_NUM  2U
+#define NVM_SECTOR_SIZE (128U * 1024U) /*F405 sectors 10 and 11*/
+
+/*Keys are 1 ... NVM_KEY_NUM - 1*/
+#define NVM_KEY_NUM 32U
+
+/*Largest value, a calibration LUT of 1024 floats*/
+#define NVM_VALUE_MAX 4096U
+
+/**********************
+ *      TYPEDEFS
+ **********************/
+
+/**
+ * Stored parameters. Append new keys, never renumber, a record
+ * found under an old number would be taken for something else.
+ * A value whose layout changes should get a new key.
+ */
+enum {
+    NVM_KEY_NONE = 0,
+    NVM_KEY_SLAVE_ID,       /**< uint8_t, Modbus slave address*/
+    NVM_KEY_DEVDESC,        /**< Device descriptor of the example*/
+    NVM_KEY_M0_GAINS,       /**< Current, velocity, position loop gains*/
+    NVM_KEY_M1_GAINS,
+    NVM_KEY_M0_ENC_OFFSET,  /**< Electrical zero of the encoder*/
+    NVM_KEY_M1_ENC_OFFSET,
+    NVM_KEY_M0_ENC_LUT,     /**< Encoder linearity correction*/
+    NVM_KEY_M1_ENC_LUT,
+    NVM_KEY_M0_PHASE_CAL,   /**< Phase resistance, inductance*/
+    NVM_KEY_M1_PHASE_CAL,
+    NVM_KEY_M0_CALIB,       /**< Calibration checked at boot, boot_calib_t*/
+    NVM_KEY_M1_CALIB,
+    NVM_KEY_CAN_NODE_ID,    /**< uint8_t, CANopen node id*/
+};
+
+typedef uint16_t nvm_key_t;
+
+/**********************
+ * GLOBAL PROTOTYPES
+ **********************/
+
+bool nvm_init();
+const void * nvm_get(nvm_key_t key, uint16_t * len_p);
+bool nvm_read(nvm_key_t key, void * data_p, uint16_t len);
+bool nvm_write(nvm_key_t key, const void * data_p, uint16_t len);
+bool nvm_delete(nvm_key_t key);
+uint32_t nvm_free();
+
+/**
+ * Port hooks, provided by the flash driver. Programming only
+ * clears bits, the store never writes a word twice.
+ */
+const uint8_t * nvm_port_sector(uint8_t sector);
+bool nvm_port_erase(uint8_t sector);
+bool nvm_port_program(const uint8_t * dst_p,
+    const uint32_t * src_p, uint32_t words);
+
+#endif /*__NVM_H__*/
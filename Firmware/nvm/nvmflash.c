@@ -0,0 +1,114 @@
+/**
+ * @file nvmflash.c
+ *
+ * Flash port of the parameter store, the NVM region
+ * of STM32F405RGTx_FLASH.ld, sectors 10 and 11.
+ */
+
+/*********************
+ *      INCLUDES
+ *********************/
+
+#include "stm32f4xx_hal.h"
+#include "nvm.h"
+
+/*********************
+ *      DEFINES
+ *********************/
+
+#define NVM_FLASH_ERRORS (FLASH_FLAG_OPERR | FLASH_FLAG_WRPERR | \
+    FLASH_FLAG_PGAERR | FLASH_FLAG_PGPERR | FLASH_FLAG_PGSERR)
+
+/**********************
+ *  STATIC PROTOTYPES
+ **********************/
+
+static void nvm_flash_cache_reset();
+
+/**********************
+ *  STATIC VARIABLES
+ **********************/
+
+static const uint32_t sector_addr[NVM_SECTOR_NUM] = {
+    0x080C0000U, 0x080E0000U
+};
+
+static const uint32_t sector_nr[NVM_SECTOR_NUM] = {
+    FLASH_SECTOR_10, FLASH_SECTOR_11
+};
+
+/**********************
+ *   GLOBAL FUNCTIONS
+ **********************/
+
+const uint8_t * nvm_port_sector(uint8_t sector)
+{
+    return (const uint8_t *)sector_addr[sector];
+}
+
+/**
+ * Erases one sector, 1-2 s for 128K.
+ * @param sector Sector of the store, 0 or 1.
+ * @return Whether the sector is erased.
+ */
+bool nvm_port_erase(uint8_t sector)
+{
+    FLASH_EraseInitTypeDef erase = {
+        .TypeErase = FLASH_TYPEERASE_SECTORS,
+        .Sector = sector_nr[sector],
+        .NbSectors = 1,
+        .VoltageRange = FLASH_VOLTAGE_RANGE_3, /*2.7 - 3.6V, x32*/
+    };
+    uint32_t fault = 0;
+    HAL_StatusTypeDef res = HAL_ERROR;
+
+    HAL_FLASH_Unlock();
+    __HAL_FLASH_CLEAR_FLAG(FLASH_FLAG_EOP | NVM_FLASH_ERRORS);
+    res = HAL_FLASHEx_Erase(&erase, &fault);
+    HAL_FLASH_Lock();
+
+    return (res == HAL_OK) && (fault == 0xFFFFFFFFU);
+}
+
+/**
+ * Programs words, the destination must be erased.
+ * @param dst_p Word aligned flash address.
+ * @param src_p Words to program.
+ * @param words Number of words.
+ * @return Whether all words are programmed.
+ */
+bool nvm_port_program(const uint8_t * dst_p,
+    const uint32_t * src_p, uint32_t words)
+{
+    uint32_t addr = (uint32_t)dst_p;
+    uint32_t i = 0;
+
+    HAL_FLASH_Unlock();
+    __HAL_FLASH_CLEAR_FLAG(FLASH_FLAG_EOP | NVM_FLASH_ERRORS);
+
+    for (i = 0; i < words; i++) {
+        if (HAL_FLASH_Program(FLASH_TYPEPROGRAM_WORD,
+            addr + i * 4, src_p[i]) != HAL_OK) break;
+    }
+
+    HAL_FLASH_Lock();
+    nvm_flash_cache_reset();
+
+    return i == words;
+}
+
+/**********************
+ *   STATIC FUNCTIONS
+ **********************/
+
+/**
+ * The ART data cache may still hold the erased words.
+ */
+static void nvm_flash_cache_reset()
+{
+    if ((FLASH->ACR & FLASH_ACR_DCEN) == 0) return;
+
+    __HAL_FLASH_DATA_CACHE_DISABLE();
+    __HAL_FLASH_DATA_CACHE_RESET();
+    __HAL_FLASH_DATA_CACHE_ENABLE();
+}
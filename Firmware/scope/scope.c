@@ -0,0 +1,249 @@
+/**
+ * @file scope.c
+ *
+ */
+
+/*********************
+ *      INCLUDES
+ *********************/
+
+#include <stddef.h>
+#include "scope.h"
+
+/**********************
+ *  STATIC PROTOTYPES
+ **********************/
+
+static bool scope_trig_hit(int16_t val);
+
+/**********************
+ *  STATIC VARIABLES
+ **********************/
+
+/*Only the CPU reads it, CCM is fine and keeps the SRAM for DMA*/
+static int16_t buf[SCOPE_BUF_WORDS] __attribute__((section(".ccmram")));
+
+/*Configuration, only changed while stopped*/
+static bool configured = false;
+static telem_ch_t chan_list[SCOPE_CH_MAX] = {0};
+static uint8_t chans = 0;
+static uint16_t depth = 0;
+static uint16_t pre = 0;
+static uint16_t decim = 1;
+static telem_ch_t trig_ch = 0;
+static scope_trig_t trig = SCOPE_TRIG_NONE;
+static int16_t level = 0;
+
+/*Control loop interrupt*/
+static volatile scope_state_t state = SCOPE_IDLE;
+static volatile bool trig_req = false;
+static uint16_t decim_cnt = 0;
+static uint16_t wr = 0;        /*Ring slot of the next sample*/
+static uint16_t filled = 0;    /*Samples in the ring*/
+static uint16_t start = 0;     /*Ring slot of the oldest captured sample*/
+static uint16_t pre_act = 0;
+static uint16_t post_left = 0;
+static int16_t prev = 0;
+static bool prev_valid = false;
+
+/**********************
+ *   GLOBAL FUNCTIONS
+ **********************/
+
+/**
+ * Sets up the capture, stops a running one.
+ * @param cfg_p Channels, decimation and trigger.
+ * @return Whether the configuration is usable,
+ * 1 to SCOPE_CH_MAX existing channels.
+ */
+bool scope_config(const scope_cfg_t * cfg_p)
+{
+    uint8_t n = 0;
+
+    scope_stop();
+
+    if (cfg_p->mask & ~((1UL << TELEM_CH_NUM) - 1)) return false;
+    if (cfg_p->trig_ch >= TELEM_CH_NUM) return false;
+    if (cfg_p->trig >= SCOPE_TRIG_NUM) return false;
+
+    for (telem_ch_t ch = 0; ch < TELEM_CH_NUM; ch++)
+        n += (cfg_p->mask >> ch) & 1U;
+
+    if ((n == 0) || (n > SCOPE_CH_MAX)) return false;
+
+    n = 0;
+    for (telem_ch_t ch = 0; ch < TELEM_CH_NUM; ch++) {
+        if (cfg_p->mask & (1UL << ch)) chan_list[n++] = ch;
+    }
+
+    chans = n;
+    depth = SCOPE_BUF_WORDS / n;
+    pre = (cfg_p->pre < depth) ? cfg_p->pre : depth - 1;
+    decim = (cfg_p->decim == 0) ? 1 : cfg_p->decim;
+    trig_ch = cfg_p->trig_ch;
+    trig = cfg_p->trig;
+    level = cfg_p->level;
+
+    configured = true;
+    return true;
+}
+
+/**
+ * Starts a capture, the last one is dropped.
+ * @return false if not configured.
+ */
+bool scope_arm()
+{
+    if (!configured) return false;
+
+    state = SCOPE_IDLE;
+    __sync_synchronize();
+
+    trig_req = false;
+    decim_cnt = 0;
+    wr = 0;
+    filled = 0;
+    start = 0;
+    pre_act = 0;
+    post_left = 0;
+    prev_valid = false;
+
+    /*The ring must be reset before the interrupt sees it armed*/
+    __sync_synchronize();
+    state = SCOPE_ARMED;
+    return true;
+}
+
+void scope_stop()
+{
+    state = SCOPE_IDLE;
+    __sync_synchronize();
+}
+
+/**
+ * Triggers an armed scope with its next sample, any context.
+ * Fault handlers call it, so the capture shows what led to a trip.
+ */
+void scope_trigger()
+{
+    trig_req = true;
+}
+
+/**
+ * Records one sample, from the control loop interrupt
+ * once per PWM cycle after the signals are updated.
+ */
+void scope_cycle()
+{
+    scope_state_t st = state;
+    int16_t * dst_p = NULL;
+    uint16_t pos = 0;
+    int16_t val = 0;
+    bool hit = false;
+
+    if ((st != SCOPE_ARMED) && (st != SCOPE_TRIGGERED)) return;
+
+    if (++decim_cnt < decim) return;
+    decim_cnt = 0;
+
+    pos = wr;
+    dst_p = &buf[pos * chans];
+
+    for (uint8_t i = 0; i < chans; i++)
+        dst_p[i] = telem_read(chan_list[i]);
+
+    wr = (pos + 1 == depth) ? 0 : pos + 1;
+    if (filled < depth) filled++;
+
+    if (st == SCOPE_TRIGGERED) {
+        if (--post_left == 0) state = SCOPE_DONE;
+        return;
+    }
+
+    /*A condition needs the full pre-trigger history,
+    a fault takes what there is*/
+    val = telem_read(trig_ch);
+    hit = trig_req || ((filled > pre) && scope_trig_hit(val));
+    prev = val;
+    prev_valid = true;
+
+    if (!hit) return;
+
+    pre_act = (filled - 1 < pre) ? filled - 1 : pre;
+    start = (pos + depth - pre_act) % depth;
+    post_left = depth - pre_act - 1;
+
+    state = (post_left == 0) ? SCOPE_DONE : SCOPE_TRIGGERED;
+}
+
+void scope_status_get(scope_status_t * status_p)
+{
+    scope_state_t st = state;
+
+    status_p->state = st;
+    status_p->chans = chans;
+    status_p->depth = depth;
+    status_p->pre = (st >= SCOPE_TRIGGERED) ? pre_act : pre;
+
+    switch (st) {
+    case SCOPE_ARMED:
+        status_p->count = filled;
+        break;
+
+    case SCOPE_TRIGGERED:
+        status_p->count = depth - post_left;
+        break;
+
+    case SCOPE_DONE:
+        status_p->count = depth;
+        break;
+
+    default:
+        status_p->count = 0;
+        break;
+    }
+}
+
+/**
+ * Reads a complete capture in the layout of scope.h.
+ * @param offset First word, sample * chans + channel.
+ * @param num Number of words.
+ * @param dst_p Receives the words.
+ * @return Number of words read, 0 without a complete capture.
+ */
+uint16_t scope_read(uint32_t offset, uint16_t num, int16_t * dst_p)
+{
+    uint32_t total = (uint32_t)depth * chans;
+    uint16_t i = 0;
+
+    if (state != SCOPE_DONE) return 0;
+
+    for (i = 0; (i < num) && (offset + i < total); i++) {
+        uint32_t w = offset + i;
+        uint32_t slot = start + w / chans;
+
+        if (slot >= depth) slot -= depth;
+        dst_p[i] = buf[slot * chans + w % chans];
+    }
+
+    return i;
+}
+
+/**********************
+ *   STATIC FUNCTIONS
+ **********************/
+
+static bool scope_trig_hit(int16_t val)
+{
+    bool up = prev_valid && (prev < level) && (val >= level);
+    bool down = prev_valid && (prev >= level) && (val < level);
+
+    switch (trig) {
+    case SCOPE_TRIG_RISE:  return up;
+    case SCOPE_TRIG_FALL:  return down;
+    case SCOPE_TRIG_EDGE:  return up || down;
+    case SCOPE_TRIG_ABOVE: return val > level;
+    case SCOPE_TRIG_BELOW: return val < level;
+    default:               return false;
+    }
+}
@@ -0,0 +1,95 @@
+/**
+ * @file scope.h
+ *
+ * On-drive scope. Records up to SCOPE_CH_MAX telemetry channels at
+ * the full control rate, or every decim-th cycle, into a ring in CCM
+ * RAM. Once armed the ring runs until the trigger, a level or an edge
+ * of one channel, a fault or a forced trigger, then the samples after
+ * it fill the rest and the capture stops. Readout is independent of
+ * the transport, Modbus file records today.
+ *
+ *  Capture, oldest sample first, channels in ascending order:
+ *  +------+------+-----+------+------+-----+------+-----+
+ *  | S0C0 | S0C1 | ... | S1C0 | S1C1 | ... | SnCm | ... |
+ *  +------+------+-----+------+------+-----+------+-----+
+ *
+ * Values are int16 of the channel scaled as in the telemetry stream,
+ * sample number pre is the trigger.
+ */
+
+#ifndef __SCOPE_H__
+#define __SCOPE_H__
+
+/*********************
+ *      INCLUDES
+ *********************/
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "telem.h"
+
+/*********************
+ *      DEFINES
+ *********************/
+
+/*32K of the 64K CCM*/
+#define SCOPE_BUF_WORDS 16384U
+
+#define SCOPE_CH_MAX 8U
+
+/**********************
+ *      TYPEDEFS
+ **********************/
+
+/**Trigger condition on the trigger channel*/
+enum {
+    SCOPE_TRIG_NONE = 0, /**< Only a fault or scope_trigger()*/
+    SCOPE_TRIG_RISE,     /**< Crosses the level upwards*/
+    SCOPE_TRIG_FALL,     /**< Crosses the level downwards*/
+    SCOPE_TRIG_EDGE,     /**< Crosses the level either way*/
+    SCOPE_TRIG_ABOVE,    /**< Above the level*/
+    SCOPE_TRIG_BELOW,    /**< Below the level*/
+    SCOPE_TRIG_NUM
+};
+
+typedef uint8_t scope_trig_t;
+
+enum {
+    SCOPE_IDLE = 0,  /**< Stopped, nothing captured*/
+    SCOPE_ARMED,     /**< Pre-trigger ring runs, waits for the trigger*/
+    SCOPE_TRIGGERED, /**< Records the samples after the trigger*/
+    SCOPE_DONE       /**< Capture complete, ready for readout*/
+};
+
+typedef uint8_t scope_state_t;
+
+typedef struct {
+    uint32_t mask;        /**< Telemetry channels, bit n is channel n*/
+    uint16_t decim;       /**< Record every decim-th cycle, 0 like 1*/
+    uint16_t pre;         /**< Samples before the trigger*/
+    telem_ch_t trig_ch;   /**< Channel the condition watches*/
+    scope_trig_t trig;    /**< Condition*/
+    int16_t level;        /**< In channel counts*/
+} scope_cfg_t;
+
+typedef struct {
+    scope_state_t state;
+    uint8_t chans;        /**< Channels per sample*/
+    uint16_t depth;       /**< Samples of a capture*/
+    uint16_t pre;         /**< Samples before the trigger, fewer on an early fault*/
+    uint16_t count;       /**< Samples recorded so far*/
+} scope_status_t;
+
+/**********************
+ * GLOBAL PROTOTYPES
+ **********************/
+
+bool scope_config(const scope_cfg_t * cfg_p);
+bool scope_arm();
+void scope_stop();
+void scope_trigger();
+void scope_cycle();
+void scope_status_get(scope_status_t * status_p);
+uint16_t scope_read(uint32_t offset, uint16_t num, int16_t * dst_p);
+
+#endif /*__SCOPE_H__*/
@@ -0,0 +1,329 @@
+/**
+ * @file telem.c
+ *
+ */
+
+/*********************
+ *      INCLUDES
+ *********************/
+
+#include <stddef.h>
+#include <string.h>
+#include "telem.h"
+
+/**********************
+ *      TYPEDEFS
+ **********************/
+
+enum {
+    TELEM_BLOCK_FREE = 0, /**< Empty, next one the interrupt fills*/
+    TELEM_BLOCK_FILL,     /**< The interrupt appends samples*/
+    TELEM_BLOCK_READY,    /**< Complete, waits for the port*/
+    TELEM_BLOCK_SEND      /**< On the wire*/
+};
+
+typedef uint8_t telem_block_state_t;
+
+typedef struct {
+    uint8_t data[TELEM_BLOCK_SIZE] __attribute__((aligned(4)));
+    uint16_t len;
+    uint16_t count;
+    volatile telem_block_state_t state;
+} telem_block_t;
+
+typedef struct {
+    const volatile float * src_p;
+    float scale;
+} telem_chan_t;
+
+/**********************
+ *  STATIC PROTOTYPES
+ **********************/
+
+static void telem_config_apply();
+static void telem_block_close(telem_block_t * blk_p);
+static int16_t telem_pack(const telem_chan_t * chan_p);
+static void telem_put_u16(uint8_t * p, uint16_t v);
+static void telem_put_u32(uint8_t * p, uint32_t v);
+static uint16_t telem_get_u16(const uint8_t * p);
+static uint32_t telem_get_u32(const uint8_t * p);
+
+/**********************
+ *  STATIC VARIABLES
+ **********************/
+
+static telem_chan_t chans[TELEM_CH_NUM] = {0};
+static telem_block_t blocks[2] = {0};
+
+/*Control loop interrupt*/
+static uint8_t fill_idx = 0;
+static uint32_t mask = 0;
+static uint16_t decim = 1;
+static uint16_t decim_cnt = 0;
+static uint16_t sample_size = 0;
+static uint32_t sample_nr = 0;
+
+/*Main loop and port*/
+static uint8_t send_idx = 0;
+static volatile bool sending = false;
+
+/*A new configuration from the host, taken over by the interrupt*/
+static volatile uint32_t cfg_mask = 0;
+static volatile uint16_t cfg_decim = 1;
+static volatile bool cfg_pending = false;
+
+static volatile telem_stats_t stats = {0};
+
+/**********************
+ *   GLOBAL FUNCTIONS
+ **********************/
+
+void telem_init()
+{
+    memset(chans, 0, sizeof(chans));
+    telem_reset();
+}
+
+/**
+ * Connects a channel to its signal, before the stream starts.
+ * @param ch Channel.
+ * @param src_p Signal, written by the control loop.
+ * @param scale Counts per unit, the signal must fit int16 after it.
+ * @return Whether the channel exists.
+ */
+bool telem_bind(telem_ch_t ch, const volatile float * src_p, float scale)
+{
+    if (ch >= TELEM_CH_NUM) return false;
+
+    chans[ch].src_p = src_p;
+    chans[ch].scale = scale;
+    return true;
+}
+
+/**
+ * Takes one sample, from the control loop interrupt once per
+ * PWM cycle. Appends to the block being filled, a full block
+ * is left for telem_poll() and the other one is started.
+ */
+void telem_cycle()
+{
+    telem_block_t * blk_p = NULL;
+    int16_t * dst_p = NULL;
+
+    if (cfg_pending) telem_config_apply();
+    if (mask == 0) return;
+
+    if (++decim_cnt < decim) return;
+    decim_cnt = 0;
+
+    blk_p = &blocks[fill_idx];
+
+    if (blk_p->state == TELEM_BLOCK_FREE) {
+        blk_p->count = 0;
+        blk_p->len = TELEM_HEAD_SIZE;
+        telem_put_u32(&blk_p->data[8], sample_nr);
+        blk_p->state = TELEM_BLOCK_FILL;
+    }
+
+    stats.samples++;
+
+    /*Both blocks wait for the host, the sample number shows the gap*/
+    if (blk_p->state != TELEM_BLOCK_FILL) {
+        stats.dropped++;
+        sample_nr++;
+        return;
+    }
+
+    dst_p = (int16_t *)&blk_p->data[blk_p->len];
+
+    for (uint8_t ch = 0; ch < TELEM_CH_NUM; ch++) {
+        if (mask & (1U << ch)) *dst_p++ = telem_pack(&chans[ch]);
+    }
+
+    blk_p->len += sample_size;
+    blk_p->count++;
+    sample_nr++;
+
+    if (blk_p->len + sample_size > TELEM_BLOCK_SIZE) {
+        telem_block_close(blk_p);
+        fill_idx ^= 1;
+    }
+}
+
+/**
+ * Current value of a channel, packed as in the stream.
+ * @param ch Channel.
+ * @return int16 of signal * scale, 0 if not bound.
+ */
+int16_t telem_read(telem_ch_t ch)
+{
+    if (ch >= TELEM_CH_NUM) return 0;
+    return telem_pack(&chans[ch]);
+}
+
+/**
+ * Hands the next complete block to the port, from the main loop.
+ * Blocks go out in the order they were filled.
+ */
+void telem_poll()
+{
+    telem_block_t * blk_p = &blocks[send_idx];
+
+    if (sending) return;
+    if (blk_p->state != TELEM_BLOCK_READY) return;
+
+    blk_p->state = TELEM_BLOCK_SEND;
+    sending = true;
+
+    if (!telem_port_send(blk_p->data, blk_p->len)) {
+        /*Port busy or not connected, try again*/
+        blk_p->state = TELEM_BLOCK_READY;
+        sending = false;
+        return;
+    }
+
+    stats.blocks++;
+}
+
+/**
+ * The port has sent the block of the last telem_port_send().
+ */
+void telem_send_end()
+{
+    if (!sending) return;
+
+    blocks[send_idx].state = TELEM_BLOCK_FREE;
+    send_idx ^= 1;
+    sending = false;
+}
+
+/**
+ * Command from the host, see telem.h. Taken over by
+ * the interrupt before its next sample.
+ * @param data_p Received bytes.
+ * @param len Number of bytes.
+ */
+void telem_recv(const uint8_t * data_p, uint16_t len)
+{
+    uint16_t n = 0;
+
+    if (len != TELEM_CMD_SIZE) return;
+    if (telem_get_u16(&data_p[0]) != TELEM_SYNC) return;
+
+    n = telem_get_u16(&data_p[2]);
+
+    cfg_decim = (n == 0) ? 1 : n;
+    cfg_mask = telem_get_u32(&data_p[4]) & ((1U << TELEM_CH_NUM) - 1);
+    cfg_pending = true;
+}
+
+/**
+ * The port lost its host, a block on the wire will not
+ * complete. Stops the stream and frees both blocks.
+ */
+void telem_reset()
+{
+    cfg_mask = 0;
+    cfg_decim = 1;
+    cfg_pending = false;
+
+    mask = 0;
+    decim = 1;
+    decim_cnt = 0;
+    sample_size = 0;
+    fill_idx = 0;
+    send_idx = 0;
+    sending = false;
+
+    blocks[0].state = TELEM_BLOCK_FREE;
+    blocks[1].state = TELEM_BLOCK_FREE;
+}
+
+void telem_stats_get(telem_stats_t * stats_p)
+{
+    stats_p->samples = stats.samples;
+    stats_p->dropped = stats.dropped;
+    stats_p->blocks = stats.blocks;
+}
+
+/**********************
+ *   STATIC FUNCTIONS
+ **********************/
+
+/**
+ * A block must not mix two configurations, the one being
+ * filled is closed first.
+ */
+static void telem_config_apply()
+{
+    telem_block_t * blk_p = &blocks[fill_idx];
+    uint32_t m = 0;
+    uint8_t n = 0;
+
+    cfg_pending = false;
+
+    if (blk_p->state == TELEM_BLOCK_FILL) {
+        if (blk_p->count != 0) {
+            telem_block_close(blk_p);
+            fill_idx ^= 1;
+        } else blk_p->state = TELEM_BLOCK_FREE;
+    }
+
+    m = cfg_mask;
+    for (uint8_t ch = 0; ch < TELEM_CH_NUM; ch++)
+        n += (m >> ch) & 1U;
+
+    mask = m;
+    decim = cfg_decim;
+    decim_cnt = 0;
+    sample_size = n * sizeof(int16_t);
+}
+
+static void telem_block_close(telem_block_t * blk_p)
+{
+    uint8_t * p = blk_p->data;
+
+    telem_put_u16(&p[0], TELEM_SYNC);
+    telem_put_u16(&p[2], blk_p->count);
+    telem_put_u32(&p[4], mask);
+    /*First sample number written at open*/
+    telem_put_u16(&p[12], decim);
+    telem_put_u16(&p[14], (uint16_t)stats.dropped);
+
+    blk_p->state = TELEM_BLOCK_READY;
+}
+
+static int16_t telem_pack(const telem_chan_t * chan_p)
+{
+    float v = 0.0f;
+
+    if (chan_p->src_p == NULL) return 0;
+
+    v = *chan_p->src_p * chan_p->scale;
+
+    if (v >= 32767.0f) return 32767;
+    if (v <= -32768.0f) return -32768;
+    return (int16_t)v;
+}
+
+static void telem_put_u16(uint8_t * p, uint16_t v)
+{
+    p[0] = (uint8_t)v;
+    p[1] = (uint8_t)(v >> 8);
+}
+
+static void telem_put_u32(uint8_t * p, uint32_t v)
+{
+    telem_put_u16(&p[0], (uint16_t)v);
+    telem_put_u16(&p[2], (uint16_t)(v >> 16));
+}
+
+static uint16_t telem_get_u16(const uint8_t * p)
+{
+    return (uint16_t)(p[0] | (p[1] << 8));
+}
+
+static uint32_t telem_get_u32(const uint8_t * p)
+{
+    return telem_get_u16(&p[0]) | ((uint32_t)telem_get_u16(&p[2]) << 16);
+}
@@ -0,0 +1,108 @@
+/**
+ * @file telem.h
+ *
+ * Telemetry stream of the control loop. The loop calls telem_cycle()
+ * every PWM cycle, the selected channels of every decim-th cycle are
+ * packed into blocks in the interrupt, two blocks alternate so one is
+ * filled while the other one is on the wire. The main loop hands the
+ * finished blocks to the port, the USB CDC data endpoint.
+ *
+ *  Block, little endian:
+ *  +------+-------+------+--------------+-------+---------+------------+
+ *  | Sync | Count | Mask | First sample | Decim | Dropped | Samples    |
+ *  +------+-------+------+--------------+-------+---------+------------+
+ *    u16    u16     u32     u32           u16     u16      Count * n * i16
+ *
+ * A sample holds the channels set in Mask in ascending order, every
+ * value is int16 of signal * scale of its channel, saturated. When
+ * the host does not read fast enough both blocks are busy, samples
+ * are dropped and counted, the sample numbers show the gap.
+ *
+ * The host selects the channels with an 8 byte command, a zero mask
+ * stops the stream:
+ *  +------+-------+------+
+ *  | Sync | Decim | Mask |
+ *  +------+-------+------+
+ *    u16    u16     u32
+ */
+
+#ifndef __TELEM_H__
+#define __TELEM_H__
+
+/*********************
+ *      INCLUDES
+ *********************/
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/*********************
+ *      DEFINES
+ *********************/
+
+#define TELEM_SYNC 0xA55AU
+
+#define TELEM_HEAD_SIZE  16U
+#define TELEM_CMD_SIZE   8U
+
+/*8 full speed packets*/
+#define TELEM_BLOCK_SIZE 512U
+
+/**********************
+ *      TYPEDEFS
+ **********************/
+
+/**Signals of the control loop, bit n of the mask is channel n*/
+enum {
+    TELEM_CH_M0_IA = 0,  /**< Phase currents, [A]*/
+    TELEM_CH_M0_IB,
+    TELEM_CH_M0_ID,      /**< Rotor frame currents, [A]*/
+    TELEM_CH_M0_IQ,
+    TELEM_CH_M0_VD,      /**< Rotor frame voltages, [V]*/
+    TELEM_CH_M0_VQ,
+    TELEM_CH_M0_ANGLE,   /**< Electrical angle, [rad]*/
+    TELEM_CH_M0_VEL,     /**< [turn/s]*/
+    TELEM_CH_M1_IA,
+    TELEM_CH_M1_IB,
+    TELEM_CH_M1_ID,
+    TELEM_CH_M1_IQ,
+    TELEM_CH_M1_VD,
+    TELEM_CH_M1_VQ,
+    TELEM_CH_M1_ANGLE,
+    TELEM_CH_M1_VEL,
+    TELEM_CH_VBUS,       /**< [V]*/
+    TELEM_CH_NUM
+};
+
+typedef uint8_t telem_ch_t;
+
+/**
+ * Stream counters.
+ */
+typedef struct {
+    uint32_t samples;  /**< Samples taken*/
+    uint32_t dropped;  /**< Samples without a free block*/
+    uint32_t blocks;   /**< Blocks handed to the port*/
+} telem_stats_t;
+
+/**********************
+ * GLOBAL PROTOTYPES
+ **********************/
+
+void telem_init();
+bool telem_bind(telem_ch_t ch, const volatile float * src_p, float scale);
+void telem_cycle();
+int16_t telem_read(telem_ch_t ch);
+void telem_poll();
+void telem_send_end();
+void telem_recv(const uint8_t * data_p, uint16_t len);
+void telem_reset();
+void telem_stats_get(telem_stats_t * stats_p);
+
+/**
+ * Port hook, starts sending a block and returns,
+ * telem_send_end() follows once it is out.
+ */
+bool telem_port_send(const uint8_t * data_p, uint16_t len);
+
+#endif /*__TELEM_H__*/
@@ -0,0 +1,645 @@
+/**
+ * @file bcpsim.c
+ *
+ * Host simulator for the binary command protocol. It links bcp.c,
+ * cobs.c and the Modbus stack unchanged, first runs a set of checks
+ * on the framing and the error replies, then benches a host loop that
+ * keeps a window of packets in flight, each packet setting setpoints
+ * and reading the state back. The same workload is run through the
+ * Modbus slave for comparison, one transaction per command.
+ *
+ *  bcpsim -b N     ... N packets, checks first.
+ *
+ *  -k K     ... SETPOINT ops per packet, axes in turn, default
+ *               MB_AXIS_NUM, one STATE op follows them.
+ *  -w W     ... Packets in flight, 1 to BCP_WINDOW, default BCP_WINDOW.
+ *  -c SIZE  ... Bytes per receive chunk, default 64, a USB packet.
+ *  -r BAUD  ... Baud rate of the line model, default 115200.
+ *
+ * Besides the processing rate the line model gives the commands per
+ * second a serial line could carry: Modbus RTU at 11 bits per character,
+ * half duplex with t3.5 after every frame, against this protocol at 10
+ * bits per character, full duplex with the replies pipelined, so a
+ * packet takes the longer of its request and its reply.
+ *
+ * Build from the repository root:
+ *  cc -O2 -Wall -I Firmware/modbus -I Firmware/bcp -o bcpsim \
+ *      Firmware/tools/bcpsim/bcpsim.c Firmware/bcp/bcp.c \
+ *      Firmware/bcp/cobs.c Firmware/modbus/mb.c \
+ *      Firmware/modbus/mbrtu.c Firmware/modbus/crc16.c
+ */
+
+/*********************
+ *      INCLUDES
+ *********************/
+
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include "bcp.h"
+#include "crc16.h"
+#include "mbrtu.h"
+#include "mbclient.h"
+
+/*********************
+ *      DEFINES
+ *********************/
+
+#define SIM_SLAVE_ADDR 0x01U
+#define SIM_BAUD_RATE  115200U
+#define SIM_CHUNK_SIZE 64U
+
+/*Latency samples kept*/
+#define LAT_WINDOW_MAX (1U << 20)
+
+/*Bits per character on the line model*/
+#define LINE_BITS_MB  11U
+#define LINE_BITS_BCP 10U
+
+/*Modbus frames of the comparison, 0x10 of one setpoint, 0x04 of the state*/
+#define MB_SP_REQ_SIZE    13U
+#define MB_SP_REP_SIZE    8U
+#define MB_STATE_REGS     (BCP_STATE_SIZE / 2U)
+#define MB_STATE_REQ_SIZE 8U
+#define MB_STATE_REP_SIZE (5U + BCP_STATE_SIZE)
+
+/**********************
+ *      TYPEDEFS
+ **********************/
+
+/*Packet in flight*/
+typedef struct {
+    uint8_t seq;
+    uint64_t t0;
+    int32_t pos;               /**< Position published before it was sent*/
+    float setpoint[MB_AXIS_NUM];
+} sim_flight_t;
+
+/**********************
+ *  STATIC PROTOTYPES
+ **********************/
+
+static uint64_t sim_clock_ns();
+static void sim_feed(const uint8_t * data_p, uint16_t len);
+static uint16_t sim_packet(uint8_t * pkt_p, const uint8_t * req_p, uint16_t len);
+static bool sim_reply(uint8_t * rep_p, uint16_t * rep_len);
+static bool sim_xfer(const uint8_t * req_p, uint16_t len,
+    uint8_t * rep_p, uint16_t * rep_len);
+static int sim_check();
+static int sim_bench(uint32_t count);
+static double sim_modbus(uint32_t count);
+static void sim_line(uint16_t req_len, uint16_t rep_len);
+static void sim_put_f32(uint8_t * p, float v);
+static uint32_t sim_get_u32(const uint8_t * p);
+
+/**********************
+ *  STATIC VARIABLES
+ **********************/
+
+static uint32_t setpoint_ops = MB_AXIS_NUM;
+static uint32_t window = BCP_WINDOW;
+static uint32_t chunk_size = SIM_CHUNK_SIZE;
+static uint32_t baud_rate = SIM_BAUD_RATE;
+
+/*Reply captured from the port*/
+static uint8_t reply_buf[BCP_TX_MAX];
+static uint16_t reply_len = 0;
+
+static uint8_t mb_reply_buf[RTU_BUF_MAX];
+static uint16_t mb_reply_len = 0;
+
+static uint32_t lat_num = 0;
+static uint32_t lat_ns[LAT_WINDOW_MAX];
+
+/**********************
+ *   GLOBAL FUNCTIONS
+ **********************/
+
+/*The simulator closes frames itself, no t3.5 timer*/
+void mb_timer_init(uint32_t baud_rate) {(void)baud_rate;}
+void mb_timer_reload() {}
+void mb_timer_enable() {}
+void mb_timer_disable() {}
+
+bool mb_rtu_port_send(const uint8_t * data_p, uint16_t len)
+{
+    memcpy(mb_reply_buf, data_p, len);
+    mb_reply_len = len;
+    mb_rtu_send_end();
+    return true;
+}
+
+uint32_t mb_rtu_port_ticks()
+{
+    return (uint32_t)(sim_clock_ns() / 1000U);
+}
+
+/**
+ * Transmit hook of the protocol, the reply is complete at once.
+ * @param data_p Points to the encoded reply.
+ * @param len Number of bytes.
+ * @return Always true.
+ */
+bool bcp_port_send(const uint8_t * data_p, uint16_t len)
+{
+    memcpy(reply_buf, data_p, len);
+    reply_len = len;
+    bcp_send_end();
+    return true;
+}
+
+int main(int argc, char ** argv)
+{
+    uint32_t bench_count = 0;
+    int opt = 0;
+
+    while ((opt = getopt(argc, argv, "b:k:w:c:r:")) != -1) {
+        switch (opt) {
+        case 'b': bench_count = strtoul(optarg, NULL, 0); break;
+        case 'k': setpoint_ops = strtoul(optarg, NULL, 0); break;
+        case 'w': window = strtoul(optarg, NULL, 0); break;
+        case 'c': chunk_size = strtoul(optarg, NULL, 0); break;
+        case 'r': baud_rate = strtoul(optarg, NULL, 0); break;
+        default:
+            fprintf(stderr, "usage: %s -b N [-k K] [-w W] [-c SIZE] "
+                "[-r BAUD]\n", argv[0]);
+            return 2;
+        }
+    }
+
+    /*SETPOINT ops and the STATE result have to fit into one packet*/
+    if ((bench_count == 0) || (window == 0) || (window > BCP_WINDOW) ||
+        (chunk_size == 0) || (baud_rate == 0) ||
+        (BCP_HEAD_SIZE + setpoint_ops * 6U + 1U + BCP_CRC_SIZE > BCP_BUF_MAX)) {
+        fprintf(stderr, "bcpsim: invalid argument\n");
+        return 2;
+    }
+
+    mb_rtu_mode_init(SIM_SLAVE_ADDR, baud_rate);
+    /*The line is idle, end the startup phase*/
+    mb_rtu_recv_end();
+    bcp_init();
+
+    if (sim_check() != 0) return 1;
+    return sim_bench(bench_count);
+}
+
+/**********************
+ *   STATIC FUNCTIONS
+ **********************/
+
+static uint64_t sim_clock_ns()
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec;
+}
+
+/**
+ * Hands bytes to the protocol in chunks, the way the USB
+ * receive interrupt does.
+ */
+static void sim_feed(const uint8_t * data_p, uint16_t len)
+{
+    uint16_t n = 0;
+
+    while (len > 0) {
+        n = (len < chunk_size) ? len : (uint16_t)chunk_size;
+        bcp_recv(data_p, n);
+        data_p += n;
+        len -= n;
+    }
+}
+
+/**
+ * Appends the CRC to a request and frames it.
+ * @param pkt_p Receives the packet with both delimiters.
+ * @param req_p Request, room for the CRC behind it.
+ * @param len Number of bytes without the CRC.
+ * @return Number of bytes in the packet.
+ */
+static uint16_t sim_packet(uint8_t * pkt_p, const uint8_t * req_p, uint16_t len)
+{
+    uint8_t buf[BCP_BUF_MAX + BCP_CRC_SIZE];
+    uint16_t crc = crc16(req_p, len);
+    uint16_t n = 0;
+
+    memcpy(buf, req_p, len);
+    buf[len++] = (uint8_t)(crc & 0xFF);
+    buf[len++] = (uint8_t)(crc >> 8);
+
+    pkt_p[0] = 0x00;
+    n = 1 + cobs_encode(buf, len, &pkt_p[1]);
+    pkt_p[n++] = 0x00;
+    return n;
+}
+
+/**
+ * Decodes the reply captured from the port.
+ * @param rep_p Receives the reply without its CRC.
+ * @param rep_len Receives its length.
+ * @return false if there was none or it is damaged.
+ */
+static bool sim_reply(uint8_t * rep_p, uint16_t * rep_len)
+{
+    uint16_t len = 0;
+
+    if ((reply_len < 4) || (reply_buf[0] != 0x00) ||
+        (reply_buf[reply_len - 1] != 0x00)) return false;
+
+    if (!cobs_decode(&reply_buf[1], reply_len - 2, rep_p, &len) ||
+        (len < BCP_REPLY_HEAD + BCP_CRC_SIZE) || (crc16(rep_p, len) != 0))
+        return false;
+
+    reply_len = 0;
+    *rep_len = len - BCP_CRC_SIZE;
+    return true;
+}
+
+/**
+ * One request, one reply, no pipelining.
+ * @return false if there was no valid reply.
+ */
+static bool sim_xfer(const uint8_t * req_p, uint16_t len,
+    uint8_t * rep_p, uint16_t * rep_len)
+{
+    uint8_t pkt[BCP_TX_MAX];
+
+    reply_len = 0;
+    sim_feed(pkt, sim_packet(pkt, req_p, len));
+    bcp_poll();
+    return sim_reply(rep_p, rep_len);
+}
+
+#define CHECK(cond, what)                                       \
+    do {                                                        \
+        if (!(cond)) {                                          \
+            fprintf(stderr, "check failed: %s\n", (what));      \
+            return 1;                                           \
+        }                                                       \
+    } while (0)
+
+/**
+ * Framing corner cases and the error replies.
+ * @return 0 if all passed.
+ */
+static int sim_check()
+{
+    uint8_t src[600];
+    uint8_t enc[COBS_ENC_MAX(600)];
+    uint8_t dec[600];
+    uint8_t req[BCP_BUF_MAX];
+    uint8_t rep[BCP_BUF_MAX];
+    uint8_t pkt[BCP_TX_MAX];
+    uint16_t len = 0;
+    uint16_t n = 0;
+    bcp_diag_t diag;
+
+    /*COBS round trip over block boundaries, all zero, none zero, mixed*/
+    for (uint16_t size = 0; size < sizeof(src); size++) {
+        for (uint8_t pat = 0; pat < 3; pat++) {
+            for (uint16_t i = 0; i < size; i++)
+                src[i] = (pat == 0) ? 0x00 :
+                    (pat == 1) ? (uint8_t)(i % 255U + 1U) : (uint8_t)rand();
+
+            n = cobs_encode(src, size, enc);
+            CHECK(n <= COBS_ENC_MAX(size), "cobs size");
+            CHECK(memchr(enc, 0x00, n) == NULL, "cobs zero");
+            CHECK(cobs_decode(enc, n, dec, &len), "cobs decode");
+            CHECK((len == size) && (memcmp(src, dec, size) == 0), "cobs data");
+        }
+    }
+
+    /*Register write and read back in one packet*/
+    req[0] = 0x11;
+    req[1] = BCP_OP_REG_WRITE;
+    req[2] = (uint8_t)(MB_REG_M0_SETPOINT >> 0);
+    req[3] = (uint8_t)(MB_REG_M0_SETPOINT >> 8);
+    req[4] = 2;
+    req[5] = 0x3F; req[6] = 0x80; req[7] = 0x00; req[8] = 0x00;
+    req[9] = BCP_OP_REG_READ;
+    req[10] = req[2];
+    req[11] = req[3];
+    req[12] = 2;
+    CHECK(sim_xfer(req, 13, rep, &len), "reg reply");
+    CHECK((rep[0] == 0x11) && (rep[1] == MB_RES_NONE) && (rep[2] == 2) &&
+        (len == BCP_REPLY_HEAD + 4), "reg status");
+    CHECK(memcmp(&rep[3], &req[5], 4) == 0, "reg data");
+    CHECK(mb_rtu_setpoint(0) == 1.0f, "reg setpoint");
+
+    /*The batch stops at an unknown op*/
+    req[0] = 0x12;
+    req[1] = BCP_OP_NOP;
+    req[2] = 0x7F;
+    req[3] = BCP_OP_NOP;
+    CHECK(sim_xfer(req, 4, rep, &len), "unknown reply");
+    CHECK((rep[1] == MB_RES_ILLEGAL_FUNCTION) && (rep[2] == 1) &&
+        (len == BCP_REPLY_HEAD), "unknown status");
+
+    /*An op cut short and an axis out of range*/
+    req[0] = 0x13;
+    req[1] = BCP_OP_SETPOINT;
+    req[2] = 0;
+    CHECK(sim_xfer(req, 3, rep, &len), "short reply");
+    CHECK((rep[1] == MB_RES_ILLEGAL_DATA_VALUE) && (rep[2] == 0), "short status");
+
+    req[0] = 0x14;
+    req[1] = BCP_OP_SETPOINT;
+    req[2] = MB_AXIS_NUM;
+    sim_put_f32(&req[3], 2.0f);
+    CHECK(sim_xfer(req, 7, rep, &len), "axis reply");
+    CHECK((rep[1] == MB_RES_ILLEGAL_DATA_VALUE) && (rep[2] == 0), "axis status");
+
+    /*Results beyond the reply buffer*/
+    req[0] = 0x15;
+    for (n = 1; n < BCP_BUF_MAX - BCP_CRC_SIZE; n++) req[n] = BCP_OP_STATE;
+    CHECK(sim_xfer(req, n, rep, &len), "full reply");
+    CHECK((rep[1] == MB_RES_ILLEGAL_DATA_VALUE) &&
+        (len == BCP_REPLY_HEAD + rep[2] * BCP_STATE_SIZE) &&
+        (len + BCP_STATE_SIZE + BCP_CRC_SIZE > BCP_BUF_MAX), "full status");
+
+    /*Damaged, cut off and oversized packets get no reply*/
+    req[0] = 0x16;
+    req[1] = BCP_OP_NOP;
+    n = sim_packet(pkt, req, 2);
+    pkt[2] ^= 0x01;
+    sim_feed(pkt, n);
+    bcp_poll();
+    CHECK(reply_len == 0, "damaged");
+
+    n = sim_packet(pkt, req, 2);
+    sim_feed(pkt, n - 2);
+    sim_feed(pkt, 1);
+    bcp_poll();
+    CHECK(reply_len == 0, "cut off");
+
+    memset(src, BCP_OP_NOP, sizeof(src));
+    src[0] = 0x17;
+    n = 1 + cobs_encode(src, BCP_BUF_MAX + 1, &enc[1]);
+    enc[0] = 0x00;
+    enc[n++] = 0x00;
+    sim_feed(enc, n);
+    bcp_poll();
+    CHECK(reply_len == 0, "oversized");
+
+    /*The link carries on*/
+    req[0] = 0x18;
+    req[1] = BCP_OP_NOP;
+    CHECK(sim_xfer(req, 2, rep, &len), "recovery reply");
+    CHECK((rep[0] == 0x18) && (rep[1] == MB_RES_NONE), "recovery status");
+
+    /*The port routes by the open packet: split after the leading 
+    delimiter and before the trailing one, done at the trailing one*/
+    req[0] = 0x19;
+    req[1] = BCP_OP_NOP;
+    n = sim_packet(pkt, req, 2);
+    reply_len = 0;
+    CHECK(bcp_recv(pkt, 1), "open after leading");
+    CHECK(bcp_recv(&pkt[1], n - 2), "open before trailing");
+    CHECK(!bcp_recv(&pkt[n - 1], 1), "closed at trailing");
+    bcp_poll();
+    CHECK(sim_reply(rep, &len) && (rep[0] == 0x19), "split reply");
+
+    bcp_diag_get(&diag);
+    CHECK(diag.bad == 3, "bad count");
+    CHECK(diag.overrun == 0, "overrun count");
+
+    printf("checks passed\n");
+    return 0;
+}
+
+static int sim_lat_cmp(const void * a_p, const void * b_p)
+{
+    uint32_t a = *(const uint32_t *)a_p;
+    uint32_t b = *(const uint32_t *)b_p;
+
+    return (a > b) - (a < b);
+}
+
+/**
+ * Host loop against the protocol, keeps the window full and checks
+ * every reply against the packet it answers.
+ * @param count Number of packets.
+ * @return Exit status.
+ */
+static int sim_bench(uint32_t count)
+{
+    static sim_flight_t flight[BCP_SLOT_NUM];
+    uint8_t req[BCP_BUF_MAX];
+    uint8_t rep[BCP_BUF_MAX];
+    uint8_t pkt[BCP_TX_MAX];
+    uint32_t head = 0;
+    uint32_t tail = 0;
+    uint32_t sent = 0;
+    uint32_t errors = 0;
+    uint16_t req_len = 0;
+    uint16_t rep_len = 0;
+    uint64_t t0 = 0;
+    uint64_t elapsed = 0;
+    mb_motor_state_t state = {0};
+    bcp_diag_t diag;
+    double cmds = (double)count * (setpoint_ops + 1U);
+    double mb_rate = 0.0;
+
+    lat_num = 0;
+    t0 = sim_clock_ns();
+
+    while (tail < count) {
+        /*Fill the window*/
+        while ((sent < count) && (head - tail < window)) {
+            sim_flight_t * f_p = &flight[head % BCP_SLOT_NUM];
+
+            f_p->seq = (uint8_t)head;
+            f_p->pos = (int32_t)head;
+
+            /*The control loop publishes a new state*/
+            for (uint8_t axis = 0; axis < MB_AXIS_NUM; axis++) {
+                state.pos = (int32_t)head + axis;
+                state.vel = (float)head * 0.5f;
+                state.iq = (float)axis;
+                state.vbus = 24.0f;
+                state.fault = head ^ axis;
+                mb_rtu_input_publish(axis, &state);
+            }
+
+            req[0] = f_p->seq;
+            req_len = BCP_HEAD_SIZE;
+            for (uint32_t i = 0; i < setpoint_ops; i++) {
+                uint8_t axis = (uint8_t)(i % MB_AXIS_NUM);
+
+                f_p->setpoint[axis] = (float)head + (float)i;
+                req[req_len++] = BCP_OP_SETPOINT;
+                req[req_len++] = axis;
+                sim_put_f32(&req[req_len], f_p->setpoint[axis]);
+                req_len += 4;
+            }
+            req[req_len++] = BCP_OP_STATE;
+
+            f_p->t0 = sim_clock_ns();
+            sim_feed(pkt, sim_packet(pkt, req, req_len));
+            head++;
+            sent++;
+        }
+
+        /*One pass of the main loop*/
+        bcp_poll();
+
+        if (reply_len > 0) {
+            sim_flight_t * f_p = &flight[tail % BCP_SLOT_NUM];
+            bool ok = sim_reply(rep, &rep_len);
+
+            if (lat_num < LAT_WINDOW_MAX)
+                lat_ns[lat_num++] = (uint32_t)(sim_clock_ns() - f_p->t0);
+
+            /*The state is the one published last before the packet ran*/
+            ok = ok && (rep[0] == f_p->seq) && (rep[1] == MB_RES_NONE) &&
+                (rep[2] == setpoint_ops + 1U) &&
+                (rep_len == BCP_REPLY_HEAD + BCP_STATE_SIZE) &&
+                ((int32_t)sim_get_u32(&rep[3]) >= f_p->pos);
+
+            /*Packets run in order, the setpoints are the ones of this one*/
+            for (uint8_t axis = 0; ok && (axis < MB_AXIS_NUM) &&
+                (axis < setpoint_ops); axis++)
+                ok = (mb_rtu_setpoint(axis) == f_p->setpoint[axis]);
+
+            if (!ok) errors++;
+            tail++;
+        }
+    }
+
+    elapsed = sim_clock_ns() - t0;
+    bcp_diag_get(&diag);
+
+    printf("bcp: %.0f packets/s, %.0f commands/s, %u packets, "
+        "%u bad replies\n",
+        count * 1e9 / elapsed, cmds * 1e9 / elapsed, count, errors);
+
+    if (lat_num > 0) {
+        uint32_t n = lat_num;
+
+        qsort(lat_ns, n, sizeof(uint32_t), sim_lat_cmp);
+        printf("  latency [us] p50 %.2f p90 %.2f p99 %.2f p99.9 %.2f max %.2f\n",
+            lat_ns[n * 50 / 100] / 1e3, lat_ns[n * 90 / 100] / 1e3,
+            lat_ns[n * 99 / 100] / 1e3, lat_ns[n * 999 / 1000] / 1e3,
+            lat_ns[n - 1] / 1e3);
+    }
+
+    printf("  link: %u packets, %u bad, %u overrun, %u exceptions\n",
+        diag.packets, diag.bad, diag.overrun, diag.exception);
+
+    mb_rate = sim_modbus(count);
+    printf("modbus: %.0f commands/s, bcp %.1f times\n",
+        mb_rate, (cmds * 1e9 / elapsed) / mb_rate);
+
+    /*A packet as above with both delimiters, COBS adds a byte per 254*/
+    req_len = BCP_HEAD_SIZE + setpoint_ops * 6U + 1U + BCP_CRC_SIZE;
+    rep_len = BCP_REPLY_HEAD + BCP_STATE_SIZE + BCP_CRC_SIZE;
+    sim_line(COBS_ENC_MAX(req_len) + 2U, COBS_ENC_MAX(rep_len) + 2U);
+
+    return ((errors == 0) && (diag.bad == 3) && (diag.overrun == 0)) ? 0 : 1;
+}
+
+/**
+ * The same workload through the Modbus slave, a 0x10 write of
+ * one setpoint per SETPOINT op and a 0x04 read of the state.
+ * @param count Number of cycles.
+ * @return Commands per second.
+ */
+static double sim_modbus(uint32_t count)
+{
+    uint8_t frame[RTU_BUF_MAX];
+    uint32_t errors = 0;
+    uint16_t crc = 0;
+    uint16_t addr = 0;
+    uint64_t t0 = sim_clock_ns();
+    uint64_t elapsed = 0;
+
+    for (uint32_t c = 0; c < count; c++) {
+        for (uint32_t i = 0; i <= setpoint_ops; i++) {
+            uint8_t axis = (uint8_t)(i % MB_AXIS_NUM);
+            uint16_t len = 0;
+            uint32_t val = 0;
+            float sp = (float)c + (float)i;
+
+            frame[len++] = SIM_SLAVE_ADDR;
+            if (i < setpoint_ops) {
+                addr = MB_REG_M0_SETPOINT + axis * 2U;
+                memcpy(&val, &sp, sizeof(val));
+                frame[len++] = 0x10;
+                frame[len++] = (uint8_t)(addr >> 8);
+                frame[len++] = (uint8_t)(addr >> 0);
+                frame[len++] = 0;
+                frame[len++] = 2;
+                frame[len++] = 4;
+                frame[len++] = (uint8_t)(val >> 24);
+                frame[len++] = (uint8_t)(val >> 16);
+                frame[len++] = (uint8_t)(val >> 8);
+                frame[len++] = (uint8_t)(val >> 0);
+            } else {
+                frame[len++] = 0x04;
+                frame[len++] = (uint8_t)(MB_IN_M0_POS >> 8);
+                frame[len++] = (uint8_t)(MB_IN_M0_POS >> 0);
+                frame[len++] = 0;
+                frame[len++] = MB_STATE_REGS;
+            }
+            crc = crc16(frame, len);
+            frame[len++] = (uint8_t)(crc & 0xFF);
+            frame[len++] = (uint8_t)(crc >> 8);
+
+            mb_reply_len = 0;
+            mb_rtu_recv_block(frame, len);
+            mb_rtu_recv_end();
+            mb_rtu_pdu_field_deal();
+
+            if ((mb_reply_len != ((i < setpoint_ops) ?
+                MB_SP_REP_SIZE : MB_STATE_REP_SIZE)) ||
+                (mb_reply_buf[1] != frame[1])) errors++;
+        }
+    }
+
+    elapsed = sim_clock_ns() - t0;
+    if (errors > 0) printf("  modbus: %u bad replies\n", errors);
+
+    return (double)count * (setpoint_ops + 1U) * 1e9 / elapsed;
+}
+
+/**
+ * Commands per second the line carries at baud_rate.
+ * @param req_len Bytes of a request packet on the line.
+ * @param rep_len Bytes of its reply.
+ */
+static void sim_line(uint16_t req_len, uint16_t rep_len)
+{
+    double cmds = setpoint_ops + 1U;
+    double mb_chars = setpoint_ops * (MB_SP_REQ_SIZE + MB_SP_REP_SIZE + 7.0) +
+        (MB_STATE_REQ_SIZE + MB_STATE_REP_SIZE + 7.0);
+    double mb_s = mb_chars * LINE_BITS_MB / baud_rate;
+    double bcp_s = (double)((req_len > rep_len) ? req_len : rep_len) *
+        LINE_BITS_BCP / baud_rate;
+
+    printf("line at %u baud: modbus %.0f commands/s, bcp %.0f commands/s "
+        "(%u + %u bytes per packet), %.1f times\n", baud_rate,
+        cmds / mb_s, cmds / bcp_s, req_len, rep_len, mb_s / bcp_s);
+}
+
+static void sim_put_f32(uint8_t * p, float v)
+{
+    uint32_t val = 0;
+
+    memcpy(&val, &v, sizeof(val));
+    p[0] = (uint8_t)(val >> 0);
+    p[1] = (uint8_t)(val >> 8);
+    p[2] = (uint8_t)(val >> 16);
+    p[3] = (uint8_t)(val >> 24);
+}
+
+static uint32_t sim_get_u32(const uint8_t * p)
+{
+    return (uint32_t)p[0] | ((uint32_t)p[1] << 8) |
+        ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24);
+}
@@ -0,0 +1,916 @@
+/**
+ * @file cansim.c
+ *
+ * Host harness for the CAN stack. A drive process links canbus.c and
+ * co402.c unchanged, its port hooks sit on a Linux SocketCAN interface,
+ * normally a vcan. The master starts the drives as child processes,
+ * brings them to operational and runs the cycle a motion controller
+ * would: SYNC, then one RPDO per axis with controlword and target
+ * position. A simulated axis takes its target at the SYNC, so the
+ * TPDO after the next SYNC echoes it.
+ *
+ *  cansim -m N     ... master with N drives of CO402_AXIS_NUM axes,
+ *                      node ids 1 ... N.
+ *  cansim -d ID    ... one drive with node id ID, the master starts
+ *                      them, alone it serves any CANopen master.
+ *
+ *  -i IF    ... SocketCAN interface, default vcan0.
+ *  -u PATH  ... Unix socket bus instead, for hosts without vcan,
+ *               the master relays every frame to all drives.
+ *  -f HZ    ... SYNC rate, default the rate that loads the bus to 80%
+ *               with the axes of -m at the bit rate of -b, 1000 at most.
+ *  -t SEC   ... Measured run time, default 5.
+ *  -b BIT   ... Bit rate the bus load is given for, default 1000000.
+ *  -x N     ... Missed echoes that still pass, default 0.
+ *
+ * Reported are the PDO round trip from an RPDO to its echo, one SYNC
+ * period included, the drive response from SYNC to TPDO, the jitter
+ * of the SYNC period as the master sends it and the load the traffic
+ * would cause on a real bus, frames with worst case bit stuffing.
+ * vcan has no bit timing, a load above 100% only shows on hardware.
+ * An echo is due before the SYNC of the cycle after next, a later one
+ * counts as late, one still out after SIM_MISS_CYCLES as missed. Late
+ * echoes come from the host scheduler as much as from the drives.
+ * The exit status is 1 when the drives did not come up or missed more
+ * echoes than allowed, so CI can run it:
+ *
+ *  ip link add dev vcan0 type vcan && ip link set up vcan0
+ *  cansim -m 8 -t 10
+ *
+ * 8 drives fill a 1 Mbit/s bus at about 270 Hz, the default SYNC rate
+ * for them is 214 Hz. A rate given with -f above that overloads the bus.
+ *
+ * Build from the repository root:
+ *  cc -O2 -Wall -I Firmware/can -o cansim Firmware/tools/cansim/cansim.c \
+ *      Firmware/can/canbus.c Firmware/can/co402.c
+ */
+
+/*********************
+ *      INCLUDES
+ *********************/
+
+#define _GNU_SOURCE
+
+#include <errno.h>
+#include <net/if.h>
+#include <poll.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <linux/can.h>
+#include <linux/can/raw.h>
+#include <sys/ioctl.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/wait.h>
+#include "co402.h"
+
+/*********************
+ *      DEFINES
+ *********************/
+
+#define SIM_NODE_MAX CO402_NODE_ID_MAX
+#define SIM_AXIS_MAX (SIM_NODE_MAX * CO402_AXIS_NUM)
+
+/*RPDO send times kept per axis, echoes older than this are lost*/
+#define SIM_RING 64U
+
+/*Cycles after which an echo that did not come counts as missed*/
+#define SIM_MISS_CYCLES (SIM_RING / 2U)
+
+/*Samples kept per statistic*/
+#define LAT_WINDOW_MAX (1U << 20)
+
+/*Default SYNC rate, bus load it aims at and its upper end*/
+#define SIM_LOAD_PCT    80U
+#define SIM_SYNC_HZ_MAX 1000U
+
+/*Boot-up, SDO and enable timeouts*/
+#define SIM_BOOT_MS       2000U
+#define SIM_SDO_MS        100U
+#define SIM_ENABLE_CYCLES 2000U
+
+/*Statusword masked with 0x6F*/
+#define SIM_SW_MASK        0x006FU
+#define SIM_SW_READY       0x0021U
+#define SIM_SW_SWITCHED_ON 0x0023U
+#define SIM_SW_OP_ENABLED  0x0027U
+
+/*Controlword, shutdown and enable operation*/
+#define SIM_CW_SHUTDOWN 0x0006U
+#define SIM_CW_ENABLE   0x000FU
+
+/**********************
+ *      TYPEDEFS
+ **********************/
+
+typedef struct {
+    uint32_t num;
+    uint32_t ns[LAT_WINDOW_MAX];
+} sim_lat_t;
+
+typedef struct {
+    uint16_t sw;                /**< Last statusword*/
+    int32_t cycle[SIM_RING];    /**< Cycle of the RPDO in the slot*/
+    uint64_t sent_ns[SIM_RING];
+    bool echo[SIM_RING];
+} sim_axis_t;
+
+typedef struct {
+    uint64_t cycles;
+    uint64_t frames;
+    uint64_t bits;
+    uint64_t echoes;
+    uint64_t late;
+    uint64_t missed;
+    uint64_t tx_drop;
+    uint32_t sdo_num;
+    uint64_t sdo_ns;
+    uint64_t sdo_max_ns;
+} sim_stats_t;
+
+/**********************
+ *  STATIC PROTOTYPES
+ **********************/
+
+static uint64_t sim_clock_ns();
+static void sim_sleep_until(uint64_t t_ns);
+static int sim_poll(struct pollfd * pfd_p, nfds_t num, uint64_t deadline_ns);
+static int sim_can_open(const char * ifname);
+static int sim_unix_listen(const char * path);
+static int sim_unix_connect(const char * path);
+static bool sim_send(const can_frame_t * frame_p);
+static bool sim_read(int fd, can_frame_t * frame_p);
+static bool sim_filter_pass(const can_frame_t * frame_p);
+static uint32_t sim_frame_bits(const can_frame_t * frame_p);
+static uint32_t sim_sync_auto(uint8_t nodes);
+static int sim_drive(uint8_t node);
+static int sim_master(uint8_t nodes);
+static bool sim_master_recv(uint64_t deadline_ns);
+static void sim_master_frame(const can_frame_t * frame_p, uint64_t t_ns);
+static bool sim_master_sdo(uint8_t node, uint16_t index,
+    uint8_t sub, uint32_t val, uint8_t size);
+static bool sim_master_cycle(uint32_t k);
+static void sim_lat_add(sim_lat_t * lat_p, uint64_t ns);
+static void sim_lat_print(const char * title, sim_lat_t * lat_p);
+static void sim_report(uint64_t elapsed_ns);
+
+/**********************
+ *  STATIC VARIABLES
+ **********************/
+
+static const char * if_name = "vcan0";
+static const char * unix_path = NULL;
+static uint32_t sync_hz = 0; /*0 derives it from the axes*/
+static uint32_t run_s = 5;
+static uint32_t bit_rate = 1000000;
+static uint64_t miss_max = 0;
+static volatile sig_atomic_t quit = 0;
+
+/*Frames go to every peer, a drive and a SocketCAN master have one*/
+static int peer_fd[SIM_NODE_MAX] = {0};
+static uint8_t peer_num = 0;
+static bool relay = false;
+
+/*Drive, the filter banks of the port*/
+static struct can_filter banks[CAN_FILTER_NUM];
+static bool bank_on[CAN_FILTER_NUM];
+
+/*Master*/
+static uint8_t node_num = 0;
+static sim_axis_t * axes = NULL;
+static bool booted[SIM_NODE_MAX + 1];
+static bool sdo_got = false;
+static can_frame_t sdo_reply;
+static bool measuring = false;
+static uint32_t measure_start = 0;
+static uint32_t cycle_now = 0;
+static uint64_t sync_ns = 0;
+static uint64_t period_ns = 0;
+
+static sim_stats_t stats;
+static sim_lat_t lat_rt;
+static sim_lat_t lat_resp;
+static sim_lat_t lat_jitter;
+
+/**********************
+ *   GLOBAL FUNCTIONS
+ **********************/
+
+/*A missing mailbox is a full socket buffer, can_tx_isr() retries*/
+bool can_port_send(const can_frame_t * frame_p)
+{
+    return sim_send(frame_p);
+}
+
+/**
+ * Filter bank of the drive, SocketCAN gets all enabled banks as
+ * its receive filter, on the Unix bus they are checked on receive.
+ */
+bool can_port_filter(uint8_t bank, uint32_t id, uint32_t mask, bool on)
+{
+    struct can_filter list[CAN_FILTER_NUM];
+    uint8_t n = 0;
+
+    if (id & CAN_FRAME_EXT) {
+        banks[bank].can_id = (id & CAN_FRAME_EXT_MASK) | CAN_EFF_FLAG;
+        banks[bank].can_mask = mask & CAN_FRAME_EXT_MASK;
+    } else {
+        banks[bank].can_id = id & CAN_FRAME_STD_MASK;
+        banks[bank].can_mask = mask & CAN_FRAME_STD_MASK;
+    }
+    if (mask & CAN_FRAME_EXT) banks[bank].can_mask |= CAN_EFF_FLAG;
+    banks[bank].can_mask |= CAN_RTR_FLAG;
+    bank_on[bank] = on;
+
+    if (unix_path != NULL) return true;
+
+    for (uint8_t i = 0; i < CAN_FILTER_NUM; i++) {
+        if (bank_on[i]) list[n++] = banks[i];
+    }
+
+    return setsockopt(peer_fd[0], SOL_CAN_RAW, CAN_RAW_FILTER,
+        list, n * sizeof(struct can_filter)) == 0;
+}
+
+/*One process, no interrupt to hold off*/
+void can_port_lock() {}
+void can_port_unlock() {}
+
+/**
+ * SYNC of a simulated drive, every enabled axis is where
+ * its target says right away.
+ */
+void co402_port_sync(uint32_t count)
+{
+    (void)count;
+
+    for (uint8_t a = 0; a < CO402_AXIS_NUM; a++) {
+        co402_cmd_t cmd;
+        co402_actual_t act = {0};
+
+        co402_cmd_get(a, &cmd);
+        if (!cmd.enabled) continue;
+
+        act.pos = cmd.pos;
+        act.vel = cmd.vel;
+        act.torque = cmd.torque;
+        co402_actual_publish(a, &act);
+    }
+}
+
+static void sim_quit(int sig)
+{
+    (void)sig;
+    quit = 1;
+}
+
+int main(int argc, char ** argv)
+{
+    uint32_t master = 0;
+    uint32_t drive = 0;
+    int opt = 0;
+
+    while ((opt = getopt(argc, argv, "m:d:i:u:f:t:b:x:")) != -1) {
+        switch (opt) {
+        case 'm': master = strtoul(optarg, NULL, 0); break;
+        case 'd': drive = strtoul(optarg, NULL, 0); break;
+        case 'i': if_name = optarg; break;
+        case 'u': unix_path = optarg; break;
+        case 'f': sync_hz = strtoul(optarg, NULL, 0); break;
+        case 't': run_s = strtoul(optarg, NULL, 0); break;
+        case 'b': bit_rate = strtoul(optarg, NULL, 0); break;
+        case 'x': miss_max = strtoull(optarg, NULL, 0); break;
+        default:
+            fprintf(stderr, "usage: %s -m N | -d ID [-i IF | -u PATH] "
+                "[-f HZ] [-t SEC] [-b BIT] [-x N]\n", argv[0]);
+            return 2;
+        }
+    }
+
+    if ((master > SIM_NODE_MAX) || (drive > SIM_NODE_MAX) ||
+        (sync_hz > 20000) || (bit_rate == 0)) {
+        fprintf(stderr, "cansim: invalid argument\n");
+        return 2;
+    }
+
+    signal(SIGINT, sim_quit);
+    signal(SIGTERM, sim_quit);
+    signal(SIGPIPE, SIG_IGN);
+
+    if (master > 0) return sim_master((uint8_t)master);
+    if (drive > 0) return sim_drive((uint8_t)drive);
+
+    fprintf(stderr, "cansim: one of -m or -d is required\n");
+    return 2;
+}
+
+/**********************
+ *   STATIC FUNCTIONS
+ **********************/
+
+static uint64_t sim_clock_ns()
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec;
+}
+
+static void sim_sleep_until(uint64_t t_ns)
+{
+    struct timespec ts = {
+        .tv_sec = (time_t)(t_ns / 1000000000ULL),
+        .tv_nsec = (long)(t_ns % 1000000000ULL),
+    };
+
+    while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL) == EINTR) {
+        if (quit) return;
+    }
+}
+
+/**
+ * Waits for the sockets until the deadline, to the nanosecond,
+ * poll() in ms would spin or oversleep at a 1 ms cycle.
+ */
+static int sim_poll(struct pollfd * pfd_p, nfds_t num, uint64_t deadline_ns)
+{
+    uint64_t now = sim_clock_ns();
+    uint64_t wait = (now < deadline_ns) ? deadline_ns - now : 0;
+    struct timespec ts = {
+        .tv_sec = (time_t)(wait / 1000000000ULL),
+        .tv_nsec = (long)(wait % 1000000000ULL),
+    };
+
+    return ppoll(pfd_p, num, &ts, NULL);
+}
+
+/**
+ * Raw socket on a SocketCAN interface, no own frames back.
+ * @return Socket or -1.
+ */
+static int sim_can_open(const char * ifname)
+{
+    struct sockaddr_can addr = {0};
+    struct ifreq ifr = {0};
+    int fd = socket(PF_CAN, SOCK_RAW | SOCK_NONBLOCK, CAN_RAW);
+
+    if (fd < 0) {
+        perror("cansim: socket");
+        return -1;
+    }
+
+    strncpy(ifr.ifr_name, ifname, IFNAMSIZ - 1);
+    if (ioctl(fd, SIOCGIFINDEX, &ifr) < 0) {
+        fprintf(stderr, "cansim: no interface %s\n", ifname);
+        close(fd);
+        return -1;
+    }
+
+    addr.can_family = AF_CAN;
+    addr.can_ifindex = ifr.ifr_ifindex;
+    if (bind(fd, (struct sockaddr *)&addr, sizeof(addr)) < 0) {
+        perror("cansim: bind");
+        close(fd);
+        return -1;
+    }
+
+    return fd;
+}
+
+static int sim_unix_listen(const char * path)
+{
+    struct sockaddr_un addr = {.sun_family = AF_UNIX};
+    int fd = socket(AF_UNIX, SOCK_SEQPACKET, 0);
+
+    if (fd < 0) return -1;
+
+    strncpy(addr.sun_path, path, sizeof(addr.sun_path) - 1);
+    unlink(path);
+
+    if ((bind(fd, (struct sockaddr *)&addr, sizeof(addr)) < 0) ||
+        (listen(fd, SIM_NODE_MAX) < 0)) {
+        perror("cansim: unix bus");
+        close(fd);
+        return -1;
+    }
+
+    return fd;
+}
+
+static int sim_unix_connect(const char * path)
+{
+    struct sockaddr_un addr = {.sun_family = AF_UNIX};
+    int fd = socket(AF_UNIX, SOCK_SEQPACKET | SOCK_NONBLOCK, 0);
+
+    if (fd < 0) return -1;
+
+    strncpy(addr.sun_path, path, sizeof(addr.sun_path) - 1);
+    if (connect(fd, (struct sockaddr *)&addr, sizeof(addr)) < 0) {
+        perror("cansim: unix bus");
+        close(fd);
+        return -1;
+    }
+
+    return fd;
+}
+
+/**
+ * Puts a frame on the bus, to every peer.
+ * @return false if a socket buffer was full.
+ */
+static bool sim_send(const can_frame_t * frame_p)
+{
+    struct can_frame cf = {0};
+    bool ok = true;
+
+    if (frame_p->id & CAN_FRAME_EXT) cf.can_id = (frame_p->id & CAN_FRAME_EXT_MASK) | CAN_EFF_FLAG;
+    else cf.can_id = frame_p->id & CAN_FRAME_STD_MASK;
+    cf.len = frame_p->dlc;
+    memcpy(cf.data, frame_p->data, frame_p->dlc);
+
+    for (uint8_t i = 0; i < peer_num; i++) {
+        if (write(peer_fd[i], &cf, sizeof(cf)) != sizeof(cf)) ok = false;
+    }
+
+    return ok;
+}
+
+/**
+ * Takes one frame from a socket.
+ * @return false if there is none, or the peer is gone.
+ */
+static bool sim_read(int fd, can_frame_t * frame_p)
+{
+    struct can_frame cf;
+    ssize_t n = read(fd, &cf, sizeof(cf));
+
+    if (n != sizeof(cf)) {
+        if (n == 0) quit = 1;
+        return false;
+    }
+
+    if (cf.can_id & (CAN_RTR_FLAG | CAN_ERR_FLAG)) {
+        frame_p->dlc = 0xFF;
+        return true;
+    }
+
+    if (cf.can_id & CAN_EFF_FLAG) frame_p->id = (cf.can_id & CAN_EFF_MASK) | CAN_FRAME_EXT;
+    else frame_p->id = cf.can_id & CAN_SFF_MASK;
+    frame_p->dlc = (cf.len > 8) ? 8 : cf.len;
+    memcpy(frame_p->data, cf.data, frame_p->dlc);
+    return true;
+}
+
+/**
+ * Filter banks on the Unix bus, the controller would do this.
+ */
+static bool sim_filter_pass(const can_frame_t * frame_p)
+{
+    uint32_t id = frame_p->id & CAN_FRAME_EXT_MASK;
+
+    if (frame_p->id & CAN_FRAME_EXT) id |= CAN_EFF_FLAG;
+
+    for (uint8_t i = 0; i < CAN_FILTER_NUM; i++) {
+        if (!bank_on[i]) continue;
+        if (((id ^ banks[i].can_id) & banks[i].can_mask) == 0) return true;
+    }
+
+    return false;
+}
+
+/**
+ * Bits a data frame takes on the bus, interframe space included,
+ * one stuff bit per 4 bits from start of frame to CRC.
+ */
+static uint32_t sim_frame_bits(const can_frame_t * frame_p)
+{
+    uint32_t data = frame_p->dlc * 8U;
+
+    if (frame_p->id & CAN_FRAME_EXT) return 67U + data + (53U + data) / 4U;
+    return 47U + data + (33U + data) / 4U;
+}
+
+/**
+ * SYNC rate that loads the bus to SIM_LOAD_PCT, a cycle is the SYNC
+ * plus an RPDO and a TPDO of 6 bytes per axis.
+ */
+static uint32_t sim_sync_auto(uint8_t nodes)
+{
+    can_frame_t sync = {.id = CO402_COB_SYNC, .dlc = 0};
+    can_frame_t pdo = {.id = CO402_COB_RPDO, .dlc = 6};
+    uint64_t bits = sim_frame_bits(&sync) +
+        (uint64_t)nodes * CO402_AXIS_NUM * 2U * sim_frame_bits(&pdo);
+    uint64_t hz = (uint64_t)bit_rate * SIM_LOAD_PCT / 100U / bits;
+
+    if (hz < 1) return 1;
+    if (hz > SIM_SYNC_HZ_MAX) return SIM_SYNC_HZ_MAX;
+    return (uint32_t)hz;
+}
+
+/**
+ * A simulated drive. The socket is the receive interrupt, the
+ * main loop and the 1 ms tick run in one loop as on the board.
+ */
+static int sim_drive(uint8_t node)
+{
+    struct pollfd pfd = {0};
+    can_frame_t frame;
+    uint64_t tick_ns = 0;
+    uint64_t now = 0;
+    int fd = (unix_path != NULL) ? sim_unix_connect(unix_path) : sim_can_open(if_name);
+
+    if (fd < 0) return 1;
+
+    peer_fd[0] = fd;
+    peer_num = 1;
+
+    co402_init(node);
+
+    pfd.fd = fd;
+    pfd.events = POLLIN;
+    tick_ns = sim_clock_ns() + 1000000ULL;
+
+    while (!quit) {
+        sim_poll(&pfd, 1, tick_ns);
+
+        while (sim_read(fd, &frame)) {
+            if (frame.dlc > 8) continue;
+            if ((unix_path != NULL) && !sim_filter_pass(&frame)) continue;
+            can_rx_isr(&frame);
+        }
+
+        can_tx_isr();
+        co402_poll();
+
+        for (now = sim_clock_ns(); now >= tick_ns; tick_ns += 1000000ULL)
+            co402_tick();
+    }
+
+    close(fd);
+    return 0;
+}
+
+/**
+ * Starts the drives, brings them up and runs the cycle.
+ */
+static int sim_master(uint8_t nodes)
+{
+    pid_t pids[SIM_NODE_MAX] = {0};
+    can_frame_t nmt = {.id = CO402_COB_NMT, .dlc = 2, .data = {CO402_NMT_CMD_START, 0}};
+    uint64_t t0 = 0;
+    uint64_t deadline = 0;
+    uint32_t cycles = 0;
+    uint32_t k = 0;
+    bool ok = true;
+    int listen_fd = -1;
+
+    if (sync_hz == 0) sync_hz = sim_sync_auto(nodes);
+    cycles = sync_hz * run_s;
+
+    node_num = nodes;
+    axes = calloc(nodes * CO402_AXIS_NUM, sizeof(sim_axis_t));
+    period_ns = 1000000000ULL / sync_hz;
+    if (axes == NULL) return 1;
+
+    if (unix_path != NULL) {
+        listen_fd = sim_unix_listen(unix_path);
+        if (listen_fd < 0) return 1;
+        relay = true;
+    } else {
+        peer_fd[0] = sim_can_open(if_name);
+        if (peer_fd[0] < 0) return 1;
+        peer_num = 1;
+    }
+
+    for (uint8_t n = 0; n < nodes; n++) {
+        pids[n] = fork();
+        if (pids[n] == 0) {
+            if (listen_fd >= 0) close(listen_fd);
+            if (!relay) close(peer_fd[0]);
+            peer_num = 0;
+            relay = false;
+            _exit(sim_drive(n + 1));
+        }
+    }
+
+    /*The relay waits for every drive, SocketCAN sees them come up*/
+    if (relay) {
+        struct pollfd pfd = {.fd = listen_fd, .events = POLLIN};
+
+        while ((peer_num < nodes) && (poll(&pfd, 1, SIM_BOOT_MS) > 0))
+            peer_fd[peer_num++] = accept4(listen_fd, NULL, NULL, SOCK_NONBLOCK);
+    }
+
+    deadline = sim_clock_ns() + SIM_BOOT_MS * 1000000ULL;
+    for (uint8_t n = 1; (n <= nodes) && !quit; n++) {
+        while (!booted[n] && sim_master_recv(deadline));
+        if (!booted[n]) {
+            fprintf(stderr, "cansim: node %u did not boot\n", n);
+            ok = false;
+            break;
+        }
+    }
+
+    /*Every axis in cyclic synchronous position, then all operational*/
+    for (uint8_t n = 1; ok && (n <= nodes); n++) {
+        for (uint8_t a = 0; ok && (a < CO402_AXIS_NUM); a++) {
+            ok = sim_master_sdo(n, CO402_IDX_MODE + a * CO402_AXIS_OFFSET,
+                0, CO402_MODE_CSP, 1);
+        }
+    }
+
+    if (ok) sim_send(&nmt);
+
+    t0 = sim_clock_ns();
+    deadline = t0;
+
+    for (k = 1; ok && !quit; k++) {
+        sim_sleep_until(deadline);
+        if (!sim_master_cycle(k)) break;
+
+        deadline += period_ns;
+        while (sim_master_recv(deadline));
+
+        if (!measuring) {
+            bool all = true;
+
+            for (uint32_t a = 0; a < nodes * CO402_AXIS_NUM; a++)
+                all &= ((axes[a].sw & SIM_SW_MASK) == SIM_SW_OP_ENABLED);
+
+            if (all) {
+                measuring = true;
+                measure_start = k + 1;
+                t0 = deadline;
+            } else if (k > SIM_ENABLE_CYCLES) {
+                fprintf(stderr, "cansim: axes not enabled\n");
+                ok = false;
+            }
+        } else if (k - measure_start + 1 >= cycles) {
+            break;
+        }
+    }
+
+    if (measuring) sim_report(sim_clock_ns() - t0);
+    if (stats.missed > miss_max) ok = false;
+
+    for (uint8_t n = 0; n < nodes; n++) {
+        if (pids[n] > 0) kill(pids[n], SIGTERM);
+    }
+    for (uint8_t n = 0; n < nodes; n++) {
+        if (pids[n] > 0) waitpid(pids[n], NULL, 0);
+    }
+
+    if (relay) unlink(unix_path);
+    free(axes);
+    return ok ? 0 : 1;
+}
+
+/**
+ * Handles the frames until the deadline, the relay passes
+ * every frame of a drive on to all the others.
+ * @return false at the deadline.
+ */
+static bool sim_master_recv(uint64_t deadline_ns)
+{
+    struct pollfd pfd[SIM_NODE_MAX];
+    can_frame_t frame;
+    struct can_frame cf;
+    uint64_t now = sim_clock_ns();
+
+    if (now >= deadline_ns) return false;
+
+    for (uint8_t i = 0; i < peer_num; i++) {
+        pfd[i].fd = peer_fd[i];
+        pfd[i].events = POLLIN;
+        pfd[i].revents = 0;
+    }
+
+    if (sim_poll(pfd, peer_num, deadline_ns) <= 0)
+        return sim_clock_ns() < deadline_ns;
+
+    for (uint8_t i = 0; i < peer_num; i++) {
+        if (!(pfd[i].revents & POLLIN)) continue;
+
+        while (sim_read(peer_fd[i], &frame)) {
+            if (frame.dlc > 8) continue;
+            now = sim_clock_ns();
+
+            if (relay) {
+                memset(&cf, 0, sizeof(cf));
+                if (frame.id & CAN_FRAME_EXT) cf.can_id = (frame.id & CAN_FRAME_EXT_MASK) | CAN_EFF_FLAG;
+                else cf.can_id = frame.id;
+                cf.len = frame.dlc;
+                memcpy(cf.data, frame.data, frame.dlc);
+
+                for (uint8_t j = 0; j < peer_num; j++) {
+                    if ((j != i) && (write(peer_fd[j], &cf, sizeof(cf)) != sizeof(cf)))
+                        stats.tx_drop++;
+                }
+            }
+
+            sim_master_frame(&frame, now);
+        }
+    }
+
+    return true;
+}
+
+static void sim_master_frame(const can_frame_t * frame_p, uint64_t t_ns)
+{
+    uint32_t id = frame_p->id;
+    uint32_t a = 0;
+    int32_t pos = 0;
+    sim_axis_t * ax_p = NULL;
+
+    if (measuring) {
+        stats.frames++;
+        stats.bits += sim_frame_bits(frame_p);
+    }
+
+    if ((id > CO402_COB_HEARTBEAT) && (id <= CO402_COB_HEARTBEAT + node_num)) {
+        if ((frame_p->dlc == 1) && (frame_p->data[0] == CO402_NMT_INIT))
+            booted[id - CO402_COB_HEARTBEAT] = true;
+        return;
+    }
+
+    if ((id > CO402_COB_SDO_TX) && (id <= CO402_COB_SDO_TX + node_num)) {
+        sdo_reply = *frame_p;
+        sdo_got = true;
+        return;
+    }
+
+    /*TPDO1 axis 0, TPDO3 axis 1, statusword and position*/
+    if ((id > CO402_COB_TPDO) && (id <= CO402_COB_TPDO + node_num)) {
+        a = (id - CO402_COB_TPDO - 1) * CO402_AXIS_NUM;
+    } else if ((id > CO402_COB_TPDO + 0x200U) && (id <= CO402_COB_TPDO + 0x200U + node_num)) {
+        a = (id - CO402_COB_TPDO - 0x200U - 1) * CO402_AXIS_NUM + 1;
+    } else return;
+
+    if (frame_p->dlc < 6) return;
+
+    ax_p = &axes[a];
+    ax_p->sw = (uint16_t)(frame_p->data[0] | (frame_p->data[1] << 8));
+    pos = (int32_t)(frame_p->data[2] | (frame_p->data[3] << 8) |
+        ((uint32_t)frame_p->data[4] << 16) | ((uint32_t)frame_p->data[5] << 24));
+
+    if (!measuring || (pos < (int32_t)measure_start)) return;
+    if ((ax_p->cycle[pos % SIM_RING] != pos) || ax_p->echo[pos % SIM_RING]) return;
+
+    ax_p->echo[pos % SIM_RING] = true;
+    stats.echoes++;
+    if (cycle_now >= (uint32_t)pos + 2U) stats.late++;
+    sim_lat_add(&lat_rt, t_ns - ax_p->sent_ns[pos % SIM_RING]);
+    sim_lat_add(&lat_resp, t_ns - sync_ns);
+}
+
+/**
+ * Expedited download, waits for the reply.
+ * @return Whether the drive confirmed it.
+ */
+static bool sim_master_sdo(uint8_t node, uint16_t index,
+    uint8_t sub, uint32_t val, uint8_t size)
+{
+    can_frame_t req = {
+        .id = CO402_COB_SDO_RX + node,
+        .dlc = 8,
+        .data = {0x23 | ((4 - size) << 2), index & 0xFF, index >> 8, sub,
+            val & 0xFF, (val >> 8) & 0xFF, (val >> 16) & 0xFF, val >> 24},
+    };
+    uint64_t t0 = sim_clock_ns();
+    uint64_t dt = 0;
+
+    sdo_got = false;
+    sim_send(&req);
+
+    while (!sdo_got && sim_master_recv(t0 + SIM_SDO_MS * 1000000ULL));
+
+    if (!sdo_got || (sdo_reply.data[0] != 0x60)) {
+        fprintf(stderr, "cansim: node %u SDO %04X:%u failed\n", node, index, sub);
+        return false;
+    }
+
+    dt = sim_clock_ns() - t0;
+    stats.sdo_num++;
+    stats.sdo_ns += dt;
+    if (dt > stats.sdo_max_ns) stats.sdo_max_ns = dt;
+    return true;
+}
+
+/**
+ * SYNC, then one RPDO per axis with the cycle as target, the
+ * controlword enables the axis step by step.
+ * @return false if the cycle could not be sent.
+ */
+static bool sim_master_cycle(uint32_t k)
+{
+    can_frame_t sync = {.id = CO402_COB_SYNC, .dlc = 0};
+    uint64_t now = sim_clock_ns();
+
+    if (measuring && (k > measure_start)) {
+        uint64_t dt = now - sync_ns;
+        sim_lat_add(&lat_jitter, (dt > period_ns) ? dt - period_ns : period_ns - dt);
+    }
+
+    sync_ns = now;
+    cycle_now = k;
+    if (!sim_send(&sync)) stats.tx_drop++;
+    if (measuring) {
+        stats.cycles++;
+        stats.frames++;
+        stats.bits += sim_frame_bits(&sync);
+    }
+
+    for (uint32_t a = 0; a < node_num * CO402_AXIS_NUM; a++) {
+        sim_axis_t * ax_p = &axes[a];
+        uint16_t sw = ax_p->sw & SIM_SW_MASK;
+        uint16_t cw = ((sw == SIM_SW_READY) || (sw == SIM_SW_SWITCHED_ON) ||
+            (sw == SIM_SW_OP_ENABLED)) ? SIM_CW_ENABLE : SIM_CW_SHUTDOWN;
+        uint8_t node = a / CO402_AXIS_NUM + 1;
+        uint32_t slot = k % SIM_RING;
+        can_frame_t rpdo = {
+            .id = CO402_COB_RPDO + (a % CO402_AXIS_NUM) * 0x200U + node,
+            .dlc = 6,
+            .data = {cw & 0xFF, cw >> 8, k & 0xFF, (k >> 8) & 0xFF,
+                (k >> 16) & 0xFF, k >> 24},
+        };
+
+        /*The echo of this cycle is given up, its slot comes up soon*/
+        if (measuring && (k >= measure_start + SIM_MISS_CYCLES)) {
+            uint32_t due = (k - SIM_MISS_CYCLES) % SIM_RING;
+            if (!ax_p->echo[due]) stats.missed++;
+        }
+
+        ax_p->cycle[slot] = (int32_t)k;
+        ax_p->echo[slot] = false;
+        ax_p->sent_ns[slot] = sim_clock_ns();
+
+        if (!sim_send(&rpdo)) stats.tx_drop++;
+        if (measuring) {
+            stats.frames++;
+            stats.bits += sim_frame_bits(&rpdo);
+        }
+    }
+
+    return !quit;
+}
+
+static void sim_lat_add(sim_lat_t * lat_p, uint64_t ns)
+{
+    if (lat_p->num < LAT_WINDOW_MAX)
+        lat_p->ns[lat_p->num++] = (ns > UINT32_MAX) ? UINT32_MAX : (uint32_t)ns;
+}
+
+static int sim_lat_cmp(const void * a_p, const void * b_p)
+{
+    uint32_t a = *(const uint32_t *)a_p;
+    uint32_t b = *(const uint32_t *)b_p;
+
+    return (a > b) - (a < b);
+}
+
+static void sim_lat_print(const char * title, sim_lat_t * lat_p)
+{
+    uint32_t n = lat_p->num;
+
+    if (n == 0) return;
+
+    qsort(lat_p->ns, n, sizeof(uint32_t), sim_lat_cmp);
+    printf("  %s [us] p50 %.1f p90 %.1f p99 %.1f p99.9 %.1f max %.1f\n", title,
+        lat_p->ns[n * 50 / 100] / 1e3, lat_p->ns[n * 90 / 100] / 1e3,
+        lat_p->ns[n * 99 / 100] / 1e3, lat_p->ns[n * 999 / 1000] / 1e3,
+        lat_p->ns[n - 1] / 1e3);
+}
+
+static void sim_report(uint64_t elapsed_ns)
+{
+    double secs = (double)elapsed_ns / 1e9;
+    double bps = (secs > 0.0) ? (double)stats.bits / secs : 0.0;
+    double per_cycle = (stats.cycles > 0) ? (double)stats.bits / (double)stats.cycles : 0.0;
+
+    printf("cansim: %u drives, %u axes, SYNC %u Hz, %llu cycles on %s\n",
+        node_num, node_num * CO402_AXIS_NUM, sync_hz,
+        (unsigned long long)stats.cycles, relay ? unix_path : if_name);
+
+    sim_lat_print("round trip", &lat_rt);
+    sim_lat_print("sync to tpdo", &lat_resp);
+    sim_lat_print("sync jitter", &lat_jitter);
+
+    printf("  bus load %.1f%% of %u bit/s, %.0f bits per cycle, "
+        "%.0f Hz SYNC at most\n", bps * 100.0 / bit_rate, bit_rate,
+        per_cycle, (per_cycle > 0.0) ? bit_rate / per_cycle : 0.0);
+
+    printf("  echoes %llu, late %llu, missed %llu, dropped %llu frames",
+        (unsigned long long)stats.echoes, (unsigned long long)stats.late,
+        (unsigned long long)stats.missed,
+        (unsigned long long)stats.tx_drop);
+    if (stats.sdo_num > 0) {
+        printf(", sdo [us] avg %.1f max %.1f",
+            (double)stats.sdo_ns / stats.sdo_num / 1e3, stats.sdo_max_ns / 1e3);
+    }
+    printf("\n");
+    fflush(stdout);
+}
@@ -0,0 +1,254 @@
+/**
+ * @file crcbench.c
+ *
+ * Host check of the sliced Modbus CRC16. crc16_update() of crc16.c
+ * is compared with the byte-wise table implementation it replaced,
+ * over random frames of random length, whole and fed in pieces at
+ * random split points the way the RTU receiver accumulates it. Then
+ * the throughput of both is measured on full frames.
+ *
+ *  crcbench        ... 100000 frames, then the throughput.
+ *
+ *  -n N     ... Number of random frames.
+ *  -s SEED  ... Seed of the frame generator.
+ *
+ * Build from the repository root:
+ *  cc -O2 -Wall -I Firmware/modbus -o crcbench \
+ *      Firmware/tools/crcbench/crcbench.c Firmware/modbus/crc16.c
+ */
+
+/*********************
+ *      INCLUDES
+ *********************/
+
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include "crc16.h"
+
+/*********************
+ *      DEFINES
+ *********************/
+
+/*Longest RTU frame*/
+#define FRAME_MAX 256U
+
+#define CHECK_FRAMES 100000U
+
+/*Bytes run through each implementation for the throughput*/
+#define BENCH_BYTES (64U << 20)
+
+/**********************
+ *  STATIC PROTOTYPES
+ **********************/
+
+static uint64_t bench_clock_ns();
+static uint16_t crc16_ref(const uint8_t * buffer, uint16_t buffer_length);
+static int bench_check(uint32_t count);
+static void bench_rate();
+
+/**********************
+ *  STATIC VARIABLES
+ **********************/
+
+/*Tables of the byte-wise implementation, as crc16.c had them*/
+static const uint8_t table_crc_hi[] = {
+    0x00, 0xC1, 0x81, 0x40, 0x01, 0xC0, 0x80, 0x41, 0x01, 0xC0, 0x80, 0x41, 0x00, 0xC1,
+    0x81, 0x40, 0x01, 0xC0, 0x80, 0x41, 0x00, 0xC1, 0x81, 0x40, 0x00, 0xC1, 0x81, 0x40,
+    0x01, 0xC0, 0x80, 0x41, 0x01, 0xC0, 0x80, 0x41, 0x00, 0xC1, 0x81, 0x40, 0x00, 0xC1,
+    0x81, 0x40, 0x01, 0xC0, 0x80, 0x41, 0x00, 0xC1, 0x81, 0x40, 0x01, 0xC0, 0x80, 0x41,
+    0x01, 0xC0, 0x80, 0x41, 0x00, 0xC1, 0x81, 0x40, 0x01, 0xC0, 0x80, 0x41, 0x00, 0xC1,
+    0x81, 0x40, 0x00, 0xC1, 0x81, 0x40, 0x01, 0xC0, 0x80, 0x41, 0x00, 0xC1, 0x81, 0x40,
+    0x01, 0xC0, 0x80, 0x41, 0x01, 0xC0, 0x80, 0x41, 0x00, 0xC1, 0x81, 0x40, 0x00, 0xC1,
+    0x81, 0x40, 0x01, 0xC0, 0x80, 0x41, 0x01, 0xC0, 0x80, 0x41, 0x00, 0xC1, 0x81, 0x40,
+    0x01, 0xC0, 0x80, 0x41, 0x00, 0xC1, 0x81, 0x40, 0x00, 0xC1, 0x81, 0x40, 0x01, 0xC0,
+    0x80, 0x41, 0x01, 0xC0, 0x80, 0x41, 0x00, 0xC1, 0x81, 0x40, 0x00, 0xC1, 0x81, 0x40,
+    0x01, 0xC0, 0x80, 0x41, 0x00, 0xC1, 0x81, 0x40, 0x01, 0xC0, 0x80, 0x41, 0x01, 0xC0,
+    0x80, 0x41, 0x00, 0xC1, 0x81, 0x40, 0x00, 0xC1, 0x81, 0x40, 0x01, 0xC0, 0x80, 0x41,
+    0x01, 0xC0, 0x80, 0x41, 0x00, 0xC1, 0x81, 0x40, 0x01, 0xC0, 0x80, 0x41, 0x00, 0xC1,
+    0x81, 0x40, 0x00, 0xC1, 0x81, 0x40, 0x01, 0xC0, 0x80, 0x41, 0x00, 0xC1, 0x81, 0x40,
+    0x01, 0xC0, 0x80, 0x41, 0x01, 0xC0, 0x80, 0x41, 0x00, 0xC1, 0x81, 0x40, 0x01, 0xC0,
+    0x80, 0x41, 0x00, 0xC1, 0x81, 0x40, 0x00, 0xC1, 0x81, 0x40, 0x01, 0xC0, 0x80, 0x41,
+    0x01, 0xC0, 0x80, 0x41, 0x00, 0xC1, 0x81, 0x40, 0x00, 0xC1, 0x81, 0x40, 0x01, 0xC0,
+    0x80, 0x41, 0x00, 0xC1, 0x81, 0x40, 0x01, 0xC0, 0x80, 0x41, 0x01, 0xC0, 0x80, 0x41,
+    0x00, 0xC1, 0x81, 0x40
+};
+
+static const uint8_t table_crc_lo[] = {
+    0x00, 0xC0, 0xC1, 0x01, 0xC3, 0x03, 0x02, 0xC2, 0xC6, 0x06, 0x07, 0xC7, 0x05, 0xC5,
+    0xC4, 0x04, 0xCC, 0x0C, 0x0D, 0xCD, 0x0F, 0xCF, 0xCE, 0x0E, 0x0A, 0xCA, 0xCB, 0x0B,
+    0xC9, 0x09, 0x08, 0xC8, 0xD8, 0x18, 0x19, 0xD9, 0x1B, 0xDB, 0xDA, 0x1A, 0x1E, 0xDE,
+    0xDF, 0x1F, 0xDD, 0x1D, 0x1C, 0xDC, 0x14, 0xD4, 0xD5, 0x15, 0xD7, 0x17, 0x16, 0xD6,
+    0xD2, 0x12, 0x13, 0xD3, 0x11, 0xD1, 0xD0, 0x10, 0xF0, 0x30, 0x31, 0xF1, 0x33, 0xF3,
+    0xF2, 0x32, 0x36, 0xF6, 0xF7, 0x37, 0xF5, 0x35, 0x34, 0xF4, 0x3C, 0xFC, 0xFD, 0x3D,
+    0xFF, 0x3F, 0x3E, 0xFE, 0xFA, 0x3A, 0x3B, 0xFB, 0x39, 0xF9, 0xF8, 0x38, 0x28, 0xE8,
+    0xE9, 0x29, 0xEB, 0x2B, 0x2A, 0xEA, 0xEE, 0x2E, 0x2F, 0xEF, 0x2D, 0xED, 0xEC, 0x2C,
+    0xE4, 0x24, 0x25, 0xE5, 0x27, 0xE7, 0xE6, 0x26, 0x22, 0xE2, 0xE3, 0x23, 0xE1, 0x21,
+    0x20, 0xE0, 0xA0, 0x60, 0x61, 0xA1, 0x63, 0xA3, 0xA2, 0x62, 0x66, 0xA6, 0xA7, 0x67,
+    0xA5, 0x65, 0x64, 0xA4, 0x6C, 0xAC, 0xAD, 0x6D, 0xAF, 0x6F, 0x6E, 0xAE, 0xAA, 0x6A,
+    0x6B, 0xAB, 0x69, 0xA9, 0xA8, 0x68, 0x78, 0xB8, 0xB9, 0x79, 0xBB, 0x7B, 0x7A, 0xBA,
+    0xBE, 0x7E, 0x7F, 0xBF, 0x7D, 0xBD, 0xBC, 0x7C, 0xB4, 0x74, 0x75, 0xB5, 0x77, 0xB7,
+    0xB6, 0x76, 0x72, 0xB2, 0xB3, 0x73, 0xB1, 0x71, 0x70, 0xB0, 0x50, 0x90, 0x91, 0x51,
+    0x93, 0x53, 0x52, 0x92, 0x96, 0x56, 0x57, 0x97, 0x55, 0x95, 0x94, 0x54, 0x9C, 0x5C,
+    0x5D, 0x9D, 0x5F, 0x9F, 0x9E, 0x5E, 0x5A, 0x9A, 0x9B, 0x5B, 0x99, 0x59, 0x58, 0x98,
+    0x88, 0x48, 0x49, 0x89, 0x4B, 0x8B, 0x8A, 0x4A, 0x4E, 0x8E, 0x8F, 0x4F, 0x8D, 0x4D,
+    0x4C, 0x8C, 0x44, 0x84, 0x85, 0x45, 0x87, 0x47, 0x46, 0x86, 0x82, 0x42, 0x43, 0x83,
+    0x41, 0x81, 0x80, 0x40
+};
+
+/*Keeps the compiler from dropping the timed loops*/
+static volatile uint16_t sink = 0;
+
+/**********************
+ *   GLOBAL FUNCTIONS
+ **********************/
+
+int main(int argc, char ** argv)
+{
+    uint32_t count = CHECK_FRAMES;
+    int opt = 0;
+
+    while ((opt = getopt(argc, argv, "n:s:")) != -1) {
+        switch (opt) {
+        case 'n': count = strtoul(optarg, NULL, 0); break;
+        case 's': srand(strtoul(optarg, NULL, 0)); break;
+        default:
+            fprintf(stderr, "usage: %s [-n N] [-s SEED]\n", argv[0]);
+            return 2;
+        }
+    }
+
+    if (bench_check(count) != 0) return 1;
+    bench_rate();
+
+    return 0;
+}
+
+/**********************
+ *   STATIC FUNCTIONS
+ **********************/
+
+static uint64_t bench_clock_ns()
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec;
+}
+
+/**
+ * The byte-wise implementation crc16.c had before the slicing.
+ */
+static uint16_t crc16_ref(const uint8_t * buffer, uint16_t buffer_length)
+{
+    uint8_t crc_hi = 0xFF; /*high CRC byte initialized*/
+    uint8_t crc_lo = 0xFF; /*low CRC byte initialized*/
+    uint32_t i = 0;        /*will index into CRC lookup*/
+
+    /*pass through message buffer*/
+    while (buffer_length--) {
+        i = crc_lo ^ *buffer++; /*calculate the CRC*/
+        crc_lo = crc_hi ^ table_crc_hi[i];
+        crc_hi = table_crc_lo[i];
+    }
+
+    return (crc_hi << 8 | crc_lo);
+}
+
+/**
+ * Compares both implementations on random frames, whole, split in 
+ * two and split in three, and on the example frame of the Modbus 
+ * specification.
+ * @param count Number of random frames.
+ * @return 0 if every CRC matched.
+ */
+static int bench_check(uint32_t count)
+{
+    static const uint8_t example[] = {0x01, 0x03, 0x00, 0x00, 0x00, 0x0A};
+    uint8_t frame[FRAME_MAX];
+    uint32_t errors = 0;
+
+    if ((crc16(example, sizeof(example)) != 0xCDC5) ||
+        (crc16_ref(example, sizeof(example)) != 0xCDC5)) {
+        printf("check: 01 03 00 00 00 0A does not give 0xCDC5\n");
+        return 1;
+    }
+
+    for (uint32_t n = 0; n < count; n++) {
+        uint16_t len = (uint16_t)(rand() % (FRAME_MAX + 1U));
+        uint16_t a = (len > 0) ? (uint16_t)(rand() % (len + 1U)) : 0;
+        uint16_t b = (uint16_t)(a + rand() % (len - a + 1U));
+        uint16_t ref = 0;
+        uint16_t crc = 0;
+
+        for (uint16_t i = 0; i < len; i++) frame[i] = (uint8_t)rand();
+        ref = crc16_ref(frame, len);
+
+        /*Whole*/
+        if (crc16(frame, len) != ref) errors++;
+
+        /*Two pieces*/
+        crc = crc16_update(CRC16_INIT, frame, a);
+        if (crc16_update(crc, &frame[a], len - a) != ref) errors++;
+
+        /*Three pieces*/
+        crc = crc16_update(CRC16_INIT, frame, a);
+        crc = crc16_update(crc, &frame[a], b - a);
+        if (crc16_update(crc, &frame[b], len - b) != ref) errors++;
+
+        /*Over the frame including its CRC the result is 0*/
+        if (len + 2U <= FRAME_MAX) {
+            frame[len + 0] = (uint8_t)(ref & 0xFF);
+            frame[len + 1] = (uint8_t)(ref >> 8);
+            if (crc16(frame, len + 2) != 0) errors++;
+        }
+    }
+
+    printf("check: %u frames, %u mismatches\n", count, errors);
+    return (errors == 0) ? 0 : 1;
+}
+
+/**
+ * Throughput of both implementations on full frames and 
+ * on short ones, like a register read request.
+ */
+static void bench_rate()
+{
+    static const uint16_t size[] = {FRAME_MAX, 8};
+    uint8_t frame[FRAME_MAX];
+    uint16_t crc = 0;
+
+    for (uint16_t i = 0; i < FRAME_MAX; i++) frame[i] = (uint8_t)rand();
+
+    for (uint8_t k = 0; k < sizeof(size) / sizeof(size[0]); k++) {
+        uint32_t rounds = BENCH_BYTES / size[k];
+        uint64_t t0 = 0;
+        double ref_ns = 0.0;
+        double new_ns = 0.0;
+
+        t0 = bench_clock_ns();
+        for (uint32_t r = 0; r < rounds; r++) {
+            frame[0] = (uint8_t)r;
+            crc ^= crc16_ref(frame, size[k]);
+        }
+        ref_ns = (double)(bench_clock_ns() - t0);
+
+        t0 = bench_clock_ns();
+        for (uint32_t r = 0; r < rounds; r++) {
+            frame[0] = (uint8_t)r;
+            crc ^= crc16(frame, size[k]);
+        }
+        new_ns = (double)(bench_clock_ns() - t0);
+
+        printf("%3u byte frames: byte-wise %.0f MB/s, sliced %.0f MB/s, "
+            "%.1f times\n", size[k],
+            (double)rounds * size[k] * 1e3 / ref_ns,
+            (double)rounds * size[k] * 1e3 / new_ns, ref_ns / new_ns);
+    }
+
+    sink = crc;
+}
@@ -0,0 +1,795 @@
+/**
+ * @file mbsim.c
+ *
+ * Host simulator for load testing the Modbus slave stack off-target.
+ * It links mb.c, mbrtu.c and crc16.c unchanged and feeds them whole
+ * frames, the way the DMA port of the firmware does, then reports the
+ * frame rate, the slave processing latency percentiles and how damaged
+ * frames were handled.
+ *
+ *  mbsim -b N      ... in-process bench, N requests from mbmaster.c
+ *                      over a simulated line, then a check of the
+ *                      MBAP to RTU conversion of the TCP front end
+ *                      and of the single and mask register writes.
+ *  mbsim -t PORT   ... Modbus TCP front end, standard tools connect
+ *                      to PORT, the gateway converts MBAP to RTU.
+ *  mbsim -p        ... RTU on a pseudo-terminal, the path is printed,
+ *                      frames end after t3.5 of silence.
+ *
+ *  -a ADDR  ... Slave address, default 1.
+ *  -r BAUD  ... Baud rate for t3.5 on the pty, default 115200.
+ *  -n PCT   ... Percentage of frames that get one bit flipped,
+ *               requests and replies alike.
+ *  -s SEED  ... Seed of the noise generator.
+ *
+ * Build from the repository root:
+ *  cc -O2 -Wall -I Firmware/modbus -o mbsim Firmware/tools/mbsim/mbsim.c \
+ *      Firmware/modbus/mb.c Firmware/modbus/mbrtu.c \
+ *      Firmware/modbus/mbmaster.c Firmware/modbus/crc16.c
+ */
+
+/*********************
+ *      INCLUDES
+ *********************/
+
+#define _GNU_SOURCE
+
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <termios.h>
+#include <time.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+#include "mbrtu.h"
+#include "mbmaster.h"
+#include "mbclient.h"
+
+/*********************
+ *      DEFINES
+ *********************/
+
+#define SIM_SLAVE_ADDR 0x01U
+#define SIM_BAUD_RATE  115200U
+
+/*Latency samples kept per report*/
+#define LAT_WINDOW_MAX (1U << 20)
+
+/*MBAP header, transaction, protocol, length, unit*/
+#define MBAP_HEAD_SIZE 7U
+#define MBAP_UNIT_DIRECT 0xFFU
+
+/*Gateway target device failed to respond*/
+#define GATEWAY_NO_REPLY 0x0BU
+
+/*Reply timeout of the bench master, the line has no delay*/
+#define BENCH_TIMEOUT_US 200U
+
+/**********************
+ *      TYPEDEFS
+ **********************/
+
+typedef struct {
+    uint64_t frames;     /**< Requests handed to the slave*/
+    uint64_t replies;    /**< Replies the slave sent*/
+    uint64_t noise_req;  /**< Requests damaged on the way*/
+    uint64_t noise_drop; /**< Damaged requests the slave dropped*/
+    uint64_t noise_miss; /**< Damaged requests the slave answered*/
+    uint64_t noise_rep;  /**< Replies damaged on the way back*/
+    uint32_t lat_num;
+    uint32_t lat_ns[LAT_WINDOW_MAX];
+} sim_stats_t;
+
+/**********************
+ *  STATIC PROTOTYPES
+ **********************/
+
+static uint64_t sim_clock_ns();
+static uint32_t sim_now_us();
+static bool sim_noise(uint8_t * frame_p, uint16_t len);
+static uint16_t sim_slave_xfer(uint8_t * frame_p, uint16_t len);
+static void sim_report(const char * title, uint64_t elapsed_ns);
+static bool sim_master_send(const uint8_t * data_p, uint16_t len);
+static void sim_bench_cb(const mb_master_req_t * req_p,
+    mb_master_res_t res, const uint8_t * data_p, uint16_t len);
+static int sim_bench(uint32_t count);
+static uint16_t sim_tcp_xfer(uint8_t * adu_p, uint16_t len);
+static int sim_tcp_check();
+static int sim_write_check();
+static int sim_tcp(uint16_t port);
+static int sim_pty(uint32_t baud_rate);
+
+/**********************
+ *  STATIC VARIABLES
+ **********************/
+
+static uint8_t slave_addr = SIM_SLAVE_ADDR;
+static uint32_t noise_pct = 0;
+static volatile sig_atomic_t quit = 0;
+
+/*Reply captured from the slave port*/
+static uint8_t reply_buf[RTU_BUF_MAX];
+static uint16_t reply_len = 0;
+
+static sim_stats_t stats;
+
+static mb_master_t bench_master;
+static uint64_t bench_res[MB_MASTER_PORT_ERR + 1];
+
+static const mb_master_port_t bench_port = {
+    .send = sim_master_send,
+    .now_us = sim_now_us,
+};
+
+/**********************
+ *   GLOBAL FUNCTIONS
+ **********************/
+
+/*The simulator closes frames itself, no t3.5 timer*/
+void mb_timer_init(uint32_t baud_rate) {(void)baud_rate;}
+void mb_timer_reload() {}
+void mb_timer_enable() {}
+void mb_timer_disable() {}
+
+/**
+ * Transmit hook of the slave, the reply is complete at once.
+ * @param data_p Points to the reply frame.
+ * @param len Number of bytes in the frame.
+ * @return Always true.
+ */
+bool mb_rtu_port_send(const uint8_t * data_p, uint16_t len)
+{
+    memcpy(reply_buf, data_p, len);
+    reply_len = len;
+    mb_rtu_send_end();
+    return true;
+}
+
+/*Timestamps of the turnaround statistics, one tick per microsecond*/
+uint32_t mb_rtu_port_ticks()
+{
+    return sim_now_us();
+}
+
+static void sim_quit(int sig)
+{
+    (void)sig;
+    quit = 1;
+}
+
+int main(int argc, char ** argv)
+{
+    uint32_t baud_rate = SIM_BAUD_RATE;
+    uint32_t bench_count = 0;
+    uint16_t tcp_port = 0;
+    bool pty = false;
+    int opt = 0;
+
+    while ((opt = getopt(argc, argv, "b:t:pa:r:n:s:")) != -1) {
+        switch (opt) {
+        case 'b': bench_count = strtoul(optarg, NULL, 0); break;
+        case 't': tcp_port = (uint16_t)strtoul(optarg, NULL, 0); break;
+        case 'p': pty = true; break;
+        case 'a': slave_addr = (uint8_t)strtoul(optarg, NULL, 0); break;
+        case 'r': baud_rate = strtoul(optarg, NULL, 0); break;
+        case 'n': noise_pct = strtoul(optarg, NULL, 0); break;
+        case 's': srand(strtoul(optarg, NULL, 0)); break;
+        default:
+            fprintf(stderr, "usage: %s -b N | -t PORT | -p "
+                "[-a ADDR] [-r BAUD] [-n PCT] [-s SEED]\n", argv[0]);
+            return 2;
+        }
+    }
+
+    if ((slave_addr < ADDRESS_MIN) || (slave_addr > ADDRESS_MAX) ||
+        (baud_rate == 0) || (noise_pct > 100)) {
+        fprintf(stderr, "mbsim: invalid argument\n");
+        return 2;
+    }
+
+    signal(SIGINT, sim_quit);
+    signal(SIGTERM, sim_quit);
+    signal(SIGPIPE, SIG_IGN);
+
+    mb_rtu_mode_init(slave_addr, baud_rate);
+    /*The line is idle, end the startup phase*/
+    mb_rtu_recv_end();
+
+    if (bench_count > 0) return sim_bench(bench_count);
+    if (tcp_port > 0) return sim_tcp(tcp_port);
+    if (pty) return sim_pty(baud_rate);
+
+    fprintf(stderr, "mbsim: one of -b, -t or -p is required\n");
+    return 2;
+}
+
+/**********************
+ *   STATIC FUNCTIONS
+ **********************/
+
+static uint64_t sim_clock_ns()
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec;
+}
+
+static uint32_t sim_now_us()
+{
+    return (uint32_t)(sim_clock_ns() / 1000U);
+}
+
+/**
+ * Flips one random bit of a frame with the noise probability.
+ * @param frame_p Frame on the line.
+ * @param len Number of bytes in the frame.
+ * @return Whether the frame was damaged.
+ */
+static bool sim_noise(uint8_t * frame_p, uint16_t len)
+{
+    if ((len == 0) || ((uint32_t)(rand() % 100) >= noise_pct))
+        return false;
+
+    uint32_t bit = (uint32_t)rand() % (len * 8U);
+    frame_p[bit / 8U] ^= (uint8_t)(1U << (bit % 8U));
+    return true;
+}
+
+/**
+ * Hands a request frame to the slave in one block, closes it like
+ * the idle line interrupt does and runs the stack until it is done.
+ * @param frame_p Request frame, noise may be applied in place.
+ * @param len Number of bytes in the frame.
+ * @return Length of the reply in reply_buf, 0 for no reply.
+ */
+static uint16_t sim_slave_xfer(uint8_t * frame_p, uint16_t len)
+{
+    bool damaged = sim_noise(frame_p, len);
+    uint64_t t0 = 0;
+
+    reply_len = 0;
+    stats.frames++;
+    if (damaged) stats.noise_req++;
+
+    t0 = sim_clock_ns();
+
+    mb_rtu_recv_block(frame_p, len);
+    mb_rtu_recv_end();
+
+    mb_rtu_pdu_field_deal();
+
+    if (stats.lat_num < LAT_WINDOW_MAX)
+        stats.lat_ns[stats.lat_num++] = (uint32_t)(sim_clock_ns() - t0);
+
+    if (reply_len > 0) {
+        stats.replies++;
+        if (damaged) stats.noise_miss++;
+        if (sim_noise(reply_buf, reply_len)) stats.noise_rep++;
+    } else if (damaged) {
+        stats.noise_drop++;
+    }
+
+    return reply_len;
+}
+
+static int sim_lat_cmp(const void * a_p, const void * b_p)
+{
+    uint32_t a = *(const uint32_t *)a_p;
+    uint32_t b = *(const uint32_t *)b_p;
+
+    return (a > b) - (a < b);
+}
+
+/**
+ * Prints the statistics since the last report and starts a new window.
+ * @param title Line prefix.
+ * @param elapsed_ns Length of the window.
+ */
+static void sim_report(const char * title, uint64_t elapsed_ns)
+{
+    static uint64_t frames_last = 0;
+    mb_rtu_turnaround_t ta;
+    uint32_t n = stats.lat_num;
+    double fps = 0.0;
+
+    if (elapsed_ns > 0)
+        fps = (double)(stats.frames - frames_last) * 1e9 / (double)elapsed_ns;
+    frames_last = stats.frames;
+
+    printf("%s: %.0f frames/s, %llu frames, %llu replies\n", title, fps,
+        (unsigned long long)stats.frames, (unsigned long long)stats.replies);
+
+    if (n > 0) {
+        qsort(stats.lat_ns, n, sizeof(uint32_t), sim_lat_cmp);
+        printf("  latency [us] p50 %.2f p90 %.2f p99 %.2f p99.9 %.2f max %.2f\n",
+            stats.lat_ns[n * 50 / 100] / 1e3, stats.lat_ns[n * 90 / 100] / 1e3,
+            stats.lat_ns[n * 99 / 100] / 1e3, stats.lat_ns[n * 999 / 1000] / 1e3,
+            stats.lat_ns[n - 1] / 1e3);
+    }
+
+    mb_rtu_turnaround_get(&ta);
+    if (ta.count > 0) {
+        printf("  turnaround [us] last %u min %u max %u over %u replies\n",
+            ta.last, ta.min, ta.max, ta.count);
+    }
+
+    if (noise_pct > 0) {
+        printf("  noise: %llu requests damaged, %llu dropped, %llu answered, "
+            "%llu replies damaged\n",
+            (unsigned long long)stats.noise_req,
+            (unsigned long long)stats.noise_drop,
+            (unsigned long long)stats.noise_miss,
+            (unsigned long long)stats.noise_rep);
+    }
+
+    stats.lat_num = 0;
+    fflush(stdout);
+}
+
+/**
+ * Send hook of the bench master, the simulated line delivers the
+ * request and the reply without delay.
+ */
+static bool sim_master_send(const uint8_t * data_p, uint16_t len)
+{
+    uint8_t frame[RTU_BUF_MAX];
+
+    memcpy(frame, data_p, len);
+    mb_master_send_end(&bench_master);
+
+    if (sim_slave_xfer(frame, len) > 0) {
+        mb_master_recv_block(&bench_master, reply_buf, reply_len);
+        mb_master_recv_end(&bench_master);
+    }
+
+    return true;
+}
+
+static void sim_bench_cb(const mb_master_req_t * req_p,
+    mb_master_res_t res, const uint8_t * data_p, uint16_t len)
+{
+    (void)req_p;
+    (void)data_p;
+    (void)len;
+    bench_res[res]++;
+}
+
+/**
+ * Runs the master against the slave, cycling through a control
+ * cycle transaction (0x17), an input read (0x04) and a holding
+ * register read (0x03).
+ * @param count Number of requests.
+ * @return Exit status.
+ */
+static int sim_bench(uint32_t count)
+{
+    const mb_master_slave_t * slave_p = NULL;
+    float setpoint[MB_AXIS_NUM] = {0};
+    uint16_t regs[MB_AXIS_NUM * 2];
+    mb_master_req_t req;
+    uint32_t sent = 0;
+    uint64_t t0 = 0;
+
+    mb_master_init(&bench_master, &bench_port);
+    mb_master_slave_config(&bench_master, slave_addr, BENCH_TIMEOUT_US, 3);
+
+    /*Write both setpoints, read the mirrored state of both axes*/
+    req.slave_addr = slave_addr;
+    req.fun_code = 0x17;
+    req.data[0] = (uint8_t)(MB_REG_M0_POS >> 8);
+    req.data[1] = (uint8_t)(MB_REG_M0_POS >> 0);
+    req.data[2] = 0;
+    req.data[3] = 20;
+    req.data[4] = (uint8_t)(MB_REG_M0_SETPOINT >> 8);
+    req.data[5] = (uint8_t)(MB_REG_M0_SETPOINT >> 0);
+    req.data[6] = 0;
+    req.data[7] = MB_AXIS_NUM * 2;
+    req.data[8] = MB_AXIS_NUM * 4;
+    req.len = 9 + MB_AXIS_NUM * 4;
+    req.cb = sim_bench_cb;
+    req.user_p = NULL;
+
+    t0 = sim_clock_ns();
+
+    while ((sent < count) || mb_master_pending(&bench_master)) {
+        while ((sent < count) && !quit) {
+            bool queued = false;
+
+            switch (sent % 3) {
+            case 0:
+                setpoint[0] = (float)sent;
+                setpoint[1] = -(float)sent;
+                for (uint8_t i = 0; i < MB_AXIS_NUM; i++) {
+                    uint32_t val = 0;
+                    memcpy(&val, &setpoint[i], sizeof(val));
+                    regs[i * 2 + 0] = (uint16_t)(val >> 16);
+                    regs[i * 2 + 1] = (uint16_t)(val >> 0);
+                }
+                for (uint8_t i = 0; i < MB_AXIS_NUM * 2; i++) {
+                    req.data[9 + i * 2] = (uint8_t)(regs[i] >> 8);
+                    req.data[10 + i * 2] = (uint8_t)(regs[i] >> 0);
+                }
+                queued = mb_master_submit(&bench_master, &req);
+                break;
+            case 1:
+                queued = mb_master_read_regs(&bench_master, slave_addr, 0x04,
+                    MB_IN_M0_POS, INPUT_COUNT, sim_bench_cb, NULL);
+                break;
+            case 2:
+                queued = mb_master_read_regs(&bench_master, slave_addr, 0x03,
+                    MB_REG_HELLO_1, 6, sim_bench_cb, NULL);
+                break;
+            }
+
+            if (!queued) break;
+            sent++;
+        }
+
+        mb_master_poll(&bench_master);
+        if (quit && (mb_master_pending(&bench_master) == 0)) break;
+    }
+
+    sim_report("bench", sim_clock_ns() - t0);
+
+    slave_p = mb_master_slave_stats(&bench_master, slave_addr);
+    printf("  master: %llu ok, %llu exceptions, %llu timeouts, "
+        "%u retries, %u damaged replies\n",
+        (unsigned long long)bench_res[MB_MASTER_OK],
+        (unsigned long long)bench_res[MB_MASTER_EXCEPTION],
+        (unsigned long long)bench_res[MB_MASTER_TIMEOUT],
+        slave_p->retries, slave_p->crc_errors);
+
+    /*Exceptions mean the slave stack misread a valid request*/
+    if (bench_res[MB_MASTER_EXCEPTION] != 0) return 1;
+
+    if (sim_tcp_check() != 0) return 1;
+    return sim_write_check();
+}
+
+/**
+ * Runs two MBAP requests through the gateway, the PDU must reach 
+ * the slave without a byte more or less: a diagnostics echo comes 
+ * back unchanged and the bus message count is no exception.
+ * @return Exit status.
+ */
+static int sim_tcp_check()
+{
+    static const uint8_t echo[] = {
+        0x00, 0x01, 0x00, 0x00, 0x00, 0x07, MBAP_UNIT_DIRECT,
+        0x08, 0x00, 0x00, 0x12, 0x34, 0x56,
+    };
+    static const uint8_t bus_msg[] = {
+        0x00, 0x02, 0x00, 0x00, 0x00, 0x06, MBAP_UNIT_DIRECT,
+        0x08, 0x00, 0x0B, 0x00, 0x00,
+    };
+    uint8_t adu[MBAP_HEAD_SIZE + RTU_BUF_MAX];
+    uint32_t noise = noise_pct;
+    uint16_t out = 0;
+    int res = 0;
+
+    /*The check is about the conversion, not the line*/
+    noise_pct = 0;
+
+    memcpy(adu, echo, sizeof(echo));
+    out = sim_tcp_xfer(adu, sizeof(echo));
+    if ((out != sizeof(echo)) || (memcmp(adu, echo, sizeof(echo)) != 0)) {
+        printf("  tcp: diagnostics echo came back altered\n");
+        res = 1;
+    }
+
+    memcpy(adu, bus_msg, sizeof(bus_msg));
+    out = sim_tcp_xfer(adu, sizeof(bus_msg));
+    if ((out != sizeof(bus_msg)) || (adu[MBAP_HEAD_SIZE] != 0x08)) {
+        printf("  tcp: bus message count failed\n");
+        res = 1;
+    }
+
+    noise_pct = noise;
+    if (res == 0) printf("  tcp: MBAP conversion ok\n");
+
+    return res;
+}
+
+/**
+ * Single register write (0x06) and mask write (0x16) on HELLO_1, 
+ * both replies echo the request and a read (0x03) shows the result.
+ * @return Exit status.
+ */
+static int sim_write_check()
+{
+    static const uint8_t write[] = {
+        0x00, 0x03, 0x00, 0x00, 0x00, 0x06, MBAP_UNIT_DIRECT,
+        0x06, MB_REG_HELLO_1 >> 8, MB_REG_HELLO_1 & 0xFF, 0x12, 0x34,
+    };
+    static const uint8_t mask[] = {
+        0x00, 0x04, 0x00, 0x00, 0x00, 0x08, MBAP_UNIT_DIRECT,
+        0x16, MB_REG_HELLO_1 >> 8, MB_REG_HELLO_1 & 0xFF, 0xFF, 0x00, 0x00, 0x56,
+    };
+    static const uint8_t read[] = {
+        0x00, 0x05, 0x00, 0x00, 0x00, 0x06, MBAP_UNIT_DIRECT,
+        0x03, MB_REG_HELLO_1 >> 8, MB_REG_HELLO_1 & 0xFF, 0x00, 0x01,
+    };
+    uint8_t adu[MBAP_HEAD_SIZE + RTU_BUF_MAX];
+    uint32_t noise = noise_pct;
+    uint16_t out = 0;
+    int res = 0;
+
+    noise_pct = 0;
+
+    memcpy(adu, write, sizeof(write));
+    out = sim_tcp_xfer(adu, sizeof(write));
+    if ((out != sizeof(write)) || (memcmp(adu, write, sizeof(write)) != 0))
+        res = 1;
+
+    memcpy(adu, mask, sizeof(mask));
+    out = sim_tcp_xfer(adu, sizeof(mask));
+    if ((out != sizeof(mask)) || (memcmp(adu, mask, sizeof(mask)) != 0))
+        res = 1;
+
+    /*0x1234 AND 0xFF00 OR (0x0056 AND 0x00FF)*/
+    memcpy(adu, read, sizeof(read));
+    out = sim_tcp_xfer(adu, sizeof(read));
+    if ((out != MBAP_HEAD_SIZE + 4) || (adu[MBAP_HEAD_SIZE + 2] != 0x12) ||
+        (adu[MBAP_HEAD_SIZE + 3] != 0x56))
+        res = 1;
+
+    noise_pct = noise;
+    printf("  write: single and mask write %s\n", (res == 0) ? "ok" : "failed");
+
+    return res;
+}
+
+/**
+ * Converts one MBAP request to RTU, runs it through the
+ * slave and builds the MBAP reply in place.
+ * @param adu_p MBAP request, replaced by the reply.
+ * @param len Number of bytes in the request.
+ * @return Number of bytes in the reply, 0 for none.
+ */
+static uint16_t sim_tcp_xfer(uint8_t * adu_p, uint16_t len)
+{
+    uint8_t frame[RTU_BUF_MAX];
+    uint16_t pdu_len = len - MBAP_HEAD_SIZE;
+    uint8_t unit = adu_p[6];
+    uint16_t crc = 0;
+    uint16_t rtu_len = 0;
+
+    frame[SLAVE_ADDR_INDEX] = (unit == MBAP_UNIT_DIRECT) ? slave_addr : unit;
+    memcpy(&frame[FUN_CODE_INDEX], &adu_p[MBAP_HEAD_SIZE], pdu_len);
+    rtu_len = SLAVE_ADDR_BYTE_SIZE + pdu_len;
+    crc = crc16(frame, rtu_len);
+    frame[rtu_len++] = (uint8_t)(crc >> 0);
+    frame[rtu_len++] = (uint8_t)(crc >> 8);
+
+    /*A broadcast is not answered on the serial line either*/
+    if (sim_slave_xfer(frame, rtu_len) == 0) {
+        if (frame[SLAVE_ADDR_INDEX] == BROADCAST_ADDRESS) return 0;
+        adu_p[MBAP_HEAD_SIZE] |= 0x80U;
+        adu_p[MBAP_HEAD_SIZE + 1] = GATEWAY_NO_REPLY;
+        pdu_len = 2;
+    } else if ((reply_len < RTU_BUF_MIN) ||
+        (crc16(reply_buf, reply_len) != 0x0000)) {
+        /*The gateway drops damaged replies, same as silence*/
+        adu_p[MBAP_HEAD_SIZE] |= 0x80U;
+        adu_p[MBAP_HEAD_SIZE + 1] = GATEWAY_NO_REPLY;
+        pdu_len = 2;
+    } else {
+        pdu_len = reply_len - SLAVE_ADDR_BYTE_SIZE - CRC_BYTE_SIZE;
+        memcpy(&adu_p[MBAP_HEAD_SIZE], &reply_buf[FUN_CODE_INDEX], pdu_len);
+    }
+
+    adu_p[4] = (uint8_t)((pdu_len + 1U) >> 8);
+    adu_p[5] = (uint8_t)((pdu_len + 1U) >> 0);
+
+    return MBAP_HEAD_SIZE + pdu_len;
+}
+
+/**
+ * Modbus TCP front end, one client at a time.
+ * @param port TCP port to listen on.
+ * @return Exit status.
+ */
+static int sim_tcp(uint16_t port)
+{
+    struct sockaddr_in addr;
+    uint8_t adu[MBAP_HEAD_SIZE + RTU_BUF_MAX];
+    uint16_t adu_len = 0;
+    int lfd = -1;
+    int cfd = -1;
+    int one = 1;
+    uint64_t t_report = sim_clock_ns();
+
+    lfd = socket(AF_INET, SOCK_STREAM, 0);
+    if (lfd < 0) {
+        perror("socket");
+        return 1;
+    }
+
+    setsockopt(lfd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_ANY);
+    addr.sin_port = htons(port);
+
+    if ((bind(lfd, (struct sockaddr *)&addr, sizeof(addr)) < 0) ||
+        (listen(lfd, 1) < 0)) {
+        perror("bind");
+        close(lfd);
+        return 1;
+    }
+
+    printf("mbsim: Modbus TCP on port %u, slave %u\n", port, slave_addr);
+    fflush(stdout);
+
+    while (!quit) {
+        struct pollfd pfd = {(cfd < 0) ? lfd : cfd, POLLIN, 0};
+        uint64_t now = 0;
+        ssize_t n = 0;
+
+        if (poll(&pfd, 1, 1000) < 0) {
+            if (errno == EINTR) continue;
+            perror("poll");
+            break;
+        }
+
+        now = sim_clock_ns();
+        if ((now - t_report) >= 1000000000ULL) {
+            if (stats.lat_num > 0) sim_report("tcp", now - t_report);
+            t_report = now;
+        }
+
+        if (!(pfd.revents & (POLLIN | POLLHUP | POLLERR))) continue;
+
+        if (cfd < 0) {
+            cfd = accept(lfd, NULL, NULL);
+            if (cfd >= 0)
+                setsockopt(cfd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+            adu_len = 0;
+            continue;
+        }
+
+        n = read(cfd, &adu[adu_len], sizeof(adu) - adu_len);
+        if (n <= 0) {
+            close(cfd);
+            cfd = -1;
+            continue;
+        }
+        adu_len += (uint16_t)n;
+
+        /*Serve every complete ADU in the stream*/
+        while (adu_len >= MBAP_HEAD_SIZE) {
+            uint16_t len = MBAP_HEAD_SIZE - 1U + ((adu[4] << 8) | adu[5]);
+            uint16_t out = 0;
+
+            if ((adu[2] != 0) || (adu[3] != 0) ||
+                (len <= MBAP_HEAD_SIZE) ||
+                (len > (MBAP_HEAD_SIZE + MB_MASTER_PDU_MAX))) {
+                /*Not Modbus, the stream can not be resynchronised*/
+                close(cfd);
+                cfd = -1;
+                break;
+            }
+            if (adu_len < len) break;
+
+            uint8_t rest[sizeof(adu)];
+            uint16_t rest_len = adu_len - len;
+
+            memcpy(rest, &adu[len], rest_len);
+            out = sim_tcp_xfer(adu, len);
+            if ((out > 0) && (write(cfd, adu, out) != out)) {
+                close(cfd);
+                cfd = -1;
+                break;
+            }
+
+            memcpy(adu, rest, rest_len);
+            adu_len = rest_len;
+        }
+    }
+
+    if (cfd >= 0) close(cfd);
+    close(lfd);
+    sim_report("tcp", sim_clock_ns() - t_report);
+
+    return 0;
+}
+
+/**
+ * RTU slave on a pseudo-terminal. A frame ends after t3.5 of
+ * silence, like mbtimer.c measures it on the target.
+ * @param baud_rate Baud rate the t3.5 time is derived from.
+ * @return Exit status.
+ */
+static int sim_pty(uint32_t baud_rate)
+{
+    uint8_t frame[RTU_BUF_MAX];
+    uint16_t frame_len = 0;
+    bool overrun = false;
+    struct termios tio;
+    struct timespec t35;
+    uint64_t t_report = sim_clock_ns();
+    int fd = -1;
+
+    fd = posix_openpt(O_RDWR | O_NOCTTY);
+    if ((fd < 0) || (grantpt(fd) < 0) || (unlockpt(fd) < 0)) {
+        perror("posix_openpt");
+        return 1;
+    }
+
+    /*Raw bytes, no echo, no line discipline*/
+    if (tcgetattr(fd, &tio) == 0) {
+        cfmakeraw(&tio);
+        tcsetattr(fd, TCSANOW, &tio);
+    }
+
+    /*Same rule as mbtimer.c, 1750us above 19200 baud*/
+    t35.tv_sec = 0;
+    t35.tv_nsec = (baud_rate > 19200U) ? 1750000L :
+        (long)(38500000000ULL / baud_rate);
+
+    printf("mbsim: RTU slave %u on %s\n", slave_addr, ptsname(fd));
+    fflush(stdout);
+
+    while (!quit) {
+        struct pollfd pfd = {fd, POLLIN, 0};
+        struct timespec one_s = {1, 0};
+        int ret = ppoll(&pfd, 1, (frame_len > 0) ? &t35 : &one_s, NULL);
+        uint64_t now = sim_clock_ns();
+
+        if ((now - t_report) >= 1000000000ULL) {
+            if (stats.lat_num > 0) sim_report("pty", now - t_report);
+            t_report = now;
+        }
+
+        if (ret < 0) {
+            if (errno == EINTR) continue;
+            perror("ppoll");
+            break;
+        }
+
+        /*Silence for t3.5, the frame is complete*/
+        if (ret == 0) {
+            if ((frame_len > 0) && !overrun &&
+                (sim_slave_xfer(frame, frame_len) > 0)) {
+                if (write(fd, reply_buf, reply_len) != reply_len)
+                    perror("write");
+            }
+            frame_len = 0;
+            overrun = false;
+            continue;
+        }
+
+        if (pfd.revents & POLLIN) {
+            uint8_t buf[RTU_BUF_MAX];
+            ssize_t n = read(fd, buf, sizeof(buf));
+
+            if (n <= 0) {
+                /*No one has the terminal open*/
+                nanosleep(&t35, NULL);
+                continue;
+            }
+            if ((frame_len + n) > RTU_BUF_MAX) {
+                overrun = true;
+                continue;
+            }
+            memcpy(&frame[frame_len], buf, (size_t)n);
+            frame_len += (uint16_t)n;
+        } else if (pfd.revents & (POLLHUP | POLLERR)) {
+            nanosleep(&one_s, NULL);
+        }
+    }
+
+    close(fd);
+    sim_report("pty", sim_clock_ns() - t_report);
+
+    return 0;
+}